@@ -73,6 +73,11 @@ struct unit_times {
         uint64_t aet;
         uint64_t time;
 };
+struct generator_times {
+        const char *name;
+        uint64_t time;
+        bool cached;
+};
 
 static int bus_get_uint64_property (DBusConnection *bus, const char *path, const char *interface, const char *property, uint64_t *val)
 {
@@ -527,6 +532,92 @@ static int analyze_blame(DBusConnection *bus)
         return 0;
 }
 
+static int compare_generator_time(const void *a, const void *b)
+{
+        return compare(((struct generator_times *)b)->time,
+                       ((struct generator_times *)a)->time);
+}
+
+static int analyze_generators(DBusConnection *bus)
+{
+        _cleanup_dbus_message_unref_ DBusMessage *reply = NULL;
+        _cleanup_free_ struct generator_times *times = NULL;
+        const char *interface = "org.freedesktop.systemd1.Manager";
+        const char *property = "GeneratorTimings";
+        DBusMessageIter iter, sub, sub2, sub3;
+        unsigned n = 0, n_allocated = 0;
+        int r;
+
+        r = bus_method_call_with_reply (
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.DBus.Properties",
+                        "Get",
+                        &reply,
+                        NULL,
+                        DBUS_TYPE_STRING, &interface,
+                        DBUS_TYPE_STRING, &property,
+                        DBUS_TYPE_INVALID);
+        if (r < 0)
+                return r;
+
+        if (!dbus_message_iter_init(reply, &iter) ||
+            dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_VARIANT)  {
+                log_error("Failed to parse reply.");
+                return -EIO;
+        }
+
+        dbus_message_iter_recurse(&iter, &sub);
+
+        if (dbus_message_iter_get_arg_type(&sub) != DBUS_TYPE_ARRAY ||
+            dbus_message_iter_get_element_type(&sub) != DBUS_TYPE_STRUCT) {
+                log_error("Failed to parse reply.");
+                return -EIO;
+        }
+
+        for (dbus_message_iter_recurse(&sub, &sub2);
+             dbus_message_iter_get_arg_type(&sub2) != DBUS_TYPE_INVALID;
+             dbus_message_iter_next(&sub2)) {
+                struct generator_times *t;
+                dbus_bool_t b;
+
+                if (n >= n_allocated) {
+                        struct generator_times *w;
+
+                        n_allocated = MAX(8U, n_allocated * 2);
+                        w = realloc(times, sizeof(struct generator_times) * n_allocated);
+                        if (!w)
+                                return log_oom();
+                        times = w;
+                }
+
+                t = times + n;
+
+                dbus_message_iter_recurse(&sub2, &sub3);
+
+                if (bus_iter_get_basic_and_next(&sub3, DBUS_TYPE_STRING, &t->name, true) < 0 ||
+                    bus_iter_get_basic_and_next(&sub3, DBUS_TYPE_UINT64, &t->time, true) < 0 ||
+                    bus_iter_get_basic_and_next(&sub3, DBUS_TYPE_BOOLEAN, &b, false) < 0) {
+                        log_error("Failed to parse reply.");
+                        return -EIO;
+                }
+
+                t->cached = b;
+                n++;
+        }
+
+        qsort(times, n, sizeof(struct generator_times), compare_generator_time);
+
+        for (unsigned i = 0; i < n; i++)
+                printf("%6llums %s%s\n",
+                       (unsigned long long) (times[i].time / 1000),
+                       times[i].name,
+                       times[i].cached ? " (cached)" : "");
+
+        return 0;
+}
+
 static int analyze_time(DBusConnection *bus)
 {
         char *buf;
@@ -711,6 +802,7 @@ static void analyze_help(void)
                "Commands:\n"
                "  time                Print time spent in the kernel before reaching userspace\n"
                "  blame               Print list of running units ordered by time to init\n"
+               "  generators          Print list of generators ordered by time they took\n"
                "  plot                Output SVG graphic showing service initialization\n"
                "  dot                 Dump dependency graph (in dot(1) format)\n\n",
                program_invocation_short_name);
@@ -791,6 +883,8 @@ int main(int argc, char *argv[]) {
                 r = analyze_time(bus);
         else if (streq(argv[optind], "blame"))
                 r = analyze_blame(bus);
+        else if (streq(argv[optind], "generators"))
+                r = analyze_generators(bus);
         else if (streq(argv[optind], "plot"))
                 r = analyze_plot(bus);
         else if (streq(argv[optind], "dot"))
@@ -22,10 +22,46 @@
 #include <dbus/dbus.h>
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "log.h"
+#include "util.h"
+#include "def.h"
 #include "dbus-common.h"
 
+static int send_datagram(const char *cgroup) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_un un;
+        } sa;
+        int fd;
+        ssize_t n;
+
+        /* The kernel invokes us for every cgroup that runs empty,
+         * hence keep this cheap: a single datagram to the manager,
+         * which processes them in batches. */
+
+        fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+
+        zero(sa);
+        sa.un.sun_family = AF_UNIX;
+        strncpy(sa.un.sun_path, SYSTEMD_CGROUP_AGENT_SOCKET, sizeof(sa.un.sun_path));
+
+        n = sendto(fd, cgroup, strlen(cgroup), MSG_NOSIGNAL, &sa.sa, offsetof(struct sockaddr_un, sun_path) + strlen(sa.un.sun_path));
+        close_nointr_nofail(fd);
+
+        if (n < 0)
+                return -errno;
+
+        return 0;
+}
+
 int main(int argc, char *argv[]) {
         DBusError error;
         DBusConnection *bus = NULL;
@@ -43,6 +79,12 @@ int main(int argc, char *argv[]) {
         log_parse_environment();
         log_open();
 
+        if (send_datagram(argv[1]) >= 0)
+                return EXIT_SUCCESS;
+
+        /* Maybe the manager is older than us and doesn't listen on
+         * the socket yet, fall back to D-Bus */
+
         /* We send this event to the private D-Bus socket and then the
          * system instance will forward this to the system bus. We do
          * this to avoid an activation loop when we start dbus when we
@@ -905,6 +905,7 @@ const UnitVTable automount_vtable = {
         .bus_interface = "org.freedesktop.systemd1.Automount",
         .bus_message_handler = bus_automount_message_handler,
         .bus_invalidating_properties = bus_automount_invalidating_properties,
+        .bus_properties = bus_automount_properties,
 
         .shutdown = automount_shutdown,
 
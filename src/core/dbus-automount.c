@@ -54,7 +54,7 @@ const char bus_automount_invalidating_properties[] =
 
 static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_automount_append_automount_result, automount_result, AutomountResult);
 
-static const BusProperty bus_automount_properties[] = {
+const BusProperty bus_automount_properties[] = {
         { "Where",         bus_property_append_string, "s", offsetof(Automount, where),    true },
         { "DirectoryMode", bus_property_append_mode,   "u", offsetof(Automount, directory_mode) },
         { "Result",        bus_automount_append_automount_result, "s", offsetof(Automount, result) },
@@ -29,3 +29,4 @@ DBusHandlerResult bus_automount_message_handler(Unit *u, DBusConnection *c, DBus
 
 extern const char bus_automount_interface[];
 extern const char bus_automount_invalidating_properties[];
+extern const BusProperty bus_automount_properties[];
@@ -48,7 +48,7 @@ const char bus_device_interface[] _introspect_("Device") = BUS_DEVICE_INTERFACE;
 const char bus_device_invalidating_properties[] =
         "SysFSPath\0";
 
-static const BusProperty bus_device_properties[] = {
+const BusProperty bus_device_properties[] = {
         { "SysFSPath", bus_property_append_string, "s", offsetof(Device, sysfs), true },
         { NULL, }
 };
@@ -29,3 +29,4 @@ DBusHandlerResult bus_device_message_handler(Unit *u, DBusConnection *c, DBusMes
 
 extern const char bus_device_interface[];
 extern const char bus_device_invalidating_properties[];
+extern const BusProperty bus_device_properties[];
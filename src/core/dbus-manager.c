@@ -280,6 +280,12 @@
         "  <property name=\"NJobs\" type=\"u\" access=\"read\"/>\n"     \
         "  <property name=\"NInstalledJobs\" type=\"u\" access=\"read\"/>\n" \
         "  <property name=\"NFailedJobs\" type=\"u\" access=\"read\"/>\n" \
+        "  <property name=\"NGCPasses\" type=\"u\" access=\"read\"/>\n" \
+        "  <property name=\"NGCScanned\" type=\"t\" access=\"read\"/>\n" \
+        "  <property name=\"NGCCollected\" type=\"t\" access=\"read\"/>\n" \
+        "  <property name=\"GCLastPassUSec\" type=\"t\" access=\"read\"/>\n" \
+        "  <property name=\"GCMaxPassUSec\" type=\"t\" access=\"read\"/>\n" \
+        "  <property name=\"GeneratorTimings\" type=\"a(stb)\" access=\"read\"/>\n" \
         "  <property name=\"Progress\" type=\"d\" access=\"read\"/>\n"  \
         "  <property name=\"Environment\" type=\"as\" access=\"read\"/>\n" \
         "  <property name=\"ConfirmSpawn\" type=\"b\" access=\"read\"/>\n" \
@@ -478,6 +484,37 @@ static int bus_manager_append_virt(DBusMessageIter *i, const char *property, voi
         return 0;
 }
 
+static int bus_manager_append_generator_timings(DBusMessageIter *i, const char *property, void *data) {
+        Manager *m = data;
+        DBusMessageIter sub, sub2;
+        unsigned j;
+
+        assert(i);
+        assert(property);
+        assert(m);
+
+        if (!dbus_message_iter_open_container(i, DBUS_TYPE_ARRAY, "(stb)", &sub))
+                return -ENOMEM;
+
+        for (j = 0; j < m->n_generator_timings; j++) {
+                GeneratorTiming *t = m->generator_timings + j;
+                uint64_t u = t->usec;
+                dbus_bool_t b = t->cached;
+
+                if (!dbus_message_iter_open_container(&sub, DBUS_TYPE_STRUCT, NULL, &sub2) ||
+                    !dbus_message_iter_append_basic(&sub2, DBUS_TYPE_STRING, &t->name) ||
+                    !dbus_message_iter_append_basic(&sub2, DBUS_TYPE_UINT64, &u) ||
+                    !dbus_message_iter_append_basic(&sub2, DBUS_TYPE_BOOLEAN, &b) ||
+                    !dbus_message_iter_close_container(&sub, &sub2))
+                        return -ENOMEM;
+        }
+
+        if (!dbus_message_iter_close_container(i, &sub))
+                return -ENOMEM;
+
+        return 0;
+}
+
 static DBusMessage *message_from_file_changes(
                 DBusMessage *m,
                 UnitFileChange *changes,
@@ -585,6 +622,12 @@ static const BusProperty bus_manager_properties[] = {
         { "NJobs",                       bus_manager_append_n_jobs,      "u",  0                                                },
         { "NInstalledJobs",              bus_property_append_uint32,     "u",  offsetof(Manager, n_installed_jobs)              },
         { "NFailedJobs",                 bus_property_append_uint32,     "u",  offsetof(Manager, n_failed_jobs)                 },
+        { "NGCPasses",                   bus_property_append_uint32,     "u",  offsetof(Manager, n_gc_passes)                   },
+        { "NGCScanned",                  bus_property_append_uint64,     "t",  offsetof(Manager, n_gc_scanned)                  },
+        { "NGCCollected",                bus_property_append_uint64,     "t",  offsetof(Manager, n_gc_collected)                },
+        { "GCLastPassUSec",              bus_property_append_usec,       "t",  offsetof(Manager, gc_last_pass_usec)             },
+        { "GCMaxPassUSec",               bus_property_append_usec,       "t",  offsetof(Manager, gc_max_pass_usec)              },
+        { "GeneratorTimings",            bus_manager_append_generator_timings, "a(stb)", 0                                      },
         { "Progress",                    bus_manager_append_progress,    "d",  0                                                },
         { "Environment",                 bus_property_append_strv,       "as", offsetof(Manager, environment),                  true },
         { "ConfirmSpawn",                bus_property_append_bool,       "b",  offsetof(Manager, confirm_spawn)                 },
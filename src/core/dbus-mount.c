@@ -137,7 +137,7 @@ static int bus_mount_append_type(DBusMessageIter *i, const char *property, void
 
 static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_mount_append_mount_result, mount_result, MountResult);
 
-static const BusProperty bus_mount_properties[] = {
+const BusProperty bus_mount_properties[] = {
         { "Where",         bus_property_append_string, "s", offsetof(Mount, where),    true },
         { "What",          bus_mount_append_what,      "s", 0 },
         { "Options",       bus_mount_append_options,   "s", 0 },
@@ -29,3 +29,4 @@ DBusHandlerResult bus_mount_message_handler(Unit *u, DBusConnection *c, DBusMess
 
 extern const char bus_mount_interface[];
 extern const char bus_mount_invalidating_properties[];
+extern const BusProperty bus_mount_properties[];
@@ -99,7 +99,7 @@ static int bus_path_append_unit(DBusMessageIter *i, const char *property, void *
 
 static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_path_append_path_result, path_result, PathResult);
 
-static const BusProperty bus_path_properties[] = {
+const BusProperty bus_path_properties[] = {
         { "Unit",          bus_path_append_unit,      "s", 0 },
         { "Paths",         bus_path_append_paths, "a(ss)", 0 },
         { "MakeDirectory", bus_property_append_bool,  "b", offsetof(Path, make_directory) },
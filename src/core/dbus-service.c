@@ -85,7 +85,13 @@ const char bus_service_invalidating_properties[] =
         "ExecReload\0"
         "ExecStop\0"
         "ExecStopPost\0"
-        "ExecMain\0"
+        "ExecMainStartTimestamp\0"
+        "ExecMainStartTimestampMonotonic\0"
+        "ExecMainExitTimestamp\0"
+        "ExecMainExitTimestampMonotonic\0"
+        "ExecMainPID\0"
+        "ExecMainCode\0"
+        "ExecMainStatus\0"
         "WatchdogTimestamp\0"
         "WatchdogTimestampMonotonic\0"
         "MainPID\0"
@@ -100,18 +106,7 @@ static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_service_append_service_result, servic
 static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_service_append_start_limit_action, start_limit_action, StartLimitAction);
 static DEFINE_BUS_PROPERTY_SET_ENUM(bus_service_set_start_limit_action, start_limit_action, StartLimitAction);
 
-static const BusProperty bus_exec_main_status_properties[] = {
-        { "ExecMainStartTimestamp",         bus_property_append_usec, "t", offsetof(ExecStatus, start_timestamp.realtime)  },
-        { "ExecMainStartTimestampMonotonic",bus_property_append_usec, "t", offsetof(ExecStatus, start_timestamp.monotonic) },
-        { "ExecMainExitTimestamp",          bus_property_append_usec, "t", offsetof(ExecStatus, start_timestamp.realtime)  },
-        { "ExecMainExitTimestampMonotonic", bus_property_append_usec, "t", offsetof(ExecStatus, start_timestamp.monotonic) },
-        { "ExecMainPID",                    bus_property_append_pid,  "u", offsetof(ExecStatus, pid)                       },
-        { "ExecMainCode",                   bus_property_append_int,  "i", offsetof(ExecStatus, code)                      },
-        { "ExecMainStatus",                 bus_property_append_int,  "i", offsetof(ExecStatus, status)                    },
-        { NULL, }
-};
-
-static const BusProperty bus_service_properties[] = {
+const BusProperty bus_service_properties[] = {
         { "Type",                   bus_service_append_type,          "s", offsetof(Service, type)                         },
         { "Restart",                bus_service_append_restart,       "s", offsetof(Service, restart)                      },
         { "PIDFile",                bus_property_append_string,       "s", offsetof(Service, pid_file),               true },
@@ -141,6 +136,15 @@ static const BusProperty bus_service_properties[] = {
         { "BusName",                bus_property_append_string,       "s", offsetof(Service, bus_name),               true },
         { "StatusText",             bus_property_append_string,       "s", offsetof(Service, status_text),            true },
         { "Result",                 bus_service_append_service_result,"s", offsetof(Service, result)                       },
+        /* Part of the service table rather than bound to the
+         * ExecStatus, so that changes to them can be detected */
+        { "ExecMainStartTimestamp",         bus_property_append_usec, "t", offsetof(Service, main_exec_status.start_timestamp.realtime)  },
+        { "ExecMainStartTimestampMonotonic",bus_property_append_usec, "t", offsetof(Service, main_exec_status.start_timestamp.monotonic) },
+        { "ExecMainExitTimestamp",          bus_property_append_usec, "t", offsetof(Service, main_exec_status.start_timestamp.realtime)  },
+        { "ExecMainExitTimestampMonotonic", bus_property_append_usec, "t", offsetof(Service, main_exec_status.start_timestamp.monotonic) },
+        { "ExecMainPID",                    bus_property_append_pid,  "u", offsetof(Service, main_exec_status.pid)                       },
+        { "ExecMainCode",                   bus_property_append_int,  "i", offsetof(Service, main_exec_status.code)                      },
+        { "ExecMainStatus",                 bus_property_append_int,  "i", offsetof(Service, main_exec_status.status)                    },
         { NULL, }
 };
 
@@ -152,7 +156,6 @@ DBusHandlerResult bus_service_message_handler(Unit *u, DBusConnection *connectio
                 { "org.freedesktop.systemd1.Service", bus_service_properties,          s },
                 { "org.freedesktop.systemd1.Service", bus_exec_context_properties,     &s->exec_context },
                 { "org.freedesktop.systemd1.Service", bus_kill_context_properties,     &s->kill_context },
-                { "org.freedesktop.systemd1.Service", bus_exec_main_status_properties, &s->main_exec_status },
                 { "org.freedesktop.systemd1.Service", bus_unit_cgroup_properties,      u },
                 { NULL, }
         };
@@ -29,3 +29,4 @@ DBusHandlerResult bus_service_message_handler(Unit *u, DBusConnection *c, DBusMe
 
 extern const char bus_service_interface[];
 extern const char bus_service_invalidating_properties[];
+extern const BusProperty bus_service_properties[];
@@ -59,8 +59,15 @@
         "  <property name=\"PassSecurity\" type=\"b\" access=\"read\"/>\n" \
         "  <property name=\"Mark\" type=\"i\" access=\"read\"/>\n"      \
         "  <property name=\"MaxConnections\" type=\"u\" access=\"read\"/>\n" \
+        "  <property name=\"Shards\" type=\"u\" access=\"read\"/>\n" \
         "  <property name=\"NAccepted\" type=\"u\" access=\"read\"/>\n" \
         "  <property name=\"NConnections\" type=\"u\" access=\"read\"/>\n" \
+        "  <property name=\"NAcceptWakeups\" type=\"u\" access=\"read\"/>\n" \
+        "  <property name=\"AcceptLatencyUSec\" type=\"t\" access=\"read\"/>\n" \
+        "  <property name=\"AcceptLatencyMaxUSec\" type=\"t\" access=\"read\"/>\n" \
+        "  <property name=\"NSpawned\" type=\"u\" access=\"read\"/>\n" \
+        "  <property name=\"SpawnUSec\" type=\"t\" access=\"read\"/>\n" \
+        "  <property name=\"SpawnMaxUSec\" type=\"t\" access=\"read\"/>\n" \
         "  <property name=\"MessageQueueMaxMessages\" type=\"x\" access=\"read\"/>\n" \
         "  <property name=\"MessageQueueMessageSize\" type=\"x\" access=\"read\"/>\n" \
         "  <property name=\"Result\" type=\"s\" access=\"read\"/>\n"    \
@@ -98,7 +105,7 @@ const char bus_socket_invalidating_properties[] =
 static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_socket_append_bind_ipv6_only, socket_address_bind_ipv6_only, SocketAddressBindIPv6Only);
 static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_socket_append_socket_result, socket_result, SocketResult);
 
-static const BusProperty bus_socket_properties[] = {
+const BusProperty bus_socket_properties[] = {
         { "BindIPv6Only",   bus_socket_append_bind_ipv6_only,  "s", offsetof(Socket, bind_ipv6_only)  },
         { "Backlog",        bus_property_append_unsigned,      "u", offsetof(Socket, backlog)         },
         { "TimeoutUSec",    bus_property_append_usec,          "t", offsetof(Socket, timeout_usec)    },
@@ -125,8 +132,15 @@ static const BusProperty bus_socket_properties[] = {
         { "PassSecurity",   bus_property_append_bool,          "b", offsetof(Socket, pass_sec)        },
         { "Mark",           bus_property_append_int,           "i", offsetof(Socket, mark)            },
         { "MaxConnections", bus_property_append_unsigned,      "u", offsetof(Socket, max_connections) },
+        { "Shards",         bus_property_append_unsigned,      "u", offsetof(Socket, shards)          },
         { "NConnections",   bus_property_append_unsigned,      "u", offsetof(Socket, n_connections)   },
         { "NAccepted",      bus_property_append_unsigned,      "u", offsetof(Socket, n_accepted)      },
+        { "NAcceptWakeups", bus_property_append_unsigned,      "u", offsetof(Socket, n_accept_wakeups) },
+        { "AcceptLatencyUSec", bus_property_append_usec,       "t", offsetof(Socket, accept_latency_usec) },
+        { "AcceptLatencyMaxUSec", bus_property_append_usec,    "t", offsetof(Socket, accept_latency_max_usec) },
+        { "NSpawned",       bus_property_append_unsigned,      "u", offsetof(Socket, n_spawned)       },
+        { "SpawnUSec",      bus_property_append_usec,          "t", offsetof(Socket, spawn_usec)      },
+        { "SpawnMaxUSec",   bus_property_append_usec,          "t", offsetof(Socket, spawn_max_usec)  },
         { "MessageQueueMaxMessages", bus_property_append_long, "x", offsetof(Socket, mq_maxmsg)       },
         { "MessageQueueMessageSize", bus_property_append_long, "x", offsetof(Socket, mq_msgsize)      },
         { "Result",         bus_socket_append_socket_result,   "s", offsetof(Socket, result)          },
@@ -29,3 +29,4 @@ DBusHandlerResult bus_socket_message_handler(Unit *u, DBusConnection *c, DBusMes
 
 extern const char bus_socket_interface[];
 extern const char bus_socket_invalidating_properties[];
+extern const BusProperty bus_socket_properties[];
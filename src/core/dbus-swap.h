@@ -30,3 +30,4 @@ DBusHandlerResult bus_swap_message_handler(Unit *u, DBusConnection *c, DBusMessa
 
 extern const char bus_swap_interface[];
 extern const char bus_swap_invalidating_properties[];
+extern const BusProperty bus_swap_properties[];
@@ -55,7 +55,7 @@ const char bus_timer_interface[] _introspect_("Timer") = BUS_TIMER_INTERFACE;
 
 const char bus_timer_invalidating_properties[] =
         "TimersMonotonic\0"
-        "TimersRealtime\0"
+        "TimersCalendar\0"
         "NextElapseUSecRealtime\0"
         "NextElapseUSecMonotonic\0"
         "Result\0";
@@ -167,7 +167,7 @@ static int bus_timer_append_unit(DBusMessageIter *i, const char *property, void
 
 static DEFINE_BUS_PROPERTY_APPEND_ENUM(bus_timer_append_timer_result, timer_result, TimerResult);
 
-static const BusProperty bus_timer_properties[] = {
+const BusProperty bus_timer_properties[] = {
         { "Unit",                    bus_timer_append_unit,             "s",      0 },
         { "TimersMonotonic",         bus_timer_append_monotonic_timers, "a(stt)", 0 },
         { "TimersCalendar",          bus_timer_append_calendar_timers,  "a(sst)", 0 },
@@ -29,3 +29,4 @@ DBusHandlerResult bus_timer_message_handler(Unit *u, DBusConnection *c, DBusMess
 
 extern const char bus_timer_interface[];
 extern const char bus_timer_invalidating_properties[];
+extern const BusProperty bus_timer_properties[];
@@ -700,16 +700,234 @@ const DBusObjectPathVTable bus_unit_vtable = {
         .message_function = bus_unit_message_handler
 };
 
+static uint64_t digest_bytes(uint64_t h, const void *p, size_t l) {
+        const uint8_t *b = p;
+
+        /* FNV-1a */
+        for (; l > 0; l--, b++) {
+                h ^= *b;
+                h *= 0x100000001b3ULL;
+        }
+
+        return h;
+}
+
+static uint64_t digest_iter(DBusMessageIter *iter, uint64_t h) {
+        int t;
+
+        while ((t = dbus_message_iter_get_arg_type(iter)) != DBUS_TYPE_INVALID) {
+
+                h = digest_bytes(h, &t, sizeof(t));
+
+                if (dbus_type_is_container(t)) {
+                        DBusMessageIter sub;
+
+                        dbus_message_iter_recurse(iter, &sub);
+                        h = digest_iter(&sub, h);
+                        h = digest_bytes(h, &t, sizeof(t));
+
+                } else if (t == DBUS_TYPE_STRING ||
+                           t == DBUS_TYPE_OBJECT_PATH ||
+                           t == DBUS_TYPE_SIGNATURE) {
+                        const char *v;
+
+                        dbus_message_iter_get_basic(iter, &v);
+                        h = digest_bytes(h, v, strlen(v) + 1);
+
+                } else {
+                        uint64_t v = 0;
+
+                        dbus_message_iter_get_basic(iter, &v);
+                        h = digest_bytes(h, &v, sizeof(v));
+                }
+
+                dbus_message_iter_next(iter);
+        }
+
+        return h;
+}
+
+static const BusProperty *find_property(const BusProperty *properties, const char *name) {
+        const BusProperty *p;
+
+        if (!properties)
+                return NULL;
+
+        for (p = properties; p->property; p++)
+                if (streq(p->property, name))
+                        return p;
+
+        return NULL;
+}
+
+/* Serializes the values of the listed properties, and stores a digest
+ * of each of them. Properties we cannot find in the table get a 0
+ * digest, and are hence always considered changed. */
+static int digest_properties(const BusProperty *properties, const void *base, const char *names, uint64_t *digests) {
+        _cleanup_dbus_message_unref_ DBusMessage *m = NULL;
+        DBusMessageIter iter, sub;
+        const char *n;
+        unsigned k;
+
+        m = dbus_message_new(DBUS_MESSAGE_TYPE_SIGNAL);
+        if (!m)
+                return -ENOMEM;
+
+        dbus_message_iter_init_append(m, &iter);
+
+        NULSTR_FOREACH(n, names) {
+                const BusProperty *p;
+                const void *data;
+                int r;
+
+                p = find_property(properties, n);
+                if (!p)
+                        continue;
+
+                if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, p->signature, &sub))
+                        return -ENOMEM;
+
+                data = (const uint8_t*) base + p->offset;
+                if (p->indirect)
+                        data = *(void**) data;
+
+                r = p->append(&sub, n, (void*) data);
+                if (r < 0)
+                        return r;
+
+                if (!dbus_message_iter_close_container(&iter, &sub))
+                        return -ENOMEM;
+        }
+
+        dbus_message_iter_init(m, &iter);
+
+        k = 0;
+        NULSTR_FOREACH(n, names) {
+                if (!find_property(properties, n)) {
+                        digests[k++] = 0;
+                        continue;
+                }
+
+                if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_VARIANT)
+                        return -EIO;
+
+                dbus_message_iter_recurse(&iter, &sub);
+                digests[k++] = digest_iter(&sub, 0xcbf29ce484222325ULL);
+                dbus_message_iter_next(&iter);
+        }
+
+        return 0;
+}
+
+static unsigned nulstr_count(const char *l) {
+        const char *i;
+        unsigned n = 0;
+
+        if (!l)
+                return 0;
+
+        NULSTR_FOREACH(i, l)
+                n++;
+
+        return n;
+}
+
+/* Picks those of names whose digest differs from the previous one, or
+ * which we could not digest, and returns them as NULSTR, or NULL if
+ * nothing changed. */
+static int changed_properties(const char *names, const uint64_t *previous, const uint64_t *current, char **ret) {
+        char *l, *e;
+        const char *n;
+        unsigned k = 0;
+        bool any = false;
+
+        NULSTR_FOREACH(n, names) {
+                if (current[k] == 0 || !previous || previous[k] != current[k])
+                        any = true;
+                k++;
+        }
+
+        if (!any) {
+                *ret = NULL;
+                return 0;
+        }
+
+        l = e = new(char, strlen(names) + nulstr_count(names) + 1);
+        if (!l)
+                return -ENOMEM;
+
+        k = 0;
+        NULSTR_FOREACH(n, names) {
+                if (current[k] == 0 || !previous || previous[k] != current[k])
+                        e = stpcpy(e, n) + 1;
+                k++;
+        }
+
+        *e = 0;
+
+        *ret = l;
+        return 0;
+}
+
+static int bus_unit_changed_properties(Unit *u, char **type_changed, char **unit_changed) {
+        const char *type_names = UNIT_VTABLE(u)->bus_invalidating_properties;
+        _cleanup_free_ uint64_t *digests = NULL;
+        unsigned n_type, n_unit;
+        int r;
+
+        assert(u);
+        assert(type_changed);
+        assert(unit_changed);
+
+        n_type = nulstr_count(type_names);
+        n_unit = nulstr_count(INVALIDATING_PROPERTIES);
+
+        digests = new(uint64_t, n_type + n_unit);
+        if (!digests)
+                return -ENOMEM;
+
+        if (type_names) {
+                r = digest_properties(UNIT_VTABLE(u)->bus_properties, u, type_names, digests);
+                if (r < 0)
+                        return r;
+        }
+
+        r = digest_properties(bus_unit_properties, u, INVALIDATING_PROPERTIES, digests + n_type);
+        if (r < 0)
+                return r;
+
+        *type_changed = NULL;
+        if (type_names) {
+                r = changed_properties(type_names,
+                                       u->bus_property_digests,
+                                       digests, type_changed);
+                if (r < 0)
+                        return r;
+        }
+
+        r = changed_properties(INVALIDATING_PROPERTIES,
+                               u->bus_property_digests ? u->bus_property_digests + n_type : NULL,
+                               digests + n_type, unit_changed);
+        if (r < 0) {
+                free(*type_changed);
+                *type_changed = NULL;
+                return r;
+        }
+
+        free(u->bus_property_digests);
+        u->bus_property_digests = digests;
+        digests = NULL;
+
+        return 0;
+}
+
 void bus_unit_send_change_signal(Unit *u) {
         _cleanup_free_ char *p = NULL;
         _cleanup_dbus_message_unref_ DBusMessage *m = NULL;
 
         assert(u);
 
-        if (u->in_dbus_queue) {
-                LIST_REMOVE(Unit, dbus_queue, u->manager->dbus_unit_queue, u);
-                u->in_dbus_queue = false;
-        }
+        unit_remove_from_dbus_queue(u);
 
         if (!u->id)
                 return;
@@ -724,16 +942,33 @@ void bus_unit_send_change_signal(Unit *u) {
                 goto oom;
 
         if (u->sent_dbus_new_signal) {
+                _cleanup_free_ char *type_changed = NULL, *unit_changed = NULL;
+                const char *type_list, *unit_list;
+
+                /* Only announce what actually changed since the
+                 * last signal. If we cannot figure that out,
+                 * invalidate everything. */
+                if (bus_unit_changed_properties(u, &type_changed, &unit_changed) < 0) {
+                        free(u->bus_property_digests);
+                        u->bus_property_digests = NULL;
+
+                        type_list = UNIT_VTABLE(u)->bus_invalidating_properties;
+                        unit_list = INVALIDATING_PROPERTIES;
+                } else {
+                        type_list = type_changed;
+                        unit_list = unit_changed;
+                }
+
                 /* Send a properties changed signal. First for the
                  * specific type, then for the generic unit. The
                  * clients may rely on this order to get atomic
                  * behavior if needed. */
 
-                if (UNIT_VTABLE(u)->bus_invalidating_properties) {
+                if (type_list) {
 
                         m = bus_properties_changed_new(p,
                                                        UNIT_VTABLE(u)->bus_interface,
-                                                       UNIT_VTABLE(u)->bus_invalidating_properties);
+                                                       type_list);
                         if (!m)
                                 goto oom;
 
@@ -741,10 +976,16 @@ void bus_unit_send_change_signal(Unit *u) {
                                 goto oom;
 
                         dbus_message_unref(m);
+                        m = NULL;
+                }
+
+                if (!unit_list) {
+                        if (type_list)
+                                u->dbus_signal_timestamp = now(CLOCK_MONOTONIC);
+                        return;
                 }
 
-                m = bus_properties_changed_new(p, "org.freedesktop.systemd1.Unit",
-                                               INVALIDATING_PROPERTIES);
+                m = bus_properties_changed_new(p, "org.freedesktop.systemd1.Unit", unit_list);
                 if (!m)
                         goto oom;
 
@@ -768,6 +1009,7 @@ void bus_unit_send_change_signal(Unit *u) {
                 goto oom;
 
         u->sent_dbus_new_signal = true;
+        u->dbus_signal_timestamp = now(CLOCK_MONOTONIC);
 
         return;
 
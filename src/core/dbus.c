@@ -1477,3 +1477,33 @@ finish:
         if (message)
                 dbus_message_unref(message);
 }
+
+void bus_forward_agent_released(Manager *m, const char *cgroup) {
+        _cleanup_dbus_message_unref_ DBusMessage *message = NULL;
+
+        assert(m);
+        assert(cgroup);
+
+        /* Forward a cgroup release notification we got from the
+         * agent socket to the system bus, so that user instances
+         * are notified as well */
+
+        if (!m->system_bus)
+                return;
+
+        message = dbus_message_new_signal("/org/freedesktop/systemd1/agent", "org.freedesktop.systemd1.Agent", "Released");
+        if (!message) {
+                log_oom();
+                return;
+        }
+
+        if (!dbus_message_append_args(message,
+                                      DBUS_TYPE_STRING, &cgroup,
+                                      DBUS_TYPE_INVALID)) {
+                log_oom();
+                return;
+        }
+
+        if (!dbus_connection_send(m->system_bus, message, NULL))
+                log_oom();
+}
@@ -37,23 +37,99 @@ static const UnitActiveState state_translation_table[_DEVICE_STATE_MAX] = {
         [DEVICE_PLUGGED] = UNIT_ACTIVE
 };
 
+static void device_group_free(Manager *m, DeviceGroup *g) {
+        assert(m);
+        assert(g);
+        assert(!g->devices);
+
+        hashmap_remove(m->devices_by_sysfs, g->sysfs);
+
+        if (g->in_plug_queue)
+                LIST_REMOVE(DeviceGroup, plug_queue, m->device_plug_queue, g);
+
+        free(g->sysfs);
+        free(g);
+}
+
+static int device_set_sysfs(Device *d, const char *sysfs) {
+        Manager *m;
+        DeviceGroup *g;
+        int r;
+
+        assert(d);
+        assert(sysfs);
+        assert(!d->sysfs);
+
+        m = UNIT(d)->manager;
+
+        if (!m->devices_by_sysfs) {
+                m->devices_by_sysfs = hashmap_new(string_hash_func, string_compare_func);
+                if (!m->devices_by_sysfs)
+                        return -ENOMEM;
+        }
+
+        d->sysfs = strdup(sysfs);
+        if (!d->sysfs)
+                return -ENOMEM;
+
+        g = hashmap_get(m->devices_by_sysfs, sysfs);
+        if (!g) {
+                g = new0(DeviceGroup, 1);
+                if (!g)
+                        goto fail;
+
+                g->sysfs = strdup(sysfs);
+                if (!g->sysfs) {
+                        free(g);
+                        goto fail;
+                }
+
+                r = hashmap_put(m->devices_by_sysfs, g->sysfs, g);
+                if (r < 0) {
+                        free(g->sysfs);
+                        free(g);
+                        goto fail;
+                }
+        }
+
+        LIST_PREPEND(Device, same_sysfs, g->devices, d);
+        g->n_devices++;
+        d->group = g;
+
+        if (!g->main && startswith(UNIT(d)->id, "sys-"))
+                g->main = d;
+
+        return 0;
+
+fail:
+        free(d->sysfs);
+        d->sysfs = NULL;
+        return -ENOMEM;
+}
+
 static void device_unset_sysfs(Device *d) {
-        Device *first;
+        DeviceGroup *g;
 
         assert(d);
 
         if (!d->sysfs)
                 return;
 
-        /* Remove this unit from the chain of devices which share the
+        /* Remove this unit from the group of devices which share the
          * same sysfs path. */
-        first = hashmap_get(UNIT(d)->manager->devices_by_sysfs, d->sysfs);
-        LIST_REMOVE(Device, same_sysfs, first, d);
+        g = d->group;
+        if (g) {
+                LIST_REMOVE(Device, same_sysfs, g->devices, d);
+                g->n_devices--;
+
+                if (g->main == d)
+                        g->main = NULL;
 
-        if (first)
-                hashmap_remove_and_replace(UNIT(d)->manager->devices_by_sysfs, d->sysfs, first->sysfs, first);
-        else
-                hashmap_remove(UNIT(d)->manager->devices_by_sysfs, d->sysfs);
+                if (!g->devices)
+                        device_group_free(UNIT(d)->manager, g);
+
+                d->group = NULL;
+        }
 
         free(d->sysfs);
         d->sysfs = NULL;
@@ -181,21 +257,19 @@ static int device_find_escape_name(Manager *m, const char *dn, Unit **_u) {
         return 0;
 }
 
-static int device_update_unit(Manager *m, struct udev_device *dev, const char *path, bool main) {
-        const char *sysfs, *model;
+static int device_update_unit(Manager *m, DeviceEvent *e, const char *path, bool main) {
         Unit *u = NULL;
         int r;
         bool delete;
 
         assert(m);
-
-        if (!(sysfs = udev_device_get_syspath(dev)))
-                return -ENOMEM;
+        assert(e);
+        assert(e->sysfs);
 
         if ((r = device_find_escape_name(m, path, &u)) < 0)
                 return r;
 
-        if (u && DEVICE(u)->sysfs && !path_equal(DEVICE(u)->sysfs, sysfs))
+        if (u && DEVICE(u)->sysfs && !path_equal(DEVICE(u)->sysfs, e->sysfs))
                 return -EEXIST;
 
         if (!u) {
@@ -218,79 +292,56 @@ static int device_update_unit(Manager *m, struct udev_device *dev, const char *p
          * initialized. Hence initialize it if necessary. */
 
         if (!DEVICE(u)->sysfs) {
-                Device *first;
-
-                if (!(DEVICE(u)->sysfs = strdup(sysfs))) {
-                        r = -ENOMEM;
-                        goto fail;
-                }
-
-                if (!m->devices_by_sysfs)
-                        if (!(m->devices_by_sysfs = hashmap_new(string_hash_func, string_compare_func))) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-
-                first = hashmap_get(m->devices_by_sysfs, sysfs);
-                LIST_PREPEND(Device, same_sysfs, first, DEVICE(u));
-
-                if ((r = hashmap_replace(m->devices_by_sysfs, DEVICE(u)->sysfs, first)) < 0)
+                r = device_set_sysfs(DEVICE(u), e->sysfs);
+                if (r < 0)
                         goto fail;
         }
 
-        if ((model = udev_device_get_property_value(dev, "ID_MODEL_FROM_DATABASE")) ||
-            (model = udev_device_get_property_value(dev, "ID_MODEL"))) {
-                if ((r = unit_set_description(u, model)) < 0)
-                        goto fail;
-        } else
-                if ((r = unit_set_description(u, path)) < 0)
-                        goto fail;
+        if ((r = unit_set_description(u, e->model ? e->model : path)) < 0)
+                goto fail;
 
         if (main) {
                 /* The additional systemd udev properties we only
                  * interpret for the main object */
-                const char *wants, *alias;
 
-                alias = udev_device_get_property_value(dev, "SYSTEMD_ALIAS");
-                if (alias) {
+                if (e->alias) {
                         char *state, *w;
                         size_t l;
 
-                        FOREACH_WORD_QUOTED(w, l, alias, state) {
-                                char *e;
+                        FOREACH_WORD_QUOTED(w, l, e->alias, state) {
+                                char *a;
 
-                                e = strndup(w, l);
-                                if (!e) {
+                                a = strndup(w, l);
+                                if (!a) {
                                         r = -ENOMEM;
                                         goto fail;
                                 }
 
-                                if (!is_path(e)) {
-                                        log_warning("SYSTEMD_ALIAS for %s is not a path, ignoring: %s", sysfs, e);
-                                        free(e);
+                                if (!is_path(a)) {
+                                        log_warning("SYSTEMD_ALIAS for %s is not a path, ignoring: %s", e->sysfs, a);
+                                        free(a);
                                 } else {
-                                        device_update_unit(m, dev, e, false);
-                                        free(e);
+                                        device_update_unit(m, e, a, false);
+                                        free(a);
                                 }
                         }
                 }
 
-                wants = udev_device_get_property_value(dev, "SYSTEMD_WANTS");
-                if (wants) {
+                if (e->wants) {
                         char *state, *w;
                         size_t l;
 
-                        FOREACH_WORD_QUOTED(w, l, wants, state) {
-                                char *e;
+                        FOREACH_WORD_QUOTED(w, l, e->wants, state) {
+                                char *a;
 
-                                e = strndup(w, l);
-                                if (!e) {
+                                a = strndup(w, l);
+                                if (!a) {
                                         r = -ENOMEM;
                                         goto fail;
                                 }
 
-                                r = unit_add_dependency_by_name(u, UNIT_WANTS, e, NULL, true);
-                                free(e);
+                                r = unit_add_dependency_by_name(u, UNIT_WANTS, a, NULL, true);
+                                free(a);
                                 if (r < 0)
                                         goto fail;
                         }
@@ -309,33 +360,26 @@ fail:
         return r;
 }
 
-static int device_process_new_device(Manager *m, struct udev_device *dev, bool update_state) {
-        const char *sysfs, *dn;
-        struct udev_list_entry *item = NULL, *first = NULL;
+static int device_process_new_device(Manager *m, DeviceEvent *e, bool update_state) {
+        char **p;
 
         assert(m);
-
-        if (!(sysfs = udev_device_get_syspath(dev)))
-                return -ENOMEM;
+        assert(e);
 
         /* Add the main unit named after the sysfs path */
-        device_update_unit(m, dev, sysfs, true);
+        device_update_unit(m, e, e->sysfs, true);
 
         /* Add an additional unit for the device node */
-        if ((dn = udev_device_get_devnode(dev)))
-                device_update_unit(m, dev, dn, false);
+        if (e->devnode)
+                device_update_unit(m, e, e->devnode, false);
 
         /* Add additional units for all symlinks */
-        first = udev_device_get_devlinks_list_entry(dev);
-        udev_list_entry_foreach(item, first) {
-                const char *p;
+        STRV_FOREACH(p, e->devlinks) {
                 struct stat st;
 
                 /* Don't bother with the /dev/block links */
-                p = udev_list_entry_get_name(item);
-
-                if (path_startswith(p, "/dev/block/") ||
-                    path_startswith(p, "/dev/char/"))
+                if (path_startswith(*p, "/dev/block/") ||
+                    path_startswith(*p, "/dev/char/"))
                         continue;
 
                 /* Verify that the symlink in the FS actually belongs
@@ -345,28 +389,84 @@ static int device_process_new_device(Manager *m, struct udev_device *dev, bool u
                  * the same label. We want to make sure that the same
                  * device that won the symlink wins in systemd, so we
                  * check the device node major/minor*/
-                if (stat(p, &st) >= 0)
+                if (stat(*p, &st) >= 0)
                         if ((!S_ISBLK(st.st_mode) && !S_ISCHR(st.st_mode)) ||
-                            st.st_rdev != udev_device_get_devnum(dev))
+                            st.st_rdev != e->devnum)
                                 continue;
 
-                device_update_unit(m, dev, p, false);
+                device_update_unit(m, e, *p, false);
         }
 
         if (update_state) {
-                Device *d, *l;
+                DeviceGroup *g;
+
+                /* The state is updated once the whole batch of
+                 * events has been processed and all new units are
+                 * loaded */
+                g = hashmap_get(m->devices_by_sysfs, e->sysfs);
+                if (g && !g->in_plug_queue) {
+                        LIST_PREPEND(DeviceGroup, plug_queue, m->device_plug_queue, g);
+                        g->in_plug_queue = true;
+                }
+        }
+
+        return 0;
+}
 
-                manager_dispatch_load_queue(m);
+static int device_event_from_udev(DeviceEvent *e, struct udev_device *dev) {
+        struct udev_list_entry *item = NULL, *first = NULL;
+        unsigned n = 0;
 
-                l = hashmap_get(m->devices_by_sysfs, sysfs);
-                LIST_FOREACH(same_sysfs, d, l)
-                        device_set_state(d, DEVICE_PLUGGED);
-        }
+        assert(e);
+        assert(dev);
+
+        zero(*e);
+
+        e->sysfs = udev_device_get_syspath(dev);
+        if (!e->sysfs)
+                return -ENOMEM;
+
+        e->action = udev_device_get_action(dev);
+        e->devnode = udev_device_get_devnode(dev);
+        e->devnum = udev_device_get_devnum(dev);
+
+        e->model = udev_device_get_property_value(dev, "ID_MODEL_FROM_DATABASE");
+        if (!e->model)
+                e->model = udev_device_get_property_value(dev, "ID_MODEL");
+
+        e->ready = udev_device_get_property_value(dev, "SYSTEMD_READY");
+        e->alias = udev_device_get_property_value(dev, "SYSTEMD_ALIAS");
+        e->wants = udev_device_get_property_value(dev, "SYSTEMD_WANTS");
+
+        first = udev_device_get_devlinks_list_entry(dev);
+        udev_list_entry_foreach(item, first)
+                n++;
+
+        if (n <= 0)
+                return 0;
+
+        e->devlinks = new(char*, n + 1);
+        if (!e->devlinks)
+                return -ENOMEM;
+
+        n = 0;
+        udev_list_entry_foreach(item, first)
+                e->devlinks[n++] = (char*) udev_list_entry_get_name(item);
+        e->devlinks[n] = NULL;
 
         return 0;
 }
 
+static void device_event_done(DeviceEvent *e) {
+        assert(e);
+
+        /* The strings belong to the udev device */
+        free(e->devlinks);
+        e->devlinks = NULL;
+}
+
 static int device_process_path(Manager *m, const char *path, bool update_state) {
+        DeviceEvent e;
         int r;
         struct udev_device *dev;
 
@@ -378,23 +478,25 @@ static int device_process_path(Manager *m, const char *path, bool update_state)
                 return -ENOMEM;
         }
 
-        r = device_process_new_device(m, dev, update_state);
+        r = device_event_from_udev(&e, dev);
+        if (r >= 0)
+                r = device_process_new_device(m, &e, update_state);
+
+        device_event_done(&e);
         udev_device_unref(dev);
         return r;
 }
 
-static int device_process_removed_device(Manager *m, struct udev_device *dev) {
-        const char *sysfs;
-        Device *d;
+static int device_process_removed_device(Manager *m, DeviceEvent *e) {
+        DeviceGroup *g;
 
         assert(m);
-        assert(dev);
-
-        if (!(sysfs = udev_device_get_syspath(dev)))
-                return -ENOMEM;
+        assert(e);
 
         /* Remove all units of this sysfs path */
-        while ((d = hashmap_get(m->devices_by_sysfs, sysfs))) {
+        while ((g = hashmap_get(m->devices_by_sysfs, e->sysfs))) {
+                Device *d = g->devices;
+
                 device_unset_sysfs(d);
                 device_set_state(d, DEVICE_DEAD);
         }
@@ -404,26 +506,20 @@ static int device_process_removed_device(Manager *m, struct udev_device *dev) {
 
 static Unit *device_following(Unit *u) {
         Device *d = DEVICE(u);
-        Device *other, *first = NULL;
+        DeviceGroup *g;
 
         assert(d);
 
-        if (startswith(u->id, "sys-"))
+        g = d->group;
+        if (!g || g->main == d)
                 return NULL;
 
-        /* Make everybody follow the unit that's named after the sysfs path */
-        for (other = d->same_sysfs_next; other; other = other->same_sysfs_next)
-                if (startswith(UNIT(other)->id, "sys-"))
-                        return UNIT(other);
+        /* Make everybody follow the unit that's named after the
+         * sysfs path, or if there is none, the first one */
+        if (g->main)
+                return UNIT(g->main);
 
-        for (other = d->same_sysfs_prev; other; other = other->same_sysfs_prev) {
-                if (startswith(UNIT(other)->id, "sys-"))
-                        return UNIT(other);
-
-                first = other;
-        }
-
-        return UNIT(first);
+        return g->devices == d ? NULL : UNIT(g->devices);
 }
 
 static int device_following_set(Unit *u, Set **_s) {
@@ -435,7 +531,7 @@ static int device_following_set(Unit *u, Set **_s) {
         assert(d);
         assert(_s);
 
-        if (!d->same_sysfs_prev && !d->same_sysfs_next) {
+        if (!d->group || d->group->n_devices <= 1) {
                 *_s = NULL;
                 return 0;
         }
@@ -443,13 +539,13 @@ static int device_following_set(Unit *u, Set **_s) {
         if (!(s = set_new(NULL, NULL)))
                 return -ENOMEM;
 
-        for (other = d->same_sysfs_next; other; other = other->same_sysfs_next)
-                if ((r = set_put(s, other)) < 0)
-                        goto fail;
+        LIST_FOREACH(same_sysfs, other, d->group->devices) {
+                if (other == d)
+                        continue;
 
-        for (other = d->same_sysfs_prev; other; other = other->same_sysfs_prev)
                 if ((r = set_put(s, other)) < 0)
                         goto fail;
+        }
 
         *_s = s;
         return 1;
@@ -548,10 +644,55 @@ fail:
         return r;
 }
 
+int device_process_events(Manager *m, DeviceEvent *events, unsigned n) {
+        DeviceGroup *g;
+        unsigned i;
+        int r = 0;
+
+        assert(m);
+        assert(events || n == 0);
+
+        for (i = 0; i < n; i++) {
+                DeviceEvent *e = events + i;
+                int k;
+
+                if (!e->action) {
+                        log_error("Failed to get udev action string.");
+                        continue;
+                }
+
+                if (streq(e->action, "remove") || (e->ready && parse_boolean(e->ready) == 0))
+                        k = device_process_removed_device(m, e);
+                else
+                        k = device_process_new_device(m, e, true);
+
+                if (k < 0) {
+                        log_error("Failed to process udev device event: %s", strerror(-k));
+                        r = k;
+                }
+        }
+
+        /* Now that all units of this batch have been created, load
+         * them, and update their state in one go */
+        manager_dispatch_load_queue(m);
+
+        while ((g = m->device_plug_queue)) {
+                Device *d;
+
+                LIST_REMOVE(DeviceGroup, plug_queue, m->device_plug_queue, g);
+                g->in_plug_queue = false;
+
+                LIST_FOREACH(same_sysfs, d, g->devices)
+                        device_set_state(d, DEVICE_PLUGGED);
+        }
+
+        return r;
+}
+
 void device_fd_event(Manager *m, int events) {
-        struct udev_device *dev;
-        int r;
-        const char *action, *ready;
+        struct udev_device *devs[DEVICE_EVENTS_BATCH_MAX];
+        DeviceEvent e[DEVICE_EVENTS_BATCH_MAX];
+        unsigned n = 0, i;
 
         assert(m);
 
@@ -564,35 +705,39 @@ void device_fd_event(Manager *m, int events) {
                         return;
         }
 
-        if (!(dev = udev_monitor_receive_device(m->udev_monitor))) {
-                /*
-                 * libudev might filter-out devices which pass the bloom filter,
-                 * so getting NULL here is not necessarily an error
-                 */
-                return;
-        }
+        /* Read everything that is queued, up to a limit, since
+         * devices tend to show up in bursts */
+        while (n < DEVICE_EVENTS_BATCH_MAX) {
+                struct udev_device *dev;
+                int r;
+
+                dev = udev_monitor_receive_device(m->udev_monitor);
+                if (!dev)
+                        /*
+                         * libudev might filter-out devices which pass the bloom filter,
+                         * so getting NULL here is not necessarily an error, but it
+                         * is as good a reason as any to stop the batch here. The
+                         * event loop will call us again if there's more.
+                         */
+                        break;
+
+                r = device_event_from_udev(&e[n], dev);
+                if (r < 0) {
+                        log_error("Failed to process udev device event: %s", strerror(-r));
+                        device_event_done(&e[n]);
+                        udev_device_unref(dev);
+                        continue;
+                }
 
-        if (!(action = udev_device_get_action(dev))) {
-                log_error("Failed to get udev action string.");
-                goto fail;
+                devs[n++] = dev;
         }
 
-        ready = udev_device_get_property_value(dev, "SYSTEMD_READY");
+        device_process_events(m, e, n);
 
-        if (streq(action, "remove") || (ready && parse_boolean(ready) == 0)) {
-                if ((r = device_process_removed_device(m, dev)) < 0) {
-                        log_error("Failed to process udev device event: %s", strerror(-r));
-                        goto fail;
-                }
-        } else {
-                if ((r = device_process_new_device(m, dev, true)) < 0) {
-                        log_error("Failed to process udev device event: %s", strerror(-r));
-                        goto fail;
-                }
+        for (i = 0; i < n; i++) {
+                device_event_done(&e[i]);
+                udev_device_unref(devs[i]);
         }
-
-fail:
-        udev_device_unref(dev);
 }
 
 static const char* const device_state_table[_DEVICE_STATE_MAX] = {
@@ -625,6 +770,7 @@ const UnitVTable device_vtable = {
         .bus_interface = "org.freedesktop.systemd1.Device",
         .bus_message_handler = bus_device_message_handler,
         .bus_invalidating_properties =  bus_device_invalidating_properties,
+        .bus_properties = bus_device_properties,
 
         .following = device_following,
         .following_set = device_following_set,
@@ -22,6 +22,8 @@
 ***/
 
 typedef struct Device Device;
+typedef struct DeviceGroup DeviceGroup;
+typedef struct DeviceEvent DeviceEvent;
 
 #include "unit.h"
 
@@ -43,14 +45,48 @@ struct Device {
         different device nodes we might end up creating multiple
         devices for the same sysfs path. We chain them up here. */
 
+        DeviceGroup *group;
         LIST_FIELDS(struct Device, same_sysfs);
 
         DeviceState state;
 };
 
+/* All devices of the same sysfs path. Everybody follows the one
+ * named after the sysfs path, which we hence keep track of here. */
+struct DeviceGroup {
+        char *sysfs;
+
+        Device *main;
+        LIST_HEAD(Device, devices);
+        unsigned n_devices;
+
+        /* Groups whose devices need to be marked plugged after all
+         * queued uevents have been processed */
+        LIST_FIELDS(DeviceGroup, plug_queue);
+        bool in_plug_queue:1;
+};
+
+/* The parts of a uevent we care about */
+struct DeviceEvent {
+        const char *action;
+        const char *sysfs;
+        const char *devnode;
+        dev_t devnum;
+        char **devlinks;
+
+        const char *model;
+        const char *ready;
+        const char *alias;
+        const char *wants;
+};
+
+/* How many uevents to process in one go */
+#define DEVICE_EVENTS_BATCH_MAX 128
+
 extern const UnitVTable device_vtable;
 
 void device_fd_event(Manager *m, int events);
+int device_process_events(Manager *m, DeviceEvent *events, unsigned n);
 
 const char* device_state_to_string(DeviceState i);
 DeviceState device_state_from_string(const char *s);
@@ -40,6 +40,7 @@
 #include <sys/poll.h>
 #include <linux/seccomp-bpf.h>
 #include <glob.h>
+#include <sys/syscall.h>
 
 #ifdef HAVE_PAM
 #include <security/pam_appl.h>
@@ -55,6 +56,7 @@
 #include "ioprio.h"
 #include "securebits.h"
 #include "cgroup.h"
+#include "cgroup-util.h"
 #include "namespace.h"
 #include "tcpwrap.h"
 #include "exit-status.h"
@@ -72,6 +74,10 @@
 /* This assumes there is a 'tty' group */
 #define TTY_MODE 0620
 
+/* The kernel's default for fs.nr_open, the most fds we look at when
+ * closing them without /proc */
+#define NR_OPEN_MAX (1024*1024)
+
 static int shift_fds(int fds[], unsigned n_fds) {
         int start, restart_from;
 
@@ -958,6 +964,582 @@ static int apply_seccomp(uint32_t *syscall_filter) {
         return 0;
 }
 
+/* Spawning via fork() has to copy PID 1's page tables, which gets
+ * expensive when we manage many units and spawn many processes, for
+ * example for Accept=yes sockets. For contexts that need nothing but
+ * a handful of system calls between fork() and execve() we hence
+ * clone() a child that shares our address space and suspends us
+ * until it called execve() or exited. Everything that allocates
+ * memory or touches global state is prepared here in the parent;
+ * the child may only do system calls. */
+
+#define CLONE_STACK_SIZE (64*1024)
+
+typedef struct CloneSpawn {
+        const ExecCommand *command;
+        const ExecContext *context;
+
+        int *fds;
+        unsigned n_fds;
+        int socket_fd;
+
+        bool apply_permissions:1;
+        bool apply_chroot:1;
+        bool apply_tty_stdin:1;
+
+        const char *ident;
+        const char *unit_id;
+        char *working_directory;
+        char oom_score_adjust[16];
+
+        /* "tasks" files of the cgroups to join, and whether joining
+         * each of them is essential */
+        char **cgroup_tasks;
+        bool *cgroup_essential;
+
+        /* Points into env, filled in by the child */
+        char *listen_pid;
+
+        char **argv;
+        char **env;
+
+        /* Set by the child if it fails before execve() */
+        int exit_status;
+        int error;
+} CloneSpawn;
+
+static bool exec_output_may_clone(ExecOutput o) {
+        return
+                o == EXEC_OUTPUT_INHERIT ||
+                o == EXEC_OUTPUT_NULL ||
+                o == EXEC_OUTPUT_SOCKET;
+}
+
+static bool exec_spawn_may_clone(
+                char **argv,
+                const ExecContext *context,
+                unsigned n_fds,
+                bool apply_permissions,
+                bool apply_chroot,
+                bool confirm_spawn,
+                int idle_pipe[2]) {
+
+        char **i;
+        unsigned l;
+
+        assert(context);
+
+        if (confirm_spawn)
+                return false;
+
+        if (idle_pipe && (idle_pipe[0] >= 0 || idle_pipe[1] >= 0))
+                return false;
+
+        /* Terminals, loggers and tcpwrap need more than plain system
+         * calls in the child */
+        if (context->std_input != EXEC_INPUT_NULL &&
+            context->std_input != EXEC_INPUT_SOCKET)
+                return false;
+
+        if (!exec_output_may_clone(context->std_output) ||
+            !exec_output_may_clone(context->std_error))
+                return false;
+
+        if (context->tty_path ||
+            context->tty_reset ||
+            context->tty_vhangup ||
+            context->tty_vt_disallocate ||
+            context->tcpwrap_name ||
+            context->utmp_id)
+                return false;
+
+        /* NSS, PAM and libcap may allocate memory or take locks */
+        if (context->user ||
+            context->group ||
+            !strv_isempty(context->supplementary_groups) ||
+            context->pam_name)
+                return false;
+
+        if (context->control_group_persistent >= 0)
+                return false;
+
+        if (context->private_network ||
+            context->private_tmp ||
+            context->mount_flags != 0 ||
+            !strv_isempty(context->read_write_dirs) ||
+            !strv_isempty(context->read_only_dirs) ||
+            !strv_isempty(context->inaccessible_dirs))
+                return false;
+
+        if (apply_permissions) {
+                if (context->capabilities ||
+                    context->capability_bounding_set_drop ||
+                    context->syscall_filter)
+                        return false;
+
+                for (l = 0; l < RLIMIT_NLIMITS; l++)
+                        if (context->rlimit[l])
+                                return false;
+        }
+
+        /* We only know our PID after the clone(), hence cannot
+         * expand it on the command line */
+        if (n_fds > 0)
+                STRV_FOREACH(i, argv)
+                        if (strstr(*i, "LISTEN_PID"))
+                                return false;
+
+        return true;
+}
+
+static bool fd_in_set_nomalloc(int fd, const int except[], unsigned n_except) {
+        unsigned j;
+
+        for (j = 0; j < n_except; j++)
+                if (except[j] == fd)
+                        return true;
+
+        return false;
+}
+
+static int close_all_fds_nomalloc(const int except[], unsigned n_except) {
+        union {
+                struct dirent64 de;
+                uint8_t buf[4096];
+        } u;
+        int d, r = 0;
+
+        /* Like close_all_fds(), but without allocating memory, so that
+         * it is usable in a child sharing our address space */
+
+        d = open("/proc/self/fd", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (d < 0) {
+                struct rlimit rl;
+                int fd, max_fd;
+
+                /* Without /proc, try every fd we might have */
+                if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+                        return -errno;
+
+                max_fd = rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > NR_OPEN_MAX ? NR_OPEN_MAX : (int) rl.rlim_cur;
+
+                for (fd = 3; fd < max_fd; fd++) {
+
+                        if (fd_in_set_nomalloc(fd, except, n_except))
+                                continue;
+
+                        if (close_nointr(fd) < 0)
+                                if (errno != EBADF && r == 0)
+                                        r = -errno;
+                }
+
+                return r;
+        }
+
+        for (;;) {
+                ssize_t n, k;
+
+                n = syscall(SYS_getdents64, d, u.buf, sizeof(u.buf));
+                if (n < 0) {
+                        r = -errno;
+                        break;
+                }
+
+                if (n == 0)
+                        break;
+
+                for (k = 0; k < n;) {
+                        struct dirent64 *de = (struct dirent64*) (u.buf + k);
+                        int fd;
+
+                        k += de->d_reclen;
+
+                        if (safe_atoi(de->d_name, &fd) < 0)
+                                continue;
+
+                        if (fd < 3 || fd == d)
+                                continue;
+
+                        if (fd_in_set_nomalloc(fd, except, n_except))
+                                continue;
+
+                        if (close_nointr(fd) < 0)
+                                if (errno != EBADF && r == 0)
+                                        r = -errno;
+                }
+        }
+
+        close_nointr_nofail(d);
+        return r;
+}
+
+static int write_string_nomalloc(const char *p, const char *s) {
+        int fd, r = 0;
+        size_t l;
+
+        fd = open(p, O_WRONLY|O_NOCTTY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        l = strlen(s);
+        if (write(fd, s, l) != (ssize_t) l)
+                r = errno > 0 ? -errno : -EIO;
+
+        close_nointr_nofail(fd);
+        return r;
+}
+
+static int exec_spawn_clone_child(void *userdata) {
+        CloneSpawn *s = userdata;
+        const ExecContext *context = s->context;
+        sigset_t ss;
+        int err, r;
+        char **t;
+        bool *e;
+
+        /* Careful! We share our memory with the suspended parent
+         * process until execve(). Don't allocate memory, don't touch
+         * global state. */
+
+        default_signals(SIGNALS_CRASH_HANDLER,
+                        SIGNALS_IGNORE, -1);
+
+        if (context->ignore_sigpipe)
+                ignore_signals(SIGPIPE, -1);
+
+        assert_se(sigemptyset(&ss) == 0);
+        if (sigprocmask(SIG_SETMASK, &ss, NULL) < 0) {
+                err = -errno;
+                r = EXIT_SIGNAL_MASK;
+                goto fail;
+        }
+
+        err = close_all_fds_nomalloc(s->socket_fd >= 0 ? &s->socket_fd : s->fds,
+                                     s->socket_fd >= 0 ? 1 : s->n_fds);
+        if (err < 0) {
+                r = EXIT_FDS;
+                goto fail;
+        }
+
+        if (!context->same_pgrp)
+                if (setsid() < 0) {
+                        err = -errno;
+                        r = EXIT_SETSID;
+                        goto fail;
+                }
+
+        if (s->socket_fd >= 0)
+                fd_nonblock(s->socket_fd, false);
+
+        err = setup_input(context, s->socket_fd, s->apply_tty_stdin);
+        if (err < 0) {
+                r = EXIT_STDIN;
+                goto fail;
+        }
+
+        err = setup_output(context, STDOUT_FILENO, s->socket_fd, s->ident, s->unit_id, s->apply_tty_stdin);
+        if (err < 0) {
+                r = EXIT_STDOUT;
+                goto fail;
+        }
+
+        err = setup_output(context, STDERR_FILENO, s->socket_fd, s->ident, s->unit_id, s->apply_tty_stdin);
+        if (err < 0) {
+                r = EXIT_STDERR;
+                goto fail;
+        }
+
+        for (t = s->cgroup_tasks, e = s->cgroup_essential; t && *t; t++, e++) {
+                err = write_string_nomalloc(*t, "0\n");
+                if (err < 0 && *e) {
+                        r = EXIT_CGROUP;
+                        goto fail;
+                }
+        }
+
+        if (context->oom_score_adjust_set) {
+                err = write_string_nomalloc("/proc/self/oom_score_adj", s->oom_score_adjust);
+                if (err < 0) {
+                        r = EXIT_OOM_ADJUST;
+                        goto fail;
+                }
+        }
+
+        if (context->nice_set)
+                if (setpriority(PRIO_PROCESS, 0, context->nice) < 0) {
+                        err = -errno;
+                        r = EXIT_NICE;
+                        goto fail;
+                }
+
+        if (context->cpu_sched_set) {
+                struct sched_param param;
+
+                zero(param);
+                param.sched_priority = context->cpu_sched_priority;
+
+                if (sched_setscheduler(0, context->cpu_sched_policy |
+                                       (context->cpu_sched_reset_on_fork ? SCHED_RESET_ON_FORK : 0), &param) < 0) {
+                        err = -errno;
+                        r = EXIT_SETSCHEDULER;
+                        goto fail;
+                }
+        }
+
+        if (context->cpuset)
+                if (sched_setaffinity(0, CPU_ALLOC_SIZE(context->cpuset_ncpus), context->cpuset) < 0) {
+                        err = -errno;
+                        r = EXIT_CPUAFFINITY;
+                        goto fail;
+                }
+
+        if (context->ioprio_set)
+                if (ioprio_set(IOPRIO_WHO_PROCESS, 0, context->ioprio) < 0) {
+                        err = -errno;
+                        r = EXIT_IOPRIO;
+                        goto fail;
+                }
+
+        if (context->timer_slack_nsec != (nsec_t) -1)
+                if (prctl(PR_SET_TIMERSLACK, context->timer_slack_nsec) < 0) {
+                        err = -errno;
+                        r = EXIT_TIMERSLACK;
+                        goto fail;
+                }
+
+        umask(context->umask);
+
+        if (s->apply_chroot && context->root_directory)
+                if (chroot(context->root_directory) < 0) {
+                        err = -errno;
+                        r = EXIT_CHROOT;
+                        goto fail;
+                }
+
+        if (chdir(s->working_directory) < 0) {
+                err = -errno;
+                r = EXIT_CHDIR;
+                goto fail;
+        }
+
+        err = shift_fds(s->fds, s->n_fds);
+        if (err >= 0)
+                err = flags_fds(s->fds, s->n_fds, context->non_blocking);
+        if (err < 0) {
+                r = EXIT_FDS;
+                goto fail;
+        }
+
+        if (s->apply_permissions) {
+                if (prctl(PR_GET_SECUREBITS) != context->secure_bits)
+                        if (prctl(PR_SET_SECUREBITS, context->secure_bits) < 0) {
+                                err = -errno;
+                                r = EXIT_SECUREBITS;
+                                goto fail;
+                        }
+
+                if (context->no_new_privileges)
+                        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+                                err = -errno;
+                                r = EXIT_NO_NEW_PRIVILEGES;
+                                goto fail;
+                        }
+        }
+
+        /* The C library might cache the PID of the parent, hence ask
+         * the kernel */
+        if (s->listen_pid)
+                snprintf(s->listen_pid + strlen("LISTEN_PID="), DECIMAL_STR_MAX(pid_t),
+                         "%lu", (unsigned long) syscall(SYS_getpid));
+
+        execve(s->command->path, s->argv, s->env);
+        err = -errno;
+        r = EXIT_EXEC;
+
+fail:
+        s->error = err;
+        s->exit_status = r;
+        _exit(r);
+}
+
+static pid_t exec_spawn_clone(
+                ExecCommand *command,
+                char **argv,
+                const ExecContext *context,
+                int fds[], unsigned n_fds,
+                int socket_fd,
+                char **environment,
+                char **files_env,
+                bool apply_permissions,
+                bool apply_chroot,
+                bool apply_tty_stdin,
+                CGroupBonding *cgroup_bondings,
+                const char *cgroup_suffix,
+                const char *unit_id) {
+
+        char _cleanup_strv_free_ **our_env = NULL, **cgroup_tasks = NULL;
+        char _cleanup_free_ *stack = NULL, *working_directory = NULL;
+        _cleanup_free_ bool *cgroup_essential = NULL;
+        _cleanup_free_ int *fds_copy = NULL;
+        CloneSpawn s;
+        CGroupBonding *b;
+        unsigned n = 0, n_env = 0;
+        sigset_t all, old;
+        pid_t pid;
+        char **i;
+        int r;
+
+        /* Returns a negative errno if the child could not be set up
+         * this way, in which case the caller should fork() instead */
+
+        zero(s);
+        s.command = command;
+        s.context = context;
+        s.n_fds = n_fds;
+        s.socket_fd = socket_fd;
+        s.apply_permissions = apply_permissions;
+        s.apply_chroot = apply_chroot;
+        s.apply_tty_stdin = apply_tty_stdin;
+        s.ident = path_get_file_name(command->path);
+        s.unit_id = unit_id;
+
+        /* The child shifts these around, don't let it clobber the
+         * caller's array */
+        if (n_fds > 0) {
+                fds_copy = newdup(int, fds, n_fds);
+                if (!fds_copy)
+                        return -ENOMEM;
+                s.fds = fds_copy;
+        }
+
+        if (apply_chroot)
+                working_directory = strdup(context->working_directory ? context->working_directory : "/");
+        else
+                working_directory = strjoin(context->root_directory ? context->root_directory : "",
+                                            "/",
+                                            context->working_directory ? context->working_directory : "",
+                                            NULL);
+        if (!working_directory)
+                return -ENOMEM;
+        s.working_directory = working_directory;
+
+        if (context->oom_score_adjust_set) {
+                snprintf(s.oom_score_adjust, sizeof(s.oom_score_adjust), "%i\n", context->oom_score_adjust);
+                char_array_0(s.oom_score_adjust);
+        }
+
+        LIST_FOREACH(by_unit, b, cgroup_bondings)
+                n++;
+
+        if (n > 0) {
+                cgroup_tasks = new0(char*, n + 1);
+                cgroup_essential = new0(bool, n);
+                if (!cgroup_tasks || !cgroup_essential)
+                        return -ENOMEM;
+
+                n = 0;
+                LIST_FOREACH(by_unit, b, cgroup_bondings) {
+                        char _cleanup_free_ *p = NULL;
+
+                        p = cgroup_suffix ? strjoin(b->path, "/", cgroup_suffix, NULL) : strdup(b->path);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = cg_create(b->controller, p);
+                        if (r < 0) {
+                                if (b->essential)
+                                        return r;
+                                continue;
+                        }
+
+                        r = cg_get_path_and_check(b->controller, p, "tasks", cgroup_tasks + n);
+                        if (r < 0) {
+                                if (b->essential)
+                                        return r;
+                                continue;
+                        }
+
+                        cgroup_essential[n++] = b->essential;
+                }
+        }
+
+        s.cgroup_tasks = cgroup_tasks;
+        s.cgroup_essential = cgroup_essential;
+
+        our_env = new0(char*, 3);
+        if (!our_env)
+                return -ENOMEM;
+
+        if (n_fds > 0)
+                if (asprintf(our_env + n_env++, "LISTEN_PID=") < 0 ||
+                    asprintf(our_env + n_env++, "LISTEN_FDS=%u", n_fds) < 0)
+                        return -ENOMEM;
+
+        s.env = strv_env_merge(4,
+                               environment,
+                               our_env,
+                               context->environment,
+                               files_env,
+                               NULL);
+        if (!s.env)
+                return -ENOMEM;
+
+        s.argv = replace_env_argv(argv, s.env);
+        if (!s.argv) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        s.env = strv_env_clean(s.env);
+
+        /* Make room for the PID the child will fill in */
+        if (n_fds > 0)
+                STRV_FOREACH(i, s.env)
+                        if (startswith(*i, "LISTEN_PID=")) {
+                                char *p;
+
+                                p = realloc(*i, strlen("LISTEN_PID=") + DECIMAL_STR_MAX(pid_t));
+                                if (!p) {
+                                        r = -ENOMEM;
+                                        goto finish;
+                                }
+
+                                *i = s.listen_pid = p;
+                                break;
+                        }
+
+        stack = malloc(CLONE_STACK_SIZE);
+        if (!stack) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        /* Don't run any of our signal handlers on the child's stack */
+        assert_se(sigfillset(&all) == 0);
+        assert_se(sigprocmask(SIG_SETMASK, &all, &old) == 0);
+
+        pid = clone(exec_spawn_clone_child, stack + CLONE_STACK_SIZE,
+                    CLONE_VM|CLONE_VFORK|SIGCHLD, &s);
+        r = pid < 0 ? -errno : pid;
+
+        assert_se(sigprocmask(SIG_SETMASK, &old, NULL) == 0);
+
+        if (r > 0 && s.exit_status != 0)
+                log_struct(LOG_ERR, MESSAGE_ID(SD_MESSAGE_SPAWN_FAILED),
+                           "EXECUTABLE=%s", command->path,
+                           "MESSAGE=Failed at step %s spawning %s: %s",
+                                  exit_status_to_string(s.exit_status, EXIT_STATUS_SYSTEMD),
+                                  command->path, strerror(-s.error),
+                           "ERRNO=%d", -s.error,
+                           NULL);
+
+finish:
+        strv_free(s.env);
+        strv_free(s.argv);
+
+        return r;
+}
+
 int exec_spawn(ExecCommand *command,
                char **argv,
                const ExecContext *context,
@@ -1028,9 +1610,23 @@ int exec_spawn(ExecCommand *command,
 
         cgroup_attribute_apply_list(cgroup_attributes, cgroup_bondings);
 
-        pid = fork();
-        if (pid < 0)
-                return -errno;
+        pid = -1;
+        if (exec_spawn_may_clone(argv, context, n_fds, apply_permissions, apply_chroot, confirm_spawn, idle_pipe)) {
+                pid = exec_spawn_clone(command, argv, context, fds, n_fds, socket_fd,
+                                       environment, files_env,
+                                       apply_permissions, apply_chroot, apply_tty_stdin,
+                                       cgroup_bondings, cgroup_suffix, unit_id);
+                if (pid < 0)
+                        log_debug_unit(unit_id,
+                                       "Failed to clone() %s, falling back to fork(): %s",
+                                       command->path, strerror(-pid));
+        }
+
+        if (pid < 0) {
+                pid = fork();
+                if (pid < 0)
+                        return -errno;
+        }
 
         if (pid == 0) {
                 int i, err;
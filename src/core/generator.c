@@ -0,0 +1,686 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "generator.h"
+#include "exit-status.h"
+#include "fileio.h"
+#include "log.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "siphash24.h"
+#include "strv.h"
+#include "util.h"
+
+static const char* const output_names[3] = {
+        "normal",
+        "early",
+        "late"
+};
+
+typedef struct Generator {
+        char *name;
+        char *path;
+
+        /* Set if the output of this generator is cached */
+        char *cache;
+        char *fingerprint;
+
+        pid_t pid;
+        usec_t start;
+} Generator;
+
+static void generator_done(Generator *g) {
+        free(g->name);
+        free(g->path);
+        free(g->cache);
+        free(g->fingerprint);
+}
+
+static int generator_compare(const void *a, const void *b) {
+        const Generator *x = a, *y = b;
+
+        return strcmp(x->name, y->name);
+}
+
+static int add_line(char **s, const char *line) {
+        char *t;
+
+        t = strjoin(*s ? *s : "", line, "\n", NULL);
+        if (!t)
+                return -ENOMEM;
+
+        free(*s);
+        *s = t;
+
+        return 0;
+}
+
+static int generator_fingerprint(Generator *g, const char *inputs_file, char **ret) {
+        static const uint8_t key[16] = {};
+        _cleanup_fclose_ FILE *f = NULL;
+        char *s = NULL, line[LINE_MAX];
+        struct stat st;
+        int r;
+
+        assert(g);
+        assert(inputs_file);
+        assert(ret);
+
+        /* The fingerprint covers the generator binary itself and the
+         * mode and contents of every declared input file. /proc and
+         * /sys files have no useful timestamps, hence we look at the
+         * contents, not at the timestamps. */
+
+        f = fopen(inputs_file, "re");
+        if (!f)
+                return -errno;
+
+        if (stat(g->path, &st) < 0)
+                return -errno;
+
+        snprintf(line, sizeof(line), "%s %llu %llu %llu",
+                 g->path,
+                 (unsigned long long) st.st_ino,
+                 (unsigned long long) st.st_size,
+                 (unsigned long long) timespec_load(&st.st_mtim));
+
+        r = add_line(&s, line);
+        if (r < 0)
+                return r;
+
+        FOREACH_LINE(line, f, r = -errno; goto fail) {
+                _cleanup_free_ char *contents = NULL;
+                char buf[LINE_MAX + 64];
+                uint8_t hash[8];
+                size_t size;
+                char *l;
+
+                l = strstrip(line);
+                if (*l == 0 || strchr(COMMENTS, *l))
+                        continue;
+
+                if (!path_is_absolute(l)) {
+                        log_warning("Input %s of %s is not an absolute path, ignoring.", l, g->name);
+                        continue;
+                }
+
+                if (stat(l, &st) < 0) {
+                        if (errno != ENOENT) {
+                                r = -errno;
+                                goto fail;
+                        }
+
+                        snprintf(buf, sizeof(buf), "%s -", l);
+                } else if (S_ISREG(st.st_mode)) {
+                        r = read_full_file(l, &contents, &size);
+                        if (r < 0)
+                                goto fail;
+
+                        siphash24(hash, contents, size, key);
+
+                        snprintf(buf, sizeof(buf), "%s %o %02x%02x%02x%02x%02x%02x%02x%02x", l,
+                                 (unsigned) st.st_mode,
+                                 hash[0], hash[1], hash[2], hash[3], hash[4], hash[5], hash[6], hash[7]);
+                } else
+                        snprintf(buf, sizeof(buf), "%s %o", l, (unsigned) st.st_mode);
+
+                r = add_line(&s, buf);
+                if (r < 0)
+                        goto fail;
+        }
+
+        *ret = s;
+        return 0;
+
+fail:
+        free(s);
+        return r;
+}
+
+static int copy_tree(const char *from, const char *to, const char *from_root, const char *to_root) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r = 0;
+
+        /* Merges the output of a generator into the directories the
+         * other generators write to. Generators like to create
+         * absolute symlinks into their own output directory, which
+         * are rewritten to point into the final one. */
+
+        d = opendir(from);
+        if (!d)
+                return errno == ENOENT ? 0 : -errno;
+
+        if (mkdir(to, 0755) < 0 && errno != EEXIST)
+                return -errno;
+
+        while ((de = readdir(d))) {
+                _cleanup_free_ char *fp = NULL, *tp = NULL;
+                struct stat st;
+                int k = 0;
+
+                if (ignore_file(de->d_name))
+                        continue;
+
+                fp = strjoin(from, "/", de->d_name, NULL);
+                tp = strjoin(to, "/", de->d_name, NULL);
+                if (!fp || !tp)
+                        return -ENOMEM;
+
+                if (lstat(fp, &st) < 0) {
+                        r = -errno;
+                        continue;
+                }
+
+                if (S_ISDIR(st.st_mode))
+                        k = copy_tree(fp, tp, from_root, to_root);
+
+                else if (S_ISLNK(st.st_mode)) {
+                        _cleanup_free_ char *target = NULL, *rewritten = NULL;
+                        const char *e;
+
+                        k = readlink_malloc(fp, &target);
+                        if (k >= 0) {
+                                e = path_startswith(target, from_root);
+                                if (e) {
+                                        rewritten = strjoin(to_root, "/", e, NULL);
+                                        if (!rewritten)
+                                                return -ENOMEM;
+                                }
+
+                                if (symlink(rewritten ? rewritten : target, tp) < 0 && errno != EEXIST)
+                                        k = -errno;
+                        }
+
+                } else if (S_ISREG(st.st_mode)) {
+                        k = copy_file(fp, tp);
+                        if (k == -EEXIST)
+                                k = 0;
+                }
+
+                if (k < 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+static int generator_install_cached(Generator *g, char *const output_dirs[3]) {
+        unsigned i;
+        int r = 0, k;
+
+        assert(g);
+        assert(g->cache);
+
+        for (i = 0; i < 3; i++) {
+                _cleanup_free_ char *p = NULL;
+
+                p = strjoin(g->cache, "/", output_names[i], NULL);
+                if (!p)
+                        return -ENOMEM;
+
+                k = copy_tree(p, output_dirs[i], p, output_dirs[i]);
+                if (k < 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+static int generator_prepare_cache(Generator *g, char *argv[5]) {
+        _cleanup_free_ char *fp = NULL;
+        unsigned i;
+        int r;
+
+        assert(g);
+        assert(g->cache);
+
+        rm_rf(g->cache, false, false, false);
+
+        r = mkdir_p(g->cache, 0755);
+        if (r < 0)
+                return r;
+
+        /* Make sure a half-written cache is never used */
+        fp = strappend(g->cache, "/fingerprint");
+        if (!fp)
+                return -ENOMEM;
+
+        unlink(fp);
+
+        for (i = 0; i < 3; i++) {
+                argv[i+1] = strjoin(g->cache, "/", output_names[i], NULL);
+                if (!argv[i+1])
+                        return -ENOMEM;
+
+                if (mkdir(argv[i+1], 0755) < 0 && errno != EEXIST)
+                        return -errno;
+        }
+
+        return 0;
+}
+
+static int generator_spawn(Generator *g, char *const output_dirs[3]) {
+        char *argv[5] = {};
+        unsigned i;
+        pid_t pid;
+        int r;
+
+        assert(g);
+
+        argv[0] = g->path;
+
+        if (g->cache) {
+                r = generator_prepare_cache(g, argv);
+                if (r < 0) {
+                        log_warning("Failed to prepare cache for %s, running uncached: %s", g->name, strerror(-r));
+
+                        for (i = 1; i < 4; i++) {
+                                free(argv[i]);
+                                argv[i] = NULL;
+                        }
+
+                        free(g->cache);
+                        g->cache = NULL;
+                }
+        }
+
+        if (!g->cache)
+                for (i = 0; i < 3; i++)
+                        argv[i+1] = output_dirs[i];
+
+        g->start = now(CLOCK_MONOTONIC);
+
+        pid = fork();
+        if (pid < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        if (pid == 0) {
+                sigset_t ss;
+
+                /* Child */
+
+                /* PID 1 and generators_run() block signals, don't
+                 * pass that on */
+                reset_all_signal_handlers();
+
+                sigemptyset(&ss);
+                sigprocmask(SIG_SETMASK, &ss, NULL);
+
+                execv(g->path, argv);
+
+                log_error("Failed to execute %s: %m", g->path);
+                _exit(EXIT_FAILURE);
+        }
+
+        log_debug("Spawned %s as %lu", g->path, (unsigned long) pid);
+
+        g->pid = pid;
+        r = 0;
+
+finish:
+        if (g->cache)
+                for (i = 1; i < 4; i++)
+                        free(argv[i]);
+
+        return r;
+}
+
+static void generator_finish(Generator *g, const siginfo_t *si, char *const output_dirs[3]) {
+        int r;
+
+        assert(g);
+        assert(si);
+
+        if (!is_clean_exit(si->si_code, si->si_status, NULL)) {
+                if (si->si_code == CLD_EXITED)
+                        log_error("%s exited with exit status %i.", g->path, si->si_status);
+                else
+                        log_error("%s terminated by signal %s.", g->path, signal_to_string(si->si_status));
+
+                /* Never cache a failure */
+                if (g->cache)
+                        rm_rf(g->cache, false, true, false);
+
+                return;
+        }
+
+        log_debug("%s exited successfully.", g->path);
+
+        if (!g->cache)
+                return;
+
+        r = generator_install_cached(g, output_dirs);
+        if (r < 0) {
+                log_error("Failed to install output of %s: %s", g->name, strerror(-r));
+                return;
+        }
+
+        if (g->fingerprint) {
+                _cleanup_free_ char *fp = NULL;
+
+                fp = strappend(g->cache, "/fingerprint");
+                if (!fp) {
+                        log_oom();
+                        return;
+                }
+
+                r = write_one_line_file_atomic(fp, g->fingerprint);
+                if (r < 0)
+                        log_warning("Failed to write fingerprint of %s: %s", g->name, strerror(-r));
+        }
+}
+
+static int generator_try_cache(Generator *g, const char *inputs_path, const char *cache_path, char *const output_dirs[3]) {
+        _cleanup_free_ char *inputs_file = NULL, *fp = NULL, *old = NULL;
+        int r;
+
+        assert(g);
+
+        /* Returns > 0 if the cached output could be used */
+
+        inputs_file = strjoin(inputs_path, "/", g->name, ".inputs", NULL);
+        if (!inputs_file)
+                return -ENOMEM;
+
+        if (access(inputs_file, F_OK) < 0)
+                return 0;
+
+        r = generator_fingerprint(g, inputs_file, &g->fingerprint);
+        if (r < 0) {
+                log_warning("Failed to determine inputs of %s, not caching: %s", g->name, strerror(-r));
+                return 0;
+        }
+
+        /* The fingerprint file ends in a newline, which
+         * read_full_file() keeps */
+        r = add_line(&g->fingerprint, "");
+        if (r < 0)
+                return r;
+
+        g->cache = strjoin(cache_path, "/", g->name, NULL);
+        if (!g->cache)
+                return -ENOMEM;
+
+        fp = strappend(g->cache, "/fingerprint");
+        if (!fp)
+                return -ENOMEM;
+
+        if (read_full_file(fp, &old, NULL) < 0 || !streq(old, g->fingerprint))
+                return 0;
+
+        r = generator_install_cached(g, output_dirs);
+        if (r < 0) {
+                log_warning("Failed to use cached output of %s, running it: %s", g->name, strerror(-r));
+                return 0;
+        }
+
+        log_debug("Inputs of %s unchanged, used cached output.", g->name);
+        return 1;
+}
+
+static int generators_enumerate(const char *generator_path, Generator **ret, unsigned *n_ret) {
+        _cleanup_closedir_ DIR *d = NULL;
+        Generator *generators = NULL;
+        size_t allocated = 0;
+        unsigned n = 0;
+        struct dirent *de;
+
+        d = opendir(generator_path);
+        if (!d) {
+                if (errno == ENOENT) {
+                        *ret = NULL;
+                        *n_ret = 0;
+                        return 0;
+                }
+
+                return -errno;
+        }
+
+        while ((de = readdir(d))) {
+                Generator *g;
+
+                if (!dirent_is_file(de))
+                        continue;
+
+                if (!GREEDY_REALLOC(generators, allocated, (n + 1) * sizeof(Generator)))
+                        goto oom;
+
+                g = generators + n;
+                zero(*g);
+
+                g->name = strdup(de->d_name);
+                g->path = strjoin(generator_path, "/", de->d_name, NULL);
+                if (!g->name || !g->path) {
+                        free(g->name);
+                        free(g->path);
+                        goto oom;
+                }
+
+                n++;
+        }
+
+        /* Make things reproducible */
+        qsort(generators, n, sizeof(Generator), generator_compare);
+
+        *ret = generators;
+        *n_ret = n;
+        return 0;
+
+oom:
+        while (n > 0)
+                generator_done(generators + --n);
+        free(generators);
+
+        return -ENOMEM;
+}
+
+int generators_run(
+                const char *generator_path,
+                const char *inputs_path,
+                const char *cache_path,
+                char *const output_dirs[3],
+                unsigned n_workers,
+                GeneratorTiming **timings,
+                unsigned *n_timings) {
+
+        Generator *generators = NULL;
+        GeneratorTiming *t = NULL;
+        Generator **running = NULL;
+        unsigned n = 0, next = 0, n_running = 0, n_done = 0, i;
+        sigset_t mask, old_mask;
+        bool got_sigchld = false;
+        int r;
+
+        assert(generator_path);
+        assert(output_dirs);
+        assert(timings);
+        assert(n_timings);
+
+        /* We find out about generators exiting via SIGCHLD, and then
+         * look at our own children only. That way we neither reap
+         * anything that isn't ours, nor wait for daemons a generator
+         * might have left behind. PID 1 has SIGCHLD blocked anyway,
+         * everybody else gets it blocked for the time being. */
+        assert_se(sigemptyset(&mask) == 0);
+        sigset_add_many(&mask, SIGCHLD, -1);
+        assert_se(sigprocmask(SIG_BLOCK, &mask, &old_mask) == 0);
+
+        r = generators_enumerate(generator_path, &generators, &n);
+        if (r < 0)
+                goto finish;
+
+        if (n <= 0)
+                goto finish;
+
+        n_workers = CLAMP(n_workers, 1U, n);
+
+        t = new0(GeneratorTiming, n);
+        running = new0(Generator*, n_workers);
+        if (!t || !running) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        for (;;) {
+                unsigned n_reaped = 0;
+                usec_t ts, deadline = (usec_t) -1;
+                struct timespec timeout;
+                int k;
+
+                /* Fill up the worker slots, skipping what's cached */
+                while (next < n && n_running < n_workers) {
+                        Generator *g = generators + next++;
+
+                        ts = now(CLOCK_MONOTONIC);
+
+                        if (inputs_path && cache_path &&
+                            generator_try_cache(g, inputs_path, cache_path, output_dirs) > 0) {
+
+                                t[n_done].name = g->name;
+                                g->name = NULL;
+                                t[n_done].usec = now(CLOCK_MONOTONIC) - ts;
+                                t[n_done].cached = true;
+                                n_done++;
+                                continue;
+                        }
+
+                        k = generator_spawn(g, output_dirs);
+                        if (k < 0) {
+                                log_error("Failed to run %s: %s", g->path, strerror(-k));
+                                continue;
+                        }
+
+                        running[n_running++] = g;
+                }
+
+                if (n_running <= 0)
+                        break;
+
+                /* Reap what has exited, and kill what took too long */
+                ts = now(CLOCK_MONOTONIC);
+
+                for (i = n_running; i > 0; i--) {
+                        Generator *g = running[i-1];
+                        siginfo_t si;
+
+                        zero(si);
+                        if (waitid(P_PID, g->pid, &si, WEXITED|WNOHANG) < 0)
+                                log_error("waitid() failed for %s: %m", g->path);
+
+                        else if (si.si_pid != g->pid) {
+
+                                if (g->start + GENERATOR_TIMEOUT_USEC > ts) {
+                                        deadline = MIN(deadline, g->start + GENERATOR_TIMEOUT_USEC);
+                                        continue;
+                                }
+
+                                log_error("%s timed out, killing.", g->path);
+
+                                kill(g->pid, SIGKILL);
+
+                                zero(si);
+                                if (wait_for_terminate(g->pid, &si) < 0)
+                                        log_error("waitid() failed for %s: %m", g->path);
+                        }
+
+                        if (si.si_pid == g->pid)
+                                generator_finish(g, &si, output_dirs);
+
+                        t[n_done].name = g->name;
+                        g->name = NULL;
+                        t[n_done].usec = now(CLOCK_MONOTONIC) - g->start;
+                        n_done++;
+
+                        running[i-1] = running[--n_running];
+                        n_reaped++;
+                }
+
+                if (n_reaped > 0)
+                        continue;
+
+                /* SIGCHLD is blocked, hence if a child exited since
+                 * we checked, this returns right away */
+                if (sigtimedwait(&mask, NULL, timespec_store(&timeout, deadline - ts)) < 0) {
+                        if (errno == EAGAIN || errno == EINTR)
+                                continue;
+
+                        r = -errno;
+                        log_error("sigtimedwait() failed: %m");
+                        break;
+                }
+
+                got_sigchld = true;
+        }
+
+        /* Don't leave anything behind if we failed half-way */
+        for (i = 0; i < n_running; i++) {
+                siginfo_t si;
+
+                kill(running[i]->pid, SIGKILL);
+                wait_for_terminate(running[i]->pid, &si);
+        }
+
+finish:
+        for (i = 0; i < n; i++)
+                generator_done(generators + i);
+        free(generators);
+        free(running);
+
+        /* The SIGCHLDs we consumed might have been meant for somebody
+         * else too, so pass one on, for PID 1 to check on its own
+         * children as well */
+        if (got_sigchld)
+                raise(SIGCHLD);
+
+        assert_se(sigprocmask(SIG_SETMASK, &old_mask, NULL) == 0);
+
+        if (r < 0) {
+                generator_timings_free(t, n_done);
+                return r;
+        }
+
+        *timings = t;
+        *n_timings = n_done;
+
+        return 0;
+}
+
+void generator_timings_free(GeneratorTiming *t, unsigned n) {
+        unsigned i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].name);
+
+        free(t);
+}
@@ -0,0 +1,57 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "util.h"
+
+/* Generators are mostly I/O bound, hence more workers don't help */
+#define GENERATOR_WORKERS_MAX 8
+
+/* Generators still running after this long are killed */
+#define GENERATOR_TIMEOUT_USEC (90*USEC_PER_SEC)
+
+typedef struct GeneratorTiming GeneratorTiming;
+
+struct GeneratorTiming {
+        char *name;
+        usec_t usec;
+        bool cached;
+};
+
+/* Runs all generators in the directory, at most n_workers at a time,
+ * and passes the three output directories to each. If cache_path is
+ * set, generators that have a list of input files in inputs_path
+ * (named after the generator with a ".inputs" suffix) are run into
+ * a private directory below cache_path, whose contents are reused
+ * later on for as long as the input files stay the same. */
+int generators_run(
+                const char *generator_path,
+                const char *inputs_path,
+                const char *cache_path,
+                char *const output_dirs[3],
+                unsigned n_workers,
+                GeneratorTiming **timings,
+                unsigned *n_timings);
+
+void generator_timings_free(GeneratorTiming *t, unsigned n);
@@ -28,6 +28,7 @@
 #include "systemd/sd-messages.h"
 #include "set.h"
 #include "unit.h"
+#include "mempool.h"
 #include "macro.h"
 #include "strv.h"
 #include "load-fragment.h"
@@ -52,6 +53,11 @@ JobBusClient* job_bus_client_new(DBusConnection *connection, const char *name) {
         return cl;
 }
 
+/* There are lots of jobs and job dependencies while a big transaction
+ * is processed, and they are short-lived, hence recycle them */
+DEFINE_MEMPOOL(job_pool, Job, 64);
+DEFINE_MEMPOOL(job_dependency_pool, JobDependency, 256);
+
 Job* job_new_raw(Unit *unit) {
         Job *j;
 
@@ -59,7 +65,7 @@ Job* job_new_raw(Unit *unit) {
 
         assert(unit);
 
-        j = new0(Job, 1);
+        j = mempool_alloc0_tile(&job_pool);
         if (!j)
                 return NULL;
 
@@ -117,7 +123,8 @@ void job_free(Job *j) {
                 LIST_REMOVE(JobBusClient, client, j->bus_client_list, cl);
                 free(cl);
         }
-        free(j);
+
+        mempool_free_tile(&job_pool, j);
 }
 
 void job_uninstall(Job *j) {
@@ -256,7 +263,7 @@ JobDependency* job_dependency_new(Job *subject, Job *object, bool matters, bool
          * this means the 'anchor' job (i.e. the one the user
          * explicitly asked for) is the requester. */
 
-        if (!(l = new0(JobDependency, 1)))
+        if (!(l = mempool_alloc0_tile(&job_dependency_pool)))
                 return NULL;
 
         l->subject = subject;
@@ -280,7 +287,7 @@ void job_dependency_free(JobDependency *l) {
 
         LIST_REMOVE(JobDependency, object, l->object->object_list, l);
 
-        free(l);
+        mempool_free_tile(&job_dependency_pool, l);
 }
 
 void job_dump(Job *j, FILE*f, const char *prefix) {
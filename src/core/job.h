@@ -141,6 +141,10 @@ struct Job {
         Job* marker;
         unsigned generation;
 
+        /* Used by the ordering cycle check in transaction.c */
+        unsigned order_index;
+        unsigned order_lowlink;
+
         uint32_t id;
 
         JobType type;
@@ -161,6 +165,7 @@ struct Job {
         bool sent_dbus_new_signal:1;
         bool ignore_order:1;
         bool forgot_bus_clients:1;
+        bool order_on_stack:1;
 };
 
 JobBusClient* job_bus_client_new(DBusConnection *connection, const char *name);
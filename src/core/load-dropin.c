@@ -30,9 +30,36 @@
 #include "conf-parser.h"
 #include "load-fragment.h"
 #include "conf-files.h"
+#include "load-prefetch.h"
+
+static int add_dependencies_from_prefetch(Unit *u, UnitPrefetchDir *p, UnitDependency dependency) {
+        char **e;
+        int r;
+
+        assert(u);
+        assert(p);
+
+        if (p->error < 0)
+                return p->error == -ENOENT ? 0 : p->error;
+
+        STRV_FOREACH(e, p->entries) {
+                _cleanup_free_ char *f = NULL;
+
+                f = strjoin(p->path, "/", *e, NULL);
+                if (!f)
+                        return log_oom();
+
+                r = unit_add_dependency_by_name(u, dependency, *e, f, true);
+                if (r < 0)
+                        log_error("Cannot add dependency %s to %s, ignoring: %s", *e, u->id, strerror(-r));
+        }
+
+        return 0;
+}
 
 static int iterate_dir(Unit *u, const char *path, UnitDependency dependency, char ***strv) {
         _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_unit_prefetch_dir_free_ UnitPrefetchDir *p = NULL;
         int r;
 
         assert(u);
@@ -48,6 +75,10 @@ static int iterate_dir(Unit *u, const char *path, UnitDependency dependency, cha
                 return 0;
         }
 
+        p = unit_prefetch_steal_dir(u->manager, path);
+        if (p)
+                return add_dependencies_from_prefetch(u, p, dependency);
+
         d = opendir(path);
         if (!d) {
                 if (errno == ENOENT)
@@ -178,7 +209,13 @@ int unit_load_dropin(Unit *u) {
                 }
 
                 STRV_FOREACH(f, files) {
-                        r = config_parse(*f, NULL, UNIT_VTABLE(u)->sections, config_item_perf_lookup, (void*) load_fragment_gperf_lookup, false, u);
+                        _cleanup_unit_prefetch_dropin_free_ UnitPrefetchDropin *p = NULL;
+
+                        p = unit_prefetch_steal_dropin(u->manager, *f);
+                        if (p)
+                                r = config_parse_lines(*f, p->lines, p->n_lines, UNIT_VTABLE(u)->sections, config_item_perf_lookup, (void*) load_fragment_gperf_lookup, false, u);
+                        else
+                                r = config_parse(*f, NULL, UNIT_VTABLE(u)->sections, config_item_perf_lookup, (void*) load_fragment_gperf_lookup, false, u);
                         if (r < 0)
                                 return r;
                 }
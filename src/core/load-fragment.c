@@ -49,6 +49,7 @@
 #include "path-util.h"
 #include "syscall-list.h"
 #include "env-util.h"
+#include "load-prefetch.h"
 
 #ifndef HAVE_SYSV_COMPAT
 int config_parse_warn_compat(
@@ -2378,6 +2379,40 @@ static int merge_by_names(Unit **u, Set *names, const char *id) {
         return 0;
 }
 
+static int load_from_prefetch(UnitPrefetch *p, char **filename, Set *names, char **_final) {
+        char **n;
+        int r;
+
+        assert(p);
+        assert(filename);
+        assert(names);
+
+        /* Like open_follow(), but takes what the prefetcher found */
+
+        if (p->error < 0)
+                return p->error;
+
+        STRV_FOREACH(n, p->symlink_names) {
+                char *k;
+
+                k = strdup(*n);
+                if (!k)
+                        return -ENOMEM;
+
+                r = set_put(names, k);
+                if (r < 0) {
+                        free(k);
+                        return r;
+                }
+        }
+
+        *filename = p->filename;
+        p->filename = NULL;
+        *_final = p->id ? set_get(names, p->id) : NULL;
+
+        return 0;
+}
+
 static int load_from_path(Unit *u, const char *path) {
         int r;
         Set *symlink_names;
@@ -2385,6 +2420,7 @@ static int load_from_path(Unit *u, const char *path) {
         char *filename = NULL, *id = NULL;
         Unit *merged;
         struct stat st;
+        _cleanup_unit_prefetch_free_ UnitPrefetch *prefetch = NULL;
 
         assert(u);
         assert(path);
@@ -2410,7 +2446,13 @@ static int load_from_path(Unit *u, const char *path) {
                                 goto finish;
                 }
 
-        } else  {
+        } else if ((prefetch = unit_prefetch_steal(u->manager, path))) {
+
+                r = load_from_prefetch(prefetch, &filename, symlink_names, &id);
+                if (r < 0 && r != -ENOENT)
+                        goto finish;
+
+        } else {
                 char **p;
 
                 STRV_FOREACH(p, u->manager->lookup_paths.unit_path) {
@@ -2463,7 +2505,9 @@ static int load_from_path(Unit *u, const char *path) {
                 goto finish;
         }
 
-        if (fstat(fileno(f), &st) < 0) {
+        if (prefetch)
+                st = prefetch->st;
+        else if (fstat(fileno(f), &st) < 0) {
                 r = -errno;
                 goto finish;
         }
@@ -2472,7 +2516,10 @@ static int load_from_path(Unit *u, const char *path) {
                 u->load_state = UNIT_MASKED;
         else {
                 /* Now, parse the file contents */
-                r = config_parse(filename, f, UNIT_VTABLE(u)->sections, config_item_perf_lookup, (void*) load_fragment_gperf_lookup, false, u);
+                if (prefetch)
+                        r = config_parse_lines(filename, prefetch->lines, prefetch->n_lines, UNIT_VTABLE(u)->sections, config_item_perf_lookup, (void*) load_fragment_gperf_lookup, false, u);
+                else
+                        r = config_parse(filename, f, UNIT_VTABLE(u)->sections, config_item_perf_lookup, (void*) load_fragment_gperf_lookup, false, u);
                 if (r < 0)
                         goto finish;
 
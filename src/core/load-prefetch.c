@@ -0,0 +1,684 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "load-prefetch.h"
+#include "conf-parser.h"
+#include "unit-name.h"
+#include "path-util.h"
+#include "strv.h"
+#include "util.h"
+
+/* Loading a unit consists of finding its fragment in the search path,
+ * following symlinks, reading the file, its drop-in snippets and its
+ * .wants/ and .requires/ directories, splitting the files into their
+ * section headers and assignments, and finally looking up and applying
+ * each assignment to the Unit object. Only the last step modifies
+ * manager state and hence needs to happen in the main thread, the rest
+ * is blocking file system I/O and string processing. Hence, before we
+ * dispatch a large load queue we do all of that for the queued units
+ * in a couple of worker threads, and then let the loaders pick up the
+ * split files from memory.
+ *
+ * The worker threads must not touch any Unit or Manager state, and
+ * must not use any Hashmap/Set write operations, since those use a
+ * process-wide allocation pool. Read-only lookups in the unit path
+ * cache are fine, since the main thread waits for the workers. */
+
+#define FOLLOW_MAX 8
+#define FILE_SIZE_MAX (4*1024*1024)
+
+typedef struct PrefetchJob {
+        UnitPrefetch fragment;
+        bool fragment_valid;
+
+        UnitPrefetchDir *dirs;
+        unsigned n_dirs;
+
+        /* The .d/ directories, and the snippets found in them */
+        char **dropin_dirs;
+        UnitPrefetchDropin *dropins;
+        unsigned n_dropins;
+} PrefetchJob;
+
+typedef struct PrefetchContext {
+        char **unit_path;
+        Set *unit_path_cache;
+
+        PrefetchJob *jobs;
+        unsigned n_jobs;
+        unsigned next_job;
+} PrefetchContext;
+
+static bool in_path_cache(PrefetchContext *c, const char *path) {
+        return !c->unit_path_cache || set_get(c->unit_path_cache, (char*) path);
+}
+
+static int read_fd(int fd, struct stat *st, char **data, size_t *size) {
+        _cleanup_free_ char *buf = NULL;
+        size_t n, l = 0;
+
+        if (fstat(fd, st) < 0)
+                return -errno;
+
+        if (st->st_size > FILE_SIZE_MAX)
+                return -E2BIG;
+
+        n = st->st_size > 0 ? (size_t) st->st_size : LINE_MAX;
+
+        for (;;) {
+                char *t;
+                ssize_t k;
+
+                t = realloc(buf, n+1);
+                if (!t)
+                        return -ENOMEM;
+                buf = t;
+
+                k = read(fd, buf + l, n - l);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (k == 0)
+                        break;
+
+                l += k;
+                if (l < n)
+                        continue;
+
+                n *= 2;
+                if (n > FILE_SIZE_MAX)
+                        return -E2BIG;
+        }
+
+        buf[l] = 0;
+        *data = buf;
+        *size = l;
+        buf = NULL;
+
+        return 0;
+}
+
+static int split_data(char *data, size_t size, ConfigLine **lines, unsigned *n_lines) {
+        FILE *f;
+        int r;
+
+        *lines = NULL;
+        *n_lines = 0;
+
+        if (size == 0)
+                return 0;
+
+        f = fmemopen(data, size, "r");
+        if (!f)
+                return -errno;
+
+        r = config_split(f, lines, n_lines);
+        fclose(f);
+
+        return r;
+}
+
+static int read_and_split(int fd, struct stat *st, ConfigLine **lines, unsigned *n_lines) {
+        _cleanup_free_ char *data = NULL;
+        size_t size;
+        int r;
+
+        r = read_fd(fd, st, &data, &size);
+        if (r < 0)
+                return r;
+
+        /* If the file changed under our feet, let the loader look
+         * at it again */
+        if (size == 0 && !null_or_empty(st))
+                return -EAGAIN;
+
+        return split_data(data, size, lines, n_lines);
+}
+
+/* This mirrors open_follow() in load-fragment.c */
+static int follow_and_read(char **filename, UnitPrefetch *p) {
+        _cleanup_close_ int fd = -1;
+        unsigned c = 0;
+        int r;
+
+        for (;;) {
+                char *target, *name;
+
+                if (c++ >= FOLLOW_MAX)
+                        return -ELOOP;
+
+                path_kill_slashes(*filename);
+
+                name = path_get_file_name(*filename);
+                if (unit_name_is_valid(name, true)) {
+
+                        if (!strv_contains(p->symlink_names, name)) {
+                                r = strv_extend(&p->symlink_names, name);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        free(p->id);
+                        p->id = strdup(name);
+                        if (!p->id)
+                                return -ENOMEM;
+                }
+
+                fd = open(*filename, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+                if (fd >= 0)
+                        break;
+
+                if (errno != ELOOP)
+                        return -errno;
+
+                r = readlink_and_make_absolute(*filename, &target);
+                if (r < 0)
+                        return r;
+
+                free(*filename);
+                *filename = target;
+        }
+
+        return read_and_split(fd, &p->st, &p->lines, &p->n_lines);
+}
+
+static void prefetch_fragment(PrefetchContext *c, PrefetchJob *j) {
+        UnitPrefetch *p = &j->fragment;
+        char **d;
+        int r;
+
+        STRV_FOREACH(d, c->unit_path) {
+                char *filename;
+
+                filename = path_make_absolute(p->name, *d);
+                if (!filename)
+                        return;
+
+                if (!in_path_cache(c, filename))
+                        r = -ENOENT;
+                else
+                        r = follow_and_read(&filename, p);
+
+                if (r < 0) {
+                        free(filename);
+
+                        strv_free(p->symlink_names);
+                        p->symlink_names = NULL;
+                        free(p->id);
+                        p->id = NULL;
+
+                        if (r == -ENOENT)
+                                continue;
+
+                        /* Leave it to the loader to deal with (and
+                         * log) everything else */
+                        return;
+                }
+
+                p->filename = filename;
+                p->error = 0;
+                j->fragment_valid = true;
+                return;
+        }
+
+        p->error = -ENOENT;
+        j->fragment_valid = true;
+}
+
+static void prefetch_dir(PrefetchContext *c, UnitPrefetchDir *d) {
+        _cleanup_closedir_ DIR *dir = NULL;
+
+        if (!in_path_cache(c, d->path)) {
+                d->error = -ENOENT;
+                return;
+        }
+
+        dir = opendir(d->path);
+        if (!dir) {
+                d->error = -errno;
+                return;
+        }
+
+        for (;;) {
+                struct dirent *de;
+                union dirent_storage buf;
+                int k;
+
+                k = readdir_r(dir, &buf.de, &de);
+                if (k != 0) {
+                        d->error = -k;
+                        return;
+                }
+
+                if (!de)
+                        break;
+
+                if (ignore_file(de->d_name))
+                        continue;
+
+                if (strv_extend(&d->entries, de->d_name) < 0) {
+                        d->error = -ENOMEM;
+                        return;
+                }
+        }
+
+        d->error = 0;
+}
+
+static void prefetch_dropin_dir(PrefetchContext *c, PrefetchJob *j, const char *p) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_free_ char *path = NULL;
+
+        if (!in_path_cache(c, p))
+                return;
+
+        /* Failures are left to the loader, which lists the
+         * directories itself and reads what we could not. It looks
+         * the snippets up by their canonical path, like
+         * conf_files_list_strv() returns them. */
+        path = canonicalize_file_name(p);
+        if (!path)
+                return;
+
+        dir = opendir(path);
+        if (!dir)
+                return;
+
+        for (;;) {
+                struct dirent *de;
+                union dirent_storage buf;
+                _cleanup_close_ int fd = -1;
+                UnitPrefetchDropin *t, *d;
+                struct stat st;
+
+                if (readdir_r(dir, &buf.de, &de) != 0 || !de)
+                        return;
+
+                if (!dirent_is_file_with_suffix(de, ".conf"))
+                        continue;
+
+                t = realloc(j->dropins, (j->n_dropins + 1) * sizeof(UnitPrefetchDropin));
+                if (!t)
+                        return;
+                j->dropins = t;
+
+                d = j->dropins + j->n_dropins;
+                zero(*d);
+
+                d->path = strjoin(path, "/", de->d_name, NULL);
+                if (!d->path)
+                        return;
+
+                fd = open(d->path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (fd < 0 ||
+                    read_and_split(fd, &st, &d->lines, &d->n_lines) < 0) {
+                        free(d->path);
+                        continue;
+                }
+
+                j->n_dropins++;
+        }
+}
+
+static void *prefetch_thread(void *userdata) {
+        PrefetchContext *c = userdata;
+
+        for (;;) {
+                PrefetchJob *j;
+                unsigned i, k;
+                char **d;
+
+                k = __sync_fetch_and_add(&c->next_job, 1);
+                if (k >= c->n_jobs)
+                        break;
+
+                j = c->jobs + k;
+
+                prefetch_fragment(c, j);
+
+                for (i = 0; i < j->n_dirs; i++)
+                        prefetch_dir(c, j->dirs + i);
+
+                STRV_FOREACH(d, j->dropin_dirs)
+                        prefetch_dropin_dir(c, j, *d);
+        }
+
+        return NULL;
+}
+
+static int prefetch_job_init(PrefetchJob *j, char **unit_path, const char *name) {
+        static const char suffixes[] = ".wants\0.requires\0";
+        char **p;
+
+        j->fragment.name = strdup(name);
+        if (!j->fragment.name)
+                return -ENOMEM;
+
+        j->dirs = new0(UnitPrefetchDir, strv_length(unit_path) * 2);
+        if (!j->dirs)
+                return -ENOMEM;
+
+        STRV_FOREACH(p, unit_path) {
+                const char *s;
+
+                _cleanup_free_ char *d = NULL;
+
+                NULSTR_FOREACH(s, suffixes) {
+                        j->dirs[j->n_dirs].path = strjoin(*p, "/", name, s, NULL);
+                        if (!j->dirs[j->n_dirs].path)
+                                return -ENOMEM;
+
+                        j->n_dirs++;
+                }
+
+                d = strjoin(*p, "/", name, ".d", NULL);
+                if (!d)
+                        return -ENOMEM;
+
+                if (strv_extend(&j->dropin_dirs, d) < 0)
+                        return -ENOMEM;
+        }
+
+        return 0;
+}
+
+static void prefetch_job_done(PrefetchJob *j) {
+        unsigned i;
+
+        free(j->fragment.name);
+        free(j->fragment.filename);
+        strv_free(j->fragment.symlink_names);
+        free(j->fragment.id);
+        config_lines_free(j->fragment.lines, j->fragment.n_lines);
+
+        for (i = 0; i < j->n_dirs; i++) {
+                free(j->dirs[i].path);
+                strv_free(j->dirs[i].entries);
+        }
+
+        free(j->dirs);
+
+        strv_free(j->dropin_dirs);
+
+        for (i = 0; i < j->n_dropins; i++) {
+                free(j->dropins[i].path);
+                config_lines_free(j->dropins[i].lines, j->dropins[i].n_lines);
+        }
+
+        free(j->dropins);
+}
+
+static int add_job(PrefetchContext *c, Manager *m, const char *name, unsigned *allocated) {
+
+        if (hashmap_get(m->prefetched_fragments, name))
+                return 0;
+
+        if (c->n_jobs >= *allocated) {
+                PrefetchJob *t;
+                unsigned n;
+
+                n = MAX(16U, *allocated * 2);
+                t = realloc(c->jobs, n * sizeof(PrefetchJob));
+                if (!t)
+                        return -ENOMEM;
+
+                c->jobs = t;
+                *allocated = n;
+        }
+
+        zero(c->jobs[c->n_jobs]);
+        c->n_jobs++;
+
+        return prefetch_job_init(c->jobs + c->n_jobs - 1, c->unit_path, name);
+}
+
+static void collect_results(PrefetchContext *c, Manager *m) {
+        unsigned i, k;
+
+        for (i = 0; i < c->n_jobs; i++) {
+                PrefetchJob *j = c->jobs + i;
+
+                if (j->fragment_valid) {
+                        UnitPrefetch *p;
+
+                        p = newdup(UnitPrefetch, &j->fragment, 1);
+                        if (p) {
+                                if (hashmap_put(m->prefetched_fragments, p->name, p) >= 0)
+                                        zero(j->fragment);
+                                else
+                                        free(p);
+                        }
+                }
+
+                for (k = 0; k < j->n_dirs; k++) {
+                        UnitPrefetchDir *d;
+
+                        /* Real errors will be logged by the loader */
+                        if (j->dirs[k].error < 0 && j->dirs[k].error != -ENOENT)
+                                continue;
+
+                        d = newdup(UnitPrefetchDir, j->dirs + k, 1);
+                        if (!d)
+                                continue;
+
+                        if (hashmap_put(m->prefetched_dirs, d->path, d) >= 0)
+                                zero(j->dirs[k]);
+                        else
+                                free(d);
+                }
+
+                for (k = 0; k < j->n_dropins; k++) {
+                        UnitPrefetchDropin *d;
+
+                        d = newdup(UnitPrefetchDropin, j->dropins + k, 1);
+                        if (!d)
+                                continue;
+
+                        if (hashmap_put(m->prefetched_dropins, d->path, d) >= 0)
+                                zero(j->dropins[k]);
+                        else
+                                free(d);
+                }
+        }
+}
+
+int unit_prefetch_load_queue(Manager *m) {
+        PrefetchContext c;
+        pthread_t threads[UNIT_PREFETCH_THREADS_MAX];
+        unsigned n_threads = 0, allocated = 0, i;
+        usec_t ts;
+        Unit *u;
+        long cpus;
+        int r = 0;
+
+        assert(m);
+
+        /* Reads and splits everything that the units currently in the
+         * load queue will need from disk, in parallel. This is purely an
+         * optimization, whatever we fail to prefetch is later read
+         * by the loaders themselves. */
+
+        zero(c);
+        c.unit_path = m->lookup_paths.unit_path;
+        c.unit_path_cache = m->unit_path_cache;
+
+        if (strv_isempty(c.unit_path))
+                return 0;
+
+        if (!m->prefetched_fragments) {
+                m->prefetched_fragments = hashmap_new(string_hash_func, string_compare_func);
+                if (!m->prefetched_fragments)
+                        return -ENOMEM;
+        }
+
+        if (!m->prefetched_dirs) {
+                m->prefetched_dirs = hashmap_new(string_hash_func, string_compare_func);
+                if (!m->prefetched_dirs)
+                        return -ENOMEM;
+        }
+
+        if (!m->prefetched_dropins) {
+                m->prefetched_dropins = hashmap_new(string_hash_func, string_compare_func);
+                if (!m->prefetched_dropins)
+                        return -ENOMEM;
+        }
+
+        LIST_FOREACH(load_queue, u, m->load_queue) {
+
+                if (u->load_state != UNIT_STUB || u->load_prefetched)
+                        continue;
+
+                u->load_prefetched = true;
+
+                r = add_job(&c, m, u->id, &allocated);
+                if (r < 0)
+                        goto finish;
+
+                if (u->instance) {
+                        _cleanup_free_ char *k = NULL;
+
+                        k = unit_name_template(u->id);
+                        if (!k) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+
+                        r = add_job(&c, m, k, &allocated);
+                        if (r < 0)
+                                goto finish;
+                }
+        }
+
+        if (c.n_jobs < UNIT_PREFETCH_MIN)
+                goto finish;
+
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus <= 1)
+                goto finish;
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < MIN((unsigned) cpus, (unsigned) UNIT_PREFETCH_THREADS_MAX); i++) {
+                r = pthread_create(threads + n_threads, NULL, prefetch_thread, &c);
+                if (r != 0) {
+                        log_debug("Failed to create prefetch thread: %s", strerror(r));
+                        break;
+                }
+
+                n_threads++;
+        }
+
+        /* Help out, and do everything ourselves if we couldn't get
+         * any threads */
+        prefetch_thread(&c);
+
+        for (i = 0; i < n_threads; i++)
+                pthread_join(threads[i], NULL);
+
+        collect_results(&c, m);
+
+        log_debug("Prefetched %u unit files with %u threads in %llu ms.",
+                  c.n_jobs, n_threads + 1,
+                  (unsigned long long) ((now(CLOCK_MONOTONIC) - ts) / USEC_PER_MSEC));
+        r = 0;
+
+finish:
+        for (i = 0; i < c.n_jobs; i++)
+                prefetch_job_done(c.jobs + i);
+        free(c.jobs);
+
+        return r;
+}
+
+UnitPrefetch *unit_prefetch_steal(Manager *m, const char *name) {
+        assert(m);
+        assert(name);
+
+        return hashmap_remove(m->prefetched_fragments, name);
+}
+
+UnitPrefetchDir *unit_prefetch_steal_dir(Manager *m, const char *path) {
+        assert(m);
+        assert(path);
+
+        return hashmap_remove(m->prefetched_dirs, path);
+}
+
+UnitPrefetchDropin *unit_prefetch_steal_dropin(Manager *m, const char *path) {
+        assert(m);
+        assert(path);
+
+        return hashmap_remove(m->prefetched_dropins, path);
+}
+
+void unit_prefetch_free(UnitPrefetch *p) {
+        assert(p);
+
+        free(p->name);
+        free(p->filename);
+        strv_free(p->symlink_names);
+        free(p->id);
+        config_lines_free(p->lines, p->n_lines);
+        free(p);
+}
+
+void unit_prefetch_dir_free(UnitPrefetchDir *d) {
+        assert(d);
+
+        free(d->path);
+        strv_free(d->entries);
+        free(d);
+}
+
+void unit_prefetch_dropin_free(UnitPrefetchDropin *d) {
+        assert(d);
+
+        free(d->path);
+        config_lines_free(d->lines, d->n_lines);
+        free(d);
+}
+
+void unit_prefetch_flush(Manager *m) {
+        UnitPrefetch *p;
+        UnitPrefetchDir *d;
+        UnitPrefetchDropin *i;
+
+        assert(m);
+
+        while ((p = hashmap_steal_first(m->prefetched_fragments)))
+                unit_prefetch_free(p);
+
+        while ((d = hashmap_steal_first(m->prefetched_dirs)))
+                unit_prefetch_dir_free(d);
+
+        while ((i = hashmap_steal_first(m->prefetched_dropins)))
+                unit_prefetch_dropin_free(i);
+}
@@ -0,0 +1,98 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/stat.h>
+
+typedef struct UnitPrefetch UnitPrefetch;
+typedef struct UnitPrefetchDir UnitPrefetchDir;
+typedef struct UnitPrefetchDropin UnitPrefetchDropin;
+
+#include "manager.h"
+#include "conf-parser.h"
+
+/* Don't bother with threads for fewer queued units than this */
+#define UNIT_PREFETCH_MIN 32
+#define UNIT_PREFETCH_THREADS_MAX 8
+
+/* The result of looking up a unit file name in the unit search
+ * path, following symlinks, reading the file and splitting it into
+ * its lines. This is done in worker threads, hence does not touch any
+ * Unit or Manager state. */
+struct UnitPrefetch {
+        char *name;
+
+        int error;              /* 0, or -ENOENT if nothing was found */
+        char *filename;         /* final path after following symlinks */
+        char **symlink_names;   /* valid unit names seen while following */
+        char *id;               /* the last of those, like open_follow() */
+
+        struct stat st;
+        ConfigLine *lines;
+        unsigned n_lines;
+};
+
+/* The contents of a .wants/ or .requires/ directory */
+struct UnitPrefetchDir {
+        char *path;
+
+        int error;
+        char **entries;
+};
+
+/* A drop-in snippet from a .d/ directory, split into its lines */
+struct UnitPrefetchDropin {
+        char *path;
+
+        ConfigLine *lines;
+        unsigned n_lines;
+};
+
+int unit_prefetch_load_queue(Manager *m);
+void unit_prefetch_flush(Manager *m);
+
+UnitPrefetch *unit_prefetch_steal(Manager *m, const char *name);
+UnitPrefetchDir *unit_prefetch_steal_dir(Manager *m, const char *path);
+UnitPrefetchDropin *unit_prefetch_steal_dropin(Manager *m, const char *path);
+
+void unit_prefetch_free(UnitPrefetch *p);
+void unit_prefetch_dir_free(UnitPrefetchDir *d);
+void unit_prefetch_dropin_free(UnitPrefetchDropin *d);
+
+static inline void unit_prefetch_freep(UnitPrefetch **p) {
+        if (*p)
+                unit_prefetch_free(*p);
+}
+
+static inline void unit_prefetch_dir_freep(UnitPrefetchDir **d) {
+        if (*d)
+                unit_prefetch_dir_free(*d);
+}
+
+static inline void unit_prefetch_dropin_freep(UnitPrefetchDropin **d) {
+        if (*d)
+                unit_prefetch_dropin_free(*d);
+}
+
+#define _cleanup_unit_prefetch_free_ __attribute__((cleanup(unit_prefetch_freep)))
+#define _cleanup_unit_prefetch_dir_free_ __attribute__((cleanup(unit_prefetch_dir_freep)))
+#define _cleanup_unit_prefetch_dropin_free_ __attribute__((cleanup(unit_prefetch_dropin_freep)))
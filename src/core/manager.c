@@ -48,6 +48,7 @@
 
 #include "manager.h"
 #include "transaction.h"
+#include "load-prefetch.h"
 #include "hashmap.h"
 #include "macro.h"
 #include "strv.h"
@@ -79,6 +80,14 @@
 /* As soon as 5s passed since a unit was added to our GC queue, make sure to run a gc sweep */
 #define GC_QUEUE_USEC_MAX (10*USEC_PER_SEC)
 
+/* Look at no more than this many units per event loop iteration while
+ * collecting */
+#define GC_UNITS_PER_ITERATION_MAX 512
+
+/* Process at most this many other events before rereading the mount
+ * and swap tables after they changed */
+#define TABLE_RELOAD_DEFER_MAX 64
+
 /* Where clients shall send notification messages to */
 #define NOTIFY_SOCKET "@/org/freedesktop/systemd1/notify"
 
@@ -140,6 +149,70 @@ static int manager_setup_notify(Manager *m) {
         return 0;
 }
 
+static int manager_setup_cgroups_agent(Manager *m) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_un un;
+        } sa;
+        struct epoll_event ev;
+        int one = 1, bufsize = 8*1024*1024;
+
+        assert(m);
+
+        /* The kernel spawns the release agent for every cgroup that
+         * runs empty. To keep that cheap the agent just sends the
+         * cgroup path as datagram to this socket instead of
+         * connecting to D-Bus, and we process all of them queued up
+         * in one go. Only the system instance is notified by the
+         * kernel, user instances get the notifications forwarded
+         * via the system bus. */
+
+        if (m->running_as != SYSTEMD_SYSTEM || getpid() != 1)
+                return 0;
+
+        m->cgroups_agent_watch.type = WATCH_CGROUPS_AGENT;
+        m->cgroups_agent_watch.fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+        if (m->cgroups_agent_watch.fd < 0) {
+                log_error("Failed to allocate cgroups agent socket: %m");
+                return -errno;
+        }
+
+        /* Make room for bursts of notifications, but don't care if
+         * that doesn't work */
+        if (setsockopt(m->cgroups_agent_watch.fd, SOL_SOCKET, SO_RCVBUFFORCE, &bufsize, sizeof(bufsize)) < 0)
+                setsockopt(m->cgroups_agent_watch.fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+        zero(sa);
+        sa.un.sun_family = AF_UNIX;
+        strncpy(sa.un.sun_path, SYSTEMD_CGROUP_AGENT_SOCKET, sizeof(sa.un.sun_path));
+
+        mkdir_parents_label(SYSTEMD_CGROUP_AGENT_SOCKET, 0755);
+        unlink(SYSTEMD_CGROUP_AGENT_SOCKET);
+
+        if (bind(m->cgroups_agent_watch.fd, &sa.sa, offsetof(struct sockaddr_un, sun_path) + strlen(sa.un.sun_path)) < 0) {
+                log_error("bind() of cgroups agent socket failed: %m");
+                return -errno;
+        }
+
+        if (setsockopt(m->cgroups_agent_watch.fd, SOL_SOCKET, SO_PASSCRED, &one, sizeof(one)) < 0) {
+                log_error("SO_PASSCRED failed: %m");
+                return -errno;
+        }
+
+        zero(ev);
+        ev.events = EPOLLIN;
+        ev.data.ptr = &m->cgroups_agent_watch;
+
+        if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->cgroups_agent_watch.fd, &ev) < 0) {
+                log_error("Failed to add cgroups agent socket fd to epoll: %m");
+                return -errno;
+        }
+
+        log_debug("Using cgroups agent socket " SYSTEMD_CGROUP_AGENT_SOCKET);
+
+        return 0;
+}
+
 static int manager_setup_time_change(Manager *m) {
         struct epoll_event ev;
         struct itimerspec its;
@@ -320,10 +393,12 @@ int manager_new(SystemdRunningAs running_as, Manager **_m) {
         m->idle_pipe[0] = m->idle_pipe[1] = -1;
 
         watch_init(&m->signal_watch);
+        watch_init(&m->cgroups_agent_watch);
         watch_init(&m->mount_watch);
         watch_init(&m->swap_watch);
         watch_init(&m->udev_watch);
         watch_init(&m->time_change_watch);
+        watch_init(&m->dbus_deferred_watch);
 
         m->epoll_fd = m->dev_autofs_fd = -1;
         m->current_job_id = 1; /* start as id #1, so that we can leave #0 around as "null-like" value */
@@ -371,6 +446,10 @@ int manager_new(SystemdRunningAs running_as, Manager **_m) {
         if (r < 0)
                 goto fail;
 
+        r = manager_setup_cgroups_agent(m);
+        if (r < 0)
+                log_warning("Failed to set up cgroups agent socket, relying on D-Bus: %s", strerror(-r));
+
         r = manager_setup_time_change(m);
         if (r < 0)
                 goto fail;
@@ -414,7 +493,7 @@ enum {
         _GC_OFFSET_MAX
 };
 
-static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
+static void unit_gc_sweep(Unit *u, unsigned gc_marker, unsigned *n_scanned) {
         Iterator i;
         Unit *other;
         bool is_bad;
@@ -426,6 +505,8 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
             u->gc_marker == gc_marker + GC_OFFSET_IN_PATH)
                 return;
 
+        (*n_scanned)++;
+
         if (u->in_cleanup_queue)
                 goto bad;
 
@@ -437,7 +518,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
         is_bad = true;
 
         SET_FOREACH(other, u->dependencies[UNIT_REFERENCED_BY], i) {
-                unit_gc_sweep(other, gc_marker);
+                unit_gc_sweep(other, gc_marker, n_scanned);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
                         goto good;
@@ -468,45 +549,98 @@ good:
 
 static unsigned manager_dispatch_gc_queue(Manager *m) {
         Unit *u;
-        unsigned n = 0;
+        unsigned n = 0, n_scanned = 0;
         unsigned gc_marker;
+        usec_t ts;
 
         assert(m);
 
-        if ((m->n_in_gc_queue < GC_QUEUE_ENTRIES_MAX) &&
-            (m->gc_queue_timestamp <= 0 ||
-             (m->gc_queue_timestamp + GC_QUEUE_USEC_MAX) > now(CLOCK_MONOTONIC)))
-                return 0;
+        if (!m->gc_pass_running) {
+                if ((m->n_in_gc_queue < GC_QUEUE_ENTRIES_MAX) &&
+                    (m->gc_queue_timestamp <= 0 ||
+                     (m->gc_queue_timestamp + GC_QUEUE_USEC_MAX) > now(CLOCK_MONOTONIC)))
+                        return 0;
 
-        log_debug("Running GC...");
+                log_debug("Running GC...");
 
-        m->gc_marker += _GC_OFFSET_MAX;
-        if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
-                m->gc_marker = 1;
+                m->gc_pass_running = true;
+                m->gc_pass_usec = 0;
+                m->gc_pass_interrupted = true;
+        }
+
+        /* Only look at so many units per iteration of the event loop,
+         * so that collecting a lot of units at once does not stall
+         * event processing. If no events were dispatched since the
+         * last iteration the markers are still valid, and we simply
+         * pick up where we left off. Otherwise any unit might have
+         * gained a job or a reference meanwhile, hence we start over
+         * with a fresh marker for whatever is still queued, so that
+         * no verdict from before the events survives. Units found
+         * bad are freed before we return to the event loop, so that
+         * nothing can get a hold of them in between. */
+
+        if (m->gc_pass_interrupted) {
+                m->gc_marker += _GC_OFFSET_MAX;
+                if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
+                        m->gc_marker = 1;
+
+                m->gc_pass_interrupted = false;
+        }
 
+        ts = now(CLOCK_MONOTONIC);
         gc_marker = m->gc_marker;
 
-        while ((u = m->gc_queue)) {
+        while ((u = m->gc_queue) && n_scanned < GC_UNITS_PER_ITERATION_MAX) {
                 assert(u->in_gc_queue);
 
-                unit_gc_sweep(u, gc_marker);
+                m->gc_sweeping = true;
+                unit_gc_sweep(u, gc_marker, &n_scanned);
+                m->gc_sweeping = false;
 
                 LIST_REMOVE(Unit, gc_queue, m->gc_queue, u);
                 u->in_gc_queue = false;
+                m->n_in_gc_queue--;
 
                 n++;
 
                 if (u->gc_marker == gc_marker + GC_OFFSET_BAD ||
                     u->gc_marker == gc_marker + GC_OFFSET_UNSURE) {
+
+                        /* The verdict might be from before events
+                         * were processed, so make sure the unit did
+                         * not get a job or reference meanwhile */
+                        if (!u->in_cleanup_queue && unit_check_gc(u)) {
+                                u->gc_marker = gc_marker + GC_OFFSET_GOOD;
+                                continue;
+                        }
+
                         log_debug_unit(u->id, "Collecting %s", u->id);
                         u->gc_marker = gc_marker + GC_OFFSET_BAD;
                         unit_add_to_cleanup_queue(u);
+                        m->n_gc_collected++;
                 }
         }
 
+        m->n_gc_scanned += n_scanned;
+        m->gc_pass_usec += now(CLOCK_MONOTONIC) - ts;
+
+        if (m->gc_queue) {
+                manager_dispatch_cleanup_queue(m);
+                return n;
+        }
+
+        m->gc_pass_running = false;
+        m->gc_pass_interrupted = false;
         m->n_in_gc_queue = 0;
         m->gc_queue_timestamp = 0;
 
+        m->n_gc_passes++;
+        m->gc_last_pass_usec = m->gc_pass_usec;
+        if (m->gc_pass_usec > m->gc_max_pass_usec)
+                m->gc_max_pass_usec = m->gc_pass_usec;
+
+        log_debug("GC pass finished, took %llu us.", (unsigned long long) m->gc_pass_usec);
+
         return n;
 }
 
@@ -548,6 +682,7 @@ void manager_free(Manager *m) {
         manager_shutdown_cgroup(m, m->exit_code != MANAGER_REEXECUTE);
 
         manager_undo_generators(m);
+        generator_timings_free(m->generator_timings, m->n_generator_timings);
 
         bus_done(m);
 
@@ -562,8 +697,12 @@ void manager_free(Manager *m) {
                 close_nointr_nofail(m->signal_watch.fd);
         if (m->notify_watch.fd >= 0)
                 close_nointr_nofail(m->notify_watch.fd);
+        if (m->cgroups_agent_watch.fd >= 0)
+                close_nointr_nofail(m->cgroups_agent_watch.fd);
         if (m->time_change_watch.fd >= 0)
                 close_nointr_nofail(m->time_change_watch.fd);
+        if (m->dbus_deferred_watch.fd >= 0)
+                close_nointr_nofail(m->dbus_deferred_watch.fd);
 
         free(m->notify_socket);
 
@@ -575,6 +714,11 @@ void manager_free(Manager *m) {
         hashmap_free(m->cgroup_bondings);
         set_free_free(m->unit_path_cache);
 
+        unit_prefetch_flush(m);
+        hashmap_free(m->prefetched_fragments);
+        hashmap_free(m->prefetched_dirs);
+        hashmap_free(m->prefetched_dropins);
+
         close_pipe(m->idle_pipe);
 
         free(m->switch_root);
@@ -802,6 +946,89 @@ tr_abort:
         return r;
 }
 
+static bool start_job_needs_transaction(Unit *unit) {
+        static const UnitDependency requirements[] = {
+                UNIT_REQUIRES,
+                UNIT_REQUIRES_OVERRIDABLE,
+                UNIT_REQUISITE,
+                UNIT_REQUISITE_OVERRIDABLE,
+                UNIT_BINDS_TO,
+                UNIT_WANTS
+        };
+        static const UnitDependency conflicts[] = {
+                UNIT_CONFLICTS,
+                UNIT_CONFLICTED_BY
+        };
+        Iterator i;
+        unsigned k;
+        Unit *other;
+
+        if (unit->load_state != UNIT_LOADED || unit->job || unit->nop_job)
+                return true;
+
+        /* If everything this unit pulls in is already up and nothing
+         * it conflicts with is, a transaction would boil down to the
+         * start job for the unit itself */
+
+        for (k = 0; k < ELEMENTSOF(requirements); k++)
+                SET_FOREACH(other, unit->dependencies[requirements[k]], i)
+                        if (other->job ||
+                            !UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(other)))
+                                return true;
+
+        for (k = 0; k < ELEMENTSOF(conflicts); k++)
+                SET_FOREACH(other, unit->dependencies[conflicts[k]], i)
+                        if (other->job ||
+                            !UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(other)))
+                                return true;
+
+        return false;
+}
+
+int manager_add_start_job_fast(Manager *m, Unit *unit, DBusError *e, Job **_ret) {
+        Job *j;
+        int r;
+
+        assert(m);
+        assert(unit);
+
+        /* Enqueues a start job like manager_add_job() in replace
+         * mode, but skips building a transaction if the unit has all
+         * its requirements fulfilled already. This is used for the
+         * per-connection instances of Accept=yes sockets, which are
+         * freshly created and hence never have a job installed. */
+
+        if (start_job_needs_transaction(unit))
+                return manager_add_job(m, JOB_START, unit, JOB_REPLACE, true, e, _ret);
+
+        j = job_new(unit, JOB_START);
+        if (!j)
+                return -ENOMEM;
+
+        j->override = true;
+
+        r = hashmap_put(m->jobs, UINT32_TO_PTR(j->id), j);
+        if (r < 0) {
+                job_free(j);
+                return r;
+        }
+
+        assert_se(job_install(j) == j);
+
+        job_add_to_run_queue(j);
+        job_add_to_dbus_queue(j);
+        job_start_timer(j);
+
+        log_debug_unit(unit->id,
+                       "Enqueued job %s/%s as %u without transaction", unit->id,
+                       job_type_to_string(JOB_START), (unsigned) j->id);
+
+        if (_ret)
+                *_ret = j;
+
+        return 0;
+}
+
 int manager_add_job_by_name(Manager *m, JobType type, const char *name, JobMode mode, bool override, DBusError *e, Job **_ret) {
         Unit *unit;
         int r;
@@ -849,10 +1076,20 @@ unsigned manager_dispatch_load_queue(Manager *m) {
         while ((u = m->load_queue)) {
                 assert(u->in_load_queue);
 
+                /* Loading units tends to pull in more units, hence
+                 * whenever we encounter one we haven't read from
+                 * disk yet, read everything queued so far in one
+                 * go. */
+                if (!u->load_prefetched)
+                        unit_prefetch_load_queue(m);
+
                 unit_load(u);
                 n++;
         }
 
+        /* Don't keep stale file contents around */
+        unit_prefetch_flush(m);
+
         m->dispatching_load_queue = false;
         return n;
 }
@@ -991,10 +1228,98 @@ unsigned manager_dispatch_run_queue(Manager *m) {
         return n;
 }
 
+static int manager_arm_dbus_deferred(Manager *m, usec_t until) {
+        struct itimerspec its;
+
+        assert(m);
+
+        if (m->dbus_deferred_until > 0 && m->dbus_deferred_until <= until)
+                return 0;
+
+        if (m->dbus_deferred_watch.type == WATCH_INVALID) {
+                struct epoll_event ev;
+
+                m->dbus_deferred_watch.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+                if (m->dbus_deferred_watch.fd < 0)
+                        return -errno;
+
+                zero(ev);
+                ev.events = EPOLLIN;
+                ev.data.ptr = &m->dbus_deferred_watch;
+
+                if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->dbus_deferred_watch.fd, &ev) < 0) {
+                        close_nointr_nofail(m->dbus_deferred_watch.fd);
+                        watch_init(&m->dbus_deferred_watch);
+                        return -errno;
+                }
+
+                m->dbus_deferred_watch.type = WATCH_DBUS_DEFERRED;
+        }
+
+        zero(its);
+        timespec_store(&its.it_value, until);
+
+        if (timerfd_settime(m->dbus_deferred_watch.fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+                return -errno;
+
+        m->dbus_deferred_until = until;
+        return 0;
+}
+
+static bool manager_defer_dbus_signal(Manager *m, Unit *u, usec_t *ts) {
+        usec_t until;
+
+        assert(m);
+        assert(u);
+        assert(ts);
+
+        /* Only changes are coalesced, announcing new units is never
+         * delayed */
+        if (m->dbus_signal_interval <= 0 ||
+            !u->sent_dbus_new_signal ||
+            u->dbus_signal_timestamp <= 0)
+                return false;
+
+        if (*ts <= 0)
+                *ts = now(CLOCK_MONOTONIC);
+
+        until = u->dbus_signal_timestamp + m->dbus_signal_interval;
+        if (until <= *ts)
+                return false;
+
+        if (manager_arm_dbus_deferred(m, until) < 0)
+                return false;
+
+        LIST_REMOVE(Unit, dbus_queue, m->dbus_unit_queue, u);
+        LIST_PREPEND(Unit, dbus_queue, m->dbus_unit_deferred, u);
+        u->in_dbus_deferred = true;
+
+        return true;
+}
+
+static void manager_dispatch_dbus_deferred(Manager *m) {
+        Unit *u;
+
+        assert(m);
+
+        /* Move everything back to the D-Bus queue. Whatever is still
+         * too recent will be deferred again, with a new timer. */
+        m->dbus_deferred_until = 0;
+
+        while ((u = m->dbus_unit_deferred)) {
+                assert(u->in_dbus_deferred);
+
+                LIST_REMOVE(Unit, dbus_queue, m->dbus_unit_deferred, u);
+                LIST_PREPEND(Unit, dbus_queue, m->dbus_unit_queue, u);
+                u->in_dbus_deferred = false;
+        }
+}
+
 unsigned manager_dispatch_dbus_queue(Manager *m) {
         Job *j;
         Unit *u;
         unsigned n = 0;
+        usec_t ts = 0;
 
         assert(m);
 
@@ -1006,6 +1331,9 @@ unsigned manager_dispatch_dbus_queue(Manager *m) {
         while ((u = m->dbus_unit_queue)) {
                 assert(u->in_dbus_queue);
 
+                if (manager_defer_dbus_signal(m, u, &ts))
+                        continue;
+
                 bus_unit_send_change_signal(u);
                 n++;
         }
@@ -1096,12 +1424,116 @@ static int manager_process_notify_fd(Manager *m) {
         return 0;
 }
 
+static int manager_process_cgroups_agent_fd(Manager *m) {
+        Set *released;
+        char *cgroup;
+        int r = 0;
+
+        assert(m);
+
+        /* When lots of services stop at the same time we might get
+         * a lot of notifications, often for the same cgroup or its
+         * parents. Collect all queued ones first, so that each
+         * cgroup is checked only once. */
+
+        released = set_new(string_hash_func, string_compare_func);
+        if (!released)
+                return -ENOMEM;
+
+        for (;;) {
+                char buf[PATH_MAX+1];
+                ssize_t n;
+                struct msghdr msghdr;
+                struct iovec iovec;
+                struct ucred *ucred;
+                union {
+                        struct cmsghdr cmsghdr;
+                        uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
+                } control;
+
+                zero(iovec);
+                iovec.iov_base = buf;
+                iovec.iov_len = sizeof(buf)-1;
+
+                zero(control);
+                zero(msghdr);
+                msghdr.msg_iov = &iovec;
+                msghdr.msg_iovlen = 1;
+                msghdr.msg_control = &control;
+                msghdr.msg_controllen = sizeof(control);
+
+                n = recvmsg(m->cgroups_agent_watch.fd, &msghdr, MSG_DONTWAIT);
+                if (n < 0) {
+                        if (errno == EAGAIN || errno == EINTR)
+                                break;
+
+                        r = -errno;
+                        goto finish;
+                }
+
+                if (msghdr.msg_controllen < CMSG_LEN(sizeof(struct ucred)) ||
+                    control.cmsghdr.cmsg_level != SOL_SOCKET ||
+                    control.cmsghdr.cmsg_type != SCM_CREDENTIALS ||
+                    control.cmsghdr.cmsg_len != CMSG_LEN(sizeof(struct ucred))) {
+                        log_warning("Received cgroups agent message without credentials. Ignoring.");
+                        continue;
+                }
+
+                ucred = (struct ucred*) CMSG_DATA(&control.cmsghdr);
+                if (ucred->uid != 0) {
+                        log_warning("Received cgroups agent message from unprivileged process %lu. Ignoring.", (unsigned long) ucred->pid);
+                        continue;
+                }
+
+                if (n == 0 || (msghdr.msg_flags & MSG_TRUNC)) {
+                        log_warning("Received invalid cgroups agent message. Ignoring.");
+                        continue;
+                }
+
+                buf[n] = 0;
+                if (set_get(released, buf))
+                        continue;
+
+                cgroup = strdup(buf);
+                if (!cgroup) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                r = set_put(released, cgroup);
+                if (r < 0) {
+                        free(cgroup);
+                        goto finish;
+                }
+        }
+
+        r = 0;
+
+finish:
+        while ((cgroup = set_steal_first(released))) {
+                log_debug("Got cgroup release notification for %s", cgroup);
+
+                cgroup_notify_empty(m, cgroup);
+                bus_forward_agent_released(m, cgroup);
+                free(cgroup);
+        }
+
+        set_free(released);
+        return r;
+}
+
 static int manager_dispatch_sigchld(Manager *m) {
+        bool debug;
+
         assert(m);
 
+        debug = log_get_max_level() >= LOG_DEBUG;
+
+        /* Reaps all children that are dead now in one go */
+
         for (;;) {
                 siginfo_t si;
-                Unit *u;
+                Unit *u, *owner = NULL;
                 int r;
 
                 zero(si);
@@ -1123,7 +1555,8 @@ static int manager_dispatch_sigchld(Manager *m) {
                 if (si.si_pid <= 0)
                         break;
 
-                if (si.si_code == CLD_EXITED || si.si_code == CLD_KILLED || si.si_code == CLD_DUMPED) {
+                if (debug &&
+                    (si.si_code == CLD_EXITED || si.si_code == CLD_KILLED || si.si_code == CLD_DUMPED)) {
                         char _cleanup_free_ *name = NULL;
 
                         get_process_comm(si.si_pid, &name);
@@ -1138,10 +1571,16 @@ static int manager_dispatch_sigchld(Manager *m) {
                 if (r < 0)
                         return r;
 
-                /* And now figure out the unit this belongs to */
+                /* And now figure out the unit this belongs to. All
+                 * main and control processes of our units are in
+                 * watch_pids. Everything else is some reparented
+                 * process of a unit, which the units ignore anyway,
+                 * hence only bother with looking up its cgroup in
+                 * /proc if we are going to log about it. That unit is
+                 * only ever logged, never dispatched to. */
                 u = hashmap_get(m->watch_pids, LONG_TO_PTR(si.si_pid));
-                if (!u)
-                        u = cgroup_unit_by_pid(m, si.si_pid);
+                if (!u && debug)
+                        owner = cgroup_unit_by_pid(m, si.si_pid);
 
                 /* And now, we actually reap the zombie. */
                 if (waitid(P_PID, si.si_pid, &si, WEXITED) < 0) {
@@ -1162,8 +1601,12 @@ static int manager_dispatch_sigchld(Manager *m) {
                                 ? exit_status_to_string(si.si_status, EXIT_STATUS_FULL)
                                 : signal_to_string(si.si_status)));
 
-                if (!u)
+                if (!u) {
+                        if (owner)
+                                log_debug_unit(owner->id,
+                                               "Child %lu belongs to %s", (long unsigned) si.si_pid, owner->id);
                         continue;
+                }
 
                 log_debug_unit(u->id,
                                "Child %lu belongs to %s", (long unsigned) si.si_pid, u->id);
@@ -1429,6 +1872,11 @@ static int process_event(Manager *m, struct epoll_event *ev) {
         if (w->type == WATCH_INVALID)
                 return 0;
 
+        /* Whatever we dispatch might invalidate what a GC pass in
+         * progress concluded so far */
+        if (m->gc_pass_running)
+                m->gc_pass_interrupted = true;
+
         switch (w->type) {
 
         case WATCH_SIGNAL:
@@ -1453,6 +1901,18 @@ static int process_event(Manager *m, struct epoll_event *ev) {
 
                 break;
 
+        case WATCH_CGROUPS_AGENT:
+
+                /* Some cgroups ran empty */
+                if (ev->events != EPOLLIN)
+                        return -EINVAL;
+
+                r = manager_process_cgroups_agent_fd(m);
+                if (r < 0)
+                        return r;
+
+                break;
+
         case WATCH_FD:
 
                 /* Some fd event, to be dispatched to the units */
@@ -1527,6 +1987,24 @@ static int process_event(Manager *m, struct epoll_event *ev) {
                 break;
         }
 
+        case WATCH_DBUS_DEFERRED: {
+                uint64_t v;
+                ssize_t k;
+
+                k = read(w->fd, &v, sizeof(v));
+                if (k != sizeof(v)) {
+
+                        if (k < 0 && (errno == EINTR || errno == EAGAIN))
+                                break;
+
+                        log_error("Failed to read timer event counter: %s", k < 0 ? strerror(-k) : "Short read");
+                        return k < 0 ? -errno : -EIO;
+                }
+
+                manager_dispatch_dbus_deferred(m);
+                break;
+        }
+
         default:
                 log_error("event type=%i", w->type);
                 assert_not_reached("Unknown epoll event type.");
@@ -1535,6 +2013,15 @@ static int process_event(Manager *m, struct epoll_event *ev) {
         return 0;
 }
 
+static void manager_dispatch_table_reload(Manager *m) {
+        assert(m);
+
+        m->n_table_reloads_deferred = 0;
+
+        mount_dispatch_reload(m);
+        swap_dispatch_reload(m);
+}
+
 int manager_loop(Manager *m) {
         int r;
 
@@ -1559,6 +2046,7 @@ int manager_loop(Manager *m) {
                 struct epoll_event event;
                 int n;
                 int wait_msec = -1;
+                bool table_reload;
 
                 if (m->runtime_watchdog > 0 && m->running_as == SYSTEMD_SYSTEM)
                         watchdog_ping();
@@ -1582,14 +2070,24 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_cleanup_queue(m) > 0)
                         continue;
 
-                if (manager_dispatch_gc_queue(m) > 0)
+                /* If the GC pass is not complete yet, let's process
+                 * pending events before continuing with it */
+                if (manager_dispatch_gc_queue(m) > 0 && !m->gc_pass_running)
                         continue;
 
                 if (manager_dispatch_dbus_queue(m) > 0)
                         continue;
 
-                if (swap_dispatch_reload(m) > 0)
+                /* Rereading the mount and swap tables is not cheap,
+                 * and their changes tend to come in bursts, for
+                 * example when a lot of devices show up at boot.
+                 * Hence, let's first handle whatever else is pending
+                 * already, but don't let that delay us forever. */
+                table_reload = m->request_mount_reload || m->request_reload;
+                if (table_reload && m->n_table_reloads_deferred >= TABLE_RELOAD_DEFER_MAX) {
+                        manager_dispatch_table_reload(m);
                         continue;
+                }
 
                 /* Sleep for half the watchdog time */
                 if (m->runtime_watchdog > 0 && m->running_as == SYSTEMD_SYSTEM) {
@@ -1599,6 +2097,9 @@ int manager_loop(Manager *m) {
                 } else
                         wait_msec = -1;
 
+                if (m->gc_pass_running || table_reload)
+                        wait_msec = 0;
+
                 n = epoll_wait(m->epoll_fd, &event, 1, wait_msec);
                 if (n < 0) {
 
@@ -1606,11 +2107,20 @@ int manager_loop(Manager *m) {
                                 continue;
 
                         return -errno;
-                } else if (n == 0)
+                } else if (n == 0) {
+
+                        /* Nothing else pending */
+                        if (table_reload)
+                                manager_dispatch_table_reload(m);
+
                         continue;
+                }
 
                 assert(n == 1);
 
+                if (table_reload)
+                        m->n_table_reloads_deferred++;
+
                 r = process_event(m, &event);
                 if (r < 0)
                         return r;
@@ -2334,17 +2844,18 @@ static void trim_generator_dir(Manager *m, char **generator) {
 }
 
 void manager_run_generators(Manager *m) {
-        DIR *d = NULL;
         const char *generator_path;
-        const char *argv[5];
+        char *output_dirs[3];
+        GeneratorTiming *timings = NULL;
+        unsigned n_timings = 0;
+        long ncpus;
         mode_t u;
         int r;
 
         assert(m);
 
         generator_path = m->running_as == SYSTEMD_SYSTEM ? SYSTEM_GENERATOR_PATH : USER_GENERATOR_PATH;
-        d = opendir(generator_path);
-        if (!d) {
+        if (access(generator_path, F_OK) < 0) {
                 if (errno == ENOENT)
                         return;
 
@@ -2355,33 +2866,44 @@ void manager_run_generators(Manager *m) {
 
         r = create_generator_dir(m, &m->generator_unit_path, "generator");
         if (r < 0)
-                goto finish;
+                return;
 
         r = create_generator_dir(m, &m->generator_unit_path_early, "generator.early");
         if (r < 0)
-                goto finish;
+                return;
 
         r = create_generator_dir(m, &m->generator_unit_path_late, "generator.late");
         if (r < 0)
-                goto finish;
+                return;
+
+        output_dirs[0] = m->generator_unit_path;
+        output_dirs[1] = m->generator_unit_path_early;
+        output_dirs[2] = m->generator_unit_path_late;
 
-        argv[0] = NULL; /* Leave this empty, execute_directory() will fill something in */
-        argv[1] = m->generator_unit_path;
-        argv[2] = m->generator_unit_path_early;
-        argv[3] = m->generator_unit_path_late;
-        argv[4] = NULL;
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 
+        /* Generator output is only cached for the system instance,
+         * in /run, hence this speeds up reloads, not boot. */
         u = umask(0022);
-        execute_directory(generator_path, d, (char**) argv);
+        r = generators_run(generator_path,
+                           m->running_as == SYSTEMD_SYSTEM ? SYSTEM_GENERATOR_INPUTS_PATH : NULL,
+                           m->running_as == SYSTEMD_SYSTEM ? "/run/systemd/generator.cache" : NULL,
+                           output_dirs,
+                           CLAMP(ncpus > 0 ? (unsigned) ncpus : 1U, 2U, GENERATOR_WORKERS_MAX),
+                           &timings, &n_timings);
         umask(u);
 
+        if (r < 0)
+                log_error("Failed to run generators: %s", strerror(-r));
+        else {
+                generator_timings_free(m->generator_timings, m->n_generator_timings);
+                m->generator_timings = timings;
+                m->n_generator_timings = n_timings;
+        }
+
         trim_generator_dir(m, &m->generator_unit_path);
         trim_generator_dir(m, &m->generator_unit_path_early);
         trim_generator_dir(m, &m->generator_unit_path_late);
-
-finish:
-        if (d)
-                closedir(d);
 }
 
 static void remove_generator_dir(Manager *m, char **generator) {
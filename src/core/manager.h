@@ -61,7 +61,9 @@ enum WatchType {
         WATCH_UDEV,
         WATCH_DBUS_WATCH,
         WATCH_DBUS_TIMEOUT,
-        WATCH_TIME_CHANGE
+        WATCH_TIME_CHANGE,
+        WATCH_DBUS_DEFERRED,
+        WATCH_CGROUPS_AGENT
 };
 
 struct Watch {
@@ -84,6 +86,8 @@ struct Watch {
 #include "set.h"
 #include "dbus.h"
 #include "path-lookup.h"
+#include "mountinfo.h"
+#include "generator.h"
 
 struct Manager {
         /* Note that the set of units we know of is allowed to be
@@ -114,6 +118,14 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* Units whose change signal is held back, since the previous
+         * one was sent less than dbus_signal_interval ago. The timer
+         * moves them back to the queue above. */
+        LIST_HEAD(Unit, dbus_unit_deferred);
+        Watch dbus_deferred_watch;
+        usec_t dbus_deferred_until;
+        usec_t dbus_signal_interval;
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -126,6 +138,7 @@ struct Manager {
 
         Watch notify_watch;
         Watch signal_watch;
+        Watch cgroups_agent_watch;
         Watch time_change_watch;
 
         int epoll_fd;
@@ -135,6 +148,11 @@ struct Manager {
         LookupPaths lookup_paths;
         Set *unit_path_cache;
 
+        /* Unit files read ahead of loading, see load-prefetch.c */
+        Hashmap *prefetched_fragments;
+        Hashmap *prefetched_dirs;
+        Hashmap *prefetched_dropins;
+
         char **environment;
         char **default_controllers;
 
@@ -157,17 +175,28 @@ struct Manager {
         struct udev_monitor* udev_monitor;
         Watch udev_watch;
         Hashmap *devices_by_sysfs;
+        LIST_HEAD(struct DeviceGroup, device_plug_queue);
 
         /* Data specific to the mount subsystem */
         FILE *proc_self_mountinfo;
         Watch mount_watch;
+        MountInfoTable mountinfo;
+        bool request_mount_reload;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
         Hashmap *swaps_by_proc_swaps;
+        Hashmap *proc_swaps_entries; /* device => last seen /proc/swaps entry */
+        unsigned proc_swaps_generation;
+        char *proc_swaps_buffer;
+        size_t proc_swaps_allocated;
         bool request_reload;
         Watch swap_watch;
 
+        /* Events handled while rereading the mount and swap tables
+         * was pending */
+        unsigned n_table_reloads_deferred;
+
         /* Data specific to the D-Bus subsystem */
         DBusConnection *api_bus, *system_bus;
         DBusServer *private_bus;
@@ -198,6 +227,24 @@ struct Manager {
         int gc_marker;
         unsigned n_in_gc_queue;
 
+        /* A GC pass is spread over multiple iterations of the event
+         * loop if the queue is long. The markers of the pass stay
+         * valid until it is finished, unless events are dispatched
+         * in between. */
+        bool gc_pass_running:1;
+        bool gc_pass_interrupted:1;
+        bool gc_sweeping:1;
+        usec_t gc_pass_usec;
+
+        /* GC statistics */
+        unsigned n_gc_passes;
+        uint64_t n_gc_scanned, n_gc_collected;
+        usec_t gc_last_pass_usec, gc_max_pass_usec;
+
+        /* How long each generator took on the last run */
+        GeneratorTiming *generator_timings;
+        unsigned n_generator_timings;
+
         /* Make sure the user cannot accidentally unmount our cgroup
          * file system */
         int pin_cgroupfs_fd;
@@ -250,6 +297,7 @@ int manager_load_unit_from_dbus_path(Manager *m, const char *s, DBusError *e, Un
 
 int manager_add_job(Manager *m, JobType type, Unit *unit, JobMode mode, bool force, DBusError *e, Job **_ret);
 int manager_add_job_by_name(Manager *m, JobType type, const char *name, JobMode mode, bool force, DBusError *e, Job **_ret);
+int manager_add_start_job_fast(Manager *m, Unit *unit, DBusError *e, Job **_ret);
 
 void manager_dump_units(Manager *s, FILE *f, const char *prefix);
 void manager_dump_jobs(Manager *s, FILE *f, const char *prefix);
@@ -1436,7 +1436,8 @@ static int mount_add_one(
                 const char *options,
                 const char *fstype,
                 int passno,
-                bool set_flags) {
+                bool set_flags,
+                Unit **ret) {
         int r;
         Unit *u;
         bool delete;
@@ -1449,6 +1450,9 @@ static int mount_add_one(
         assert(where);
         assert(options);
         assert(fstype);
+        assert(ret);
+
+        *ret = NULL;
 
         /* Ignore API mount points. They should never be referenced in
          * dependencies ever. */
@@ -1526,7 +1530,6 @@ static int mount_add_one(
 
         p = &MOUNT(u)->parameters_proc_self_mountinfo;
         if (set_flags) {
-                MOUNT(u)->is_mounted = true;
                 MOUNT(u)->just_mounted = !MOUNT(u)->from_proc_self_mountinfo;
                 MOUNT(u)->just_changed = !streq_ptr(p->options, o);
         }
@@ -1552,7 +1555,8 @@ static int mount_add_one(
 
         unit_add_to_dbus_queue(u);
 
-        return 0;
+        *ret = u;
+        return 1;
 
 fail:
         free(w);
@@ -1565,88 +1569,127 @@ fail:
         return r;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
-        int r = 0;
-        unsigned i;
-        char *device, *path, *options, *options2, *fstype, *d, *p, *o;
+typedef struct MountInfoDiff {
+        Manager *manager;
+        bool set_flags;
+        Set *changed;
+} MountInfoDiff;
 
-        assert(m);
+static int mount_process_mountinfo(MountInfo *mi, MountInfoChange change, void *userdata) {
+        MountInfoDiff *d = userdata;
+        Unit *u;
+        int r;
 
-        rewind(m->proc_self_mountinfo);
-
-        for (i = 1;; i++) {
-                int k;
-
-                device = path = options = options2 = fstype = d = p = o = NULL;
-
-                if ((k = fscanf(m->proc_self_mountinfo,
-                                "%*s "       /* (1) mount id */
-                                "%*s "       /* (2) parent id */
-                                "%*s "       /* (3) major:minor */
-                                "%*s "       /* (4) root */
-                                "%ms "       /* (5) mount point */
-                                "%ms"        /* (6) mount options */
-                                "%*[^-]"     /* (7) optional fields */
-                                "- "         /* (8) separator */
-                                "%ms "       /* (9) file system type */
-                                "%ms"        /* (10) mount source */
-                                "%ms"        /* (11) mount options 2 */
-                                "%*[^\n]",   /* some rubbish at the end */
-                                &path,
-                                &options,
-                                &fstype,
-                                &device,
-                                &options2)) != 5) {
-
-                        if (k == EOF)
-                                break;
+        assert(mi);
+        assert(d);
 
-                        log_warning("Failed to parse /proc/self/mountinfo:%u.", i);
-                        goto clean_up;
-                }
+        if (change == MOUNTINFO_ADDED) {
+                _cleanup_free_ char *o = NULL;
 
-                o = strjoin(options, ",", options2, NULL);
-                if (!o) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+                o = strjoin(mi->options, ",", mi->super_options, NULL);
+                if (!o)
+                        return -ENOMEM;
 
-                if (!(d = cunescape(device)) ||
-                    !(p = cunescape(path))) {
-                        r = -ENOMEM;
-                        goto finish;
+                r = mount_add_one(d->manager, mi->what, mi->where, o, mi->fstype, 0, d->set_flags, &u);
+                if (r <= 0)
+                        return r;
+
+                MOUNT(u)->n_proc_self_mountinfo++;
+
+        } else {
+                _cleanup_free_ char *e = NULL;
+
+                if (!is_path(mi->where))
+                        return 0;
+
+                e = unit_name_from_path(mi->where, ".mount");
+                if (!e)
+                        return -ENOMEM;
+
+                u = manager_get_unit(d->manager, e);
+                if (!u)
+                        return 0;
+
+                if (MOUNT(u)->n_proc_self_mountinfo > 0)
+                        MOUNT(u)->n_proc_self_mountinfo--;
+
+                /* If this was the top of a stack of mounts on the
+                 * same path, the parameters are now those of the
+                 * mount that is uncovered again */
+                if (MOUNT(u)->n_proc_self_mountinfo > 0) {
+                        _cleanup_free_ char *line = NULL, *o = NULL;
+                        MountInfo top;
+                        Unit *t;
+
+                        r = mountinfo_table_find(&d->manager->mountinfo, mi->where, &top, &line);
+                        if (r < 0)
+                                return r;
+                        if (r > 0) {
+                                o = strjoin(top.options, ",", top.super_options, NULL);
+                                if (!o)
+                                        return -ENOMEM;
+
+                                r = mount_add_one(d->manager, top.what, top.where, o, top.fstype, 0, d->set_flags, &t);
+                                if (r < 0)
+                                        return r;
+                        }
                 }
+        }
 
-                if ((k = mount_add_one(m, d, p, o, fstype, 0, set_flags)) < 0)
-                        r = k;
-
-clean_up:
-                free(device);
-                free(path);
-                free(options);
-                free(options2);
-                free(fstype);
-                free(d);
-                free(p);
-                free(o);
+        if (d->changed) {
+                r = set_put(d->changed, u);
+                if (r < 0 && r != -EEXIST)
+                        return r;
         }
 
-finish:
-        free(device);
-        free(path);
-        free(options);
-        free(options2);
-        free(fstype);
-        free(d);
-        free(p);
-        free(o);
+        return 0;
+}
 
-        return r;
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, Set *changed) {
+        MountInfoDiff d;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        /* Only the lines that were added, changed or removed since
+         * the last call are processed. If we have no snapshot of the
+         * previous state we have to look at all mount units, since
+         * we don't know which ones vanished in the meantime. */
+
+        if (changed && mountinfo_table_size(&m->mountinfo) <= 0)
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                        r = set_put(changed, u);
+                        if (r < 0)
+                                return r;
+                }
+
+        zero(d);
+        d.manager = m;
+        d.set_flags = set_flags;
+        d.changed = changed;
+
+        return mountinfo_table_read(&m->mountinfo, fileno(m->proc_self_mountinfo), mount_process_mountinfo, &d);
+}
+
+static void mount_flush_proc_self_mountinfo(Manager *m) {
+        Unit *u;
+
+        assert(m);
+
+        /* Forget what we know, so that the next read starts from
+         * scratch */
+        mountinfo_table_flush(&m->mountinfo);
+
+        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
+                MOUNT(u)->n_proc_self_mountinfo = 0;
 }
 
 static void mount_shutdown(Manager *m) {
         assert(m);
 
+        mountinfo_table_done(&m->mountinfo);
+
         if (m->proc_self_mountinfo) {
                 fclose(m->proc_self_mountinfo);
                 m->proc_self_mountinfo = NULL;
@@ -1673,7 +1716,11 @@ static int mount_enumerate(Manager *m) {
                         return -errno;
         }
 
-        if ((r = mount_load_proc_self_mountinfo(m, false)) < 0)
+        /* We might get called again after a reload, with all units
+         * gone */
+        mount_flush_proc_self_mountinfo(m);
+
+        if ((r = mount_load_proc_self_mountinfo(m, false, NULL)) < 0)
                 goto fail;
 
         return 0;
@@ -1683,37 +1730,51 @@ fail:
         return r;
 }
 
-void mount_fd_event(Manager *m, int events) {
+int mount_dispatch_reload(Manager *m) {
+        Set *changed;
         Unit *u;
+        Iterator i;
         int r;
 
         assert(m);
-        assert(events & EPOLLPRI);
 
-        /* The manager calls this for every fd event happening on the
-         * /proc/self/mountinfo file, which informs us about mounting
-         * table changes */
+        if (_likely_(!m->request_mount_reload))
+                return 0;
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        m->request_mount_reload = false;
+
+        if (!m->proc_self_mountinfo)
+                return 0;
+
+        changed = set_new(trivial_hash_func, trivial_compare_func);
+        if (!changed) {
+                log_oom();
+                return 0;
+        }
+
+        r = mount_load_proc_self_mountinfo(m, true, changed);
         if (r < 0) {
                 log_error("Failed to reread /proc/self/mountinfo: %s", strerror(-r));
 
-                /* Reset flags, just in case, for later calls */
-                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                /* Reset flags, just in case, and start from
+                 * scratch the next time */
+                SET_FOREACH(u, changed, i) {
                         Mount *mount = MOUNT(u);
 
-                        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+                        mount->just_mounted = mount->just_changed = false;
                 }
 
-                return;
+                mount_flush_proc_self_mountinfo(m);
+                set_free(changed);
+                return 0;
         }
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+        SET_FOREACH(u, changed, i) {
                 Mount *mount = MOUNT(u);
 
-                if (!mount->is_mounted) {
+                if (mount->n_proc_self_mountinfo <= 0) {
                         /* This has just been unmounted. */
 
                         mount->from_proc_self_mountinfo = false;
@@ -1757,8 +1818,24 @@ void mount_fd_event(Manager *m, int events) {
                 }
 
                 /* Reset the flags for later calls */
-                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+                mount->just_mounted = mount->just_changed = false;
         }
+
+        set_free(changed);
+
+        return 1;
+}
+
+void mount_fd_event(Manager *m, int events) {
+        assert(m);
+        assert(events & EPOLLPRI);
+
+        /* The manager calls this for every fd event happening on the
+         * /proc/self/mountinfo file, which informs us about mounting
+         * table changes. We only note that it needs to be reread, and
+         * do that once per burst of changes. */
+
+        m->request_mount_reload = true;
 }
 
 static void mount_reset_failed(Unit *u) {
@@ -1904,6 +1981,7 @@ const UnitVTable mount_vtable = {
         .bus_interface = "org.freedesktop.systemd1.Mount",
         .bus_message_handler = bus_mount_message_handler,
         .bus_invalidating_properties =  bus_mount_invalidating_properties,
+        .bus_properties = bus_mount_properties,
 
         .enumerate = mount_enumerate,
         .shutdown = mount_shutdown,
@@ -83,10 +83,13 @@ struct Mount {
 
         /* Used while looking for mount points that vanished or got
          * added from/to /proc/self/mountinfo */
-        bool is_mounted:1;
         bool just_mounted:1;
         bool just_changed:1;
 
+        /* How many lines of /proc/self/mountinfo currently refer to
+         * this mount point */
+        unsigned n_proc_self_mountinfo;
+
         MountResult result;
         MountResult reload_result;
 
@@ -109,6 +112,7 @@ struct Mount {
 
 extern const UnitVTable mount_vtable;
 
+int mount_dispatch_reload(Manager *m);
 void mount_fd_event(Manager *m, int events);
 
 const char* mount_state_to_string(MountState i);
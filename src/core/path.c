@@ -779,5 +779,6 @@ const UnitVTable path_vtable = {
 
         .bus_interface = "org.freedesktop.systemd1.Path",
         .bus_message_handler = bus_path_message_handler,
-        .bus_invalidating_properties = bus_path_invalidating_properties
+        .bus_invalidating_properties = bus_path_invalidating_properties,
+        .bus_properties = bus_path_properties
 };
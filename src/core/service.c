@@ -190,6 +190,11 @@ static int service_set_main_pid(Service *s, pid_t pid) {
         if (pid == getpid())
                 return -EINVAL;
 
+        /* Don't leave the previous main PID pointing to us, we
+         * might be gone by the time it exits */
+        if (s->main_pid > 0 && s->main_pid != pid && !s->main_pid_alien && s->main_pid != s->control_pid)
+                unit_unwatch_pid(UNIT(s), s->main_pid);
+
         s->main_pid = pid;
         s->main_pid_known = true;
 
@@ -199,9 +204,20 @@ static int service_set_main_pid(Service *s, pid_t pid) {
                                  UNIT(s)->id, (unsigned long) pid);
 
                 s->main_pid_alien = true;
-        } else
+        } else {
+                int r;
+
                 s->main_pid_alien = false;
 
+                /* Make sure we can attribute its SIGCHLD to us
+                 * without looking into /proc */
+                r = unit_watch_pid(UNIT(s), pid);
+                if (r < 0)
+                        log_warning_unit(UNIT(s)->id,
+                                         "%s: Failed to watch main PID %lu: %s",
+                                         UNIT(s)->id, (unsigned long) pid, strerror(-r));
+        }
+
         exec_status_start(&s->main_exec_status, pid);
 
         return 0;
@@ -1467,7 +1483,7 @@ static void service_notify_sockets_dead(Service *s, bool failed_permanent) {
 
         SET_FOREACH(u, UNIT(s)->dependencies[UNIT_TRIGGERED_BY], i)
                 if (u->type == UNIT_SOCKET)
-                        socket_notify_service_dead(SOCKET(u), failed_permanent);
+                        socket_notify_service_dead(SOCKET(u), UNIT(s), failed_permanent);
 
         return;
 }
@@ -1663,7 +1679,7 @@ static int service_collect_fds(Service *s, int **fds, unsigned *n_fds) {
 
                 sock = SOCKET(u);
 
-                if ((r = socket_collect_fds(sock, &cfds, &cn_fds)) < 0)
+                if ((r = socket_collect_fds(sock, UNIT(s), &cfds, &cn_fds)) < 0)
                         goto fail;
 
                 if (!cfds)
@@ -2137,6 +2153,12 @@ static void service_enter_start(Service *s) {
         if (r < 0)
                 goto fail;
 
+        if (s->socket_fd_timestamp > 0 && UNIT_DEREF(s->accept_socket)) {
+                socket_connection_spawned(SOCKET(UNIT_DEREF(s->accept_socket)),
+                                          now(CLOCK_MONOTONIC) - s->socket_fd_timestamp);
+                s->socket_fd_timestamp = 0;
+        }
+
         if (s->type == SERVICE_SIMPLE || s->type == SERVICE_IDLE) {
                 /* For simple services we immediately start
                  * the START_POST binaries. */
@@ -3624,6 +3646,7 @@ int service_set_socket_fd(Service *s, int fd, Socket *sock) {
                 return -EAGAIN;
 
         s->socket_fd = fd;
+        s->socket_fd_timestamp = now(CLOCK_MONOTONIC);
         s->got_socket_fd = true;
 
         unit_ref_set(&s->accept_socket, UNIT(sock));
@@ -3840,6 +3863,7 @@ const UnitVTable service_vtable = {
         .bus_interface = "org.freedesktop.systemd1.Service",
         .bus_message_handler = bus_service_message_handler,
         .bus_invalidating_properties =  bus_service_invalidating_properties,
+        .bus_properties = bus_service_properties,
 
 #ifdef HAVE_SYSV_COMPAT
         .enumerate = service_enumerate,
@@ -154,6 +154,7 @@ struct Service {
 
         pid_t main_pid, control_pid;
         int socket_fd;
+        usec_t socket_fd_timestamp;
 
         int fsck_passno;
 
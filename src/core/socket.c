@@ -135,6 +135,16 @@ static void socket_done(Unit *u) {
 
         unit_ref_unset(&s->service);
 
+        if (s->shard_services) {
+                unsigned i;
+
+                for (i = 0; i < s->shards; i++)
+                        unit_ref_unset(&s->shard_services[i]);
+
+                free(s->shard_services);
+                s->shard_services = NULL;
+        }
+
         free(s->tcp_congestion);
         s->tcp_congestion = NULL;
 
@@ -213,6 +223,41 @@ static bool have_non_accept_socket(Socket *s) {
         return false;
 }
 
+static int socket_verify_shards(Socket *s) {
+        SocketPort *p;
+
+        assert(s);
+        assert(s->shards > 0);
+
+        /* This is checked before the ports and services are
+         * multiplied, hence not in socket_verify() */
+
+        if (s->accept || UNIT_DEREF(s->service)) {
+                log_error_unit(UNIT(s)->id,
+                               "%s has Shards= set, which is incompatible with Accept= and Service=. Refusing.",
+                               UNIT(s)->id);
+                return -EINVAL;
+        }
+
+        if (s->shards > SOCKET_SHARDS_MAX) {
+                log_error_unit(UNIT(s)->id,
+                               "%s's Shards setting too large. Refusing.", UNIT(s)->id);
+                return -EINVAL;
+        }
+
+        LIST_FOREACH(port, p, s->ports)
+                if (p->type != SOCKET_SOCKET ||
+                    (socket_address_family(&p->address) != AF_INET &&
+                     socket_address_family(&p->address) != AF_INET6)) {
+                        log_error_unit(UNIT(s)->id,
+                                       "%s has Shards= set, but not all sockets are IP sockets. Refusing.",
+                                       UNIT(s)->id);
+                        return -EINVAL;
+                }
+
+        return 0;
+}
+
 static int socket_verify(Socket *s) {
         assert(s);
 
@@ -353,6 +398,91 @@ static bool socket_has_exec(Socket *s) {
         return false;
 }
 
+static int socket_add_shard_ports(Socket *s) {
+        SocketPort *p, *tail, *last;
+        unsigned i;
+
+        assert(s);
+
+        /* Duplicate each port once for each additional shard, so
+         * that each service instance gets its own copy of each
+         * socket in the same order */
+
+        LIST_FIND_TAIL(SocketPort, port, s->ports, last);
+        if (!last)
+                return 0;
+
+        tail = last;
+
+        for (i = 1; i < s->shards; i++) {
+                LIST_FOREACH(port, p, s->ports) {
+                        SocketPort *c;
+
+                        c = new0(SocketPort, 1);
+                        if (!c)
+                                return -ENOMEM;
+
+                        c->type = p->type;
+                        c->fd = -1;
+                        c->address = p->address;
+                        c->shard = i;
+
+                        if (p->path) {
+                                c->path = strdup(p->path);
+                                if (!c->path) {
+                                        free(c);
+                                        return -ENOMEM;
+                                }
+                        }
+
+                        LIST_INSERT_AFTER(SocketPort, port, s->ports, tail, c);
+                        tail = c;
+
+                        if (p == last)
+                                break;
+                }
+        }
+
+        return 0;
+}
+
+static int socket_load_shard_services(Socket *s) {
+        _cleanup_free_ char *prefix = NULL;
+        unsigned i;
+        int r;
+
+        assert(s);
+        assert(s->shards > 0);
+
+        s->shard_services = new0(UnitRef, s->shards);
+        if (!s->shard_services)
+                return -ENOMEM;
+
+        prefix = unit_name_to_prefix(UNIT(s)->id);
+        if (!prefix)
+                return -ENOMEM;
+
+        for (i = 0; i < s->shards; i++) {
+                _cleanup_free_ char *name = NULL;
+                Unit *x;
+
+                if (asprintf(&name, "%s@%u.service", prefix, i) < 0)
+                        return -ENOMEM;
+
+                r = manager_load_unit(UNIT(s)->manager, name, NULL, NULL, &x);
+                if (r < 0)
+                        return r;
+
+                unit_ref_set(&s->shard_services[i], x);
+
+                r = unit_add_two_dependencies(UNIT(s), UNIT_BEFORE, UNIT_TRIGGERS, x, true);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int socket_load(Unit *u) {
         Socket *s = SOCKET(u);
         int r;
@@ -366,7 +496,21 @@ static int socket_load(Unit *u) {
         /* This is a new unit? Then let's add in some extras */
         if (u->load_state == UNIT_LOADED) {
 
-                if (have_non_accept_socket(s)) {
+                if (s->shards > 0) {
+
+                        r = socket_verify_shards(s);
+                        if (r < 0)
+                                return r;
+
+                        r = socket_add_shard_ports(s);
+                        if (r < 0)
+                                return r;
+
+                        r = socket_load_shard_services(s);
+                        if (r < 0)
+                                return r;
+
+                } else if (have_non_accept_socket(s)) {
 
                         if (!UNIT_DEREF(s->service)) {
                                 Unit *x;
@@ -431,6 +575,7 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
         SocketPort *p;
         const char *prefix2;
         char *p2;
+        char time_string[FORMAT_TIMESPAN_MAX], time_string2[FORMAT_TIMESPAN_MAX];
 
         assert(s);
         assert(f);
@@ -476,6 +621,11 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
                         "%sBindToDevice: %s\n",
                         prefix, s->bind_to_device);
 
+        if (s->shards > 0)
+                fprintf(f,
+                        "%sShards: %u\n",
+                        prefix, s->shards);
+
         if (s->accept)
                 fprintf(f,
                         "%sAccepted: %u\n"
@@ -485,6 +635,24 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
                         prefix, s->n_connections,
                         prefix, s->max_connections);
 
+        if (s->accept && s->n_accept_wakeups > 0)
+                fprintf(f,
+                        "%sAcceptWakeups: %u\n"
+                        "%sAcceptLatencyAvg: %s\n"
+                        "%sAcceptLatencyMax: %s\n",
+                        prefix, s->n_accept_wakeups,
+                        prefix, format_timespan(time_string, sizeof(time_string), s->n_accept_samples > 0 ? s->accept_latency_usec / s->n_accept_samples : 0),
+                        prefix, format_timespan(time_string2, sizeof(time_string2), s->accept_latency_max_usec));
+
+        if (s->accept && s->n_spawned > 0)
+                fprintf(f,
+                        "%sSpawned: %u\n"
+                        "%sSpawnTimeAvg: %s\n"
+                        "%sSpawnTimeMax: %s\n",
+                        prefix, s->n_spawned,
+                        prefix, format_timespan(time_string, sizeof(time_string), s->spawn_usec / s->n_spawned),
+                        prefix, format_timespan(time_string2, sizeof(time_string2), s->spawn_max_usec));
+
         if (s->priority >= 0)
                 fprintf(f,
                         "%sPriority: %i\n",
@@ -994,13 +1162,20 @@ static int socket_open_fds(Socket *s) {
                 if (p->type == SOCKET_SOCKET) {
 
                         if (!know_label) {
+                                Unit *service;
 
-                                if ((r = socket_instantiate_service(s)) < 0)
-                                        return r;
+                                if (s->shards > 0)
+                                        service = UNIT_DEREF(s->shard_services[0]);
+                                else {
+                                        if ((r = socket_instantiate_service(s)) < 0)
+                                                return r;
+
+                                        service = UNIT_DEREF(s->service);
+                                }
 
-                                if (UNIT_DEREF(s->service) &&
-                                    SERVICE(UNIT_DEREF(s->service))->exec_command[SERVICE_EXEC_START]) {
-                                        r = label_get_create_label_from_exe(SERVICE(UNIT_DEREF(s->service))->exec_command[SERVICE_EXEC_START]->path, &label);
+                                if (service &&
+                                    SERVICE(service)->exec_command[SERVICE_EXEC_START]) {
+                                        r = label_get_create_label_from_exe(SERVICE(service)->exec_command[SERVICE_EXEC_START]->path, &label);
 
                                         if (r < 0) {
                                                 if (r != -EPERM)
@@ -1018,6 +1193,7 @@ static int socket_open_fds(Socket *s) {
                                              s->bind_to_device,
                                              s->free_bind,
                                              s->transparent,
+                                             s->shards > 0,
                                              s->directory_mode,
                                              s->socket_mode,
                                              label,
@@ -1552,7 +1728,10 @@ static void socket_enter_running(Socket *s, int cfd) {
                 cfd = -1;
                 s->n_connections ++;
 
-                r = manager_add_job(UNIT(s)->manager, JOB_START, UNIT(service), JOB_REPLACE, true, &error, NULL);
+                /* The instance is brand new, so unless it needs
+                 * something that is not up yet we can skip the
+                 * transaction logic */
+                r = manager_add_start_job_fast(UNIT(s)->manager, UNIT(service), &error, NULL);
                 if (r < 0)
                         goto fail;
 
@@ -1576,6 +1755,75 @@ fail:
         dbus_error_free(&error);
 }
 
+static void socket_unwatch_shard(Socket *s, unsigned shard) {
+        SocketPort *p;
+
+        assert(s);
+
+        LIST_FOREACH(port, p, s->ports)
+                if (p->fd >= 0 && p->shard == shard)
+                        unit_unwatch_fd(UNIT(s), &p->fd_watch);
+}
+
+static int socket_watch_shard(Socket *s, unsigned shard) {
+        SocketPort *p;
+        int r;
+
+        assert(s);
+
+        LIST_FOREACH(port, p, s->ports) {
+                if (p->fd < 0 || p->shard != shard)
+                        continue;
+
+                r = unit_watch_fd(UNIT(s), p->fd, EPOLLIN, &p->fd_watch);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void socket_enter_running_shard(Socket *s, unsigned shard) {
+        DBusError error;
+        Unit *service;
+        int r;
+
+        assert(s);
+        assert(shard < s->shards);
+
+        /* For sharded sockets the socket unit stays in listening
+         * state, and only stops watching the sockets of the shard
+         * whose service instance is started now. The kernel
+         * distributes the traffic among the instances from then
+         * on. */
+
+        if (unit_pending_inactive(UNIT(s))) {
+                log_debug_unit(UNIT(s)->id,
+                               "Suppressing connection request on %s since unit stop is scheduled.",
+                               UNIT(s)->id);
+                socket_unwatch_shard(s, shard);
+                return;
+        }
+
+        dbus_error_init(&error);
+
+        service = UNIT_DEREF(s->shard_services[shard]);
+
+        if (!unit_pending_active(service)) {
+                r = manager_add_job(UNIT(s)->manager, JOB_START, service, JOB_REPLACE, true, &error, NULL);
+                if (r < 0) {
+                        log_warning_unit(UNIT(s)->id,
+                                         "%s failed to queue service startup job for shard %u: %s",
+                                         UNIT(s)->id, shard, bus_error(&error, r));
+                        dbus_error_free(&error);
+                        socket_enter_stop_pre(s, SOCKET_FAILURE_RESOURCES);
+                        return;
+                }
+        }
+
+        socket_unwatch_shard(s, shard);
+}
+
 static void socket_run_next(Socket *s) {
         int r;
 
@@ -1871,8 +2119,11 @@ static int socket_deserialize_item(Unit *u, const char *key, const char *value,
                                        "Failed to parse socket value %s", value);
                 else {
 
+                        /* Sharded sockets have the same address
+                         * multiple times, in order */
                         LIST_FOREACH(port, p, s->ports)
-                                if (socket_address_is(&p->address, value+skip, type))
+                                if (socket_address_is(&p->address, value+skip, type) &&
+                                    (s->shards <= 0 || p->fd < 0))
                                         break;
 
                         if (p) {
@@ -1957,9 +2208,59 @@ static bool socket_check_gc(Unit *u) {
         return s->n_connections > 0;
 }
 
+static int socket_accept_batch(Socket *s, int fd) {
+        unsigned k = 0;
+        usec_t ts;
+
+        assert(s);
+        assert(fd >= 0);
+
+        /* Drain the backlog, so that a burst of connections does not
+         * cost a wakeup per connection, but stop after a while so
+         * that a flood on one socket does not starve everything
+         * else. */
+
+        ts = now(CLOCK_MONOTONIC);
+        s->n_accept_wakeups++;
+
+        while (k < SOCKET_ACCEPT_BATCH_MAX && s->state == SOCKET_LISTENING) {
+                usec_t latency;
+                int cfd;
+
+                cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
+                if (cfd < 0) {
+
+                        if (errno == EINTR || errno == ECONNABORTED)
+                                continue;
+
+                        if (errno == EAGAIN)
+                                break;
+
+                        log_error_unit(UNIT(s)->id,
+                                       "Failed to accept socket: %m");
+                        return -errno;
+                }
+
+                latency = now(CLOCK_MONOTONIC) - ts;
+                s->n_accept_samples++;
+                s->accept_latency_usec += latency;
+                if (latency > s->accept_latency_max_usec)
+                        s->accept_latency_max_usec = latency;
+
+                socket_apply_socket_options(s, cfd);
+                socket_enter_running(s, cfd);
+                k++;
+        }
+
+        if (k > 1)
+                log_debug_unit(UNIT(s)->id,
+                               "%s: Accepted %u connections in one go.", UNIT(s)->id, k);
+
+        return 0;
+}
+
 static void socket_fd_event(Unit *u, int fd, uint32_t events, Watch *w) {
         Socket *s = SOCKET(u);
-        int cfd = -1;
 
         assert(s);
         assert(fd >= 0);
@@ -1984,26 +2285,20 @@ static void socket_fd_event(Unit *u, int fd, uint32_t events, Watch *w) {
         }
 
         if (w->socket_accept) {
-                for (;;) {
-
-                        cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
-                        if (cfd < 0) {
-
-                                if (errno == EINTR)
-                                        continue;
+                if (socket_accept_batch(s, fd) < 0)
+                        goto fail;
 
-                                log_error_unit(u->id,
-                                               "Failed to accept socket: %m");
-                                goto fail;
-                        }
+                return;
+        }
 
-                        break;
-                }
+        if (s->shards > 0) {
+                SocketPort *p = container_of(w, SocketPort, fd_watch);
 
-                socket_apply_socket_options(s, cfd);
+                socket_enter_running_shard(s, p->shard);
+                return;
         }
 
-        socket_enter_running(s, cfd);
+        socket_enter_running(s, -1);
         return;
 
 fail:
@@ -2181,20 +2476,43 @@ static void socket_timer_event(Unit *u, uint64_t elapsed, Watch *w) {
         }
 }
 
-int socket_collect_fds(Socket *s, int **fds, unsigned *n_fds) {
+static int socket_find_shard(Socket *s, Unit *service) {
+        unsigned i;
+
+        assert(s);
+
+        for (i = 0; i < s->shards; i++)
+                if (UNIT_DEREF(s->shard_services[i]) == service)
+                        return (int) i;
+
+        return -ENOENT;
+}
+
+int socket_collect_fds(Socket *s, Unit *service, int **fds, unsigned *n_fds) {
         int *rfds;
         unsigned rn_fds, k;
         SocketPort *p;
+        int shard = -1;
 
         assert(s);
         assert(fds);
         assert(n_fds);
 
-        /* Called from the service code for requesting our fds */
+        /* Called from the service code for requesting our fds. The
+         * instances of sharded sockets only get their own share. */
+
+        if (s->shards > 0) {
+                shard = socket_find_shard(s, service);
+                if (shard < 0) {
+                        *fds = NULL;
+                        *n_fds = 0;
+                        return 0;
+                }
+        }
 
         rn_fds = 0;
         LIST_FOREACH(port, p, s->ports)
-                if (p->fd >= 0)
+                if (p->fd >= 0 && (shard < 0 || p->shard == (unsigned) shard))
                         rn_fds++;
 
         if (rn_fds <= 0) {
@@ -2208,7 +2526,7 @@ int socket_collect_fds(Socket *s, int **fds, unsigned *n_fds) {
 
         k = 0;
         LIST_FOREACH(port, p, s->ports)
-                if (p->fd >= 0)
+                if (p->fd >= 0 && (shard < 0 || p->shard == (unsigned) shard))
                         rfds[k++] = p->fd;
 
         assert(k == rn_fds);
@@ -2219,7 +2537,7 @@ int socket_collect_fds(Socket *s, int **fds, unsigned *n_fds) {
         return 0;
 }
 
-void socket_notify_service_dead(Socket *s, bool failed_permanent) {
+void socket_notify_service_dead(Socket *s, Unit *service, bool failed_permanent) {
         assert(s);
 
         /* The service is dead. Dang!
@@ -2227,6 +2545,36 @@ void socket_notify_service_dead(Socket *s, bool failed_permanent) {
          * This is strictly for one-instance-for-all-connections
          * services. */
 
+        if (s->shards > 0) {
+                int shard, r;
+
+                if (s->state != SOCKET_LISTENING)
+                        return;
+
+                shard = socket_find_shard(s, service);
+                if (shard < 0)
+                        return;
+
+                log_debug_unit(UNIT(s)->id,
+                               "%s got notified about death of shard %i (failed permanently: %s)",
+                               UNIT(s)->id, shard, yes_no(failed_permanent));
+
+                if (failed_permanent) {
+                        socket_enter_stop_pre(s, SOCKET_FAILURE_SERVICE_FAILED_PERMANENT);
+                        return;
+                }
+
+                r = socket_watch_shard(s, (unsigned) shard);
+                if (r < 0) {
+                        log_warning_unit(UNIT(s)->id,
+                                         "%s failed to watch sockets: %s",
+                                         UNIT(s)->id, strerror(-r));
+                        socket_enter_stop_pre(s, SOCKET_FAILURE_RESOURCES);
+                }
+
+                return;
+        }
+
         if (s->state == SOCKET_RUNNING) {
                 log_debug_unit(UNIT(s)->id,
                                "%s got notified about service death (failed permanently: %s)",
@@ -2253,6 +2601,17 @@ void socket_connection_unref(Socket *s) {
                        "%s: One connection closed, %u left.", UNIT(s)->id, s->n_connections);
 }
 
+void socket_connection_spawned(Socket *s, usec_t spawn_usec) {
+        assert(s);
+
+        s->n_spawned++;
+        s->spawn_usec += spawn_usec;
+        if (spawn_usec > s->spawn_max_usec)
+                s->spawn_max_usec = spawn_usec;
+
+        unit_add_to_dbus_queue(UNIT(s));
+}
+
 static void socket_reset_failed(Unit *u) {
         Socket *s = SOCKET(u);
 
@@ -2394,6 +2753,7 @@ const UnitVTable socket_vtable = {
         .bus_interface = "org.freedesktop.systemd1.Socket",
         .bus_message_handler = bus_socket_message_handler,
         .bus_invalidating_properties =  bus_socket_invalidating_properties,
+        .bus_properties = bus_socket_properties,
 
         .status_message_formats = {
                 /*.starting_stopping = {
@@ -84,6 +84,10 @@ typedef struct SocketPort {
         char *path;
         Watch fd_watch;
 
+        /* With Shards= set, which of the service instances this
+         * port belongs to */
+        unsigned shard;
+
         LIST_FIELDS(struct SocketPort, port);
 } SocketPort;
 
@@ -96,6 +100,15 @@ struct Socket {
         unsigned n_connections;
         unsigned max_connections;
 
+        /* Statistics for Accept=yes sockets. The accept latency is
+         * the time from the wakeup until a connection was taken off
+         * the backlog, the spawn time the time from handing it to
+         * the instance until its process was forked off. */
+        unsigned n_accept_wakeups, n_accept_samples;
+        usec_t accept_latency_usec, accept_latency_max_usec;
+        unsigned n_spawned;
+        usec_t spawn_usec, spawn_max_usec;
+
         unsigned backlog;
         usec_t timeout_usec;
 
@@ -108,6 +121,11 @@ struct Socket {
         when the next service we spawn. */
         UnitRef service;
 
+        /* For Shards= sockets refers to the service instance for each
+        shard, which gets one SO_REUSEPORT socket of each address */
+        unsigned shards;
+        UnitRef *shard_services;
+
         SocketState state, deserialized_state;
 
         Watch timer_watch;
@@ -151,10 +169,10 @@ struct Socket {
 };
 
 /* Called from the service code when collecting fds */
-int socket_collect_fds(Socket *s, int **fds, unsigned *n_fds);
+int socket_collect_fds(Socket *s, Unit *service, int **fds, unsigned *n_fds);
 
 /* Called from the service when it shut down */
-void socket_notify_service_dead(Socket *s, bool failed_permanent);
+void socket_notify_service_dead(Socket *s, Unit *service, bool failed_permanent);
 
 /* Called from the mount code figure out if a mount is a dependency of
  * any of the sockets of this socket */
@@ -163,8 +181,18 @@ int socket_add_one_mount_link(Socket *s, Mount *m);
 /* Called from the service code when a per-connection service ended */
 void socket_connection_unref(Socket *s);
 
+/* Called from the service code when a per-connection service forked
+ * off its main process */
+void socket_connection_spawned(Socket *s, usec_t spawn_usec);
+
 void socket_free_ports(Socket *s);
 
+/* How many connections we accept at most per wakeup */
+#define SOCKET_ACCEPT_BATCH_MAX 64
+
+/* How many SO_REUSEPORT sockets we are willing to create per address */
+#define SOCKET_SHARDS_MAX 1024
+
 extern const UnitVTable socket_vtable;
 
 const char* socket_state_to_string(SocketState i);
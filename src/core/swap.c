@@ -312,7 +312,8 @@ static int swap_add_one(
                 int priority,
                 bool noauto,
                 bool nofail,
-                bool set_flags) {
+                bool set_flags,
+                Set *changed) {
 
         Unit *u = NULL;
         char _cleanup_free_ *e = NULL;
@@ -386,11 +387,10 @@ static int swap_add_one(
                         goto fail;
         }
 
-        if (set_flags) {
-                SWAP(u)->is_active = true;
+        if (set_flags)
                 SWAP(u)->just_activated = !SWAP(u)->from_proc_swaps;
-        }
 
+        SWAP(u)->is_active = true;
         SWAP(u)->from_proc_swaps = true;
 
         p->priority = priority;
@@ -399,6 +399,12 @@ static int swap_add_one(
 
         unit_add_to_dbus_queue(u);
 
+        if (changed) {
+                r = set_put(changed, u);
+                if (r < 0 && r != -EEXIST)
+                        return r;
+        }
+
         return 0;
 
 fail:
@@ -412,7 +418,7 @@ fail:
         return r;
 }
 
-static int swap_process_new_swap(Manager *m, const char *device, int prio, bool set_flags) {
+static int swap_process_new_swap(Manager *m, const char *device, int prio, bool set_flags, Set *changed) {
         struct stat st;
         int r = 0, k;
 
@@ -433,7 +439,7 @@ static int swap_process_new_swap(Manager *m, const char *device, int prio, bool
                 dn = udev_device_get_devnode(d);
                 /* Skip dn==device, since that case will be handled below */
                 if (dn && !streq(dn, device))
-                        r = swap_add_one(m, dn, device, prio, false, false, set_flags);
+                        r = swap_add_one(m, dn, device, prio, false, false, set_flags, changed);
 
                 /* Add additional units for all symlinks */
                 first = udev_device_get_devlinks_list_entry(d);
@@ -451,7 +457,7 @@ static int swap_process_new_swap(Manager *m, const char *device, int prio, bool
                                     st.st_rdev != udev_device_get_devnum(d))
                                         continue;
 
-                        k = swap_add_one(m, p, device, prio, false, false, set_flags);
+                        k = swap_add_one(m, p, device, prio, false, false, set_flags, changed);
                         if (k < 0)
                                 r = k;
                 }
@@ -459,7 +465,7 @@ static int swap_process_new_swap(Manager *m, const char *device, int prio, bool
                 udev_device_unref(d);
         }
 
-        k = swap_add_one(m, device, device, prio, false, false, set_flags);
+        k = swap_add_one(m, device, device, prio, false, false, set_flags, changed);
         if (k < 0)
                 r = k;
 
@@ -497,6 +503,18 @@ static void swap_set_state(Swap *s, SwapState state) {
                     state_translation_table[state], true);
 }
 
+static void swap_notify_same_proc_swaps(Swap *s) {
+        Swap *other;
+
+        assert(s);
+
+        LIST_FOREACH_AFTER(same_proc_swaps, other, s)
+                swap_set_state(other, other->state);
+
+        LIST_FOREACH_BEFORE(same_proc_swaps, other, s)
+                swap_set_state(other, other->state);
+}
+
 static int swap_coldplug(Unit *u) {
         Swap *s = SWAP(u);
         SwapState new_state = SWAP_DEAD;
@@ -968,9 +986,10 @@ static void swap_sigchld_event(Unit *u, pid_t pid, int code, int status) {
         /* Notify clients about changed exit status */
         unit_add_to_dbus_queue(u);
 
-        /* Request a reload of /proc/swaps, so that following units
-         * can follow our state change */
-        u->manager->request_reload = true;
+        /* The change of /proc/swaps itself is picked up by the fd
+         * event, but let the units on the same device follow our
+         * state change right away */
+        swap_notify_same_proc_swaps(s);
 }
 
 static void swap_timer_event(Unit *u, uint64_t elapsed, Watch *w) {
@@ -1023,87 +1042,269 @@ static void swap_timer_event(Unit *u, uint64_t elapsed, Watch *w) {
         }
 }
 
-static int swap_load_proc_swaps(Manager *m, bool set_flags) {
+typedef struct ProcSwapsEntry {
+        int priority;
+        unsigned generation;
+        char device[];
+} ProcSwapsEntry;
+
+static int swap_read_proc_swaps(Manager *m, size_t *ret_size) {
+        size_t size = 0;
+        int fd;
+
+        assert(m);
+        assert(ret_size);
+
+        /* /proc/swaps is small, but we get woken up for it a lot
+         * during boot, so keep the buffer around */
+
+        fd = fileno(m->proc_swaps);
+
+        if (lseek(fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        for (;;) {
+                ssize_t n;
+
+                if (!GREEDY_REALLOC(m->proc_swaps_buffer, m->proc_swaps_allocated, MAX(size + 1024 + 1, (size_t) 4096)))
+                        return -ENOMEM;
+
+                n = read(fd, m->proc_swaps_buffer + size, m->proc_swaps_allocated - size - 1);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (n == 0)
+                        break;
+
+                size += n;
+        }
+
+        m->proc_swaps_buffer[size] = 0;
+        *ret_size = size;
+
+        return 0;
+}
+
+static int swap_parse_proc_swaps_line(char *line, char **device, int *priority) {
+        char *p = line, *fields[5];
         unsigned i;
-        int r = 0;
+
+        assert(line);
+        assert(device);
+        assert(priority);
+
+        /* Device/file, type of swap, swap size, used, priority */
+        for (i = 0; i < ELEMENTSOF(fields); i++) {
+                p += strspn(p, WHITESPACE);
+                if (*p == 0)
+                        return -EINVAL;
+
+                fields[i] = p;
+                p += strcspn(p, WHITESPACE);
+                if (*p != 0)
+                        *(p++) = 0;
+        }
+
+        if (safe_atoi(fields[4], priority) < 0)
+                return -EINVAL;
+
+        *device = cunescape(fields[0]);
+        if (!*device)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int swap_process_removed_swap(Manager *m, const char *device, Set *changed) {
+        Swap *first, *s;
+        int r;
 
         assert(m);
+        assert(device);
 
-        rewind(m->proc_swaps);
+        first = hashmap_get(m->swaps_by_proc_swaps, device);
+        LIST_FOREACH(same_proc_swaps, s, first) {
+                s->is_active = false;
 
-        (void) fscanf(m->proc_swaps, "%*s %*s %*s %*s %*s\n");
+                if (changed) {
+                        r = set_put(changed, s);
+                        if (r < 0 && r != -EEXIST)
+                                return r;
+                }
+        }
 
-        for (i = 1;; i++) {
-                char *dev = NULL, *d;
-                int prio = 0, k;
+        return 0;
+}
 
-                k = fscanf(m->proc_swaps,
-                           "%ms "  /* device/file */
-                           "%*s "  /* type of swap */
-                           "%*s "  /* swap size */
-                           "%*s "  /* used */
-                           "%i\n", /* priority */
-                           &dev, &prio);
-                if (k != 2) {
-                        if (k == EOF)
-                                break;
+static int swap_load_proc_swaps(Manager *m, bool set_flags, Set *changed) {
+        ProcSwapsEntry *e;
+        Iterator i;
+        char *line, *next, *end;
+        size_t size;
+        unsigned n;
+        int r = 0, k;
+
+        assert(m);
+
+        /* Only the entries that were added, changed or removed since
+         * the last call are processed. If we have no snapshot of the
+         * previous state we have to look at all swap units, since we
+         * don't know which ones vanished in the meantime. */
 
-                        log_warning("Failed to parse /proc/swaps:%u", i);
-                        free(dev);
+        if (!m->proc_swaps_entries) {
+                m->proc_swaps_entries = hashmap_new(string_hash_func, string_compare_func);
+                if (!m->proc_swaps_entries)
+                        return -ENOMEM;
+        }
+
+        if (changed && hashmap_isempty(m->proc_swaps_entries)) {
+                Unit *u;
+
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_SWAP]) {
+                        k = set_put(changed, u);
+                        if (k < 0)
+                                return k;
+                }
+        }
+
+        k = swap_read_proc_swaps(m, &size);
+        if (k < 0)
+                return k;
+
+        m->proc_swaps_generation++;
+
+        end = m->proc_swaps_buffer + size;
+
+        /* Skip the header line */
+        line = memchr(m->proc_swaps_buffer, '\n', size);
+        line = line ? line + 1 : end;
+
+        for (n = 2; line < end; line = next, n++) {
+                _cleanup_free_ char *d = NULL;
+                char *nl;
+                int prio;
+
+                nl = memchr(line, '\n', end - line);
+                if (nl) {
+                        *nl = 0;
+                        next = nl + 1;
+                } else
+                        next = end;
+
+                if (*line == 0)
+                        continue;
+
+                k = swap_parse_proc_swaps_line(line, &d, &prio);
+                if (k == -ENOMEM)
+                        return k;
+                if (k < 0) {
+                        log_warning("Failed to parse /proc/swaps:%u", n);
                         continue;
                 }
 
-                d = cunescape(dev);
-                free(dev);
+                e = hashmap_get(m->proc_swaps_entries, d);
+                if (e) {
+                        e->generation = m->proc_swaps_generation;
 
-                if (!d)
-                        return -ENOMEM;
+                        /* The common case: nothing changed */
+                        if (e->priority == prio)
+                                continue;
+                } else {
+                        e = malloc(offsetof(ProcSwapsEntry, device) + strlen(d) + 1);
+                        if (!e)
+                                return -ENOMEM;
 
-                k = swap_process_new_swap(m, d, prio, set_flags);
-                free(d);
+                        e->generation = m->proc_swaps_generation;
+                        strcpy(e->device, d);
 
+                        k = hashmap_put(m->proc_swaps_entries, e->device, e);
+                        if (k < 0) {
+                                free(e);
+                                return k;
+                        }
+                }
+
+                e->priority = prio;
+
+                k = swap_process_new_swap(m, d, prio, set_flags, changed);
+                if (k < 0)
+                        r = k;
+        }
+
+        HASHMAP_FOREACH(e, m->proc_swaps_entries, i) {
+                if (e->generation == m->proc_swaps_generation)
+                        continue;
+
+                hashmap_remove(m->proc_swaps_entries, e->device);
+
+                k = swap_process_removed_swap(m, e->device, changed);
                 if (k < 0)
                         r = k;
+
+                free(e);
         }
 
         return r;
 }
 
-int swap_dispatch_reload(Manager *m) {
-        /* This function should go as soon as the kernel properly notifies us */
+static void swap_flush_proc_swaps(Manager *m) {
+        ProcSwapsEntry *e;
+        Unit *u;
 
-        if (_likely_(!m->request_reload))
-                return 0;
+        assert(m);
 
-        m->request_reload = false;
+        /* Forget what we know, so that the next read starts from
+         * scratch */
+        while ((e = hashmap_steal_first(m->proc_swaps_entries)))
+                free(e);
 
-        return swap_fd_event(m, EPOLLPRI);
+        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_SWAP]) {
+                Swap *swap = SWAP(u);
+
+                swap->is_active = swap->just_activated = false;
+        }
 }
 
-int swap_fd_event(Manager *m, int events) {
+int swap_dispatch_reload(Manager *m) {
+        Set *changed;
         Unit *u;
+        Iterator i;
         int r;
 
         assert(m);
-        assert(events & EPOLLPRI);
 
-        r = swap_load_proc_swaps(m, true);
-        if (r < 0) {
-                log_error("Failed to reread /proc/swaps: %s", strerror(-r));
+        if (_likely_(!m->request_reload))
+                return 0;
 
-                /* Reset flags, just in case, for late calls */
-                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_SWAP]) {
-                        Swap *swap = SWAP(u);
+        m->request_reload = false;
 
-                        swap->is_active = swap->just_activated = false;
-                }
+        if (!m->proc_swaps)
+                return 0;
 
+        changed = set_new(trivial_hash_func, trivial_compare_func);
+        if (!changed) {
+                log_oom();
+                return 0;
+        }
+
+        r = swap_load_proc_swaps(m, true, changed);
+        if (r < 0) {
+                log_error("Failed to reread /proc/swaps: %s", strerror(-r));
+
+                /* Reset flags, just in case, and start from
+                 * scratch the next time */
+                swap_flush_proc_swaps(m);
+                set_free(changed);
                 return 0;
         }
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_SWAP]) {
+        SET_FOREACH(u, changed, i) {
                 Swap *swap = SWAP(u);
 
                 if (!swap->is_active) {
@@ -1144,13 +1345,26 @@ int swap_fd_event(Manager *m, int events) {
                         }
                 }
 
-                /* Reset the flags for later calls */
-                swap->is_active = swap->just_activated = false;
+                /* Reset the flag for later calls */
+                swap->just_activated = false;
         }
 
+        set_free(changed);
+
         return 1;
 }
 
+void swap_fd_event(Manager *m, int events) {
+        assert(m);
+        assert(events & EPOLLPRI);
+
+        /* The manager calls this for every fd event happening on the
+         * /proc/swaps file. We only note that it needs to be reread,
+         * and do that once per burst of changes. */
+
+        m->request_reload = true;
+}
+
 static Unit *swap_following(Unit *u) {
         Swap *s = SWAP(u);
         Swap *other, *first = NULL;
@@ -1220,6 +1434,14 @@ static void swap_shutdown(Manager *m) {
 
         hashmap_free(m->swaps_by_proc_swaps);
         m->swaps_by_proc_swaps = NULL;
+
+        swap_flush_proc_swaps(m);
+        hashmap_free(m->proc_swaps_entries);
+        m->proc_swaps_entries = NULL;
+
+        free(m->proc_swaps_buffer);
+        m->proc_swaps_buffer = NULL;
+        m->proc_swaps_allocated = 0;
 }
 
 static int swap_enumerate(Manager *m) {
@@ -1243,7 +1465,11 @@ static int swap_enumerate(Manager *m) {
                         return -errno;
         }
 
-        r = swap_load_proc_swaps(m, false);
+        /* We might get called again after a reload, with all units
+         * gone */
+        swap_flush_proc_swaps(m);
+
+        r = swap_load_proc_swaps(m, false, NULL);
         if (r < 0)
                 swap_shutdown(m);
 
@@ -1386,6 +1612,7 @@ const UnitVTable swap_vtable = {
         .bus_interface = "org.freedesktop.systemd1.Swap",
         .bus_message_handler = bus_swap_message_handler,
         .bus_invalidating_properties =  bus_swap_invalidating_properties,
+        .bus_properties = bus_swap_properties,
 
         .following = swap_following,
         .following_set = swap_following_set,
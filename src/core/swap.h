@@ -76,8 +76,8 @@ struct Swap {
         bool from_proc_swaps:1;
         bool from_fragment:1;
 
-        /* Used while looking for swaps that vanished or got added
-         * from/to /proc/swaps */
+        /* Whether this swap is currently listed in /proc/swaps, and
+         * whether that is news */
         bool is_active:1;
         bool just_activated:1;
 
@@ -109,7 +109,7 @@ extern const UnitVTable swap_vtable;
 int swap_add_one_mount_link(Swap *s, Mount *m);
 
 int swap_dispatch_reload(Manager *m);
-int swap_fd_event(Manager *m, int events);
+void swap_fd_event(Manager *m, int events);
 
 const char* swap_state_to_string(SwapState i);
 SwapState swap_state_from_string(const char *s);
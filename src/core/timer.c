@@ -619,5 +619,6 @@ const UnitVTable timer_vtable = {
 
         .bus_interface = "org.freedesktop.systemd1.Timer",
         .bus_message_handler = bus_timer_message_handler,
-        .bus_invalidating_properties =  bus_timer_invalidating_properties
+        .bus_invalidating_properties =  bus_timer_invalidating_properties,
+        .bus_properties = bus_timer_properties
 };
@@ -299,7 +299,10 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         assert(tr);
 
-rescan:
+        /* Deleting jobs without their dependencies only touches the
+         * hashmap entry of the unit we are currently looking at,
+         * hence a single pass is sufficient. */
+
         HASHMAP_FOREACH(j, tr->jobs, i) {
                 Job *k;
 
@@ -312,8 +315,9 @@ rescan:
                 }
 
                 /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
+                while ((k = j->transaction_next))
+                        transaction_delete_job(tr, k, false);
                 transaction_delete_job(tr, j, false);
-                goto rescan;
         next_unit:;
         }
 }
@@ -443,6 +447,141 @@ static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsi
         return 0;
 }
 
+static Job *transaction_order_next(Transaction *tr, Job *j, Iterator *i) {
+        Unit *u;
+
+        /* Returns the next job ordered after j, following the same
+         * edges as transaction_verify_order_one() */
+
+        while ((u = set_iterate(j->unit->dependencies[UNIT_BEFORE], i))) {
+                Job *o;
+
+                o = hashmap_get(tr->jobs, u);
+                if (!o)
+                        o = u->job;
+                if (o)
+                        return o;
+        }
+
+        return NULL;
+}
+
+typedef struct OrderFrame {
+        Job *job;
+        Iterator i;
+} OrderFrame;
+
+static int transaction_order_is_acyclic(Transaction *tr, unsigned generation) {
+        OrderFrame *frames = NULL;
+        Job **stack = NULL;
+        size_t frames_allocated = 0, stack_allocated = 0;
+        unsigned n_frames = 0, n_stack = 0, index = 0;
+        Iterator i;
+        Job *root;
+        int r = 1;
+
+        assert(tr);
+
+        /* Iterative version of Tarjan's strongly connected components
+         * algorithm over the ordering graph. Returns > 0 if the graph
+         * is acyclic, 0 if there is at least one cycle. This visits
+         * every job and ordering edge exactly once, and does not
+         * recurse, so it is cheap even for huge transactions. The
+         * (much more expensive) cycle breaking logic is only
+         * invoked if this finds a cycle. */
+
+        HASHMAP_FOREACH(root, tr->jobs, i) {
+
+                if (root->generation == generation)
+                        continue;
+
+                if (!GREEDY_REALLOC(frames, frames_allocated, n_frames + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                frames[n_frames].job = root;
+                frames[n_frames].i = ITERATOR_FIRST;
+                n_frames++;
+
+                root->generation = generation;
+                root->order_index = root->order_lowlink = index++;
+                root->order_on_stack = true;
+
+                if (!GREEDY_REALLOC(stack, stack_allocated, n_stack + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+                stack[n_stack++] = root;
+
+                while (n_frames > 0) {
+                        OrderFrame *f = frames + n_frames - 1;
+                        Job *j = f->job, *o;
+
+                        o = transaction_order_next(tr, j, &f->i);
+                        if (o) {
+                                if (o == j) {
+                                        r = 0;
+                                        goto finish;
+                                }
+
+                                if (o->generation != generation) {
+                                        /* Descend */
+                                        o->generation = generation;
+                                        o->order_index = o->order_lowlink = index++;
+                                        o->order_on_stack = true;
+
+                                        if (!GREEDY_REALLOC(stack, stack_allocated, n_stack + 1) ||
+                                            !GREEDY_REALLOC(frames, frames_allocated, n_frames + 1)) {
+                                                r = -ENOMEM;
+                                                goto finish;
+                                        }
+
+                                        stack[n_stack++] = o;
+                                        frames[n_frames].job = o;
+                                        frames[n_frames].i = ITERATOR_FIRST;
+                                        n_frames++;
+
+                                } else if (o->order_on_stack)
+                                        j->order_lowlink = MIN(j->order_lowlink, o->order_index);
+
+                                continue;
+                        }
+
+                        /* All edges of j are done, ascend */
+                        n_frames--;
+
+                        if (j->order_lowlink == j->order_index) {
+                                /* j is the root of a strongly
+                                 * connected component. If it has
+                                 * more than one member, we found a
+                                 * cycle. */
+                                if (stack[n_stack - 1] != j) {
+                                        r = 0;
+                                        goto finish;
+                                }
+
+                                n_stack--;
+                                j->order_on_stack = false;
+                        }
+
+                        if (n_frames > 0) {
+                                Job *parent = frames[n_frames - 1].job;
+                                parent->order_lowlink = MIN(parent->order_lowlink, j->order_lowlink);
+                        }
+                }
+        }
+
+finish:
+        while (n_stack > 0)
+                stack[--n_stack]->order_on_stack = false;
+
+        free(frames);
+        free(stack);
+
+        return r;
+}
+
 static int transaction_verify_order(Transaction *tr, unsigned *generation, DBusError *e) {
         Job *j;
         int r;
@@ -457,6 +596,14 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, DBusE
 
         g = (*generation)++;
 
+        r = transaction_order_is_acyclic(tr, g);
+        if (r > 0)
+                return 0;
+
+        /* There's a cycle (or we ran out of memory trying to find
+         * out), do a full sweep to find and break it. */
+        g = (*generation)++;
+
         HASHMAP_FOREACH(j, tr->jobs, i)
                 if ((r = transaction_verify_order_one(tr, j, NULL, g, e)) < 0)
                         return r;
@@ -465,6 +612,9 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, DBusE
 }
 
 static void transaction_collect_garbage(Transaction *tr) {
+        Unit **queue = NULL;
+        size_t allocated = 0;
+        unsigned n = 0;
         Iterator i;
         Job *j;
 
@@ -472,6 +622,54 @@ static void transaction_collect_garbage(Transaction *tr) {
 
         /* Drop jobs that are not required by any other job */
 
+        /* Since the job we drop is not required by anything, deleting
+         * it never deletes any other jobs, it just might leave the
+         * jobs it required unrequired. Hence we only need to recheck
+         * those, which we do with a simple work list of units, instead
+         * of rescanning the whole transaction after each deletion. */
+
+        if (!GREEDY_REALLOC(queue, allocated, hashmap_size(tr->jobs)))
+                goto fallback;
+
+        HASHMAP_FOREACH(j, tr->jobs, i)
+                queue[n++] = j->unit;
+
+        while (n > 0) {
+                JobDependency *l;
+                Unit *u;
+
+                u = queue[--n];
+
+                j = hashmap_get(tr->jobs, u);
+                if (!j)
+                        continue;
+
+                if (tr->anchor_job == j || j->object_list)
+                        continue;
+
+                /* Recheck the jobs we required, and the next job of
+                 * this unit, once this one is gone */
+                LIST_FOREACH(subject, l, j->subject_list) {
+                        if (!GREEDY_REALLOC(queue, allocated, n + 1))
+                                goto fallback;
+
+                        queue[n++] = l->object->unit;
+                }
+
+                if (!GREEDY_REALLOC(queue, allocated, n + 1))
+                        goto fallback;
+                queue[n++] = u;
+
+                /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
+                transaction_delete_job(tr, j, true);
+        }
+
+        free(queue);
+        return;
+
+fallback:
+        free(queue);
+
 rescan:
         HASHMAP_FOREACH(j, tr->jobs, i) {
                 if (tr->anchor_job == j || j->object_list) {
@@ -514,7 +712,52 @@ static int transaction_is_destructive(Transaction *tr, DBusError *e) {
         return 0;
 }
 
+static Job* transaction_find_impacting_job(Job *j) {
+
+        /* Returns the first job of a unit that we should drop to
+         * minimize impact */
+
+        LIST_FOREACH(transaction, j, j) {
+                bool stops_running_service, changes_existing_job;
+
+                /* If it matters, we shouldn't drop it */
+                if (j->matters_to_anchor)
+                        continue;
+
+                /* Would this stop a running service?
+                 * Would this change an existing job?
+                 * If so, let's drop this entry */
+
+                stops_running_service =
+                        j->type == JOB_STOP && UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(j->unit));
+
+                changes_existing_job =
+                        j->unit->job &&
+                        job_type_is_conflicting(j->type, j->unit->job->type);
+
+                if (!stops_running_service && !changes_existing_job)
+                        continue;
+
+                if (stops_running_service)
+                        log_debug_unit(j->unit->id,
+                                       "%s/%s would stop a running service.",
+                                       j->unit->id, job_type_to_string(j->type));
+
+                if (changes_existing_job)
+                        log_debug_unit(j->unit->id,
+                                       "%s/%s would change existing job.",
+                                       j->unit->id, job_type_to_string(j->type));
+
+                return j;
+        }
+
+        return NULL;
+}
+
 static void transaction_minimize_impact(Transaction *tr) {
+        Unit **units = NULL;
+        size_t allocated = 0;
+        unsigned n = 0, k;
         Job *j;
         Iterator i;
 
@@ -523,38 +766,21 @@ static void transaction_minimize_impact(Transaction *tr) {
         /* Drops all unnecessary jobs that reverse already active jobs
          * or that stop a running service. */
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                LIST_FOREACH(transaction, j, j) {
-                        bool stops_running_service, changes_existing_job;
-
-                        /* If it matters, we shouldn't drop it */
-                        if (j->matters_to_anchor)
-                                continue;
+        /* Whether a job is dropped here only depends on the job
+         * itself, so deleting a job (and what depends on it) never
+         * makes other jobs eligible. Hence we can go through a
+         * snapshot of the units once, instead of rescanning the
+         * transaction after each deletion. */
 
-                        /* Would this stop a running service?
-                         * Would this change an existing job?
-                         * If so, let's drop this entry */
+        if (!GREEDY_REALLOC(units, allocated, hashmap_size(tr->jobs)))
+                goto fallback;
 
-                        stops_running_service =
-                                j->type == JOB_STOP && UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(j->unit));
-
-                        changes_existing_job =
-                                j->unit->job &&
-                                job_type_is_conflicting(j->type, j->unit->job->type);
-
-                        if (!stops_running_service && !changes_existing_job)
-                                continue;
-
-                        if (stops_running_service)
-                                log_debug_unit(j->unit->id,
-                                               "%s/%s would stop a running service.",
-                                               j->unit->id, job_type_to_string(j->type));
+        HASHMAP_FOREACH(j, tr->jobs, i)
+                units[n++] = j->unit;
 
-                        if (changes_existing_job)
-                                log_debug_unit(j->unit->id,
-                                               "%s/%s would change existing job.",
-                                               j->unit->id, job_type_to_string(j->type));
+        for (k = 0; k < n; k++)
+                while ((j = hashmap_get(tr->jobs, units[k])) &&
+                       (j = transaction_find_impacting_job(j))) {
 
                         /* Ok, let's get rid of this */
                         log_debug_unit(j->unit->id,
@@ -562,8 +788,26 @@ rescan:
                                        j->unit->id, job_type_to_string(j->type));
 
                         transaction_delete_job(tr, j, true);
-                        goto rescan;
                 }
+
+        free(units);
+        return;
+
+fallback:
+        free(units);
+
+rescan:
+        HASHMAP_FOREACH(j, tr->jobs, i) {
+                j = transaction_find_impacting_job(j);
+                if (!j)
+                        continue;
+
+                log_debug_unit(j->unit->id,
+                               "Deleting %s/%s to minimize impact.",
+                               j->unit->id, job_type_to_string(j->type));
+
+                transaction_delete_job(tr, j, true);
+                goto rescan;
         }
 }
 
@@ -48,6 +48,7 @@
 #include "mkdir.h"
 #include "label.h"
 #include "fileio-label.h"
+#include "mempool.h"
 
 const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX] = {
         [UNIT_SERVICE] = &service_vtable,
@@ -62,19 +63,55 @@ const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX] = {
         [UNIT_PATH] = &path_vtable
 };
 
+/* Units are allocated from one pool per object size, i.e. roughly
+ * one per unit type, so that units of the same type end up next to
+ * each other in memory */
+static struct mempool unit_pools[_UNIT_TYPE_MAX];
+
+static struct mempool *unit_pool_for_size(size_t size) {
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(unit_pools); i++) {
+                if (unit_pools[i].tile_size == size)
+                        return unit_pools + i;
+
+                if (unit_pools[i].tile_size == 0) {
+                        unit_pools[i].tile_size = size;
+                        unit_pools[i].at_least = 64;
+                        return unit_pools + i;
+                }
+        }
+
+        return NULL;
+}
+
+static void unit_release(Unit *u) {
+        if (u->mempool)
+                mempool_free_tile(u->mempool, u);
+        else
+                free(u);
+}
+
 Unit *unit_new(Manager *m, size_t size) {
+        struct mempool *mp;
         Unit *u;
 
         assert(m);
         assert(size >= sizeof(Unit));
 
-        u = malloc0(size);
+        mp = unit_pool_for_size(size);
+        if (mp)
+                u = mempool_alloc0_tile(mp);
+        else
+                u = malloc0(size);
         if (!u)
                 return NULL;
 
+        u->mempool = mp;
+
         u->names = set_new(string_hash_func, string_compare_func);
         if (!u->names) {
-                free(u);
+                unit_release(u);
                 return NULL;
         }
 
@@ -300,6 +337,12 @@ void unit_add_to_gc_queue(Unit *u) {
         if (unit_check_gc(u))
                 return;
 
+        /* Forget anything a GC pass that is still in progress might
+         * have concluded about this unit already, unless it is the
+         * GC itself that requeues it */
+        if (!u->manager->gc_sweeping)
+                u->gc_marker = 0;
+
         LIST_PREPEND(Unit, gc_queue, u->manager->gc_queue, u);
         u->in_gc_queue = true;
 
@@ -326,6 +369,20 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
+void unit_remove_from_dbus_queue(Unit *u) {
+        assert(u);
+
+        if (!u->in_dbus_queue)
+                return;
+
+        if (u->in_dbus_deferred)
+                LIST_REMOVE(Unit, dbus_queue, u->manager->dbus_unit_deferred, u);
+        else
+                LIST_REMOVE(Unit, dbus_queue, u->manager->dbus_unit_queue, u);
+
+        u->in_dbus_queue = u->in_dbus_deferred = false;
+}
+
 static void bidi_set_free(Unit *u, Set *s) {
         Iterator i;
         Unit *other;
@@ -389,8 +446,7 @@ void unit_free(Unit *u) {
         if (u->in_load_queue)
                 LIST_REMOVE(Unit, load_queue, u->manager->load_queue, u);
 
-        if (u->in_dbus_queue)
-                LIST_REMOVE(Unit, dbus_queue, u->manager->dbus_unit_queue, u);
+        unit_remove_from_dbus_queue(u);
 
         if (u->in_cleanup_queue)
                 LIST_REMOVE(Unit, cleanup_queue, u->manager->cleanup_queue, u);
@@ -408,6 +464,7 @@ void unit_free(Unit *u) {
         free(u->fragment_path);
         free(u->source_path);
         free(u->instance);
+        free(u->bus_property_digests);
 
         set_free_free(u->names);
 
@@ -416,7 +473,7 @@ void unit_free(Unit *u) {
         while (u->refs)
                 unit_ref_unset(u->refs);
 
-        free(u);
+        unit_release(u);
 }
 
 UnitActiveState unit_active_state(Unit *u) {
@@ -40,6 +40,7 @@ typedef struct UnitStatusMessageFormats UnitStatusMessageFormats;
 #include "condition.h"
 #include "install.h"
 #include "unit-name.h"
+#include "dbus-common.h"
 
 enum UnitActiveState {
         UNIT_ACTIVE,
@@ -120,6 +121,9 @@ enum UnitDependency {
 struct Unit {
         Manager *manager;
 
+        /* The pool this object was allocated from, if any */
+        struct mempool *mempool;
+
         UnitType type;
         UnitLoadState load_state;
         Unit *merged_into;
@@ -177,6 +181,12 @@ struct Unit {
         /* D-Bus queue */
         LIST_FIELDS(Unit, dbus_queue);
 
+        /* When the last PropertiesChanged signal for this unit was
+         * sent, and digests of the values it announced, so that the
+         * next one only includes what changed since */
+        usec_t dbus_signal_timestamp;
+        uint64_t *bus_property_digests;
+
         /* Cleanup queue */
         LIST_FIELDS(Unit, cleanup_queue);
 
@@ -226,7 +236,9 @@ struct Unit {
         bool condition_result;
 
         bool in_load_queue:1;
+        bool load_prefetched:1;
         bool in_dbus_queue:1;
+        bool in_dbus_deferred:1;
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
 
@@ -383,6 +395,10 @@ struct UnitVTable {
          * strings, to minimize relocations a little. */
         const char *bus_invalidating_properties;
 
+        /* The property table of the type specific interface, to
+         * check which of the above actually changed */
+        const BusProperty *bus_properties;
+
         /* The interface name */
         const char *bus_interface;
 
@@ -454,6 +470,7 @@ bool unit_check_gc(Unit *u);
 
 void unit_add_to_load_queue(Unit *u);
 void unit_add_to_dbus_queue(Unit *u);
+void unit_remove_from_dbus_queue(Unit *u);
 void unit_add_to_cleanup_queue(Unit *u);
 void unit_add_to_gc_queue(Unit *u);
 
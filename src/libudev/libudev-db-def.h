@@ -0,0 +1,89 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifndef _LIBUDEV_DB_DEF_H_
+#define _LIBUDEV_DB_DEF_H_
+
+#include <stdint.h>
+
+#include "macro.h"
+
+/*
+ * DISCLAIMER - The file format mentioned here is private to udev/libudev,
+ *              and may be changed without notice.
+ *
+ * The database of the devices is a copy of the files in /run/udev/data,
+ * which can be mapped by the readers. It lives in /run and is only read
+ * on the machine which wrote it, all values are in native byte order.
+ *
+ * The records of all devices are written, sorted by device id, followed
+ * by an index of the records, and an index of the records by tag. Every
+ * change of a device is appended as a new record, the last record of a
+ * device in the appended part is the current one. The file is re-created
+ * by udevd to merge the appended records; a replaced file is marked as
+ * obsolete, and the readers switch to the new one.
+ */
+
+#define UDEV_DB_SIG { 'U', 'D', 'E', 'V', 'D', 'B', '0', '1' }
+
+struct udev_db_header_f {
+        uint8_t signature[8];
+
+        /* size of structures to allow them to grow */
+        uint64_t header_size;
+        uint64_t record_size;
+        uint64_t tag_size;
+
+        /* array of record offsets, sorted by device id */
+        uint64_t index_off;
+        uint64_t index_count;
+
+        /* array of tags, sorted by name */
+        uint64_t tags_off;
+        uint64_t tags_count;
+
+        /* appended records; the end is moved after a record is written */
+        uint64_t tail_off;
+        uint64_t tail_end;
+        uint64_t tail_count;
+
+        /* the file was replaced, or the appended records are not complete */
+        uint64_t obsolete;
+} _packed_;
+
+#define UDEV_DB_RECORD_DELETED                  (1 << 0)
+
+/* followed by the id and the text of the database file, both NUL terminated */
+struct udev_db_record_f {
+        /* size of the record, including the strings and the alignment */
+        uint32_t size;
+        uint32_t flags;
+        uint32_t id_len;
+        uint32_t data_len;
+} _packed_;
+
+struct udev_db_tag_f {
+        uint64_t name_off;
+
+        /* array of record offsets, sorted by device id */
+        uint64_t entries_off;
+        uint64_t entries_count;
+} _packed_;
+
+#endif
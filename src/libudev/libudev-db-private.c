@@ -0,0 +1,650 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "libudev-db-def.h"
+#include "hashmap.h"
+#include "fileio.h"
+
+struct db_entry {
+        char *id;
+        char *data;
+        size_t len;
+        uint64_t off;
+};
+
+struct db_tag {
+        char *name;
+        uint64_t name_off;
+        uint64_t *entries;
+        size_t entries_count;
+        size_t entries_allocated;
+        uint64_t entries_off;
+};
+
+static int db_entry_cmp(const void *a, const void *b)
+{
+        const struct db_entry *e1 = a;
+        const struct db_entry *e2 = b;
+
+        return strcmp(e1->id, e2->id);
+}
+
+static int db_tag_cmp(const void *a, const void *b)
+{
+        const struct db_tag *t1 = *(const struct db_tag **)a;
+        const struct db_tag *t2 = *(const struct db_tag **)b;
+
+        return strcmp(t1->name, t2->name);
+}
+
+static uint64_t db_align(FILE *f)
+{
+        off_t pos = ftello(f);
+        static const char zeros[8];
+
+        if (pos % 8)
+                fwrite(zeros, 8 - (pos % 8), 1, f);
+        return ftello(f);
+}
+
+static void db_write_record(FILE *f, const char *id, const char *data, size_t len, uint32_t flags)
+{
+        static const char zeros[8];
+        struct udev_db_record_f rec = {
+                .flags = flags,
+                .id_len = strlen(id),
+                .data_len = len,
+        };
+        size_t size;
+
+        size = sizeof(struct udev_db_record_f) + rec.id_len + 1 + rec.data_len + 1;
+        rec.size = ALIGN_TO(size, 8);
+
+        fwrite(&rec, sizeof(struct udev_db_record_f), 1, f);
+        fwrite(id, rec.id_len + 1, 1, f);
+        fwrite(data, len, 1, f);
+        fwrite(zeros, 1 + rec.size - size, 1, f);
+}
+
+static int db_add_tags(Hashmap *tags, const char *data, uint64_t off)
+{
+        const char *s = data;
+
+        for (;;) {
+                const char *eol = strchrnul(s, '\n');
+
+                if (startswith(s, "G:") && eol - s > 2) {
+                        _cleanup_free_ char *name = NULL;
+                        struct db_tag *t;
+
+                        name = strndup(s + 2, eol - s - 2);
+                        if (name == NULL)
+                                return -ENOMEM;
+
+                        t = hashmap_get(tags, name);
+                        if (t == NULL) {
+                                t = new0(struct db_tag, 1);
+                                if (t == NULL)
+                                        return -ENOMEM;
+                                t->name = name;
+                                name = NULL;
+                                if (hashmap_put(tags, t->name, t) < 0) {
+                                        free(t->name);
+                                        free(t);
+                                        return -ENOMEM;
+                                }
+                        }
+
+                        if (!GREEDY_REALLOC(t->entries, t->entries_allocated, t->entries_count + 1))
+                                return -ENOMEM;
+                        t->entries[t->entries_count++] = off;
+                }
+
+                if (eol[0] == '\0')
+                        return 0;
+                s = eol + 1;
+        }
+}
+
+static int db_mark_obsolete(int fd)
+{
+        uint64_t obsolete = 1;
+
+        if (pwrite(fd, &obsolete, sizeof(obsolete), offsetof(struct udev_db_header_f, obsolete)) != sizeof(obsolete))
+                return -EIO;
+        return 0;
+}
+
+/* opens and locks the current database, NULL if there is none */
+static int db_open_locked(const char *filename, struct udev_db_header_f *h)
+{
+        unsigned int i;
+
+        /* the file might get replaced while we wait for the lock */
+        for (i = 0; i < 8; i++) {
+                int fd;
+
+                fd = open(filename, O_RDWR|O_CLOEXEC);
+                if (fd < 0)
+                        return -errno;
+
+                if (flock(fd, LOCK_EX) < 0 ||
+                    pread(fd, h, sizeof(struct udev_db_header_f), 0) != sizeof(struct udev_db_header_f) ||
+                    h->header_size != sizeof(struct udev_db_header_f)) {
+                        close(fd);
+                        return -EIO;
+                }
+
+                if (!h->obsolete)
+                        return fd;
+                close(fd);
+        }
+
+        return -EBUSY;
+}
+
+static void db_entries_free(struct db_entry *entries, size_t entries_count)
+{
+        size_t i;
+
+        for (i = 0; i < entries_count; i++) {
+                free(entries[i].id);
+                free(entries[i].data);
+        }
+        free(entries);
+}
+
+/* the files in dir, which are the current state of all devices */
+static int db_read_dir(const char *dir, struct db_entry **ret, size_t *ret_count)
+{
+        struct db_entry *entries = NULL;
+        size_t entries_count = 0, entries_allocated = 0;
+        DIR *d;
+        struct dirent *dent;
+        int err = 0;
+
+        d = opendir(dir);
+        if (d == NULL)
+                return -errno;
+
+        for (dent = readdir(d); dent != NULL; dent = readdir(d)) {
+                char path[UTIL_PATH_SIZE];
+                struct db_entry *e;
+
+                if (dent->d_name[0] == '.' || endswith(dent->d_name, ".tmp"))
+                        continue;
+
+                if (!GREEDY_REALLOC(entries, entries_allocated, entries_count + 1)) {
+                        err = -ENOMEM;
+                        break;
+                }
+                e = &entries[entries_count];
+
+                strscpyl(path, sizeof(path), dir, "/", dent->d_name, NULL);
+                if (read_full_file(path, &e->data, &e->len) < 0)
+                        continue;
+                e->id = strdup(dent->d_name);
+                if (e->id == NULL) {
+                        free(e->data);
+                        err = -ENOMEM;
+                        break;
+                }
+                entries_count++;
+        }
+        closedir(d);
+
+        if (err < 0) {
+                db_entries_free(entries, entries_count);
+                return err;
+        }
+
+        *ret = entries;
+        *ret_count = entries_count;
+        return 0;
+}
+
+static const struct udev_db_record_f *db_read_record(const char *map, uint64_t off, uint64_t end)
+{
+        const struct udev_db_record_f *rec;
+        const char *id;
+
+        if (off > end || end - off < sizeof(struct udev_db_record_f))
+                return NULL;
+
+        rec = (const struct udev_db_record_f *)(map + off);
+        if (rec->size < sizeof(struct udev_db_record_f) + 2 || rec->size > end - off ||
+            (uint64_t)rec->id_len + rec->data_len + 2 > rec->size - sizeof(struct udev_db_record_f))
+                return NULL;
+
+        id = (const char *)rec + sizeof(struct udev_db_record_f);
+        if (id[rec->id_len] != '\0' || id[rec->id_len + 1 + rec->data_len] != '\0')
+                return NULL;
+
+        return rec;
+}
+
+/* sets the current record of a device, the last one wins */
+static int db_entry_set(struct db_entry **entries, size_t *entries_count, size_t *entries_allocated,
+                        Hashmap *ids, const struct udev_db_record_f *rec)
+{
+        const char *id = (const char *)rec + sizeof(struct udev_db_record_f);
+        const char *data = id + rec->id_len + 1;
+        struct db_entry *e;
+        unsigned int i;
+
+        i = PTR_TO_UINT(hashmap_get(ids, id));
+        if (i > 0) {
+                e = &(*entries)[i - 1];
+                free(e->data);
+                e->data = NULL;
+        } else {
+                if (!GREEDY_REALLOC(*entries, *entries_allocated, *entries_count + 1))
+                        return -ENOMEM;
+                e = &(*entries)[*entries_count];
+                zero(*e);
+
+                e->id = strdup(id);
+                if (e->id == NULL)
+                        return -ENOMEM;
+                (*entries_count)++;
+
+                if (hashmap_put(ids, e->id, UINT_TO_PTR(*entries_count)) < 0)
+                        return -ENOMEM;
+        }
+
+        /* a deleted device has no data */
+        if (rec->flags & UDEV_DB_RECORD_DELETED)
+                return 0;
+
+        e->data = strndup(data, rec->data_len);
+        if (e->data == NULL)
+                return -ENOMEM;
+        e->len = rec->data_len;
+        return 0;
+}
+
+/* the records of the locked database file, with the appended ones merged */
+static int db_read_file(int fd, const struct udev_db_header_f *h, struct db_entry **ret, size_t *ret_count)
+{
+        struct db_entry *entries = NULL;
+        size_t entries_count = 0, entries_allocated = 0, i, n;
+        Hashmap *ids = NULL;
+        const uint64_t *index;
+        const struct udev_db_record_f *rec;
+        const char *map;
+        struct stat st;
+        uint64_t off;
+        int err = 0;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (h->tail_off > h->tail_end || h->tail_end > (uint64_t)st.st_size ||
+            h->index_off > h->tail_off || h->index_count > (h->tail_off - h->index_off) / sizeof(uint64_t))
+                return -EINVAL;
+
+        map = mmap(NULL, h->tail_end, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        ids = hashmap_new(string_hash_func, string_compare_func);
+        if (ids == NULL) {
+                err = -ENOMEM;
+                goto out;
+        }
+
+        index = (const uint64_t *)(map + h->index_off);
+        for (i = 0; i < h->index_count; i++) {
+                rec = db_read_record(map, index[i], h->tail_off);
+                if (rec == NULL) {
+                        err = -EINVAL;
+                        goto out;
+                }
+                err = db_entry_set(&entries, &entries_count, &entries_allocated, ids, rec);
+                if (err < 0)
+                        goto out;
+        }
+
+        for (off = h->tail_off; off < h->tail_end; off += rec->size) {
+                rec = db_read_record(map, off, h->tail_end);
+                if (rec == NULL) {
+                        err = -EINVAL;
+                        goto out;
+                }
+                err = db_entry_set(&entries, &entries_count, &entries_allocated, ids, rec);
+                if (err < 0)
+                        goto out;
+        }
+
+        /* drop the deleted devices */
+        for (i = 0, n = 0; i < entries_count; i++) {
+                if (entries[i].data == NULL) {
+                        free(entries[i].id);
+                        continue;
+                }
+                entries[n++] = entries[i];
+        }
+        entries_count = n;
+out:
+        hashmap_free(ids);
+        munmap((void *)map, h->tail_end);
+
+        if (err < 0) {
+                db_entries_free(entries, entries_count);
+                return err;
+        }
+
+        *ret = entries;
+        *ret_count = entries_count;
+        return 0;
+}
+
+/* writes the records sorted by id, with their indexes, to a new file */
+static int db_write(struct udev *udev, const char *filename, struct db_entry *entries, size_t entries_count)
+{
+        struct udev_db_header_f h = {
+                .signature = UDEV_DB_SIG,
+                .header_size = sizeof(struct udev_db_header_f),
+                .record_size = sizeof(struct udev_db_record_f),
+                .tag_size = sizeof(struct udev_db_tag_f),
+        };
+        Hashmap *tags = NULL;
+        struct db_tag **tags_sorted = NULL;
+        struct db_tag *t;
+        Iterator it;
+        char *filename_tmp = NULL;
+        FILE *f = NULL;
+        size_t i, n;
+        int err = 0;
+
+        qsort(entries, entries_count, sizeof(struct db_entry), db_entry_cmp);
+
+        tags = hashmap_new(string_hash_func, string_compare_func);
+        if (tags == NULL) {
+                err = -ENOMEM;
+                goto out;
+        }
+
+        err = fopen_temporary(filename, &f, &filename_tmp);
+        if (err < 0)
+                goto out;
+        fchmod(fileno(f), 0644);
+
+        fseeko(f, sizeof(struct udev_db_header_f), SEEK_SET);
+
+        /* the records, sorted by id */
+        for (i = 0; i < entries_count; i++) {
+                entries[i].off = db_align(f);
+                db_write_record(f, entries[i].id, entries[i].data, entries[i].len, 0);
+                err = db_add_tags(tags, entries[i].data, entries[i].off);
+                if (err < 0)
+                        goto out;
+        }
+
+        tags_sorted = new(struct db_tag *, hashmap_size(tags) + 1);
+        if (tags_sorted == NULL) {
+                err = -ENOMEM;
+                goto out;
+        }
+        n = 0;
+        HASHMAP_FOREACH(t, tags, it)
+                tags_sorted[n++] = t;
+        qsort(tags_sorted, n, sizeof(struct db_tag *), db_tag_cmp);
+
+        for (i = 0; i < n; i++) {
+                tags_sorted[i]->name_off = ftello(f);
+                fwrite(tags_sorted[i]->name, strlen(tags_sorted[i]->name) + 1, 1, f);
+        }
+
+        /* the devices of every tag, followed by the index of the tags */
+        for (i = 0; i < n; i++) {
+                tags_sorted[i]->entries_off = db_align(f);
+                fwrite(tags_sorted[i]->entries, sizeof(uint64_t), tags_sorted[i]->entries_count, f);
+        }
+
+        h.tags_off = db_align(f);
+        h.tags_count = n;
+        for (i = 0; i < n; i++) {
+                struct udev_db_tag_f tag = {
+                        .name_off = tags_sorted[i]->name_off,
+                        .entries_off = tags_sorted[i]->entries_off,
+                        .entries_count = tags_sorted[i]->entries_count,
+                };
+
+                fwrite(&tag, sizeof(struct udev_db_tag_f), 1, f);
+        }
+
+        h.index_off = db_align(f);
+        h.index_count = entries_count;
+        for (i = 0; i < entries_count; i++)
+                fwrite(&entries[i].off, sizeof(uint64_t), 1, f);
+
+        h.tail_off = db_align(f);
+        h.tail_end = h.tail_off;
+
+        fseeko(f, 0, SEEK_SET);
+        fwrite(&h, sizeof(struct udev_db_header_f), 1, f);
+
+        fflush(f);
+        if (ferror(f)) {
+                err = -EIO;
+                goto out;
+        }
+
+        if (rename(filename_tmp, filename) < 0) {
+                err = -errno;
+                goto out;
+        }
+
+        udev_dbg(udev, "wrote %s, %zu devices, %zu tags\n", filename, entries_count, n);
+out:
+        if (f != NULL) {
+                fclose(f);
+                if (err < 0)
+                        unlink(filename_tmp);
+        }
+        free(filename_tmp);
+
+        if (tags != NULL) {
+                while ((t = hashmap_steal_first(tags)) != NULL) {
+                        free(t->name);
+                        free(t->entries);
+                        free(t);
+                }
+                hashmap_free(tags);
+        }
+        free(tags_sorted);
+        return err;
+}
+
+/* the readers and writers of the old file switch to the new one */
+static void db_replace(int fd_old, const char *filename, int err)
+{
+        db_mark_obsolete(fd_old);
+        if (err < 0)
+                unlink(filename);
+        close(fd_old);
+}
+
+/*
+ * Writes a new database from the files in dir, which are the current state
+ * of all devices. Appending records to the file being replaced is blocked
+ * until it is marked as obsolete.
+ */
+int udev_db_rebuild(struct udev *udev, const char *dir, const char *filename)
+{
+        struct db_entry *entries = NULL;
+        size_t entries_count = 0;
+        int fd_old;
+        int err;
+
+        /* block the writers of the current file */
+        fd_old = open(filename, O_RDWR|O_CLOEXEC);
+        if (fd_old >= 0)
+                flock(fd_old, LOCK_EX);
+
+        err = db_read_dir(dir, &entries, &entries_count);
+        if (err >= 0)
+                err = db_write(udev, filename, entries, entries_count);
+
+        if (fd_old >= 0)
+                db_replace(fd_old, filename, err);
+
+        db_entries_free(entries, entries_count);
+        return err;
+}
+
+/*
+ * Writes a new database with the appended records merged, from the current
+ * database alone, which is much cheaper than reading all the files in
+ * /run/udev/data again. Returns -ENOENT if there is no current database.
+ */
+int udev_db_compact(struct udev *udev, const char *filename)
+{
+        struct udev_db_header_f h;
+        struct db_entry *entries = NULL;
+        size_t entries_count = 0;
+        int fd_old;
+        int err;
+
+        fd_old = db_open_locked(filename, &h);
+        if (fd_old < 0)
+                return fd_old;
+
+        err = db_read_file(fd_old, &h, &entries, &entries_count);
+        if (err >= 0)
+                err = db_write(udev, filename, entries, entries_count);
+
+        db_replace(fd_old, filename, err);
+
+        db_entries_free(entries, entries_count);
+        return err;
+}
+
+/*
+ * Appends the text of the database file of the device, or with data NULL,
+ * records that the device has none. If that fails, the database is removed,
+ * and the readers use the files in /run/udev/data until udevd writes a new
+ * one.
+ */
+int udev_db_append(struct udev *udev, const char *filename, const char *id, const char *data, size_t len)
+{
+        static const char zeros[8];
+        struct udev_db_header_f h;
+        struct udev_db_record_f rec = {
+                .flags = data == NULL ? UDEV_DB_RECORD_DELETED : 0,
+                .id_len = strlen(id),
+                .data_len = data == NULL ? 0 : len,
+        };
+        struct iovec iov[4];
+        size_t size;
+        uint64_t tail[2];
+        int fd;
+        int err = 0;
+
+        fd = db_open_locked(filename, &h);
+        if (fd == -ENOENT)
+                return 0;
+        if (fd < 0)
+                return fd;
+
+        size = sizeof(struct udev_db_record_f) + rec.id_len + 1 + rec.data_len + 1;
+        rec.size = ALIGN_TO(size, 8);
+
+        iov[0].iov_base = &rec;
+        iov[0].iov_len = sizeof(struct udev_db_record_f);
+        iov[1].iov_base = (char *)id;
+        iov[1].iov_len = rec.id_len + 1;
+        iov[2].iov_base = (char *)strempty(data);
+        iov[2].iov_len = rec.data_len;
+        iov[3].iov_base = (char *)zeros;
+        iov[3].iov_len = 1 + rec.size - size;
+
+        /* the readers only look at records before the end of the tail */
+        if (pwritev(fd, iov, ELEMENTSOF(iov), h.tail_end) != (ssize_t)rec.size) {
+                err = -EIO;
+                goto out;
+        }
+
+        tail[0] = h.tail_end + rec.size;
+        tail[1] = h.tail_count + 1;
+        if (pwrite(fd, tail, sizeof(tail), offsetof(struct udev_db_header_f, tail_end)) != sizeof(tail))
+                err = -EIO;
+out:
+        if (err < 0) {
+                udev_err(udev, "unable to append to %s, removing it\n", filename);
+                db_mark_obsolete(fd);
+                unlink(filename);
+        }
+        close(fd);
+        return err;
+}
+
+/* the readers of the database switch to the files in /run/udev/data */
+int udev_db_invalidate(struct udev *udev, const char *filename)
+{
+        struct udev_db_header_f h;
+        int fd;
+        int err;
+
+        fd = db_open_locked(filename, &h);
+        if (fd == -ENOENT)
+                return 0;
+        if (fd < 0)
+                return fd;
+
+        err = db_mark_obsolete(fd);
+        if (unlink(filename) < 0 && err == 0)
+                err = -errno;
+        close(fd);
+        return err;
+}
+
+/* the number of records appended since the database was written */
+int udev_db_get_tail_count(struct udev *udev, const char *filename, unsigned long long int *count)
+{
+        struct udev_db_header_f h;
+        int fd;
+
+        fd = open(filename, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+        if (pread(fd, &h, sizeof(struct udev_db_header_f), 0) != sizeof(struct udev_db_header_f)) {
+                close(fd);
+                return -EIO;
+        }
+        close(fd);
+
+        *count = h.tail_count;
+        return 0;
+}
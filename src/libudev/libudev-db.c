@@ -0,0 +1,347 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "libudev-db-def.h"
+#include "hashmap.h"
+
+/* the mapped database of the devices, see libudev-db-def.h */
+struct udev_db {
+        struct udev *udev;
+        int fd;
+        const char *map;
+        size_t map_size;
+};
+
+static inline const struct udev_db_header_f *db_header(struct udev_db *db)
+{
+        return (const struct udev_db_header_f *)db->map;
+}
+
+static bool section_valid(struct udev_db *db, uint64_t off, uint64_t count, uint64_t size)
+{
+        uint64_t end = db_header(db)->tail_off;
+
+        if (off > end)
+                return false;
+        if (count > (end - off) / size)
+                return false;
+        return true;
+}
+
+struct udev_db *udev_db_new(struct udev *udev, const char *filename)
+{
+        static const uint8_t sig[] = UDEV_DB_SIG;
+        const struct udev_db_header_f *head;
+        struct udev_db *db;
+        struct stat st;
+
+        db = calloc(1, sizeof(struct udev_db));
+        if (db == NULL)
+                return NULL;
+        db->udev = udev;
+
+        db->fd = open(filename, O_RDONLY|O_CLOEXEC);
+        if (db->fd < 0)
+                goto err;
+
+        if (fstat(db->fd, &st) < 0 || (size_t)st.st_size < sizeof(struct udev_db_header_f))
+                goto err;
+
+        db->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, db->fd, 0);
+        if (db->map == MAP_FAILED) {
+                db->map = NULL;
+                goto err;
+        }
+        db->map_size = st.st_size;
+
+        head = db_header(db);
+        if (memcmp(head->signature, sig, sizeof(head->signature)) != 0 ||
+            head->header_size != sizeof(struct udev_db_header_f) ||
+            head->record_size != sizeof(struct udev_db_record_f) ||
+            head->tag_size != sizeof(struct udev_db_tag_f) ||
+            head->tail_off > db->map_size ||
+            head->obsolete) {
+                udev_dbg(udev, "error recognizing the format of %s\n", filename);
+                goto err;
+        }
+
+        if (!section_valid(db, head->index_off, head->index_count, sizeof(uint64_t)) ||
+            !section_valid(db, head->tags_off, head->tags_count, sizeof(struct udev_db_tag_f))) {
+                udev_dbg(udev, "error reading %s\n", filename);
+                goto err;
+        }
+
+        return db;
+err:
+        udev_db_free(db);
+        return NULL;
+}
+
+struct udev_db *udev_db_free(struct udev_db *db)
+{
+        if (db == NULL)
+                return NULL;
+        if (db->map != NULL)
+                munmap((void *)db->map, db->map_size);
+        if (db->fd >= 0)
+                close(db->fd);
+        free(db);
+        return NULL;
+}
+
+bool udev_db_is_obsolete(struct udev_db *db)
+{
+        return db_header(db)->obsolete != 0;
+}
+
+/* the records appended after we have mapped the file need to be mapped too */
+static int db_map_tail(struct udev_db *db, uint64_t *end)
+{
+        uint64_t tail_end = db_header(db)->tail_end;
+        void *map;
+
+        if (tail_end < db_header(db)->tail_off)
+                return -EINVAL;
+
+        if (tail_end > db->map_size) {
+                map = mremap((void *)db->map, db->map_size, tail_end, MREMAP_MAYMOVE);
+                if (map == MAP_FAILED)
+                        return -errno;
+                db->map = map;
+                db->map_size = tail_end;
+        }
+
+        *end = tail_end;
+        return 0;
+}
+
+static inline const char *record_id(const struct udev_db_record_f *rec)
+{
+        return (const char *)rec + sizeof(struct udev_db_record_f);
+}
+
+static inline const char *record_data(const struct udev_db_record_f *rec)
+{
+        return record_id(rec) + rec->id_len + 1;
+}
+
+static const struct udev_db_record_f *db_record(struct udev_db *db, uint64_t off, uint64_t end)
+{
+        const struct udev_db_record_f *rec;
+
+        if (off > end || end - off < sizeof(struct udev_db_record_f))
+                return NULL;
+
+        rec = (const struct udev_db_record_f *)(db->map + off);
+        if (rec->size < sizeof(struct udev_db_record_f) + 2 || rec->size > end - off ||
+            (uint64_t)rec->id_len + rec->data_len + 2 > rec->size - sizeof(struct udev_db_record_f))
+                return NULL;
+        if (record_id(rec)[rec->id_len] != '\0' || record_data(rec)[rec->data_len] != '\0')
+                return NULL;
+
+        return rec;
+}
+
+static const struct udev_db_record_f *db_lookup_index(struct udev_db *db, const char *id)
+{
+        const struct udev_db_header_f *head = db_header(db);
+        const uint64_t *index = (const uint64_t *)(db->map + head->index_off);
+        uint64_t lo = 0, hi = head->index_count;
+
+        while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                const struct udev_db_record_f *rec;
+                int c;
+
+                rec = db_record(db, index[mid], head->tail_off);
+                if (rec == NULL)
+                        return NULL;
+
+                c = strcmp(id, record_id(rec));
+                if (c == 0)
+                        return rec;
+                if (c < 0)
+                        hi = mid;
+                else
+                        lo = mid + 1;
+        }
+
+        return NULL;
+}
+
+/*
+ * Returns 1 and the text of the database file of the device, 0 if there is
+ * no database file for the device, or a negative error if the database can
+ * not be used. The text stays valid until the database is used again.
+ */
+int udev_db_get(struct udev_db *db, const char *id, const char **data, size_t *len)
+{
+        const struct udev_db_record_f *r, *rec = NULL;
+        size_t id_len = strlen(id);
+        uint64_t off, end;
+        int err;
+
+        err = db_map_tail(db, &end);
+        if (err < 0)
+                return err;
+
+        /* the last appended record of the device is the current one */
+        for (off = db_header(db)->tail_off; off < end; off += r->size) {
+                r = db_record(db, off, end);
+                if (r == NULL)
+                        return -EINVAL;
+                if (r->id_len == id_len && memcmp(record_id(r), id, id_len) == 0)
+                        rec = r;
+        }
+
+        if (rec == NULL)
+                rec = db_lookup_index(db, id);
+
+        if (rec == NULL || rec->flags & UDEV_DB_RECORD_DELETED)
+                return 0;
+
+        *data = record_data(rec);
+        *len = rec->data_len;
+        return 1;
+}
+
+static bool data_has_tag(const char *data, const char *tag)
+{
+        size_t len = strlen(tag);
+        const char *s = data;
+
+        for (;;) {
+                const char *eol = strchrnul(s, '\n');
+
+                if ((size_t)(eol - s) == len + 2 && startswith(s, "G:") && strneq(s + 2, tag, len))
+                        return true;
+                if (eol[0] == '\0')
+                        return false;
+                s = eol + 1;
+        }
+}
+
+static const struct udev_db_tag_f *db_lookup_tag(struct udev_db *db, const char *tag)
+{
+        const struct udev_db_header_f *head = db_header(db);
+        const struct udev_db_tag_f *tags = (const struct udev_db_tag_f *)(db->map + head->tags_off);
+        uint64_t lo = 0, hi = head->tags_count;
+
+        while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                const char *name;
+                int c;
+
+                if (tags[mid].name_off >= head->tail_off)
+                        return NULL;
+                name = db->map + tags[mid].name_off;
+                if (memchr(name, '\0', head->tail_off - tags[mid].name_off) == NULL)
+                        return NULL;
+
+                c = strcmp(tag, name);
+                if (c == 0)
+                        return &tags[mid];
+                if (c < 0)
+                        hi = mid;
+                else
+                        lo = mid + 1;
+        }
+
+        return NULL;
+}
+
+/* adds the ids of all devices with the tag to the list */
+int udev_db_get_tagged(struct udev_db *db, const char *tag, struct udev_list *list)
+{
+        const struct udev_db_header_f *head;
+        const struct udev_db_tag_f *t;
+        const struct udev_db_record_f *r;
+        Hashmap *tail;
+        Iterator i;
+        uint64_t off, end;
+        int err;
+
+        err = db_map_tail(db, &end);
+        if (err < 0)
+                return err;
+        head = db_header(db);
+
+        tail = hashmap_new(string_hash_func, string_compare_func);
+        if (tail == NULL)
+                return -ENOMEM;
+
+        /* the appended records replace the ones in the index */
+        for (off = head->tail_off; off < end; off += r->size) {
+                r = db_record(db, off, end);
+                if (r == NULL) {
+                        err = -EINVAL;
+                        goto out;
+                }
+                err = hashmap_replace(tail, record_id(r), (void *)r);
+                if (err < 0)
+                        goto out;
+        }
+
+        t = db_lookup_tag(db, tag);
+        if (t != NULL) {
+                const uint64_t *entries;
+                uint64_t n;
+
+                if (!section_valid(db, t->entries_off, t->entries_count, sizeof(uint64_t))) {
+                        err = -EINVAL;
+                        goto out;
+                }
+
+                entries = (const uint64_t *)(db->map + t->entries_off);
+                for (n = 0; n < t->entries_count; n++) {
+                        r = db_record(db, entries[n], head->tail_off);
+                        if (r == NULL) {
+                                err = -EINVAL;
+                                goto out;
+                        }
+                        if (hashmap_get(tail, record_id(r)) != NULL)
+                                continue;
+                        udev_list_entry_add(list, record_id(r), NULL);
+                }
+        }
+
+        HASHMAP_FOREACH(r, tail, i) {
+                if (r->flags & UDEV_DB_RECORD_DELETED)
+                        continue;
+                if (!data_has_tag(record_data(r), tag))
+                        continue;
+                udev_list_entry_add(list, record_id(r), NULL);
+        }
+
+        err = 0;
+out:
+        hashmap_free(tail);
+        return err;
+}
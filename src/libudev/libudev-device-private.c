@@ -108,6 +108,8 @@ int udev_device_update_db(struct udev_device *udev_device)
         const char *id;
         char filename[UTIL_PATH_SIZE];
         char filename_tmp[UTIL_PATH_SIZE];
+        char *buf = NULL;
+        size_t len = 0;
         FILE *f;
         int r;
 
@@ -123,24 +125,14 @@ int udev_device_update_db(struct udev_device *udev_device)
             major(udev_device_get_devnum(udev_device)) == 0 &&
             udev_device_get_ifindex(udev_device) == 0) {
                 unlink(filename);
+                udev_db_append(udev, UDEV_DB_FILE, id, NULL, 0);
                 return 0;
         }
 
-        /* write a database file */
-        strscpyl(filename_tmp, sizeof(filename_tmp), filename, ".tmp", NULL);
-        mkdir_parents(filename_tmp, 0755);
-        f = fopen(filename_tmp, "we");
-        if (f == NULL) {
-                udev_err(udev, "unable to create temporary db file '%s': %m\n", filename_tmp);
+        /* the same text goes to the database file and the mapped database */
+        f = open_memstream(&buf, &len);
+        if (f == NULL)
                 return -1;
-        }
-
-        /*
-         * set 'sticky' bit to indicate that we should not clean the
-         * database when we transition from initramfs to the real root
-         */
-        if (udev_device_get_db_persist(udev_device))
-                fchmod(fileno(f), 01644);
 
         if (has_info) {
                 struct udev_list_entry *list_entry;
@@ -169,10 +161,37 @@ int udev_device_update_db(struct udev_device *udev_device)
                         fprintf(f, "G:%s\n", udev_list_entry_get_name(list_entry));
         }
 
+        fclose(f);
+        if (buf == NULL)
+                return -1;
+
+        /* write a database file */
+        strscpyl(filename_tmp, sizeof(filename_tmp), filename, ".tmp", NULL);
+        mkdir_parents(filename_tmp, 0755);
+        f = fopen(filename_tmp, "we");
+        if (f == NULL) {
+                udev_err(udev, "unable to create temporary db file '%s': %m\n", filename_tmp);
+                free(buf);
+                return -1;
+        }
+
+        /*
+         * set 'sticky' bit to indicate that we should not clean the
+         * database when we transition from initramfs to the real root
+         */
+        if (udev_device_get_db_persist(udev_device))
+                fchmod(fileno(f), 01644);
+
+        fwrite(buf, len, 1, f);
         fclose(f);
         r = rename(filename_tmp, filename);
-        if (r < 0)
+        if (r < 0) {
+                free(buf);
                 return -1;
+        }
+
+        udev_db_append(udev, UDEV_DB_FILE, id, buf, len);
+        free(buf);
         udev_dbg(udev, "created %s file '%s' for '%s'\n", has_info ? "db" : "empty",
              filename, udev_device_get_devpath(udev_device));
         return 0;
@@ -188,5 +207,6 @@ int udev_device_delete_db(struct udev_device *udev_device)
                 return -1;
         strscpyl(filename, sizeof(filename), "/run/udev/data/", id, NULL);
         unlink(filename);
+        udev_db_append(udev_device_get_udev(udev_device), UDEV_DB_FILE, id, NULL, 0);
         return 0;
 }
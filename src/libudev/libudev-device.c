@@ -510,6 +510,61 @@ _public_ const char *udev_device_get_property_value(struct udev_device *udev_dev
         return udev_list_entry_get_value(list_entry);
 }
 
+static void read_db_line(struct udev_device *udev_device, const char *line)
+{
+        char filename[UTIL_PATH_SIZE];
+        const char *val;
+        struct udev_list_entry *entry;
+
+        val = &line[2];
+        switch(line[0]) {
+        case 'S':
+                strscpyl(filename, sizeof(filename), "/dev/", val, NULL);
+                udev_device_add_devlink(udev_device, filename);
+                break;
+        case 'L':
+                udev_device_set_devlink_priority(udev_device, atoi(val));
+                break;
+        case 'E':
+                entry = udev_device_add_property_from_string(udev_device, val);
+                udev_list_entry_set_num(entry, true);
+                break;
+        case 'G':
+                udev_device_add_tag(udev_device, val);
+                break;
+        case 'W':
+                udev_device_set_watch_handle(udev_device, atoi(val));
+                break;
+        case 'I':
+                udev_device_set_usec_initialized(udev_device, strtoull(val, NULL, 10));
+                break;
+        }
+}
+
+/* the text of a database file, as stored in the mapped database */
+static void read_db_data(struct udev_device *udev_device, const char *data, size_t len)
+{
+        char line[UTIL_LINE_SIZE];
+        const char *s = data;
+        const char *end = data + len;
+
+        while (s < end) {
+                const char *eol;
+                size_t l;
+
+                eol = memchr(s, '\n', end - s);
+                if (eol == NULL)
+                        eol = end;
+                l = eol - s;
+                if (l < 3 || l >= sizeof(line))
+                        break;
+                memcpy(line, s, l);
+                line[l] = '\0';
+                read_db_line(udev_device, line);
+                s = eol + 1;
+        }
+}
+
 int udev_device_read_db(struct udev_device *udev_device, const char *dbfile)
 {
         char filename[UTIL_PATH_SIZE];
@@ -519,6 +574,7 @@ int udev_device_read_db(struct udev_device *udev_device, const char *dbfile)
         /* providing a database file will always force-load it */
         if (dbfile == NULL) {
                 const char *id;
+                struct udev_db *db;
 
                 if (udev_device->db_loaded)
                         return 0;
@@ -527,6 +583,27 @@ int udev_device_read_db(struct udev_device *udev_device, const char *dbfile)
                 id = udev_device_get_id_filename(udev_device);
                 if (id == NULL)
                         return -1;
+
+                /* the mapped database, if udevd maintains it, knows about all devices */
+                db = udev_get_db(udev_device->udev);
+                if (db != NULL) {
+                        const char *data;
+                        size_t len;
+                        int r;
+
+                        r = udev_db_get(db, id, &data, &len);
+                        if (r == 0) {
+                                udev_dbg(udev_device->udev, "no db entry for %s\n", id);
+                                return -1;
+                        }
+                        if (r > 0) {
+                                udev_device->is_initialized = true;
+                                read_db_data(udev_device, data, len);
+                                udev_dbg(udev_device->udev, "device %p filled with db data\n", udev_device);
+                                return 0;
+                        }
+                }
+
                 strscpyl(filename, sizeof(filename), "/run/udev/data/", id, NULL);
                 dbfile = filename;
         }
@@ -540,36 +617,12 @@ int udev_device_read_db(struct udev_device *udev_device, const char *dbfile)
 
         while (fgets(line, sizeof(line), f)) {
                 ssize_t len;
-                const char *val;
-                struct udev_list_entry *entry;
 
                 len = strlen(line);
                 if (len < 4)
                         break;
                 line[len-1] = '\0';
-                val = &line[2];
-                switch(line[0]) {
-                case 'S':
-                        strscpyl(filename, sizeof(filename), "/dev/", val, NULL);
-                        udev_device_add_devlink(udev_device, filename);
-                        break;
-                case 'L':
-                        udev_device_set_devlink_priority(udev_device, atoi(val));
-                        break;
-                case 'E':
-                        entry = udev_device_add_property_from_string(udev_device, val);
-                        udev_list_entry_set_num(entry, true);
-                        break;
-                case 'G':
-                        udev_device_add_tag(udev_device, val);
-                        break;
-                case 'W':
-                        udev_device_set_watch_handle(udev_device, atoi(val));
-                        break;
-                case 'I':
-                        udev_device_set_usec_initialized(udev_device, strtoull(val, NULL, 10));
-                        break;
-                }
+                read_db_line(udev_device, line);
         }
         fclose(f);
 
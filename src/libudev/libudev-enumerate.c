@@ -24,8 +24,10 @@
 #include <errno.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/param.h>
 
@@ -67,6 +69,7 @@ struct udev_enumerate {
         unsigned int devices_max;
         bool devices_uptodate:1;
         bool match_is_initialized;
+        unsigned int threads;
 };
 
 /**
@@ -256,6 +259,12 @@ static size_t devices_delay_later(struct udev *udev, const char *syspath)
         return 0;
 }
 
+/* For devices the sorted list moves behind devices sorting after them */
+bool udev_enumerate_syspath_delayed(struct udev *udev, const char *syspath)
+{
+        return devices_delay_end(udev, syspath) || devices_delay_later(udev, syspath) > 0;
+}
+
 /**
  * udev_enumerate_get_list_entry:
  * @udev_enumerate: context
@@ -529,6 +538,18 @@ _public_ int udev_enumerate_add_match_is_initialized(struct udev_enumerate *udev
         return 0;
 }
 
+/*
+ * Read the directories of the subsystems with several threads in
+ * udev_enumerate_scan_devices(); 0 or 1 reads them one after the other.
+ */
+int udev_enumerate_set_threads(struct udev_enumerate *udev_enumerate, unsigned int threads)
+{
+        if (udev_enumerate == NULL)
+                return -EINVAL;
+        udev_enumerate->threads = threads;
+        return 0;
+}
+
 /**
  * udev_enumerate_add_match_sysname:
  * @udev_enumerate: context
@@ -649,71 +670,356 @@ static bool match_sysname(struct udev_enumerate *udev_enumerate, const char *sys
         return false;
 }
 
-static int scan_dir_and_add_devices(struct udev_enumerate *udev_enumerate,
-                                    const char *basedir, const char *subdir1, const char *subdir2)
+enum {
+        ENTRY_NOMATCH,
+        ENTRY_MATCH,
+        ENTRY_DEVICE,
+};
+
+/*
+ * Read a sys attribute like udev_device_get_sysattr_value(), without
+ * creating the device. Returns 1 for a value, 0 for no value, and
+ * -EAGAIN for links to other devices, which only the device resolves.
+ */
+static int sysattr_read(const char *syspath, const char *sysattr, char *value, size_t size)
 {
         char path[UTIL_PATH_SIZE];
+        struct stat statbuf;
+        int fd;
+        ssize_t len;
+
+        strscpyl(path, sizeof(path), syspath, "/", sysattr, NULL);
+        if (lstat(path, &statbuf) != 0)
+                return 0;
+
+        if (S_ISLNK(statbuf.st_mode)) {
+                if (streq(sysattr, "driver") ||
+                    streq(sysattr, "subsystem") ||
+                    streq(sysattr, "module"))
+                        return util_get_sys_core_link_value(NULL, sysattr, syspath, value, size) < 0 ? 0 : 1;
+                if (streq(sysattr, "device"))
+                        return 0;
+                return -EAGAIN;
+        }
+
+        if (S_ISDIR(statbuf.st_mode))
+                return 0;
+        if ((statbuf.st_mode & S_IRUSR) == 0)
+                return 0;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return 0;
+        len = read(fd, value, size);
+        close(fd);
+        if (len < 0 || (size_t)len == size)
+                return 0;
+        value[len] = '\0';
+        util_remove_trailing_chars(value, '\n');
+        return 1;
+}
+
+static int match_sysattr_entry(const char *syspath, const char *sysattr, const char *match_val)
+{
+        char value[4096];
+        int r;
+
+        r = sysattr_read(syspath, sysattr, value, sizeof(value));
+        if (r <= 0)
+                return r;
+        if (match_val == NULL)
+                return 1;
+        return fnmatch(match_val, value, 0) == 0;
+}
+
+/* match_sysattr() on the attribute files, without the device */
+static int match_sysattr_syspath(struct udev_enumerate *udev_enumerate, const char *syspath)
+{
+        struct udev_list_entry *list_entry;
+        int r;
+
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_enumerate->sysattr_nomatch_list)) {
+                r = match_sysattr_entry(syspath, udev_list_entry_get_name(list_entry),
+                                        udev_list_entry_get_value(list_entry));
+                if (r < 0)
+                        return ENTRY_DEVICE;
+                if (r > 0)
+                        return ENTRY_NOMATCH;
+        }
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_enumerate->sysattr_match_list)) {
+                r = match_sysattr_entry(syspath, udev_list_entry_get_name(list_entry),
+                                        udev_list_entry_get_value(list_entry));
+                if (r < 0)
+                        return ENTRY_DEVICE;
+                if (r == 0)
+                        return ENTRY_NOMATCH;
+        }
+        return ENTRY_MATCH;
+}
+
+/*
+ * Check a directory entry with the matches which only need the name and
+ * the files in /sys, and leave the matches which need the udev_device
+ * to the caller. Does not touch the udev context, it is called from
+ * several threads at once.
+ */
+static int entry_check(struct udev_enumerate *udev_enumerate, const char *path, const char *name,
+                       char *syspath, size_t size)
+{
+        char file[UTIL_PATH_SIZE];
+        struct stat statbuf;
+        int r;
+
+        if (name[0] == '.')
+                return ENTRY_NOMATCH;
+        if (!match_sysname(udev_enumerate, name))
+                return ENTRY_NOMATCH;
+
+        /* the same checks as udev_device_new_from_syspath() */
+        strscpyl(syspath, size, path, "/", name, NULL);
+        util_resolve_sys_link(NULL, syspath, size);
+        if (startswith(syspath + strlen("/sys"), "/devices/")) {
+                strscpyl(file, sizeof(file), syspath, "/uevent", NULL);
+                if (stat(file, &statbuf) != 0)
+                        return ENTRY_NOMATCH;
+        } else {
+                if (stat(syspath, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode))
+                        return ENTRY_NOMATCH;
+        }
+
+        if (udev_enumerate->parent_match != NULL &&
+            !startswith(syspath + strlen("/sys"), udev_device_get_devpath(udev_enumerate->parent_match)))
+                return ENTRY_NOMATCH;
+
+        r = match_sysattr_syspath(udev_enumerate, syspath);
+        if (r != ENTRY_MATCH)
+                return r;
+
+        /* the state, the properties and the tags are only known to the device */
+        if (udev_enumerate->match_is_initialized ||
+            udev_list_get_entry(&udev_enumerate->properties_match_list) != NULL ||
+            udev_list_get_entry(&udev_enumerate->tags_match_list) != NULL)
+                return ENTRY_DEVICE;
+
+        return ENTRY_MATCH;
+}
+
+static void device_check_add(struct udev_enumerate *udev_enumerate, const char *syspath)
+{
+        struct udev_device *dev;
+
+        dev = udev_device_new_from_syspath(udev_enumerate->udev, syspath);
+        if (dev == NULL)
+                return;
+
+        if (udev_enumerate->match_is_initialized) {
+                /*
+                 * All devices with a device node or network interfaces
+                 * possibly need udev to adjust the device node permission
+                 * or context, or rename the interface before it can be
+                 * reliably used from other processes.
+                 *
+                 * For now, we can only check these types of devices, we
+                 * might not store a database, and have no way to find out
+                 * for all other types of devices.
+                 */
+                if (!udev_device_get_is_initialized(dev) &&
+                    (major(udev_device_get_devnum(dev)) > 0 || udev_device_get_ifindex(dev) > 0))
+                        goto nomatch;
+        }
+        if (!match_parent(udev_enumerate, dev))
+                goto nomatch;
+        if (!match_tag(udev_enumerate, dev))
+                goto nomatch;
+        if (!match_property(udev_enumerate, dev))
+                goto nomatch;
+        if (!match_sysattr(udev_enumerate, dev))
+                goto nomatch;
+
+        syspath_add(udev_enumerate, udev_device_get_syspath(dev));
+nomatch:
+        udev_device_unref(dev);
+}
+
+static void dir_path(char *path, size_t size, const char *basedir, const char *subdir1, const char *subdir2)
+{
         size_t l;
         char *s;
-        DIR *dir;
-        struct dirent *dent;
 
         s = path;
-        l = strpcpyl(&s, sizeof(path), "/sys/", basedir, NULL);
+        l = strpcpyl(&s, size, "/sys/", basedir, NULL);
         if (subdir1 != NULL)
                 l = strpcpyl(&s, l, "/", subdir1, NULL);
         if (subdir2 != NULL)
                 strpcpyl(&s, l, "/", subdir2, NULL);
+}
+
+static int scan_dir_and_add_devices(struct udev_enumerate *udev_enumerate,
+                                    const char *basedir, const char *subdir1, const char *subdir2)
+{
+        char path[UTIL_PATH_SIZE];
+        DIR *dir;
+        struct dirent *dent;
+
+        dir_path(path, sizeof(path), basedir, subdir1, subdir2);
         dir = opendir(path);
         if (dir == NULL)
                 return -ENOENT;
         for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
                 char syspath[UTIL_PATH_SIZE];
-                struct udev_device *dev;
 
-                if (dent->d_name[0] == '.')
-                        continue;
+                switch (entry_check(udev_enumerate, path, dent->d_name, syspath, sizeof(syspath))) {
+                case ENTRY_MATCH:
+                        syspath_add(udev_enumerate, syspath);
+                        break;
+                case ENTRY_DEVICE:
+                        device_check_add(udev_enumerate, syspath);
+                        break;
+                }
+        }
+        closedir(dir);
+        return 0;
+}
 
-                if (!match_sysname(udev_enumerate, dent->d_name))
-                        continue;
+/*
+ * The directories of the subsystems are read by several threads, which
+ * collect the syspaths of the matching entries; the devices which are
+ * needed for the remaining matches are created afterwards by the caller.
+ */
+#define SCAN_THREADS_MAX 16
 
-                strscpyl(syspath, sizeof(syspath), path, "/", dent->d_name, NULL);
-                dev = udev_device_new_from_syspath(udev_enumerate->udev, syspath);
-                if (dev == NULL)
-                        continue;
+struct scan_job {
+        char *path;
+        char *syspaths;
+        size_t syspaths_len;
+        size_t syspaths_allocated;
+};
 
-                if (udev_enumerate->match_is_initialized) {
-                        /*
-                         * All devices with a device node or network interfaces
-                         * possibly need udev to adjust the device node permission
-                         * or context, or rename the interface before it can be
-                         * reliably used from other processes.
-                         *
-                         * For now, we can only check these types of devices, we
-                         * might not store a database, and have no way to find out
-                         * for all other types of devices.
-                         */
-                        if (!udev_device_get_is_initialized(dev) &&
-                            (major(udev_device_get_devnum(dev)) > 0 || udev_device_get_ifindex(dev) > 0))
-                                goto nomatch;
-                }
-                if (!match_parent(udev_enumerate, dev))
-                        goto nomatch;
-                if (!match_tag(udev_enumerate, dev))
-                        goto nomatch;
-                if (!match_property(udev_enumerate, dev))
-                        goto nomatch;
-                if (!match_sysattr(udev_enumerate, dev))
-                        goto nomatch;
+struct scan_context {
+        struct udev_enumerate *udev_enumerate;
+        struct scan_job *jobs;
+        unsigned int jobs_count;
+        size_t jobs_allocated;
+        unsigned int next_job;
+};
 
-                syspath_add(udev_enumerate, udev_device_get_syspath(dev));
-nomatch:
-                udev_device_unref(dev);
+/* every syspath is stored with the result of the check in front of it */
+static int scan_job_add_syspath(struct scan_job *job, int check, const char *syspath)
+{
+        size_t len;
+
+        len = strlen(syspath);
+        if (!GREEDY_REALLOC(job->syspaths, job->syspaths_allocated, job->syspaths_len + len + 2))
+                return -ENOMEM;
+        job->syspaths[job->syspaths_len] = check;
+        memcpy(job->syspaths + job->syspaths_len + 1, syspath, len + 1);
+        job->syspaths_len += len + 2;
+        return 0;
+}
+
+static void scan_job_run(struct udev_enumerate *udev_enumerate, struct scan_job *job)
+{
+        DIR *dir;
+        struct dirent *dent;
+
+        dir = opendir(job->path);
+        if (dir == NULL)
+                return;
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                char syspath[UTIL_PATH_SIZE];
+                int r;
+
+                r = entry_check(udev_enumerate, job->path, dent->d_name, syspath, sizeof(syspath));
+                if (r == ENTRY_NOMATCH)
+                        continue;
+                if (scan_job_add_syspath(job, r, syspath) < 0)
+                        break;
         }
         closedir(dir);
+}
+
+static void *scan_thread(void *userdata)
+{
+        struct scan_context *c = userdata;
+
+        for (;;) {
+                unsigned int k;
+
+                k = __sync_fetch_and_add(&c->next_job, 1);
+                if (k >= c->jobs_count)
+                        break;
+
+                scan_job_run(c->udev_enumerate, &c->jobs[k]);
+        }
+
+        return NULL;
+}
+
+static int scan_context_add(struct scan_context *c, const char *path)
+{
+        struct scan_job *job;
+
+        if (!GREEDY_REALLOC(c->jobs, c->jobs_allocated, c->jobs_count + 1))
+                return -ENOMEM;
+        job = &c->jobs[c->jobs_count];
+        memset(job, 0, sizeof(struct scan_job));
+        job->path = strdup(path);
+        if (job->path == NULL)
+                return -ENOMEM;
+        c->jobs_count++;
         return 0;
 }
 
+static void scan_context_run(struct scan_context *c)
+{
+        struct udev_enumerate *udev_enumerate = c->udev_enumerate;
+        pthread_t threads[SCAN_THREADS_MAX];
+        unsigned int n_threads = 0, i;
+
+        while (n_threads + 1 < MIN(udev_enumerate->threads, c->jobs_count) && n_threads < SCAN_THREADS_MAX) {
+                int r;
+
+                r = pthread_create(&threads[n_threads], NULL, scan_thread, c);
+                if (r != 0) {
+                        udev_dbg(udev_enumerate->udev, "failed to create scan thread: %s\n", strerror(r));
+                        break;
+                }
+                n_threads++;
+        }
+
+        /* help out, and do everything ourselves if we could not get any threads */
+        scan_thread(c);
+
+        for (i = 0; i < n_threads; i++)
+                pthread_join(threads[i], NULL);
+
+        for (i = 0; i < c->jobs_count; i++) {
+                struct scan_job *job = &c->jobs[i];
+                size_t pos = 0;
+
+                while (pos < job->syspaths_len) {
+                        const char *syspath = job->syspaths + pos + 1;
+
+                        if (job->syspaths[pos] == ENTRY_MATCH)
+                                syspath_add(udev_enumerate, syspath);
+                        else
+                                device_check_add(udev_enumerate, syspath);
+                        pos += strlen(syspath) + 2;
+                }
+        }
+}
+
+static void scan_context_cleanup(struct scan_context *c)
+{
+        unsigned int i;
+
+        for (i = 0; i < c->jobs_count; i++) {
+                free(c->jobs[i].path);
+                free(c->jobs[i].syspaths);
+        }
+        free(c->jobs);
+}
+
 static bool match_subsystem(struct udev_enumerate *udev_enumerate, const char *subsystem)
 {
         struct udev_list_entry *list_entry;
@@ -732,7 +1038,9 @@ static bool match_subsystem(struct udev_enumerate *udev_enumerate, const char *s
         return true;
 }
 
-static int scan_dir(struct udev_enumerate *udev_enumerate, const char *basedir, const char *subdir, const char *subsystem)
+/* scans the directories of the matching subsystems, or only collects them if a context is given */
+static int scan_dir(struct udev_enumerate *udev_enumerate, const char *basedir, const char *subdir, const char *subsystem,
+                    struct scan_context *c)
 {
         char path[UTIL_PATH_SIZE];
         DIR *dir;
@@ -743,11 +1051,19 @@ static int scan_dir(struct udev_enumerate *udev_enumerate, const char *basedir,
         if (dir == NULL)
                 return -1;
         for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                char subdir_path[UTIL_PATH_SIZE];
+
                 if (dent->d_name[0] == '.')
                         continue;
                 if (!match_subsystem(udev_enumerate, subsystem != NULL ? subsystem : dent->d_name))
                         continue;
-                scan_dir_and_add_devices(udev_enumerate, basedir, dent->d_name, subdir);
+                if (c == NULL) {
+                        scan_dir_and_add_devices(udev_enumerate, basedir, dent->d_name, subdir);
+                        continue;
+                }
+                dir_path(subdir_path, sizeof(subdir_path), basedir, dent->d_name, subdir);
+                if (scan_context_add(c, subdir_path) < 0)
+                        break;
         }
         closedir(dir);
         return 0;
@@ -779,6 +1095,30 @@ _public_ int udev_enumerate_add_syspath(struct udev_enumerate *udev_enumerate, c
         return 0;
 }
 
+static void tagged_device_add(struct udev_enumerate *udev_enumerate, const char *id)
+{
+        struct udev_device *dev;
+
+        dev = udev_device_new_from_device_id(udev_enumerate->udev, (char *)id);
+        if (dev == NULL)
+                return;
+
+        if (!match_subsystem(udev_enumerate, udev_device_get_subsystem(dev)))
+                goto nomatch;
+        if (!match_sysname(udev_enumerate, udev_device_get_sysname(dev)))
+                goto nomatch;
+        if (!match_parent(udev_enumerate, dev))
+                goto nomatch;
+        if (!match_property(udev_enumerate, dev))
+                goto nomatch;
+        if (!match_sysattr(udev_enumerate, dev))
+                goto nomatch;
+
+        syspath_add(udev_enumerate, udev_device_get_syspath(dev));
+nomatch:
+        udev_device_unref(dev);
+}
+
 static int scan_devices_tags(struct udev_enumerate *udev_enumerate)
 {
         struct udev_list_entry *list_entry;
@@ -788,35 +1128,34 @@ static int scan_devices_tags(struct udev_enumerate *udev_enumerate)
                 DIR *dir;
                 struct dirent *dent;
                 char path[UTIL_PATH_SIZE];
+                struct udev_db *db;
+
+                /* the mapped database has an index of the tags */
+                db = udev_get_db(udev_enumerate->udev);
+                if (db != NULL) {
+                        struct udev_list ids;
+                        struct udev_list_entry *id_entry;
+                        int r;
+
+                        udev_list_init(udev_enumerate->udev, &ids, false);
+                        r = udev_db_get_tagged(db, udev_list_entry_get_name(list_entry), &ids);
+                        if (r >= 0)
+                                udev_list_entry_foreach(id_entry, udev_list_get_entry(&ids))
+                                        tagged_device_add(udev_enumerate, udev_list_entry_get_name(id_entry));
+                        udev_list_cleanup(&ids);
+                        if (r >= 0)
+                                continue;
+                }
 
                 strscpyl(path, sizeof(path), "/run/udev/tags/", udev_list_entry_get_name(list_entry), NULL);
                 dir = opendir(path);
                 if (dir == NULL)
                         continue;
                 for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
-                        struct udev_device *dev;
-
                         if (dent->d_name[0] == '.')
                                 continue;
 
-                        dev = udev_device_new_from_device_id(udev_enumerate->udev, dent->d_name);
-                        if (dev == NULL)
-                                continue;
-
-                        if (!match_subsystem(udev_enumerate, udev_device_get_subsystem(dev)))
-                                goto nomatch;
-                        if (!match_sysname(udev_enumerate, udev_device_get_sysname(dev)))
-                                goto nomatch;
-                        if (!match_parent(udev_enumerate, dev))
-                                goto nomatch;
-                        if (!match_property(udev_enumerate, dev))
-                                goto nomatch;
-                        if (!match_sysattr(udev_enumerate, dev))
-                                goto nomatch;
-
-                        syspath_add(udev_enumerate, udev_device_get_syspath(dev));
-nomatch:
-                        udev_device_unref(dev);
+                        tagged_device_add(udev_enumerate, dent->d_name);
                 }
                 closedir(dir);
         }
@@ -885,13 +1224,25 @@ static int scan_devices_children(struct udev_enumerate *enumerate)
 static int scan_devices_all(struct udev_enumerate *udev_enumerate)
 {
         struct stat statbuf;
+        struct scan_context c, *context = NULL;
+
+        if (udev_enumerate->threads > 1) {
+                zero(c);
+                c.udev_enumerate = udev_enumerate;
+                context = &c;
+        }
 
         if (stat("/sys/subsystem", &statbuf) == 0) {
                 /* we have /subsystem/, forget all the old stuff */
-                scan_dir(udev_enumerate, "subsystem", "devices", NULL);
+                scan_dir(udev_enumerate, "subsystem", "devices", NULL, context);
         } else {
-                scan_dir(udev_enumerate, "bus", "devices", NULL);
-                scan_dir(udev_enumerate, "class", NULL, NULL);
+                scan_dir(udev_enumerate, "bus", "devices", NULL, context);
+                scan_dir(udev_enumerate, "class", NULL, NULL, context);
+        }
+
+        if (context != NULL) {
+                scan_context_run(context);
+                scan_context_cleanup(context);
         }
         return 0;
 }
@@ -953,6 +1304,6 @@ _public_ int udev_enumerate_scan_subsystems(struct udev_enumerate *udev_enumerat
 
         /* all subsystem drivers */
         if (match_subsystem(udev_enumerate, "drivers"))
-                scan_dir(udev_enumerate, subsysdir, "drivers", "drivers");
+                scan_dir(udev_enumerate, subsysdir, "drivers", "drivers", NULL);
         return 0;
 }
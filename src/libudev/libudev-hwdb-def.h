@@ -71,4 +71,40 @@ struct trie_value_entry_f {
         le64_t value_off;
 } _packed_;
 
+/*
+ * Version 2 of the format, stored in hwdb2.bin next to hwdb.bin. It uses
+ * the same header, with its own signature and the sizes of the version 2
+ * structures. All offsets are 32 bits, the nodes, child arrays and value
+ * arrays are aligned to 4 bytes.
+ */
+#define HWDB_SIG_V2 { 'K', 'S', 'L', 'P', 'H', 'H', 'R', '2' }
+
+/* the children are a table indexed by the character, instead of a sorted array */
+#define TRIE_NODE_DENSE                         (1 << 0)
+/* one of the children is a glob character: '*', '?' or '[' */
+#define TRIE_NODE_GLOB                          (1 << 1)
+
+struct trie_node_f2 {
+        /* prefix of lookup string, shared by all children  */
+        le32_t prefix_off;
+        /* size of value entry array appended to the node */
+        le32_t values_count;
+        /* size of children array or table appended to the node */
+        le16_t children_count;
+        /* character of the first entry of a children table */
+        uint8_t children_first;
+        uint8_t flags;
+} _packed_;
+
+/*
+ * A sorted children array is the array of the characters, padded to 4
+ * bytes, followed by the array of the child node offsets. A children
+ * table is an array of child node offsets, indexed by the character
+ * minus children_first; 0 means no child.
+ */
+struct trie_value_entry_f2 {
+        le32_t key_off;
+        le32_t value_off;
+} _packed_;
+
 #endif
@@ -30,6 +30,7 @@
 
 #include "libudev-private.h"
 #include "libudev-hwdb-def.h"
+#include "hashmap.h"
 
 /**
  * SECTION:libudev-hwdb
@@ -53,10 +54,31 @@ struct udev_hwdb {
                 struct trie_header_f *head;
                 const char *map;
         };
+        bool v2;
 
         struct udev_list properties_list;
+
+        /* the results of the recent lookups, the least recently used first */
+        Hashmap *cache;
+        struct udev_list_node cache_list;
+        unsigned int cache_size;
+
+        /* the key/value pairs added by the current lookup */
+        const char **lookup;
+        size_t lookup_count;
+        size_t lookup_allocated;
 };
 
+/* the properties of a modalias, the keys and values point into the mapped file */
+struct hwdb_cache_entry {
+        struct udev_list_node node;
+        char *modalias;
+        size_t properties_count;
+        const char *properties[];
+};
+
+#define HWDB_CACHE_SIZE 64
+
 struct linebuf {
         char bytes[LINE_MAX];
         size_t size;
@@ -145,6 +167,14 @@ static int hwdb_add_property(struct udev_hwdb *hwdb, const char *key, const char
                 return 0;
         if (udev_list_entry_add(&hwdb->properties_list, key+1, value) == NULL)
                 return -ENOMEM;
+
+        /* the cache refers to the strings of the mapped file */
+        if (hwdb->cache) {
+                if (!GREEDY_REALLOC(hwdb->lookup, hwdb->lookup_allocated, hwdb->lookup_count + 2))
+                        return -ENOMEM;
+                hwdb->lookup[hwdb->lookup_count++] = key+1;
+                hwdb->lookup[hwdb->lookup_count++] = value;
+        }
         return 0;
 }
 
@@ -252,54 +282,308 @@ static int trie_search_f(struct udev_hwdb *hwdb, const char *search) {
         return 0;
 }
 
-/**
- * udev_hwdb_new:
- * @udev: udev library context
- *
- * Create a hardware database context to query properties for devices.
- *
- * Returns: a hwdb context.
- **/
-_public_ struct udev_hwdb *udev_hwdb_new(struct udev *udev) {
+static const struct trie_node_f2 *trie_node_from_off_f2(struct udev_hwdb *hwdb, le32_t off) {
+        return (const struct trie_node_f2 *)(hwdb->map + le32toh(off));
+}
+
+static const char *trie_string_f2(struct udev_hwdb *hwdb, le32_t off) {
+        return hwdb->map + le32toh(off);
+}
+
+static const le32_t *trie_node_children_f2(const struct trie_node_f2 *node) {
+        const char *base = (const char *)node + sizeof(struct trie_node_f2);
+
+        if (node->flags & TRIE_NODE_DENSE)
+                return (const le32_t *)base;
+        return (const le32_t *)(base + ALIGN_TO(le16toh(node->children_count), 4));
+}
+
+static const struct trie_value_entry_f2 *trie_node_values_f2(const struct trie_node_f2 *node) {
+        const char *base = (const char *)trie_node_children_f2(node);
+
+        return (const struct trie_value_entry_f2 *)(base + le16toh(node->children_count) * sizeof(le32_t));
+}
+
+/* the character of the child, and its node or NULL for an empty slot of a table */
+static const struct trie_node_f2 *node_child_f2(struct udev_hwdb *hwdb, const struct trie_node_f2 *node, size_t i, uint8_t *c) {
+        le32_t off = trie_node_children_f2(node)[i];
+
+        if (node->flags & TRIE_NODE_DENSE)
+                *c = node->children_first + i;
+        else
+                *c = ((const uint8_t *)node + sizeof(struct trie_node_f2))[i];
+
+        if (le32toh(off) == 0)
+                return NULL;
+        return trie_node_from_off_f2(hwdb, off);
+}
+
+static const struct trie_node_f2 *node_lookup_f2(struct udev_hwdb *hwdb, const struct trie_node_f2 *node, uint8_t c) {
+        size_t count = le16toh(node->children_count);
+        const uint8_t *chars;
+        const uint8_t *pos;
+
+        if (count == 0)
+                return NULL;
+
+        if (node->flags & TRIE_NODE_DENSE) {
+                le32_t off;
+
+                if (c < node->children_first || (size_t)(c - node->children_first) >= count)
+                        return NULL;
+                off = trie_node_children_f2(node)[c - node->children_first];
+                if (le32toh(off) == 0)
+                        return NULL;
+                return trie_node_from_off_f2(hwdb, off);
+        }
+
+        /* the characters are packed next to each other */
+        chars = (const uint8_t *)node + sizeof(struct trie_node_f2);
+        pos = memchr(chars, c, count);
+        if (!pos)
+                return NULL;
+        return trie_node_from_off_f2(hwdb, trie_node_children_f2(node)[pos - chars]);
+}
+
+static int node_add_values_f2(struct udev_hwdb *hwdb, const struct trie_node_f2 *node) {
+        const struct trie_value_entry_f2 *values = trie_node_values_f2(node);
+        size_t i;
+        int err;
+
+        for (i = 0; i < le32toh(node->values_count); i++) {
+                err = hwdb_add_property(hwdb, trie_string_f2(hwdb, values[i].key_off),
+                                        trie_string_f2(hwdb, values[i].value_off));
+                if (err < 0)
+                        return err;
+        }
+        return 0;
+}
+
+static int trie_fnmatch_f2(struct udev_hwdb *hwdb, const struct trie_node_f2 *node, size_t p,
+                           struct linebuf *buf, const char *search) {
+        size_t len;
+        size_t i;
+        const char *prefix;
+        int err;
+
+        prefix = trie_string_f2(hwdb, node->prefix_off);
+        len = strlen(prefix + p);
+        linebuf_add(buf, prefix + p, len);
+
+        for (i = 0; i < le16toh(node->children_count); i++) {
+                const struct trie_node_f2 *child;
+                uint8_t c;
+
+                child = node_child_f2(hwdb, node, i, &c);
+                if (!child)
+                        continue;
+
+                linebuf_add_char(buf, c);
+                err = trie_fnmatch_f2(hwdb, child, 0, buf, search);
+                if (err < 0)
+                        return err;
+                linebuf_rem_char(buf);
+        }
+
+        if (le32toh(node->values_count) && fnmatch(linebuf_get(buf), search, 0) == 0) {
+                err = node_add_values_f2(hwdb, node);
+                if (err < 0)
+                        return err;
+        }
+
+        linebuf_rem(buf, len);
+        return 0;
+}
+
+static int trie_search_f2(struct udev_hwdb *hwdb, const char *search) {
+        static const char globs[] = { '*', '?', '[' };
+        struct linebuf buf;
+        const struct trie_node_f2 *node;
+        size_t i = 0;
+        int err;
+
+        linebuf_init(&buf);
+
+        node = (const struct trie_node_f2 *)(hwdb->map + le64toh(hwdb->head->nodes_root_off));
+        while (node) {
+                size_t p = 0;
+
+                if (le32toh(node->prefix_off)) {
+                        const char *prefix = trie_string_f2(hwdb, node->prefix_off);
+                        uint8_t c;
+
+                        for (; (c = prefix[p]); p++) {
+                                if (c == '*' || c == '?' || c == '[')
+                                        return trie_fnmatch_f2(hwdb, node, p, &buf, search + i + p);
+                                if (c != search[i + p])
+                                        return 0;
+                        }
+                        i += p;
+                }
+
+                /* only the nodes with a glob child need to match the rest of the string */
+                if (node->flags & TRIE_NODE_GLOB) {
+                        size_t g;
+
+                        for (g = 0; g < ELEMENTSOF(globs); g++) {
+                                const struct trie_node_f2 *child;
+
+                                child = node_lookup_f2(hwdb, node, globs[g]);
+                                if (!child)
+                                        continue;
+
+                                linebuf_add_char(&buf, globs[g]);
+                                err = trie_fnmatch_f2(hwdb, child, 0, &buf, search + i);
+                                if (err < 0)
+                                        return err;
+                                linebuf_rem_char(&buf);
+                        }
+                }
+
+                if (search[i] == '\0')
+                        return node_add_values_f2(hwdb, node);
+
+                node = node_lookup_f2(hwdb, node, search[i]);
+                i++;
+        }
+        return 0;
+}
+
+static void cache_entry_free(struct hwdb_cache_entry *entry) {
+        udev_list_node_remove(&entry->node);
+        free(entry->modalias);
+        free(entry);
+}
+
+static void hwdb_cache_flush(struct udev_hwdb *hwdb) {
+        struct hwdb_cache_entry *entry;
+
+        if (!hwdb->cache)
+                return;
+
+        while ((entry = hashmap_steal_first(hwdb->cache)))
+                cache_entry_free(entry);
+}
+
+/* fill the properties list from a cached lookup */
+static int hwdb_cache_get(struct udev_hwdb *hwdb, const char *modalias) {
+        struct hwdb_cache_entry *entry;
+        size_t i;
+
+        if (!hwdb->cache)
+                return 0;
+
+        entry = hashmap_get(hwdb->cache, modalias);
+        if (!entry)
+                return 0;
+
+        /* most recently used */
+        udev_list_node_remove(&entry->node);
+        udev_list_node_append(&entry->node, &hwdb->cache_list);
+
+        for (i = 0; i < entry->properties_count; i++)
+                if (udev_list_entry_add(&hwdb->properties_list, entry->properties[i*2], entry->properties[i*2+1]) == NULL)
+                        return -ENOMEM;
+        return 1;
+}
+
+/* remember the properties of the lookup, replacing the least recently used one */
+static void hwdb_cache_add(struct udev_hwdb *hwdb, const char *modalias) {
+        struct hwdb_cache_entry *entry;
+
+        if (!hwdb->cache)
+                return;
+
+        if (hashmap_size(hwdb->cache) >= hwdb->cache_size) {
+                entry = container_of(hwdb->cache_list.next, struct hwdb_cache_entry, node);
+                hashmap_remove(hwdb->cache, entry->modalias);
+                cache_entry_free(entry);
+        }
+
+        entry = malloc(offsetof(struct hwdb_cache_entry, properties) + hwdb->lookup_count * sizeof(const char *));
+        if (!entry)
+                return;
+        entry->modalias = strdup(modalias);
+        if (!entry->modalias) {
+                free(entry);
+                return;
+        }
+        entry->properties_count = hwdb->lookup_count / 2;
+        memcpy(entry->properties, hwdb->lookup, hwdb->lookup_count * sizeof(const char *));
+
+        if (hashmap_put(hwdb->cache, entry->modalias, entry) < 0) {
+                free(entry->modalias);
+                free(entry);
+                return;
+        }
+        udev_list_node_append(&entry->node, &hwdb->cache_list);
+}
+
+/* open the database in either format, and remember the results of the given number of lookups */
+struct udev_hwdb *udev_hwdb_new_from_file(struct udev *udev, const char *filename, unsigned int cache_size) {
         struct udev_hwdb *hwdb;
         const char sig[] = HWDB_SIG;
+        const char sig_v2[] = HWDB_SIG_V2;
 
         hwdb = new0(struct udev_hwdb, 1);
         if (!hwdb)
                 return NULL;
 
+        hwdb->udev = udev;
         hwdb->refcount = 1;
         udev_list_init(udev, &hwdb->properties_list, true);
+        udev_list_node_init(&hwdb->cache_list);
 
-        hwdb->f = fopen("/etc/udev/hwdb.bin", "re");
+        hwdb->f = fopen(filename, "re");
         if (!hwdb->f) {
-                log_debug("error reading /etc/udev/hwdb.bin: %m");
+                log_debug("error reading %s: %m", filename);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
         if (fstat(fileno(hwdb->f), &hwdb->st) < 0 ||
             (size_t)hwdb->st.st_size < offsetof(struct trie_header_f, strings_len) + 8) {
-                log_debug("error reading /etc/udev/hwdb.bin: %m");
+                log_debug("error reading %s: %m", filename);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
         hwdb->map = mmap(0, hwdb->st.st_size, PROT_READ, MAP_SHARED, fileno(hwdb->f), 0);
         if (hwdb->map == MAP_FAILED) {
-                log_debug("error mapping /etc/udev/hwdb.bin: %m");
+                log_debug("error mapping %s: %m", filename);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
-        if (memcmp(hwdb->map, sig, sizeof(hwdb->head->signature)) != 0 ||
-            (size_t)hwdb->st.st_size != le64toh(hwdb->head->file_size)) {
-                log_debug("error recognizing the format of /etc/udev/hwdb.bin");
+        /* version 2 uses the structures of the library, version 1 the sizes in the header */
+        if (memcmp(hwdb->map, sig_v2, sizeof(hwdb->head->signature)) == 0 &&
+            le64toh(hwdb->head->node_size) == sizeof(struct trie_node_f2) &&
+            le64toh(hwdb->head->child_entry_size) == sizeof(le32_t) &&
+            le64toh(hwdb->head->value_entry_size) == sizeof(struct trie_value_entry_f2))
+                hwdb->v2 = true;
+        else if (memcmp(hwdb->map, sig, sizeof(hwdb->head->signature)) != 0) {
+                log_debug("error recognizing the format of %s", filename);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
+        if ((size_t)hwdb->st.st_size != le64toh(hwdb->head->file_size)) {
+                log_debug("error recognizing the format of %s", filename);
+                udev_hwdb_unref(hwdb);
+                return NULL;
+        }
+
+        if (cache_size > 0) {
+                hwdb->cache = hashmap_new(string_hash_func, string_compare_func);
+                if (!hwdb->cache) {
+                        udev_hwdb_unref(hwdb);
+                        return NULL;
+                }
+                hwdb->cache_size = cache_size;
+        }
+
         log_debug("=== trie on-disk ===\n");
+        log_debug("file:             %s, version %i\n", filename, hwdb->v2 ? 2 : 1);
         log_debug("tool version:          %llu", (unsigned long long)le64toh(hwdb->head->tool_version));
         log_debug("file size:        %8llu bytes\n", (unsigned long long)hwdb->st.st_size);
         log_debug("header size       %8llu bytes\n", (unsigned long long)le64toh(hwdb->head->header_size));
@@ -308,6 +592,23 @@ _public_ struct udev_hwdb *udev_hwdb_new(struct udev *udev) {
         return hwdb;
 }
 
+/**
+ * udev_hwdb_new:
+ * @udev: udev library context
+ *
+ * Create a hardware database context to query properties for devices.
+ *
+ * Returns: a hwdb context.
+ **/
+_public_ struct udev_hwdb *udev_hwdb_new(struct udev *udev) {
+        struct udev_hwdb *hwdb;
+
+        hwdb = udev_hwdb_new_from_file(udev, "/etc/udev/hwdb2.bin", HWDB_CACHE_SIZE);
+        if (!hwdb)
+                hwdb = udev_hwdb_new_from_file(udev, "/etc/udev/hwdb.bin", HWDB_CACHE_SIZE);
+        return hwdb;
+}
+
 /**
  * udev_hwdb_ref:
  * @hwdb: context
@@ -342,6 +643,9 @@ _public_ struct udev_hwdb *udev_hwdb_unref(struct udev_hwdb *hwdb) {
                 munmap((void *)hwdb->map, hwdb->st.st_size);
         if (hwdb->f)
                 fclose(hwdb->f);
+        hwdb_cache_flush(hwdb);
+        hashmap_free(hwdb->cache);
+        free(hwdb->lookup);
         udev_list_cleanup(&hwdb->properties_list);
         free(hwdb);
         return NULL;
@@ -383,7 +687,16 @@ _public_ struct udev_list_entry *udev_hwdb_get_properties_list_entry(struct udev
         }
 
         udev_list_cleanup(&hwdb->properties_list);
-        err = trie_search_f(hwdb, modalias);
+        err = hwdb_cache_get(hwdb, modalias);
+        if (err == 0) {
+                hwdb->lookup_count = 0;
+                if (hwdb->v2)
+                        err = trie_search_f2(hwdb, modalias);
+                else
+                        err = trie_search_f(hwdb, modalias);
+                if (err >= 0)
+                        hwdb_cache_add(hwdb, modalias);
+        }
         if (err < 0) {
                 errno = -err;
                 return NULL;
@@ -53,6 +53,7 @@ void udev_log(struct udev *udev,
 int udev_get_rules_path(struct udev *udev, char **path[], usec_t *ts_usec[]);
 struct udev_list_entry *udev_add_property(struct udev *udev, const char *key, const char *value);
 struct udev_list_entry *udev_get_properties_list_entry(struct udev *udev);
+struct udev_db *udev_get_db(struct udev *udev);
 
 /* libudev-device.c */
 struct udev_device *udev_device_new(struct udev *udev);
@@ -93,6 +94,10 @@ int udev_device_update_db(struct udev_device *udev_device);
 int udev_device_delete_db(struct udev_device *udev_device);
 int udev_device_tag_index(struct udev_device *dev, struct udev_device *dev_old, bool add);
 
+/* libudev-enumerate.c */
+int udev_enumerate_set_threads(struct udev_enumerate *udev_enumerate, unsigned int threads);
+bool udev_enumerate_syspath_delayed(struct udev *udev, const char *syspath);
+
 /* libudev-monitor.c - netlink/unix socket communication  */
 int udev_monitor_disconnect(struct udev_monitor *udev_monitor);
 int udev_monitor_allow_unicast_sender(struct udev_monitor *udev_monitor, struct udev_monitor *sender);
@@ -139,6 +144,22 @@ void udev_list_entry_set_num(struct udev_list_entry *list_entry, int num);
              entry != NULL; \
              entry = tmp, tmp = udev_list_entry_get_next(tmp))
 
+/* libudev-db.c */
+#define UDEV_DB_FILE "/run/udev/data.bin"
+struct udev_db;
+struct udev_db *udev_db_new(struct udev *udev, const char *filename);
+struct udev_db *udev_db_free(struct udev_db *db);
+bool udev_db_is_obsolete(struct udev_db *db);
+int udev_db_get(struct udev_db *db, const char *id, const char **data, size_t *len);
+int udev_db_get_tagged(struct udev_db *db, const char *tag, struct udev_list *list);
+
+/* libudev-db-private.c */
+int udev_db_append(struct udev *udev, const char *filename, const char *id, const char *data, size_t len);
+int udev_db_rebuild(struct udev *udev, const char *dir, const char *filename);
+int udev_db_compact(struct udev *udev, const char *filename);
+int udev_db_invalidate(struct udev *udev, const char *filename);
+int udev_db_get_tail_count(struct udev *udev, const char *filename, unsigned long long int *count);
+
 /* libudev-queue.c */
 unsigned long long int udev_get_kernel_seqnum(struct udev *udev);
 int udev_queue_read_seqnum(FILE *queue_file, unsigned long long int *seqnum);
@@ -153,6 +174,7 @@ int udev_queue_export_device_queued(struct udev_queue_export *udev_queue_export,
 int udev_queue_export_device_finished(struct udev_queue_export *udev_queue_export, struct udev_device *udev_device);
 
 /* libudev-hwdb.c */
+struct udev_hwdb *udev_hwdb_new_from_file(struct udev *udev, const char *filename, unsigned int cache_size);
 bool udev_hwdb_validate(struct udev_hwdb *hwdb);
 
 /* libudev-util.c */
@@ -150,38 +150,85 @@ static int next_assignment(
         return 0;
 }
 
-/* Parse a variable assignment line */
+/* Split a line into a section header or a variable assignment, in
+ * place. Returns false for empty lines and comments. */
+static bool split_line(char *l, ConfigLine *c) {
+        char *e;
+
+        assert(l);
+        assert(c);
+
+        zero(*c);
+
+        l = strstrip(l);
+
+        if (!*l)
+                return false;
+
+        if (strchr(COMMENTS, *l))
+                return false;
+
+        if (startswith(l, ".include ")) {
+                c->type = CONFIG_LINE_INCLUDE;
+                c->lvalue = strstrip(l+9);
+                return true;
+        }
+
+        if (*l == '[') {
+                size_t k;
+
+                k = strlen(l);
+                assert(k > 0);
+
+                if (l[k-1] != ']') {
+                        c->type = CONFIG_LINE_INVALID_SECTION;
+                        return true;
+                }
+
+                l[k-1] = 0;
+                c->type = CONFIG_LINE_SECTION;
+                c->lvalue = l+1;
+                return true;
+        }
+
+        e = strchr(l, '=');
+        if (!e) {
+                c->type = CONFIG_LINE_MISSING_EQUAL;
+                return true;
+        }
+
+        *e = 0;
+        e++;
+
+        c->type = CONFIG_LINE_ASSIGNMENT;
+        c->lvalue = strstrip(l);
+        c->rvalue = strstrip(e);
+        return true;
+}
+
+/* Parse a section header or variable assignment line */
 static int parse_line(
                 const char *filename,
-                unsigned line,
+                const ConfigLine *c,
                 const char *sections,
                 ConfigItemLookup lookup,
                 void *table,
                 bool relaxed,
                 char **section,
-                char *l,
                 void *userdata) {
 
-        char *e;
-
         assert(filename);
-        assert(line > 0);
+        assert(c);
+        assert(c->line > 0);
         assert(lookup);
-        assert(l);
 
-        l = strstrip(l);
+        switch (c->type) {
 
-        if (!*l)
-                return 0;
-
-        if (strchr(COMMENTS, *l))
-                return 0;
-
-        if (startswith(l, ".include ")) {
+        case CONFIG_LINE_INCLUDE: {
                 char *fn;
                 int r;
 
-                fn = file_in_same_dir(filename, strstrip(l+9));
+                fn = file_in_same_dir(filename, c->lvalue);
                 if (!fn)
                         return -ENOMEM;
 
@@ -191,26 +238,21 @@ static int parse_line(
                 return r;
         }
 
-        if (*l == '[') {
-                size_t k;
-                char *n;
-
-                k = strlen(l);
-                assert(k > 0);
+        case CONFIG_LINE_INVALID_SECTION:
+                log_error("[%s:%u] Invalid section header.", filename, c->line);
+                return -EBADMSG;
 
-                if (l[k-1] != ']') {
-                        log_error("[%s:%u] Invalid section header.", filename, line);
-                        return -EBADMSG;
-                }
+        case CONFIG_LINE_SECTION: {
+                char *n;
 
-                n = strndup(l+1, k-2);
+                n = strdup(c->lvalue);
                 if (!n)
                         return -ENOMEM;
 
                 if (sections && !nulstr_contains(sections, n)) {
 
                         if (!relaxed)
-                                log_info("[%s:%u] Unknown section '%s'. Ignoring.", filename, line, n);
+                                log_info("[%s:%u] Unknown section '%s'. Ignoring.", filename, c->line, n);
 
                         free(n);
                         *section = NULL;
@@ -222,76 +264,87 @@ static int parse_line(
                 return 0;
         }
 
+        default:
+                break;
+        }
+
         if (sections && !*section) {
 
                 if (!relaxed)
-                        log_info("[%s:%u] Assignment outside of section. Ignoring.", filename, line);
+                        log_info("[%s:%u] Assignment outside of section. Ignoring.", filename, c->line);
 
                 return 0;
         }
 
-        e = strchr(l, '=');
-        if (!e) {
-                log_error("[%s:%u] Missing '='.", filename, line);
+        if (c->type == CONFIG_LINE_MISSING_EQUAL) {
+                log_error("[%s:%u] Missing '='.", filename, c->line);
                 return -EBADMSG;
         }
 
-        *e = 0;
-        e++;
-
         return next_assignment(
                         filename,
-                        line,
+                        c->line,
                         lookup,
                         table,
                         *section,
-                        strstrip(l),
-                        strstrip(e),
+                        c->lvalue,
+                        c->rvalue,
                         relaxed,
                         userdata);
 }
 
-/* Go through the file and parse each line */
-int config_parse(
-                const char *filename,
-                FILE *f,
-                const char *sections,
-                ConfigItemLookup lookup,
-                void *table,
-                bool relaxed,
-                void *userdata) {
+static int add_line(ConfigLine **lines, unsigned *n, size_t *allocated, const ConfigLine *c) {
+        ConfigLine *t;
 
-        unsigned line = 0;
-        char *section = NULL;
-        int r;
-        bool ours = false;
-        char *continuation = NULL;
+        if (!GREEDY_REALLOC(*lines, *allocated, *n + 1))
+                return -ENOMEM;
 
-        assert(filename);
-        assert(lookup);
+        t = *lines + *n;
+        *t = *c;
 
-        if (!f) {
-                f = fopen(filename, "re");
-                if (!f) {
-                        r = -errno;
-                        log_error("Failed to open configuration file '%s': %s", filename, strerror(-r));
-                        goto finish;
-                }
+        if (c->lvalue) {
+                t->lvalue = strdup(c->lvalue);
+                if (!t->lvalue)
+                        return -ENOMEM;
+        }
 
-                ours = true;
+        if (c->rvalue) {
+                t->rvalue = strdup(c->rvalue);
+                if (!t->rvalue) {
+                        free(t->lvalue);
+                        return -ENOMEM;
+                }
         }
 
+        (*n)++;
+        return 0;
+}
+
+/* Go through the file and split each line, without looking up
+ * anything. This does not log, and may hence be called from any
+ * thread. */
+int config_split(FILE *f, ConfigLine **_lines, unsigned *_n_lines) {
+        ConfigLine *lines = NULL;
+        unsigned line = 0, n = 0;
+        size_t allocated = 0;
+        char *continuation = NULL;
+        int r;
+
+        assert(f);
+        assert(_lines);
+        assert(_n_lines);
+
         while (!feof(f)) {
                 char l[LINE_MAX], *p, *c = NULL, *e;
                 bool escaped = false;
+                ConfigLine cl;
 
                 if (!fgets(l, sizeof(l), f)) {
                         if (feof(f))
                                 break;
 
-                        r = -errno;
-                        log_error("Failed to read configuration file '%s': %s", filename, strerror(-r));
-                        goto finish;
+                        r = errno > 0 ? -errno : -EIO;
+                        goto fail;
                 }
 
                 truncate_nl(l);
@@ -300,7 +353,7 @@ int config_parse(
                         c = strappend(continuation, l);
                         if (!c) {
                                 r = -ENOMEM;
-                                goto finish;
+                                goto fail;
                         }
 
                         free(continuation);
@@ -325,37 +378,129 @@ int config_parse(
                                 continuation = strdup(l);
                                 if (!continuation) {
                                         r = -ENOMEM;
-                                        goto finish;
+                                        goto fail;
                                 }
                         }
 
                         continue;
                 }
 
-                r = parse_line(filename,
-                                ++line,
-                                sections,
-                                lookup,
-                                table,
-                                relaxed,
-                                &section,
-                                p,
-                                userdata);
+                line++;
+
+                if (split_line(p, &cl)) {
+                        cl.line = line;
+                        r = add_line(&lines, &n, &allocated, &cl);
+                } else
+                        r = 0;
                 free(c);
 
                 if (r < 0)
-                        goto finish;
+                        goto fail;
         }
 
-        r = 0;
+        free(continuation);
 
-finish:
-        free(section);
+        *_lines = lines;
+        *_n_lines = n;
+        return 0;
+
+fail:
         free(continuation);
+        config_lines_free(lines, n);
+        return r;
+}
+
+/* Parse the lines of a file split before */
+int config_parse_lines(
+                const char *filename,
+                const ConfigLine *lines,
+                unsigned n_lines,
+                const char *sections,
+                ConfigItemLookup lookup,
+                void *table,
+                bool relaxed,
+                void *userdata) {
 
-        if (f && ours)
+        char *section = NULL;
+        unsigned i;
+        int r = 0;
+
+        assert(filename);
+        assert(lines || n_lines == 0);
+        assert(lookup);
+
+        for (i = 0; i < n_lines; i++) {
+                r = parse_line(filename,
+                               lines + i,
+                               sections,
+                               lookup,
+                               table,
+                               relaxed,
+                               &section,
+                               userdata);
+                if (r < 0)
+                        break;
+        }
+
+        free(section);
+
+        return r < 0 ? r : 0;
+}
+
+void config_lines_free(ConfigLine *lines, unsigned n_lines) {
+        unsigned i;
+
+        for (i = 0; i < n_lines; i++) {
+                free(lines[i].lvalue);
+                free(lines[i].rvalue);
+        }
+
+        free(lines);
+}
+
+/* Go through the file and parse each line */
+int config_parse(
+                const char *filename,
+                FILE *f,
+                const char *sections,
+                ConfigItemLookup lookup,
+                void *table,
+                bool relaxed,
+                void *userdata) {
+
+        ConfigLine *lines = NULL;
+        unsigned n_lines = 0;
+        int r;
+        bool ours = false;
+
+        assert(filename);
+        assert(lookup);
+
+        if (!f) {
+                f = fopen(filename, "re");
+                if (!f) {
+                        r = -errno;
+                        log_error("Failed to open configuration file '%s': %s", filename, strerror(-r));
+                        return r;
+                }
+
+                ours = true;
+        }
+
+        r = config_split(f, &lines, &n_lines);
+
+        if (ours)
                 fclose(f);
 
+        if (r < 0) {
+                if (r != -ENOMEM)
+                        log_error("Failed to read configuration file '%s': %s", filename, strerror(-r));
+                return r;
+        }
+
+        r = config_parse_lines(filename, lines, n_lines, sections, lookup, table, relaxed, userdata);
+        config_lines_free(lines, n_lines);
+
         return r;
 }
 
@@ -78,6 +78,35 @@ int config_item_table_lookup(void *table, const char *section, const char *lvalu
  * ConfigPerfItem tables */
 int config_item_perf_lookup(void *table, const char *section, const char *lvalue, ConfigParserCallback *func, int *ltype, void **data, void *userdata);
 
+/* A line of a configuration file, split but not looked up yet */
+typedef enum ConfigLineType {
+        CONFIG_LINE_SECTION,            /* lvalue is the section name */
+        CONFIG_LINE_ASSIGNMENT,
+        CONFIG_LINE_INCLUDE,            /* lvalue is the file name */
+        CONFIG_LINE_INVALID_SECTION,
+        CONFIG_LINE_MISSING_EQUAL
+} ConfigLineType;
+
+typedef struct ConfigLine {
+        ConfigLineType type;
+        unsigned line;
+        char *lvalue;
+        char *rvalue;
+} ConfigLine;
+
+int config_split(FILE *f, ConfigLine **lines, unsigned *n_lines);
+void config_lines_free(ConfigLine *lines, unsigned n_lines);
+
+int config_parse_lines(
+                const char *filename,
+                const ConfigLine *lines,
+                unsigned n_lines,
+                const char *sections,  /* nulstr */
+                ConfigItemLookup lookup,
+                void *table,
+                bool relaxed,
+                void *userdata);
+
 int config_parse(
                 const char *filename,
                 FILE *f,
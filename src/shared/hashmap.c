@@ -23,20 +23,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/auxv.h>
 
 #include "util.h"
 #include "hashmap.h"
 #include "macro.h"
+#include "siphash24.h"
+#include "mempool.h"
 
-#define NBUCKETS 127
+/* Open addressing with linear probing. The bucket array only stores
+ * the hash and a pointer to the entry, so that probing stays within
+ * a few cache lines. The entries themselves stay where they are when
+ * the table is resized, and are linked in insertion order, hence
+ * iterators remain valid across insertions and removal of the
+ * current entry. */
+
+#define INITIAL_BUCKETS 8U
 
 struct hashmap_entry {
         const void *key;
         void *value;
-        struct hashmap_entry *bucket_next, *bucket_previous;
         struct hashmap_entry *iterate_next, *iterate_previous;
 };
 
+struct bucket {
+        struct hashmap_entry *entry;
+        unsigned hash;
+};
+
 struct Hashmap {
         hash_func_t hash_func;
         compare_func_t compare_func;
@@ -44,95 +58,65 @@ struct Hashmap {
         struct hashmap_entry *iterate_list_head, *iterate_list_tail;
         unsigned n_entries;
 
-        bool from_pool;
-};
+        /* Always a power of two */
+        unsigned n_buckets;
+        struct bucket *buckets;
 
-#define BY_HASH(h) ((struct hashmap_entry**) ((uint8_t*) (h) + ALIGN(sizeof(Hashmap))))
+        bool from_pool;
 
-struct pool {
-        struct pool *next;
-        unsigned n_tiles;
-        unsigned n_used;
+        /* Small maps, which are the vast majority, don't need a
+         * separate allocation for their buckets */
+        struct bucket initial_buckets[INITIAL_BUCKETS];
 };
 
-static struct pool *first_hashmap_pool = NULL;
-static void *first_hashmap_tile = NULL;
-
-static struct pool *first_entry_pool = NULL;
-static void *first_entry_tile = NULL;
-
-static void* allocate_tile(struct pool **first_pool, void **first_tile, size_t tile_size) {
-        unsigned i;
-
-        if (*first_tile) {
-                void *r;
+DEFINE_MEMPOOL(hashmap_pool, Hashmap, 512);
+DEFINE_MEMPOOL(hashmap_entry_pool, struct hashmap_entry, 512);
 
-                r = *first_tile;
-                *first_tile = * (void**) (*first_tile);
-                return r;
-        }
-
-        if (_unlikely_(!*first_pool) || _unlikely_((*first_pool)->n_used >= (*first_pool)->n_tiles)) {
-                unsigned n;
-                size_t size;
-                struct pool *p;
-
-                n = *first_pool ? (*first_pool)->n_tiles : 0;
-                n = MAX(512U, n * 2);
-                size = PAGE_ALIGN(ALIGN(sizeof(struct pool)) + n*tile_size);
-                n = (size - ALIGN(sizeof(struct pool))) / tile_size;
+#ifdef VALGRIND
 
-                p = malloc(size);
-                if (!p)
-                        return NULL;
+__attribute__((destructor)) static void cleanup_pool(void) {
+        /* Be nice to valgrind */
 
-                p->next = *first_pool;
-                p->n_tiles = n;
-                p->n_used = 0;
+        mempool_drop(&hashmap_pool);
+        mempool_drop(&hashmap_entry_pool);
+}
 
-                *first_pool = p;
-        }
+#endif
 
-        i = (*first_pool)->n_used++;
+static const uint8_t *hash_key(void) {
+        static const uint8_t *key = NULL;
+        static uint8_t fallback[16];
 
-        return ((uint8_t*) (*first_pool)) + ALIGN(sizeof(struct pool)) + i*tile_size;
-}
+        /* The kernel passes 16 random bytes to every process, which
+         * we use to key the string hash, so that hash collisions
+         * cannot be predicted from the outside. Reading them is
+         * idempotent, hence racing threads do no harm. */
 
-static void deallocate_tile(void **first_tile, void *p) {
-        * (void**) p = *first_tile;
-        *first_tile = p;
-}
+        if (_likely_(key))
+                return key;
 
-#ifdef VALGRIND
+        key = (const uint8_t*) getauxval(AT_RANDOM);
+        if (!key) {
+                uint64_t a, b;
 
-static void drop_pool(struct pool *p) {
-        while (p) {
-                struct pool *n;
-                n = p->next;
-                free(p);
-                p = n;
+                a = random_ull();
+                b = random_ull();
+                memcpy(fallback, &a, sizeof(a));
+                memcpy(fallback + 8, &b, sizeof(b));
+                key = fallback;
         }
-}
 
-__attribute__((destructor)) static void cleanup_pool(void) {
-        /* Be nice to valgrind */
-
-        drop_pool(first_hashmap_pool);
-        drop_pool(first_entry_pool);
+        return key;
 }
 
-#endif
-
 unsigned string_hash_func(const void *p) {
-        unsigned hash = 5381;
-        const signed char *c;
-
-        /* DJB's hash function */
+        uint8_t out[8];
+        uint64_t u;
 
-        for (c = p; *c; c++)
-                hash = (hash << 5) + hash + (unsigned) *c;
+        siphash24(out, p, strlen(p), hash_key());
+        memcpy(&u, out, sizeof(u));
 
-        return hash;
+        return (unsigned) ((u >> 32) ^ u);
 }
 
 int string_compare_func(const void *a, const void *b) {
@@ -166,24 +150,191 @@ int uint64_compare_func(const void *_a, const void *_b) {
         return a < b ? -1 : (a > b ? 1 : 0);
 }
 
+static unsigned bucket_hash(Hashmap *h, const void *key) {
+        unsigned x;
+
+        /* We only use the low bits of the hash to pick a bucket,
+         * hence mix them well, since pointers and small integers
+         * make for rather poor hash values. This is the finalizer
+         * of MurmurHash3. */
+
+        x = h->hash_func(key);
+        x ^= x >> 16;
+        x *= 0x85ebca6bU;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35U;
+        x ^= x >> 16;
+
+        return x;
+}
+
+static unsigned bucket_find(Hashmap *h, unsigned hash, const void *key) {
+        unsigned mask, i;
+
+        assert(h);
+
+        mask = h->n_buckets - 1;
+
+        for (i = hash & mask;; i = (i + 1) & mask) {
+                struct bucket *b = h->buckets + i;
+
+                if (!b->entry)
+                        return (unsigned) -1;
+
+                if (b->hash == hash && h->compare_func(b->entry->key, key) == 0)
+                        return i;
+        }
+}
+
+static unsigned bucket_find_entry(Hashmap *h, struct hashmap_entry *e) {
+        unsigned mask, i;
+
+        assert(h);
+        assert(e);
+
+        mask = h->n_buckets - 1;
+
+        for (i = bucket_hash(h, e->key) & mask;; i = (i + 1) & mask) {
+                assert(h->buckets[i].entry);
+
+                if (h->buckets[i].entry == e)
+                        return i;
+        }
+}
+
+static void bucket_insert(struct bucket *buckets, unsigned n_buckets, struct hashmap_entry *e, unsigned hash) {
+        unsigned mask, i;
+
+        mask = n_buckets - 1;
+
+        for (i = hash & mask; buckets[i].entry; i = (i + 1) & mask)
+                ;
+
+        buckets[i].entry = e;
+        buckets[i].hash = hash;
+}
+
+static void bucket_delete(Hashmap *h, unsigned i) {
+        unsigned mask, j;
+
+        assert(h);
+        assert(h->buckets[i].entry);
+
+        /* Shift back following entries that would become unreachable,
+         * so that we never need tombstones */
+
+        mask = h->n_buckets - 1;
+
+        for (j = (i + 1) & mask; h->buckets[j].entry; j = (j + 1) & mask) {
+                unsigned k;
+
+                k = h->buckets[j].hash & mask;
+
+                /* Can the entry in j be moved to i, i.e. is its
+                 * ideal bucket k not cyclically within (i, j]? */
+                if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+                        h->buckets[i] = h->buckets[j];
+                        i = j;
+                }
+        }
+
+        h->buckets[i].entry = NULL;
+}
+
+static int resize_buckets(Hashmap *h, unsigned n) {
+        struct bucket *buckets, *old;
+        unsigned n_old, i;
+
+        assert(h);
+        assert(n >= INITIAL_BUCKETS);
+        assert((n & (n - 1)) == 0);
+        assert(n > h->n_entries);
+
+        if (n == h->n_buckets)
+                return 0;
+
+        old = h->buckets;
+        n_old = h->n_buckets;
+
+        if (n == INITIAL_BUCKETS) {
+                assert(old != h->initial_buckets);
+                buckets = h->initial_buckets;
+                memzero(buckets, sizeof(h->initial_buckets));
+        } else {
+                buckets = new0(struct bucket, n);
+                if (!buckets)
+                        return -ENOMEM;
+        }
+
+        for (i = 0; i < n_old; i++)
+                if (old[i].entry)
+                        bucket_insert(buckets, n, old[i].entry, old[i].hash);
+
+        if (old != h->initial_buckets)
+                free(old);
+
+        h->buckets = buckets;
+        h->n_buckets = n;
+
+        return 0;
+}
+
+static int reserve_buckets(Hashmap *h, unsigned n_add) {
+        unsigned n, need;
+
+        assert(h);
+
+        /* Keep the load factor at or below 3/4 */
+
+        need = h->n_entries + n_add;
+        if (need <= h->n_buckets / 4 * 3)
+                return 0;
+
+        for (n = h->n_buckets; n / 4 * 3 < need; n *= 2)
+                if (n >= UINT_MAX / 4)
+                        break;
+
+        if (resize_buckets(h, n) >= 0)
+                return 0;
+
+        /* We can live with a fuller table for a while, as long as at
+         * least one bucket stays free */
+        if (need < h->n_buckets)
+                return 0;
+
+        return -ENOMEM;
+}
+
+static void shrink_buckets(Hashmap *h) {
+        unsigned n;
+
+        assert(h);
+
+        if (h->n_buckets <= INITIAL_BUCKETS ||
+            h->n_entries >= h->n_buckets / 8)
+                return;
+
+        for (n = h->n_buckets / 2; n > INITIAL_BUCKETS && h->n_entries < n / 8; n /= 2)
+                ;
+
+        /* If this fails we simply keep the bigger table */
+        resize_buckets(h, n);
+}
+
 Hashmap *hashmap_new(hash_func_t hash_func, compare_func_t compare_func) {
         bool b;
         Hashmap *h;
-        size_t size;
 
         b = is_main_thread();
 
-        size = ALIGN(sizeof(Hashmap)) + NBUCKETS * sizeof(struct hashmap_entry*);
-
         if (b) {
-                h = allocate_tile(&first_hashmap_pool, &first_hashmap_tile, size);
+                h = mempool_alloc_tile(&hashmap_pool);
                 if (!h)
                         return NULL;
 
-                memset(h, 0, size);
+                memzero(h, sizeof(Hashmap));
         } else {
-                h = malloc0(size);
-
+                h = new0(Hashmap, 1);
                 if (!h)
                         return NULL;
         }
@@ -194,6 +345,9 @@ Hashmap *hashmap_new(hash_func_t hash_func, compare_func_t compare_func) {
         h->n_entries = 0;
         h->iterate_list_head = h->iterate_list_tail = NULL;
 
+        h->buckets = h->initial_buckets;
+        h->n_buckets = INITIAL_BUCKETS;
+
         h->from_pool = b;
 
         return h;
@@ -215,12 +369,11 @@ static void link_entry(Hashmap *h, struct hashmap_entry *e, unsigned hash) {
         assert(h);
         assert(e);
 
+        /* The caller has to make sure there's a free bucket */
+        assert(h->n_entries + 1 < h->n_buckets);
+
         /* Insert into hash table */
-        e->bucket_next = BY_HASH(h)[hash];
-        e->bucket_previous = NULL;
-        if (BY_HASH(h)[hash])
-                BY_HASH(h)[hash]->bucket_previous = e;
-        BY_HASH(h)[hash] = e;
+        bucket_insert(h->buckets, h->n_buckets, e, hash);
 
         /* Insert into iteration list */
         e->iterate_previous = h->iterate_list_tail;
@@ -238,9 +391,10 @@ static void link_entry(Hashmap *h, struct hashmap_entry *e, unsigned hash) {
         assert(h->n_entries >= 1);
 }
 
-static void unlink_entry(Hashmap *h, struct hashmap_entry *e, unsigned hash) {
+static void unlink_entry(Hashmap *h, struct hashmap_entry *e, unsigned i) {
         assert(h);
         assert(e);
+        assert(h->buckets[i].entry == e);
 
         /* Remove from iteration list */
         if (e->iterate_next)
@@ -253,35 +407,32 @@ static void unlink_entry(Hashmap *h, struct hashmap_entry *e, unsigned hash) {
         else
                 h->iterate_list_head = e->iterate_next;
 
-        /* Remove from hash table bucket list */
-        if (e->bucket_next)
-                e->bucket_next->bucket_previous = e->bucket_previous;
-
-        if (e->bucket_previous)
-                e->bucket_previous->bucket_next = e->bucket_next;
-        else
-                BY_HASH(h)[hash] = e->bucket_next;
+        /* Remove from hash table */
+        bucket_delete(h, i);
 
         assert(h->n_entries >= 1);
         h->n_entries--;
 }
 
-static void remove_entry(Hashmap *h, struct hashmap_entry *e) {
-        unsigned hash;
-
+static void free_entry(Hashmap *h, struct hashmap_entry *e) {
         assert(h);
         assert(e);
 
-        hash = h->hash_func(e->key) % NBUCKETS;
-
-        unlink_entry(h, e, hash);
-
         if (h->from_pool)
-                deallocate_tile(&first_entry_tile, e);
+                mempool_free_tile(&hashmap_entry_pool, e);
         else
                 free(e);
 }
 
+static void remove_entry(Hashmap *h, struct hashmap_entry *e, unsigned i) {
+        assert(h);
+        assert(e);
+
+        unlink_entry(h, e, i);
+        free_entry(h, e);
+        shrink_buckets(h);
+}
+
 void hashmap_free(Hashmap*h) {
 
         /* Free the hashmap, but nothing in it */
@@ -292,7 +443,7 @@ void hashmap_free(Hashmap*h) {
         hashmap_clear(h);
 
         if (h->from_pool)
-                deallocate_tile(&first_hashmap_tile, h);
+                mempool_free_tile(&hashmap_pool, h);
         else
                 free(h);
 }
@@ -320,50 +471,73 @@ void hashmap_free_free_free(Hashmap *h) {
         hashmap_free(h);
 }
 
+static void clear_entries(Hashmap *h, bool free_values, bool free_keys) {
+        struct hashmap_entry *e, *n;
+
+        assert(h);
+
+        /* No need to maintain the buckets while we are dropping
+         * everything anyway */
+        for (e = h->iterate_list_head; e; e = n) {
+                void *a, *b;
+
+                n = e->iterate_next;
+                a = e->value;
+                b = (void*) e->key;
+
+                free_entry(h, e);
+
+                if (free_values)
+                        free(a);
+                if (free_keys)
+                        free(b);
+        }
+
+        if (h->buckets != h->initial_buckets)
+                free(h->buckets);
+
+        memzero(h->initial_buckets, sizeof(h->initial_buckets));
+        h->buckets = h->initial_buckets;
+        h->n_buckets = INITIAL_BUCKETS;
+
+        h->iterate_list_head = h->iterate_list_tail = NULL;
+        h->n_entries = 0;
+}
+
 void hashmap_clear(Hashmap *h) {
         if (!h)
                 return;
 
-        while (h->iterate_list_head)
-                remove_entry(h, h->iterate_list_head);
+        clear_entries(h, false, false);
 }
 
 void hashmap_clear_free(Hashmap *h) {
-        void *p;
-
         if (!h)
                 return;
 
-        while ((p = hashmap_steal_first(h)))
-                free(p);
+        clear_entries(h, true, false);
 }
 
 void hashmap_clear_free_free(Hashmap *h) {
         if (!h)
                 return;
 
-        while (h->iterate_list_head) {
-                void *a, *b;
-
-                a = h->iterate_list_head->value;
-                b = (void*) h->iterate_list_head->key;
-                remove_entry(h, h->iterate_list_head);
-                free(a);
-                free(b);
-        }
+        clear_entries(h, true, true);
 }
 
+static struct hashmap_entry *hash_scan(Hashmap *h, unsigned hash, const void *key, unsigned *ret) {
+        unsigned i;
 
-static struct hashmap_entry *hash_scan(Hashmap *h, unsigned hash, const void *key) {
-        struct hashmap_entry *e;
         assert(h);
-        assert(hash < NBUCKETS);
 
-        for (e = BY_HASH(h)[hash]; e; e = e->bucket_next)
-                if (h->compare_func(e->key, key) == 0)
-                        return e;
+        i = bucket_find(h, hash, key);
+        if (i == (unsigned) -1)
+                return NULL;
 
-        return NULL;
+        if (ret)
+                *ret = i;
+
+        return h->buckets[i].entry;
 }
 
 int hashmap_put(Hashmap *h, const void *key, void *value) {
@@ -372,9 +546,9 @@ int hashmap_put(Hashmap *h, const void *key, void *value) {
 
         assert(h);
 
-        hash = h->hash_func(key) % NBUCKETS;
+        hash = bucket_hash(h, key);
 
-        e = hash_scan(h, hash, key);
+        e = hash_scan(h, hash, key, NULL);
         if (e) {
 
                 if (e->value == value)
@@ -383,8 +557,11 @@ int hashmap_put(Hashmap *h, const void *key, void *value) {
                 return -EEXIST;
         }
 
+        if (reserve_buckets(h, 1) < 0)
+                return -ENOMEM;
+
         if (h->from_pool)
-                e = allocate_tile(&first_entry_pool, &first_entry_tile, sizeof(struct hashmap_entry));
+                e = mempool_alloc_tile(&hashmap_entry_pool);
         else
                 e = new(struct hashmap_entry, 1);
 
@@ -405,8 +582,8 @@ int hashmap_replace(Hashmap *h, const void *key, void *value) {
 
         assert(h);
 
-        hash = h->hash_func(key) % NBUCKETS;
-        e = hash_scan(h, hash, key);
+        hash = bucket_hash(h, key);
+        e = hash_scan(h, hash, key, NULL);
         if (e) {
                 e->key = key;
                 e->value = value;
@@ -422,8 +599,8 @@ int hashmap_update(Hashmap *h, const void *key, void *value) {
 
         assert(h);
 
-        hash = h->hash_func(key) % NBUCKETS;
-        e = hash_scan(h, hash, key);
+        hash = bucket_hash(h, key);
+        e = hash_scan(h, hash, key, NULL);
         if (!e)
                 return -ENOENT;
 
@@ -438,8 +615,8 @@ void* hashmap_get(Hashmap *h, const void *key) {
         if (!h)
                 return NULL;
 
-        hash = h->hash_func(key) % NBUCKETS;
-        e = hash_scan(h, hash, key);
+        hash = bucket_hash(h, key);
+        e = hash_scan(h, hash, key, NULL);
         if (!e)
                 return NULL;
 
@@ -453,8 +630,8 @@ void* hashmap_get2(Hashmap *h, const void *key, void **key2) {
         if (!h)
                 return NULL;
 
-        hash = h->hash_func(key) % NBUCKETS;
-        e = hash_scan(h, hash, key);
+        hash = bucket_hash(h, key);
+        e = hash_scan(h, hash, key, NULL);
         if (!e)
                 return NULL;
 
@@ -470,9 +647,9 @@ bool hashmap_contains(Hashmap *h, const void *key) {
         if (!h)
                 return false;
 
-        hash = h->hash_func(key) % NBUCKETS;
+        hash = bucket_hash(h, key);
 
-        if (!hash_scan(h, hash, key))
+        if (!hash_scan(h, hash, key, NULL))
                 return false;
 
         return true;
@@ -480,39 +657,39 @@ bool hashmap_contains(Hashmap *h, const void *key) {
 
 void* hashmap_remove(Hashmap *h, const void *key) {
         struct hashmap_entry *e;
-        unsigned hash;
+        unsigned hash, i;
         void *data;
 
         if (!h)
                 return NULL;
 
-        hash = h->hash_func(key) % NBUCKETS;
+        hash = bucket_hash(h, key);
 
-        if (!(e = hash_scan(h, hash, key)))
+        if (!(e = hash_scan(h, hash, key, &i)))
                 return NULL;
 
         data = e->value;
-        remove_entry(h, e);
+        remove_entry(h, e, i);
 
         return data;
 }
 
 int hashmap_remove_and_put(Hashmap *h, const void *old_key, const void *new_key, void *value) {
         struct hashmap_entry *e;
-        unsigned old_hash, new_hash;
+        unsigned old_hash, new_hash, i;
 
         if (!h)
                 return -ENOENT;
 
-        old_hash = h->hash_func(old_key) % NBUCKETS;
-        if (!(e = hash_scan(h, old_hash, old_key)))
+        old_hash = bucket_hash(h, old_key);
+        if (!(e = hash_scan(h, old_hash, old_key, &i)))
                 return -ENOENT;
 
-        new_hash = h->hash_func(new_key) % NBUCKETS;
-        if (hash_scan(h, new_hash, new_key))
+        new_hash = bucket_hash(h, new_key);
+        if (hash_scan(h, new_hash, new_key, NULL))
                 return -EEXIST;
 
-        unlink_entry(h, e, old_hash);
+        unlink_entry(h, e, i);
 
         e->key = new_key;
         e->value = value;
@@ -524,22 +701,25 @@ int hashmap_remove_and_put(Hashmap *h, const void *old_key, const void *new_key,
 
 int hashmap_remove_and_replace(Hashmap *h, const void *old_key, const void *new_key, void *value) {
         struct hashmap_entry *e, *k;
-        unsigned old_hash, new_hash;
+        unsigned old_hash, new_hash, i;
 
         if (!h)
                 return -ENOENT;
 
-        old_hash = h->hash_func(old_key) % NBUCKETS;
-        if (!(e = hash_scan(h, old_hash, old_key)))
+        old_hash = bucket_hash(h, old_key);
+        if (!(e = hash_scan(h, old_hash, old_key, NULL)))
                 return -ENOENT;
 
-        new_hash = h->hash_func(new_key) % NBUCKETS;
+        new_hash = bucket_hash(h, new_key);
 
-        if ((k = hash_scan(h, new_hash, new_key)))
+        if ((k = hash_scan(h, new_hash, new_key, &i)))
                 if (e != k)
-                        remove_entry(h, k);
+                        remove_entry(h, k, i);
 
-        unlink_entry(h, e, old_hash);
+        /* Removing k might have moved e around */
+        assert_se(hash_scan(h, old_hash, old_key, &i) == e);
+
+        unlink_entry(h, e, i);
 
         e->key = new_key;
         e->value = value;
@@ -551,20 +731,20 @@ int hashmap_remove_and_replace(Hashmap *h, const void *old_key, const void *new_
 
 void* hashmap_remove_value(Hashmap *h, const void *key, void *value) {
         struct hashmap_entry *e;
-        unsigned hash;
+        unsigned hash, i;
 
         if (!h)
                 return NULL;
 
-        hash = h->hash_func(key) % NBUCKETS;
+        hash = bucket_hash(h, key);
 
-        if (!(e = hash_scan(h, hash, key)))
+        if (!(e = hash_scan(h, hash, key, &i)))
                 return NULL;
 
         if (e->value != value)
                 return NULL;
 
-        remove_entry(h, e);
+        remove_entry(h, e, i);
 
         return value;
 }
@@ -646,9 +826,9 @@ void *hashmap_iterate_skip(Hashmap *h, const void *key, Iterator *i) {
         if (!h)
                 return NULL;
 
-        hash = h->hash_func(key) % NBUCKETS;
+        hash = bucket_hash(h, key);
 
-        if (!(e = hash_scan(h, hash, key)))
+        if (!(e = hash_scan(h, hash, key, NULL)))
                 return NULL;
 
         *i = (Iterator) e;
@@ -690,31 +870,35 @@ void* hashmap_last(Hashmap *h) {
 }
 
 void* hashmap_steal_first(Hashmap *h) {
+        struct hashmap_entry *e;
         void *data;
 
         if (!h)
                 return NULL;
 
-        if (!h->iterate_list_head)
+        e = h->iterate_list_head;
+        if (!e)
                 return NULL;
 
-        data = h->iterate_list_head->value;
-        remove_entry(h, h->iterate_list_head);
+        data = e->value;
+        remove_entry(h, e, bucket_find_entry(h, e));
 
         return data;
 }
 
 void* hashmap_steal_first_key(Hashmap *h) {
+        struct hashmap_entry *e;
         void *key;
 
         if (!h)
                 return NULL;
 
-        if (!h->iterate_list_head)
+        e = h->iterate_list_head;
+        if (!e)
                 return NULL;
 
-        key = (void*) h->iterate_list_head->key;
-        remove_entry(h, h->iterate_list_head);
+        key = (void*) e->key;
+        remove_entry(h, e, bucket_find_entry(h, e));
 
         return key;
 }
@@ -743,6 +927,10 @@ int hashmap_merge(Hashmap *h, Hashmap *other) {
         if (!other)
                 return 0;
 
+        /* Size the table in one go, rather than doubling it again
+         * and again. If this fails hashmap_put() will tell. */
+        reserve_buckets(h, other->n_entries);
+
         for (e = other->iterate_list_head; e; e = e->iterate_next) {
                 int r;
 
@@ -760,30 +948,37 @@ void hashmap_move(Hashmap *h, Hashmap *other) {
         assert(h);
 
         /* The same as hashmap_merge(), but every new item from other
-         * is moved to h. This function is guaranteed to succeed. */
+         * is moved to h. This function is guaranteed to succeed,
+         * unless we cannot even allocate memory for the buckets, in
+         * which case the items that did not fit stay in other. */
 
         if (!other)
                 return;
 
+        reserve_buckets(h, other->n_entries);
+
         for (e = other->iterate_list_head; e; e = n) {
-                unsigned h_hash, other_hash;
+                unsigned h_hash;
 
                 n = e->iterate_next;
 
-                h_hash = h->hash_func(e->key) % NBUCKETS;
+                h_hash = bucket_hash(h, e->key);
 
-                if (hash_scan(h, h_hash, e->key))
+                if (hash_scan(h, h_hash, e->key, NULL))
                         continue;
 
-                other_hash = other->hash_func(e->key) % NBUCKETS;
+                if (reserve_buckets(h, 1) < 0)
+                        break;
 
-                unlink_entry(other, e, other_hash);
+                unlink_entry(other, e, bucket_find_entry(other, e));
                 link_entry(h, e, h_hash);
         }
+
+        shrink_buckets(other);
 }
 
 int hashmap_move_one(Hashmap *h, Hashmap *other, const void *key) {
-        unsigned h_hash, other_hash;
+        unsigned h_hash, other_hash, i;
         struct hashmap_entry *e;
 
         if (!other)
@@ -791,17 +986,22 @@ int hashmap_move_one(Hashmap *h, Hashmap *other, const void *key) {
 
         assert(h);
 
-        h_hash = h->hash_func(key) % NBUCKETS;
-        if (hash_scan(h, h_hash, key))
+        h_hash = bucket_hash(h, key);
+        if (hash_scan(h, h_hash, key, NULL))
                 return -EEXIST;
 
-        other_hash = other->hash_func(key) % NBUCKETS;
-        if (!(e = hash_scan(other, other_hash, key)))
+        other_hash = bucket_hash(other, key);
+        if (!(e = hash_scan(other, other_hash, key, &i)))
                 return -ENOENT;
 
-        unlink_entry(other, e, other_hash);
+        if (reserve_buckets(h, 1) < 0)
+                return -ENOMEM;
+
+        unlink_entry(other, e, i);
         link_entry(h, e, h_hash);
 
+        shrink_buckets(other);
+
         return 0;
 }
 
@@ -849,8 +1049,8 @@ void *hashmap_next(Hashmap *h, const void *key) {
         if (!h)
                 return NULL;
 
-        hash = h->hash_func(key) % NBUCKETS;
-        e = hash_scan(h, hash, key);
+        hash = bucket_hash(h, key);
+        e = hash_scan(h, hash, key, NULL);
         if (!e)
                 return NULL;
 
@@ -0,0 +1,55 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+/* A simple allocator for many objects of the same size, which are
+ * carved out of page-sized chunks and recycled through a free
+ * list. Chunks are never returned to the system. This is not thread
+ * safe, and meant for use from the main thread only. */
+
+struct pool;
+
+struct mempool {
+        struct pool *first_pool;
+        void *freelist;
+        size_t tile_size;
+        unsigned at_least;
+};
+
+#define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least)            \
+        static struct mempool pool_name = {                             \
+                .tile_size = sizeof(tile_type),                         \
+                .at_least = alloc_at_least,                             \
+        }
+
+void* mempool_alloc_tile(struct mempool *mp);
+void* mempool_alloc0_tile(struct mempool *mp);
+void mempool_free_tile(struct mempool *mp, void *p);
+
+/* Returns the number of bytes allocated for the pool, used or not */
+size_t mempool_allocated(struct mempool *mp);
+
+#ifdef VALGRIND
+void mempool_drop(struct mempool *mp);
+#endif
@@ -0,0 +1,452 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sysmacros.h>
+
+#include "log.h"
+#include "list.h"
+#include "mountinfo.h"
+#include "util.h"
+
+typedef struct MountInfoEntry MountInfoEntry;
+
+struct MountInfoEntry {
+        unsigned mount_id;
+        unsigned parent_id;
+        unsigned generation;
+
+        /* The mount point, or NULL if the line does not parse. All
+         * entries on the same mount point are linked up, the head of
+         * that list is indexed by the mount point. */
+        char *where;
+        LIST_FIELDS(MountInfoEntry, same_where);
+
+        size_t size;
+
+        /* The line, followed by a parsed copy of it */
+        char line[];
+};
+
+static char *next_field(char **p) {
+        char *s, *e;
+
+        s = *p;
+        if (*s == 0)
+                return NULL;
+
+        e = strchr(s, ' ');
+        if (e) {
+                *e = 0;
+                *p = e + 1;
+        } else
+                *p = s + strlen(s);
+
+        return s;
+}
+
+/* The kernel escapes space, tab, newline and backslash as \ooo */
+static char *unescape_field(char *s) {
+        char *f, *t;
+
+        f = t = s;
+        while (*f) {
+                if (f[0] == '\\' &&
+                    f[1] >= '0' && f[1] <= '3' &&
+                    f[2] >= '0' && f[2] <= '7' &&
+                    f[3] >= '0' && f[3] <= '7' &&
+                    (f[1] != '0' || f[2] != '0' || f[3] != '0')) {
+                        *(t++) = (char) (((f[1] - '0') << 6) | ((f[2] - '0') << 3) | (f[3] - '0'));
+                        f += 4;
+                } else
+                        *(t++) = *(f++);
+        }
+
+        *t = 0;
+        return s;
+}
+
+int mountinfo_parse_line(char *line, MountInfo *mi) {
+        char *p = line, *id, *parent, *devnum, *sep, *field;
+        unsigned maj, min;
+
+        assert(line);
+        assert(mi);
+
+        /* Splits the line up in place, without allocating anything:
+         *
+         * (1) mount id, (2) parent id, (3) major:minor, (4) root,
+         * (5) mount point, (6) mount options, (7) optional fields,
+         * (8) separator, (9) file system type, (10) mount source,
+         * (11) super options */
+
+        if (!(id = next_field(&p)) ||
+            !(parent = next_field(&p)) ||
+            !(devnum = next_field(&p)) ||
+            !(mi->root = next_field(&p)) ||
+            !(mi->where = next_field(&p)) ||
+            !(mi->options = next_field(&p)))
+                return -EINVAL;
+
+        for (;;) {
+                field = next_field(&p);
+                if (!field)
+                        return -EINVAL;
+
+                if (streq(field, "-"))
+                        break;
+        }
+
+        if (!(mi->fstype = next_field(&p)) ||
+            !(mi->what = next_field(&p)))
+                return -EINVAL;
+
+        /* The super options are the last field, but let's ignore any
+         * fields future kernels might add */
+        mi->super_options = next_field(&p);
+        if (!mi->super_options)
+                mi->super_options = p;
+
+        if (safe_atou(id, &mi->mount_id) < 0 ||
+            safe_atou(parent, &mi->parent_id) < 0)
+                return -EINVAL;
+
+        sep = strchr(devnum, ':');
+        if (!sep)
+                return -EINVAL;
+        *sep = 0;
+
+        if (safe_atou(devnum, &maj) < 0 ||
+            safe_atou(sep + 1, &min) < 0)
+                return -EINVAL;
+
+        mi->devnum = makedev(maj, min);
+
+        unescape_field(mi->root);
+        unescape_field(mi->where);
+        unescape_field(mi->what);
+
+        return 0;
+}
+
+static int report(char *line, MountInfoChange change, mountinfo_callback_t callback, void *userdata) {
+        MountInfo mi;
+
+        if (mountinfo_parse_line(line, &mi) < 0) {
+                log_warning("Failed to parse /proc/self/mountinfo line, ignoring.");
+                return 0;
+        }
+
+        return callback(&mi, change, userdata);
+}
+
+static MountInfoEntry *entry_new(const char *line, size_t l) {
+        MountInfoEntry *e;
+        MountInfo mi;
+
+        e = malloc(offsetof(MountInfoEntry, line) + 2 * (l + 1));
+        if (!e)
+                return NULL;
+
+        e->size = l;
+        memcpy(e->line, line, l + 1);
+        memcpy(e->line + l + 1, line, l + 1);
+
+        if (mountinfo_parse_line(e->line + l + 1, &mi) >= 0) {
+                e->parent_id = mi.parent_id;
+                e->where = mi.where;
+        } else {
+                e->parent_id = 0;
+                e->where = NULL;
+        }
+
+        LIST_INIT(MountInfoEntry, same_where, e);
+
+        return e;
+}
+
+static int index_add(MountInfoTable *t, MountInfoEntry *e) {
+        MountInfoEntry *head;
+        int r;
+
+        if (!e->where)
+                return 0;
+
+        head = hashmap_get(t->by_where, e->where);
+        LIST_PREPEND(MountInfoEntry, same_where, head, e);
+
+        r = hashmap_replace(t->by_where, e->where, e);
+        if (r < 0)
+                LIST_REMOVE(MountInfoEntry, same_where, head, e);
+
+        return r;
+}
+
+static void index_remove(MountInfoTable *t, MountInfoEntry *e) {
+        MountInfoEntry *head;
+
+        if (!e->where)
+                return;
+
+        head = hashmap_get(t->by_where, e->where);
+        if (!head)
+                return;
+
+        if (head != e) {
+                LIST_REMOVE(MountInfoEntry, same_where, head, e);
+                return;
+        }
+
+        /* The key belongs to the head, hence re-add the rest of the
+         * list under the key of the new head */
+        hashmap_remove(t->by_where, e->where);
+        LIST_REMOVE(MountInfoEntry, same_where, head, e);
+
+        if (head)
+                assert_se(hashmap_put(t->by_where, head->where, head) >= 0);
+}
+
+int mountinfo_table_update(MountInfoTable *t, char *buffer, size_t size, mountinfo_callback_t callback, void *userdata) {
+        MountInfoEntry *e;
+        Iterator i;
+        char *line, *next, *end;
+        int r = 0, k;
+
+        assert(t);
+        assert(buffer);
+        assert(buffer[size] == 0);
+        assert(callback);
+
+        if (!t->entries) {
+                t->entries = hashmap_new(trivial_hash_func, trivial_compare_func);
+                if (!t->entries)
+                        return -ENOMEM;
+        }
+
+        if (!t->by_where) {
+                t->by_where = hashmap_new(string_hash_func, string_compare_func);
+                if (!t->by_where)
+                        return -ENOMEM;
+        }
+
+        /* Entries that are not seen in this generation are gone */
+        t->generation++;
+
+        for (line = buffer, end = buffer + size; line < end; line = next) {
+                unsigned long id;
+                size_t l;
+                char *nl;
+
+                nl = memchr(line, '\n', end - line);
+                if (nl) {
+                        *nl = 0;
+                        next = nl + 1;
+                } else
+                        next = end;
+
+                l = strlen(line);
+                if (l == 0)
+                        continue;
+
+                errno = 0;
+                id = strtoul(line, NULL, 10);
+                if (errno != 0 || id > (unsigned long) UINT_MAX)
+                        continue;
+
+                e = hashmap_get(t->entries, UINT_TO_PTR(id));
+                if (e) {
+                        /* The common case: nothing changed */
+                        if (e->size == l && memcmp(e->line, line, l) == 0) {
+                                e->generation = t->generation;
+                                continue;
+                        }
+
+                        hashmap_remove(t->entries, UINT_TO_PTR(id));
+                        index_remove(t, e);
+
+                        k = report(e->line, MOUNTINFO_REMOVED, callback, userdata);
+                        if (k < 0)
+                                r = k;
+
+                        free(e);
+                }
+
+                e = entry_new(line, l);
+                if (!e)
+                        return -ENOMEM;
+
+                e->mount_id = (unsigned) id;
+                e->generation = t->generation;
+
+                k = hashmap_put(t->entries, UINT_TO_PTR(id), e);
+                if (k < 0) {
+                        free(e);
+                        return k;
+                }
+
+                k = index_add(t, e);
+                if (k < 0) {
+                        hashmap_remove(t->entries, UINT_TO_PTR(id));
+                        free(e);
+                        return k;
+                }
+
+                k = report(line, MOUNTINFO_ADDED, callback, userdata);
+                if (k < 0)
+                        r = k;
+        }
+
+        /* Unindex everything that is gone first, so that the
+         * callbacks only find what is still mounted */
+        HASHMAP_FOREACH(e, t->entries, i)
+                if (e->generation != t->generation)
+                        index_remove(t, e);
+
+        HASHMAP_FOREACH(e, t->entries, i) {
+                if (e->generation == t->generation)
+                        continue;
+
+                hashmap_remove(t->entries, UINT_TO_PTR(e->mount_id));
+
+                k = report(e->line, MOUNTINFO_REMOVED, callback, userdata);
+                if (k < 0)
+                        r = k;
+
+                free(e);
+        }
+
+        return r;
+}
+
+int mountinfo_table_read(MountInfoTable *t, int fd, mountinfo_callback_t callback, void *userdata) {
+        size_t size = 0;
+
+        assert(t);
+        assert(fd >= 0);
+
+        /* The buffer is kept around between calls, so that the
+         * steady state does not allocate anything at all */
+
+        if (lseek(fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        for (;;) {
+                ssize_t n;
+
+                if (!GREEDY_REALLOC(t->buffer, t->allocated, MAX(size + 4096 + 1, (size_t) 16*1024)))
+                        return -ENOMEM;
+
+                n = read(fd, t->buffer + size, t->allocated - size - 1);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (n == 0)
+                        break;
+
+                size += n;
+        }
+
+        t->buffer[size] = 0;
+
+        return mountinfo_table_update(t, t->buffer, size, callback, userdata);
+}
+
+int mountinfo_table_find(MountInfoTable *t, const char *where, MountInfo *mi, char **line) {
+        MountInfoEntry *head, *e, *f, *found = NULL;
+        char *copy;
+
+        assert(t);
+        assert(where);
+        assert(mi);
+        assert(line);
+
+        head = hashmap_get(t->by_where, where);
+        if (!head)
+                return 0;
+
+        /* Of a stack of mounts on the same mount point, each one is
+         * the parent of the one on top of it. The top one is hence
+         * the one which is nobody's parent. Should there be more
+         * than one, take the one mounted last. */
+        LIST_FOREACH(same_where, e, head) {
+                LIST_FOREACH(same_where, f, head)
+                        if (f->parent_id == e->mount_id)
+                                break;
+
+                if (f)
+                        continue;
+
+                if (!found || e->mount_id > found->mount_id)
+                        found = e;
+        }
+
+        if (!found)
+                found = head;
+
+        copy = memdup(found->line, found->size + 1);
+        if (!copy)
+                return -ENOMEM;
+
+        assert_se(mountinfo_parse_line(copy, mi) >= 0);
+
+        *line = copy;
+        return 1;
+}
+
+unsigned mountinfo_table_size(MountInfoTable *t) {
+        assert(t);
+
+        return hashmap_size(t->entries);
+}
+
+void mountinfo_table_flush(MountInfoTable *t) {
+        MountInfoEntry *e;
+
+        assert(t);
+
+        hashmap_clear(t->by_where);
+
+        while ((e = hashmap_steal_first(t->entries)))
+                free(e);
+}
+
+void mountinfo_table_done(MountInfoTable *t) {
+        assert(t);
+
+        mountinfo_table_flush(t);
+        hashmap_free(t->entries);
+        t->entries = NULL;
+        hashmap_free(t->by_where);
+        t->by_where = NULL;
+
+        free(t->buffer);
+        t->buffer = NULL;
+        t->allocated = 0;
+}
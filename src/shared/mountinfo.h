@@ -0,0 +1,89 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "hashmap.h"
+
+typedef struct MountInfo MountInfo;
+typedef struct MountInfoTable MountInfoTable;
+
+/* One parsed line of /proc/self/mountinfo. All strings point into
+ * the line buffer that was passed to mountinfo_parse_line(), with
+ * octal escapes already undone. */
+struct MountInfo {
+        unsigned mount_id;
+        unsigned parent_id;
+        dev_t devnum;
+        char *root;
+        char *where;
+        char *options;
+        char *fstype;
+        char *what;
+        char *super_options;
+};
+
+typedef enum MountInfoChange {
+        MOUNTINFO_ADDED,
+        MOUNTINFO_REMOVED,
+        _MOUNTINFO_CHANGE_MAX,
+        _MOUNTINFO_CHANGE_INVALID = -1
+} MountInfoChange;
+
+/* A snapshot of the mount table, keyed by mount id, which is used
+ * to compute the difference to the previous state whenever the
+ * kernel notifies us about a change. It is also indexed by mount
+ * point. */
+struct MountInfoTable {
+        Hashmap *entries;
+        Hashmap *by_where;
+        unsigned generation;
+
+        char *buffer;
+        size_t allocated;
+};
+
+typedef int (*mountinfo_callback_t)(MountInfo *mi, MountInfoChange change, void *userdata);
+
+int mountinfo_parse_line(char *line, MountInfo *mi);
+
+/* Compares the mount table in the buffer (which must be NUL
+ * terminated at buffer[size], and is modified) with the snapshot and
+ * calls the callback for every line that was added or removed since
+ * the last call. A changed line is reported as removal of the old
+ * line followed by the addition of the new one. */
+int mountinfo_table_update(MountInfoTable *t, char *buffer, size_t size, mountinfo_callback_t callback, void *userdata);
+
+/* Reads the mount table from fd, which must refer to
+ * /proc/self/mountinfo, and calls mountinfo_table_update() on it. */
+int mountinfo_table_read(MountInfoTable *t, int fd, mountinfo_callback_t callback, void *userdata);
+
+/* Looks up the topmost mount on where in the snapshot, following the
+ * parent ids of the mounts on it. On success the strings in mi point
+ * into *line, which the caller has to free. */
+int mountinfo_table_find(MountInfoTable *t, const char *where, MountInfo *mi, char **line);
+
+unsigned mountinfo_table_size(MountInfoTable *t);
+void mountinfo_table_flush(MountInfoTable *t);
+void mountinfo_table_done(MountInfoTable *t);
@@ -46,6 +46,7 @@ int socket_address_listen(
                 const char *bind_to_device,
                 bool free_bind,
                 bool transparent,
+                bool reuse_port,
                 mode_t directory_mode,
                 mode_t socket_mode,
                 const char *label,
@@ -102,6 +103,14 @@ int socket_address_listen(
         if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0)
                 goto fail;
 
+        /* Allow multiple sockets bound to the same address, among
+         * which the kernel distributes incoming traffic */
+        if (reuse_port) {
+                one = 1;
+                if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+                        goto fail;
+        }
+
         if (socket_address_family(a) == AF_UNIX && a->sockaddr.un.sun_path[0] != 0) {
                 mode_t old_mask;
 
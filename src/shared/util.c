@@ -4763,6 +4763,29 @@ void* memdup(const void *p, size_t l) {
         return r;
 }
 
+void* greedy_realloc(void **p, size_t *allocated, size_t need) {
+        size_t a;
+        void *q;
+
+        assert(p);
+        assert(allocated);
+
+        /* Makes sure at least need bytes are allocated, growing
+         * exponentially to keep the number of reallocations small */
+
+        if (*allocated >= need)
+                return *p;
+
+        a = MAX(64u, need * 2);
+        q = realloc(*p, a);
+        if (!q)
+                return NULL;
+
+        *p = q;
+        *allocated = a;
+        return q;
+}
+
 int fd_inc_sndbuf(int fd, size_t n) {
         int r, value;
         socklen_t l = sizeof(value);
@@ -536,6 +536,10 @@ _malloc_ static inline void *memdup_multiply(const void *p, size_t a, size_t b)
         return memdup(p, a * b);
 }
 
+void* greedy_realloc(void **p, size_t *allocated, size_t need);
+#define GREEDY_REALLOC(array, allocated, need) \
+        greedy_realloc((void**) &(array), &(allocated), sizeof((array)[0]) * (need))
+
 bool filename_is_safe(const char *p);
 bool path_is_safe(const char *p);
 bool string_is_safe(const char *p);
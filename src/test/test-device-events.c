@@ -0,0 +1,161 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "manager.h"
+#include "device.h"
+#include "unit-name.h"
+#include "strv.h"
+#include "util.h"
+
+/* Benchmarks feeding synthetic uevents of block devices into the
+ * device unit type, in batches as device_fd_event() would. Each
+ * device has a device node, a few by-id/by-path links and an alias,
+ * i.e. six units of the same sysfs path. */
+
+#define N_LINKS 3
+
+typedef struct BenchDevice {
+        char *sysfs, *devnode, *alias;
+        char **devlinks;
+} BenchDevice;
+
+static void bench_device_init(BenchDevice *b, unsigned i) {
+        unsigned j;
+
+        assert_se(asprintf(&b->sysfs, "/sys/devices/pci0000:00/0000:00:%02x.0/host%u/target%u:0:0/%u:0:0:0/block/sd%u", i % 32, i, i, i, i) >= 0);
+        assert_se(asprintf(&b->devnode, "/dev/bench-sd%u", i) >= 0);
+        assert_se(asprintf(&b->alias, "/dev/bench-alias/%u", i) >= 0);
+
+        assert_se(b->devlinks = new0(char*, N_LINKS + 1));
+        for (j = 0; j < N_LINKS; j++)
+                assert_se(asprintf(&b->devlinks[j], "/dev/bench-disk/by-%u/%u", j, i) >= 0);
+}
+
+static void bench_device_done(BenchDevice *b) {
+        free(b->sysfs);
+        free(b->devnode);
+        free(b->alias);
+        strv_free(b->devlinks);
+}
+
+static void feed(Manager *m, BenchDevice *devices, unsigned n, const char *action) {
+        DeviceEvent e[DEVICE_EVENTS_BATCH_MAX];
+        unsigned i, k = 0;
+
+        for (i = 0; i < n; i++) {
+                zero(e[k]);
+                e[k].action = action;
+                e[k].sysfs = devices[i].sysfs;
+                e[k].devnode = devices[i].devnode;
+                e[k].devlinks = devices[i].devlinks;
+                e[k].alias = devices[i].alias;
+                e[k].model = "Bench Disk";
+                k++;
+
+                if (k >= DEVICE_EVENTS_BATCH_MAX) {
+                        assert_se(device_process_events(m, e, k) >= 0);
+                        k = 0;
+                }
+        }
+
+        assert_se(device_process_events(m, e, k) >= 0);
+}
+
+static unsigned long long msec_since(usec_t ts) {
+        return (unsigned long long) ((now(CLOCK_MONOTONIC) - ts) / USEC_PER_MSEC);
+}
+
+static void bench(unsigned n) {
+        Manager *m = NULL;
+        BenchDevice *devices;
+        unsigned i;
+        usec_t ts;
+        unsigned long long add, change, follow, remove;
+
+        assert_se(devices = new0(BenchDevice, n));
+        for (i = 0; i < n; i++)
+                bench_device_init(devices + i, i);
+
+        assert_se(manager_new(SYSTEMD_USER, &m) >= 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        feed(m, devices, n, "add");
+        add = msec_since(ts);
+
+        assert_se(hashmap_size(m->units) == n * (3 + N_LINKS));
+
+        ts = now(CLOCK_MONOTONIC);
+        feed(m, devices, n, "change");
+        change = msec_since(ts);
+
+        /* Everything follows the unit named after the sysfs path */
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *main_name = NULL, *node_name = NULL;
+                Unit *main_unit, *node_unit;
+
+                assert_se(main_name = unit_name_from_path(devices[i].sysfs, ".device"));
+                assert_se(node_name = unit_name_from_path(devices[i].devnode, ".device"));
+
+                assert_se(main_unit = manager_get_unit(m, main_name));
+                assert_se(node_unit = manager_get_unit(m, node_name));
+
+                assert_se(DEVICE(main_unit)->state == DEVICE_PLUGGED);
+                assert_se(!unit_following(main_unit));
+                assert_se(unit_following(node_unit) == main_unit);
+        }
+        follow = msec_since(ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        feed(m, devices, n, "remove");
+        remove = msec_since(ts);
+
+        assert_se(hashmap_isempty(m->devices_by_sysfs));
+
+        printf("%6u devices: add %6llu ms, change %6llu ms, follow %6llu ms, remove %6llu ms\n",
+               n, add, change, follow, remove);
+
+        manager_free(m);
+
+        for (i = 0; i < n; i++)
+                bench_device_done(devices + i);
+        free(devices);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n = 10000;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0);
+
+        log_set_max_level(LOG_NOTICE);
+        log_parse_environment();
+        log_open();
+
+        bench(100);
+        bench(n);
+
+        return 0;
+}
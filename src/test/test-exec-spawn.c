@@ -0,0 +1,198 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "manager.h"
+#include "unit.h"
+#include "path-lookup.h"
+#include "fileio.h"
+#include "util.h"
+
+/* Benchmarks Accept=yes socket units: a client connects to two
+ * sockets run by a manager of our own, and waits for each connection
+ * to be closed by the instance /bin/true spawned for it. The
+ * instances of fast.socket are eligible for the clone() fast path,
+ * the ones of slow.socket are forced onto fork() by a resource limit.
+ * Some memory is allocated and touched in the manager first to
+ * emulate one with many units loaded, since that's what makes fork()
+ * expensive. */
+
+static void write_units(const char *dir, const char *name, const char *extra) {
+        _cleanup_free_ char *p = NULL, *c = NULL;
+
+        assert_se(asprintf(&p, "%s/%s.socket", dir, name) >= 0);
+        assert_se(asprintf(&c,
+                           "[Unit]\n"
+                           "DefaultDependencies=no\n"
+                           "[Socket]\n"
+                           "ListenStream=%s/%s\n"
+                           "Accept=yes\n", dir, name) >= 0);
+        assert_se(write_one_line_file(p, c) >= 0);
+
+        free(p);
+        free(c);
+
+        assert_se(asprintf(&p, "%s/%s@.service", dir, name) >= 0);
+        assert_se(asprintf(&c,
+                           "[Unit]\n"
+                           "DefaultDependencies=no\n"
+                           "[Service]\n"
+                           "ExecStart=/bin/true\n"
+                           "StandardInput=socket\n"
+                           "StandardOutput=inherit\n"
+                           "StandardError=inherit\n"
+                           "%s", extra) >= 0);
+        assert_se(write_one_line_file(p, c) >= 0);
+}
+
+static int connect_and_wait(const char *dir, const char *name) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_un un;
+        } sa;
+        char buf[16];
+        int fd;
+
+        zero(sa);
+        sa.un.sun_family = AF_UNIX;
+        snprintf(sa.un.sun_path, sizeof(sa.un.sun_path), "%s/%s", dir, name);
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+
+        if (connect(fd, &sa.sa, offsetof(struct sockaddr_un, sun_path) + strlen(sa.un.sun_path)) < 0) {
+                close_nointr_nofail(fd);
+                return -errno;
+        }
+
+        /* The instance closes the connection when it exits */
+        while (read(fd, buf, sizeof(buf)) > 0)
+                ;
+
+        close_nointr_nofail(fd);
+        return 0;
+}
+
+static void bench(const char *dir, const char *name, unsigned n) {
+        usec_t ts;
+        unsigned i;
+
+        /* Wait for the manager to listen */
+        while (connect_and_wait(dir, name) < 0)
+                usleep(10 * USEC_PER_MSEC);
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n; i++)
+                assert_se(connect_and_wait(dir, name) >= 0);
+
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        printf("%-6s %6u spawns in %6llu ms, %8.1f spawns/s\n",
+               name, n, (unsigned long long) (ts / USEC_PER_MSEC),
+               (double) n * USEC_PER_SEC / (double) MAX(ts, 1ULL));
+}
+
+static void start_socket(Manager *m, const char *name) {
+        Unit *u;
+        Job *j;
+
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        assert_se(u->load_state == UNIT_LOADED);
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, false, NULL, &j) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n = 500, ballast = 256;
+        char dir[] = "/tmp/test-exec-spawn.XXXXXX";
+        _cleanup_free_ char *limit = NULL;
+        struct rlimit rl;
+        Manager *m;
+        pid_t pid;
+        int status;
+        char *p;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &ballast) >= 0);
+
+        assert_se(mkdtemp(dir));
+
+        /* Not supported by the fast path, but a NOP for us */
+        assert_se(getrlimit(RLIMIT_NOFILE, &rl) >= 0);
+        assert_se(asprintf(&limit, "LimitNOFILE=%llu\n", (unsigned long long) rl.rlim_cur) >= 0);
+
+        write_units(dir, "fast", "");
+        write_units(dir, "slow", limit);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                /* Makes a user manager exit */
+                assert_se(prctl(PR_SET_PDEATHSIG, SIGTERM) >= 0);
+
+                log_set_max_level(LOG_NOTICE);
+                log_parse_environment();
+                log_open();
+
+                /* Touch every page so that fork() has to copy the page tables */
+                assert_se(p = malloc((size_t) ballast * 1024 * 1024));
+                memset(p, 1, (size_t) ballast * 1024 * 1024);
+
+                assert_se(setenv("SYSTEMD_UNIT_PATH", dir, 1) >= 0);
+                assert_se(manager_new(SYSTEMD_USER, &m) >= 0);
+                assert_se(lookup_paths_init(&m->lookup_paths, m->running_as, true, NULL, NULL, NULL) >= 0);
+
+                start_socket(m, "fast.socket");
+                start_socket(m, "slow.socket");
+
+                assert_se(manager_loop(m) >= 0);
+
+                manager_free(m);
+                free(p);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        printf("%u MiB allocated\n", ballast);
+
+        bench(dir, "fast", n);
+        bench(dir, "slow", n);
+
+        assert_se(kill(pid, SIGTERM) >= 0);
+        assert_se(waitpid(pid, &status, 0) == pid);
+        assert_se(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        rm_rf_dangerous(dir, false, true, false);
+
+        return 0;
+}
@@ -0,0 +1,236 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashmap.h"
+#include "set.h"
+#include "siphash24.h"
+#include "util.h"
+
+static void test_siphash24(void) {
+        static const uint8_t expected[8] = { 0xe5, 0x45, 0xbe, 0x49, 0x61, 0xca, 0x29, 0xa1 };
+        uint8_t key[16], in[15], out[8];
+        unsigned i;
+
+        /* Test vector from the SipHash paper */
+        for (i = 0; i < sizeof(key); i++)
+                key[i] = i;
+        for (i = 0; i < sizeof(in); i++)
+                in[i] = i;
+
+        siphash24(out, in, sizeof(in), key);
+        assert_se(memcmp(out, expected, sizeof(out)) == 0);
+}
+
+static void test_basic(void) {
+        Hashmap *h;
+        Iterator i;
+        const char *k;
+        char *v;
+        unsigned n;
+
+        assert_se(h = hashmap_new(string_hash_func, string_compare_func));
+
+        assert_se(hashmap_put(h, "foo", (char*) "1") == 1);
+        assert_se(hashmap_put(h, "bar", (char*) "2") == 1);
+        assert_se(hashmap_put(h, "baz", (char*) "3") == 1);
+        assert_se(hashmap_put(h, "foo", (char*) "1") == 0);
+        assert_se(hashmap_put(h, "foo", (char*) "4") == -EEXIST);
+        assert_se(hashmap_size(h) == 3);
+
+        assert_se(streq(hashmap_get(h, "bar"), "2"));
+        assert_se(!hashmap_get(h, "quux"));
+        assert_se(hashmap_contains(h, "baz"));
+
+        assert_se(hashmap_update(h, "baz", (char*) "5") == 0);
+        assert_se(hashmap_update(h, "quux", (char*) "5") == -ENOENT);
+        assert_se(hashmap_replace(h, "quux", (char*) "6") == 1);
+
+        /* Insertion order is kept */
+        assert_se(streq(hashmap_first_key(h), "foo"));
+        assert_se(streq(hashmap_last(h), "6"));
+        assert_se(streq(hashmap_next(h, "foo"), "2"));
+
+        assert_se(hashmap_remove_and_put(h, "foo", "bar", (char*) "7") == -EEXIST);
+        assert_se(hashmap_remove_and_put(h, "foo", "waldo", (char*) "7") == 0);
+        assert_se(!hashmap_get(h, "foo"));
+        assert_se(streq(hashmap_last(h), "7"));
+
+        assert_se(hashmap_remove_and_replace(h, "waldo", "bar", (char*) "8") == 0);
+        assert_se(hashmap_size(h) == 3);
+        assert_se(streq(hashmap_get(h, "bar"), "8"));
+
+        assert_se(!hashmap_remove_value(h, "baz", (char*) "3"));
+        assert_se(streq(hashmap_remove_value(h, "baz", (char*) "5"), "5"));
+
+        n = 0;
+        HASHMAP_FOREACH_KEY(v, k, h, i)
+                n++;
+        assert_se(n == hashmap_size(h));
+
+        assert_se(streq(hashmap_iterate_skip(h, "quux", &i), "6"));
+        assert_se(streq(hashmap_iterate(h, &i, NULL), "6"));
+        assert_se(streq(hashmap_iterate(h, &i, NULL), "8"));
+        assert_se(!hashmap_iterate(h, &i, NULL));
+
+        hashmap_free(h);
+}
+
+static void test_many(unsigned n) {
+        Hashmap *h, *other;
+        Iterator i;
+        unsigned j;
+        void *v;
+
+        assert_se(h = hashmap_new(trivial_hash_func, trivial_compare_func));
+
+        for (j = 1; j <= n; j++)
+                assert_se(hashmap_put(h, UINT_TO_PTR(j), UINT_TO_PTR(j)) == 1);
+
+        /* Iteration yields insertion order, also when removing the
+         * current entry while iterating */
+        j = 0;
+        HASHMAP_FOREACH(v, h, i) {
+                assert_se(PTR_TO_UINT(v) == ++j);
+
+                if (j % 3 == 0)
+                        assert_se(hashmap_remove(h, v) == v);
+        }
+        assert_se(j == n);
+        assert_se(hashmap_size(h) == n - n / 3);
+
+        for (j = 1; j <= n; j++)
+                assert_se(hashmap_contains(h, UINT_TO_PTR(j)) == (j % 3 != 0));
+
+        /* Inserting while iterating gets the new entries iterated
+         * too */
+        j = 0;
+        HASHMAP_FOREACH(v, h, i)
+                if (PTR_TO_UINT(v) % 3 == 1 && PTR_TO_UINT(v) + 2 <= n) {
+                        assert_se(hashmap_put(h, UINT_TO_PTR(PTR_TO_UINT(v) + 2), UINT_TO_PTR(PTR_TO_UINT(v) + 2)) == 1);
+                        j++;
+                } else if (PTR_TO_UINT(v) % 3 == 0)
+                        j--;
+        assert_se(j == 0);
+        assert_se(hashmap_size(h) == n);
+
+        assert_se(other = hashmap_new(trivial_hash_func, trivial_compare_func));
+        assert_se(hashmap_put(other, UINT_TO_PTR(1), UINT_TO_PTR(1)) == 1);
+        assert_se(hashmap_put(other, UINT_TO_PTR(n + 1), UINT_TO_PTR(n + 1)) == 1);
+        hashmap_move(h, other);
+        assert_se(hashmap_size(h) == n + 1);
+        assert_se(hashmap_size(other) == 1);
+        assert_se(hashmap_move_one(h, other, UINT_TO_PTR(1)) == -EEXIST);
+        hashmap_free(other);
+
+        /* Drain it, so that the table shrinks again */
+        for (j = 0; hashmap_steal_first(h) || hashmap_size(h) > 0; j++)
+                ;
+        assert_se(j == n + 1);
+        assert_se(hashmap_isempty(h));
+
+        hashmap_free(h);
+}
+
+static void test_set(void) {
+        Set *s;
+
+        assert_se(s = set_new(string_hash_func, string_compare_func));
+        assert_se(set_put(s, (char*) "a") == 1);
+        assert_se(set_put(s, (char*) "b") == 1);
+        assert_se(set_put(s, (char*) "a") == 0);
+        assert_se(set_size(s) == 2);
+        assert_se(set_remove(s, (char*) "a"));
+        assert_se(!set_get(s, (char*) "a"));
+        set_free(s);
+}
+
+static unsigned long long usec_since(usec_t ts) {
+        return (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+}
+
+static void bench(unsigned n) {
+        Hashmap *h;
+        char **keys;
+        Iterator i;
+        unsigned j;
+        usec_t ts;
+        unsigned long long put, get, iterate, remove;
+        void *v;
+
+        assert_se(keys = new(char*, n));
+        for (j = 0; j < n; j++)
+                assert_se(asprintf(&keys[j], "unit-%u.service", j) >= 0);
+
+        assert_se(h = hashmap_new(string_hash_func, string_compare_func));
+
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 0; j < n; j++)
+                assert_se(hashmap_put(h, keys[j], keys[j]) == 1);
+        put = usec_since(ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 0; j < n; j++)
+                assert_se(hashmap_get(h, keys[(j * 7919) % n]));
+        get = usec_since(ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        j = 0;
+        HASHMAP_FOREACH(v, h, i)
+                j++;
+        iterate = usec_since(ts);
+        assert_se(j == n);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 0; j < n; j++)
+                assert_se(hashmap_remove(h, keys[j]));
+        remove = usec_since(ts);
+
+        printf("%8u entries: put %8llu us, get %8llu us, iterate %8llu us, remove %8llu us\n",
+               n, put, get, iterate, remove);
+
+        hashmap_free(h);
+
+        for (j = 0; j < n; j++)
+                free(keys[j]);
+        free(keys);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n;
+
+        test_siphash24();
+        test_basic();
+        test_many(10);
+        test_many(10000);
+        test_set();
+
+        /* The timings are only of interest when asked for, they
+         * take too long for "make check" */
+        if (argc > 1 && streq(argv[1], "bench"))
+                for (n = 100; n <= 1000000; n *= 10)
+                        bench(n);
+
+        return 0;
+}
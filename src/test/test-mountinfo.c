@@ -0,0 +1,305 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/sysmacros.h>
+
+#include "mountinfo.h"
+#include "util.h"
+
+static unsigned n_added, n_removed;
+
+static int count_changes(MountInfo *mi, MountInfoChange change, void *userdata) {
+        assert_se(mi);
+
+        if (change == MOUNTINFO_ADDED)
+                n_added++;
+        else
+                n_removed++;
+
+        return 0;
+}
+
+static void test_parse_line(void) {
+        char line[] = "36 35 98:0 /mnt1 /mnt\\040two rw,noatime master:1 shared:2 - ext3 /dev/root\\134x rw,errors=continue";
+        char short_line[] = "36 35 98:0 / /mnt rw,noatime";
+        MountInfo mi;
+
+        assert_se(mountinfo_parse_line(line, &mi) == 0);
+        assert_se(mi.mount_id == 36);
+        assert_se(mi.parent_id == 35);
+        assert_se(major(mi.devnum) == 98 && minor(mi.devnum) == 0);
+        assert_se(streq(mi.root, "/mnt1"));
+        assert_se(streq(mi.where, "/mnt two"));
+        assert_se(streq(mi.options, "rw,noatime"));
+        assert_se(streq(mi.fstype, "ext3"));
+        assert_se(streq(mi.what, "/dev/root\\x"));
+        assert_se(streq(mi.super_options, "rw,errors=continue"));
+
+        assert_se(mountinfo_parse_line(short_line, &mi) == -EINVAL);
+}
+
+static void test_read(void) {
+        MountInfoTable t;
+        int fd;
+
+        fd = open("/proc/self/mountinfo", O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return;
+
+        zero(t);
+
+        n_added = n_removed = 0;
+        assert_se(mountinfo_table_read(&t, fd, count_changes, NULL) == 0);
+        assert_se(n_added > 0 && n_removed == 0);
+        assert_se(mountinfo_table_size(&t) == n_added);
+
+        /* Rereading without changes reports nothing */
+        n_added = 0;
+        assert_se(mountinfo_table_read(&t, fd, count_changes, NULL) == 0);
+        assert_se(n_added == 0 && n_removed == 0);
+
+        mountinfo_table_done(&t);
+        close_nointr_nofail(fd);
+}
+
+static void test_find(void) {
+        char table[] =
+                "20 1 0:1 / /mnt rw - tmpfs first rw\n"
+                "21 1 0:2 / /other rw - tmpfs other rw\n"
+                "22 20 0:3 / /mnt ro - tmpfs second rw\n";
+        char *line = NULL;
+        MountInfoTable t;
+        MountInfo mi;
+
+        zero(t);
+
+        assert_se(mountinfo_table_update(&t, table, strlen(table), count_changes, NULL) == 0);
+
+        /* The mount on top wins */
+        assert_se(mountinfo_table_find(&t, "/mnt", &mi, &line) == 1);
+        assert_se(mi.mount_id == 22);
+        assert_se(streq(mi.what, "second"));
+        free(line);
+
+        assert_se(mountinfo_table_find(&t, "/nowhere", &mi, &line) == 0);
+
+        mountinfo_table_done(&t);
+}
+
+static unsigned uncovered_id;
+
+static int find_uncovered(MountInfo *mi, MountInfoChange change, void *userdata) {
+        MountInfoTable *t = userdata;
+        char *line = NULL;
+        MountInfo top;
+
+        if (change != MOUNTINFO_REMOVED || !streq(mi->where, "/mnt"))
+                return 0;
+
+        uncovered_id = 0;
+        if (mountinfo_table_find(t, "/mnt", &top, &line) > 0)
+                uncovered_id = top.mount_id;
+        free(line);
+
+        return 0;
+}
+
+static void test_find_changed(void) {
+        char table[] =
+                "20 1 0:1 / /mnt rw - tmpfs first rw\n"
+                "22 20 0:3 / /mnt ro - tmpfs second rw\n";
+        char changed[] =
+                "20 1 0:1 / /mnt ro - tmpfs first rw\n"
+                "22 20 0:3 / /mnt ro - tmpfs second rw\n";
+        char removed[] =
+                "20 1 0:1 / /mnt ro - tmpfs first rw\n";
+        char empty[] = "";
+        char *line = NULL;
+        MountInfoTable t;
+        MountInfo mi;
+
+        zero(t);
+
+        assert_se(mountinfo_table_update(&t, table, strlen(table), count_changes, NULL) == 0);
+
+        /* The changed line of the mount below is added again after
+         * the one on top, which stays on top nonetheless */
+        assert_se(mountinfo_table_update(&t, changed, strlen(changed), count_changes, NULL) == 0);
+        assert_se(mountinfo_table_find(&t, "/mnt", &mi, &line) == 1);
+        assert_se(mi.mount_id == 22);
+        free(line);
+
+        /* When the top one goes away, the one below is found, also
+         * from the callback reporting the removal */
+        assert_se(mountinfo_table_update(&t, removed, strlen(removed), find_uncovered, &t) == 0);
+        assert_se(uncovered_id == 20);
+        assert_se(mountinfo_table_find(&t, "/mnt", &mi, &line) == 1);
+        assert_se(mi.mount_id == 20);
+        assert_se(streq(mi.options, "ro"));
+        free(line);
+
+        assert_se(mountinfo_table_update(&t, empty, 0, count_changes, NULL) == 0);
+        assert_se(mountinfo_table_find(&t, "/mnt", &mi, &line) == 0);
+
+        mountinfo_table_done(&t);
+}
+
+static char *make_table(unsigned n, unsigned skip, unsigned remount, unsigned extra, size_t *size) {
+        char *buf, *p;
+        unsigned i;
+
+        assert_se(buf = malloc((size_t) (n + 1) * 160 + 1));
+        p = buf;
+
+        for (i = 0; i < n + extra; i++) {
+                if (i == skip)
+                        continue;
+
+                p += sprintf(p, "%u 1 0:%u / /var/lib/containers/%u/rootfs %s,relatime shared:%u - overlay overlay rw,lowerdir=/l/%u\n",
+                             i + 100, i % 256, i, i == remount ? "ro" : "rw", i, i);
+        }
+
+        *size = p - buf;
+        return buf;
+}
+
+static unsigned long long usec_since(usec_t ts) {
+        return (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+}
+
+/* How the mount table was parsed before: fscanf() with %ms for the
+ * whole table on every change */
+static unsigned parse_fscanf(const char *buf, size_t size) {
+        FILE *f;
+        unsigned n = 0;
+
+        assert_se(f = fmemopen((void*) buf, size, "r"));
+
+        for (;;) {
+                char *path = NULL, *options = NULL, *fstype = NULL, *device = NULL, *options2 = NULL;
+                int k;
+
+                k = fscanf(f,
+                           "%*s "
+                           "%*s "
+                           "%*s "
+                           "%*s "
+                           "%ms "
+                           "%ms"
+                           "%*[^-]"
+                           "- "
+                           "%ms "
+                           "%ms"
+                           "%ms"
+                           "%*[^\n]",
+                           &path, &options, &fstype, &device, &options2);
+
+                free(path);
+                free(options);
+                free(fstype);
+                free(device);
+                free(options2);
+
+                if (k != 5)
+                        break;
+
+                n++;
+        }
+
+        fclose(f);
+        return n;
+}
+
+static void update(MountInfoTable *t, const char *table, size_t size, unsigned added, unsigned removed, unsigned long long *usec) {
+        char *copy;
+        usec_t ts;
+
+        /* The buffer is modified while parsing */
+        assert_se(copy = memdup(table, size + 1));
+
+        n_added = n_removed = 0;
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(mountinfo_table_update(t, copy, size, count_changes, NULL) == 0);
+        *usec = usec_since(ts);
+
+        assert_se(n_added == added);
+        assert_se(n_removed == removed);
+
+        free(copy);
+}
+
+static void bench(unsigned n) {
+        MountInfoTable t;
+        char *full, *changed;
+        size_t full_size, changed_size;
+        unsigned long long fscanf_usec, initial, unchanged, diff;
+        usec_t ts;
+
+        /* The second table lacks one mount, has one more and has one
+         * remounted read-only */
+        full = make_table(n, (unsigned) -1, (unsigned) -1, 0, &full_size);
+        changed = make_table(n, n / 2, n / 3, 1, &changed_size);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(parse_fscanf(full, full_size) == n);
+        fscanf_usec = usec_since(ts);
+
+        zero(t);
+
+        update(&t, full, full_size, n, 0, &initial);
+        assert_se(mountinfo_table_size(&t) == n);
+
+        update(&t, full, full_size, 0, 0, &unchanged);
+
+        update(&t, changed, changed_size, 2, 2, &diff);
+        assert_se(mountinfo_table_size(&t) == n);
+
+        printf("%6u mounts: fscanf %7llu us, initial %7llu us, unchanged %7llu us, one change %7llu us\n",
+               n, fscanf_usec, initial, unchanged, diff);
+
+        mountinfo_table_done(&t);
+        free(full);
+        free(changed);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n;
+
+        test_parse_line();
+        test_read();
+        test_find();
+        test_find_changed();
+
+        /* The small table checks the diffing, the large ones are
+         * only timed when asked for */
+        bench(50);
+
+        if (argc > 1 && streq(argv[1], "bench"))
+                for (n = 500; n <= 50000; n *= 10)
+                        bench(n);
+
+        return 0;
+}
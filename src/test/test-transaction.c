@@ -0,0 +1,291 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "manager.h"
+#include "bus-errors.h"
+#include "fileio.h"
+#include "mkdir.h"
+#include "util.h"
+
+/* Checks that transactions with ordering cycles are still detected
+ * and fixed, or refused, and with "bench" or a list of sizes
+ * benchmarks building transactions for synthetic dependency graphs.
+ * Each service of the benchmark requires and is ordered after its
+ * parent in a binary tree and wants a third one, and all of them are
+ * pulled in by bench.target. */
+
+static void write_units(const char *dir, unsigned n) {
+        _cleanup_free_ char *wants = NULL, *target = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned i;
+
+        assert_se(asprintf(&wants, "%s/bench.target.wants", dir) >= 0);
+        assert_se(mkdir_p(wants, 0755) >= 0);
+
+        assert_se(asprintf(&target, "%s/bench.target", dir) >= 0);
+        assert_se(f = fopen(target, "we"));
+        fputs("[Unit]\n"
+              "AllowIsolate=yes\n"
+              "DefaultDependencies=no\n", f);
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *p = NULL, *l = NULL, *t = NULL;
+                _cleanup_fclose_ FILE *g = NULL;
+
+                assert_se(asprintf(&p, "%s/svc-%u.service", dir, i) >= 0);
+                assert_se(g = fopen(p, "we"));
+
+                fputs("[Unit]\n"
+                      "DefaultDependencies=no\n", g);
+                if (i > 0)
+                        fprintf(g,
+                                "Requires=svc-%u.service\n"
+                                "After=svc-%u.service\n"
+                                "Wants=svc-%u.service\n",
+                                (i - 1) / 2, (i - 1) / 2, i / 3);
+                fputs("[Service]\n"
+                      "ExecStart=/bin/true\n", g);
+
+                assert_se(asprintf(&l, "%s/svc-%u.service", wants, i) >= 0);
+                assert_se(asprintf(&t, "../svc-%u.service", i) >= 0);
+                assert_se(symlink(t, l) >= 0);
+        }
+}
+
+static void write_unit(const char *dir, const char *name, const char *contents) {
+        _cleanup_free_ char *p = NULL;
+
+        assert_se(asprintf(&p, "%s/%s", dir, name) >= 0);
+        assert_se(write_one_line_file(p, contents) >= 0);
+}
+
+static Manager *manager_for_dir(const char *dir) {
+        Manager *m = NULL;
+
+        /* set_unit_path() does not override an earlier one */
+        assert_se(setenv("SYSTEMD_UNIT_PATH", dir, 1) >= 0);
+        assert_se(manager_new(SYSTEMD_SYSTEM, &m) >= 0);
+        assert_se(lookup_paths_init(&m->lookup_paths, m->running_as, true, NULL, NULL, NULL) >= 0);
+
+        return m;
+}
+
+static Unit *load_unit(Manager *m, const char *name) {
+        Unit *u = NULL;
+
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        assert_se(u->load_state == UNIT_LOADED);
+
+        return u;
+}
+
+static bool has_job(Manager *m, const char *name) {
+        Unit *u;
+
+        u = manager_get_unit(m, name);
+        return u && u->job;
+}
+
+/* A cycle of wanted jobs in a long acyclic chain: one of the cycle's
+ * jobs is dropped, the rest of the transaction is kept. */
+static void test_cycle_dropped(void) {
+        char dir[] = "/tmp/test-transaction.XXXXXX";
+        Manager *m;
+        Unit *target;
+        Job *j;
+        unsigned i, n;
+
+        assert_se(mkdtemp(dir));
+
+        write_unit(dir, "cycle.target",
+                   "[Unit]\n"
+                   "DefaultDependencies=no\n"
+                   "Wants=a.service b.service c.service chain-99.service\n");
+        write_unit(dir, "a.service", "[Unit]\nDefaultDependencies=no\nAfter=b.service chain-50.service\n[Service]\nExecStart=/bin/true\n");
+        write_unit(dir, "b.service", "[Unit]\nDefaultDependencies=no\nAfter=c.service\n[Service]\nExecStart=/bin/true\n");
+        write_unit(dir, "c.service", "[Unit]\nDefaultDependencies=no\nAfter=a.service\n[Service]\nExecStart=/bin/true\n");
+        for (i = 0; i < 100; i++) {
+                _cleanup_free_ char *name = NULL, *contents = NULL;
+
+                assert_se(asprintf(&name, "chain-%u.service", i) >= 0);
+                if (i > 0)
+                        assert_se(asprintf(&contents,
+                                           "[Unit]\nDefaultDependencies=no\nRequires=chain-%u.service\nAfter=chain-%u.service\n"
+                                           "[Service]\nExecStart=/bin/true\n", i - 1, i - 1) >= 0);
+                else
+                        assert_se(contents = strdup("[Unit]\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n"));
+                write_unit(dir, name, contents);
+        }
+
+        m = manager_for_dir(dir);
+        target = load_unit(m, "cycle.target");
+
+        assert_se(manager_add_job(m, JOB_START, target, JOB_REPLACE, false, NULL, &j) == 0);
+
+        n = has_job(m, "a.service") + has_job(m, "b.service") + has_job(m, "c.service");
+        assert_se(n == 2);
+        for (i = 0; i < 100; i++) {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(asprintf(&name, "chain-%u.service", i) >= 0);
+                assert_se(has_job(m, name));
+        }
+
+        manager_free(m);
+        assert_se(rm_rf_dangerous(dir, false, true, false) >= 0);
+}
+
+/* A cycle through the anchor's required jobs and a wanted job: only
+ * the wanted job may be dropped to break it. */
+static void test_cycle_drop_wanted(void) {
+        char dir[] = "/tmp/test-transaction.XXXXXX";
+        Manager *m;
+        Unit *a;
+        Job *j;
+
+        assert_se(mkdtemp(dir));
+
+        write_unit(dir, "a.service", "[Unit]\nDefaultDependencies=no\nRequires=b.service\nAfter=b.service\n[Service]\nExecStart=/bin/true\n");
+        write_unit(dir, "b.service", "[Unit]\nDefaultDependencies=no\nWants=c.service\nAfter=c.service\n[Service]\nExecStart=/bin/true\n");
+        write_unit(dir, "c.service", "[Unit]\nDefaultDependencies=no\nAfter=a.service\n[Service]\nExecStart=/bin/true\n");
+
+        m = manager_for_dir(dir);
+        a = load_unit(m, "a.service");
+
+        assert_se(manager_add_job(m, JOB_START, a, JOB_REPLACE, false, NULL, &j) == 0);
+        assert_se(has_job(m, "a.service"));
+        assert_se(has_job(m, "b.service"));
+        assert_se(!has_job(m, "c.service"));
+
+        manager_free(m);
+        assert_se(rm_rf_dangerous(dir, false, true, false) >= 0);
+}
+
+/* A cycle of jobs which all matter to the anchor cannot be broken,
+ * the transaction is refused and nothing is installed. */
+static void test_cycle_unfixable(void) {
+        char dir[] = "/tmp/test-transaction.XXXXXX";
+        DBusError e;
+        Manager *m;
+        Unit *a;
+        Job *j;
+
+        assert_se(mkdtemp(dir));
+
+        write_unit(dir, "a.service", "[Unit]\nDefaultDependencies=no\nRequires=b.service\nAfter=b.service\n[Service]\nExecStart=/bin/true\n");
+        write_unit(dir, "b.service", "[Unit]\nDefaultDependencies=no\nRequires=a.service\nAfter=a.service\n[Service]\nExecStart=/bin/true\n");
+
+        m = manager_for_dir(dir);
+        a = load_unit(m, "a.service");
+
+        dbus_error_init(&e);
+        assert_se(manager_add_job(m, JOB_START, a, JOB_REPLACE, false, &e, &j) == -ENOEXEC);
+        assert_se(dbus_error_has_name(&e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC));
+        dbus_error_free(&e);
+
+        assert_se(!has_job(m, "a.service"));
+        assert_se(!has_job(m, "b.service"));
+        assert_se(hashmap_isempty(m->jobs));
+
+        manager_free(m);
+        assert_se(rm_rf_dangerous(dir, false, true, false) >= 0);
+}
+
+static unsigned long long msec_since(usec_t ts) {
+        return (unsigned long long) ((now(CLOCK_MONOTONIC) - ts) / USEC_PER_MSEC);
+}
+
+static void bench(unsigned n) {
+        char dir[] = "/tmp/test-transaction.XXXXXX";
+        Manager *m;
+        Unit *target = NULL;
+        Job *j;
+        usec_t ts;
+        unsigned long long load, start, isolate, stop;
+
+        assert_se(mkdtemp(dir));
+        write_units(dir, n);
+
+        m = manager_for_dir(dir);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_unit(m, "bench.target", NULL, NULL, &target) >= 0);
+        load = msec_since(ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, target, JOB_REPLACE, false, NULL, &j) == 0);
+        start = msec_since(ts);
+        manager_clear_jobs(m);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_START, target, JOB_ISOLATE, false, NULL, &j) == 0);
+        isolate = msec_since(ts);
+        manager_clear_jobs(m);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, JOB_STOP, target, JOB_FAIL, false, NULL, &j) == 0);
+        stop = msec_since(ts);
+        manager_clear_jobs(m);
+
+        printf("%6u units: load %6llu ms, start %6llu ms, isolate %6llu ms, stop %6llu ms\n",
+               n, load, start, isolate, stop);
+
+        manager_free(m);
+        assert_se(rm_rf_dangerous(dir, false, true, false) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        static const unsigned sizes[] = { 1000, 5000, 10000, 50000 };
+        unsigned i;
+        int k;
+
+        log_set_max_level(LOG_NOTICE);
+        log_parse_environment();
+        log_open();
+
+        if (argc <= 1) {
+                test_cycle_dropped();
+                test_cycle_drop_wanted();
+                test_cycle_unfixable();
+                return 0;
+        }
+
+        if (streq(argv[1], "bench")) {
+                for (i = 0; i < ELEMENTSOF(sizes); i++)
+                        bench(sizes[i]);
+                return 0;
+        }
+
+        for (k = 1; k < argc; k++) {
+                unsigned n;
+
+                assert_se(safe_atou(argv[k], &n) >= 0);
+                bench(n);
+        }
+
+        return 0;
+}
@@ -0,0 +1,197 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+
+#include "udev.h"
+#include "strv.h"
+
+/* Compares the cost of a device probe, which the rules of a disk used
+ * to run as a program with IMPORT{program}, with running it as a
+ * builtin in the worker. The probes run against /dev/null, so they
+ * fail early and the numbers show the cost of the call itself, which
+ * for the program is at least the fork and exec of the given program,
+ * /bin/true by default.
+ *
+ * Before that, the programs which are still installed are run from
+ * the current directory on the given device node, /dev/null by
+ * default, and need to print the same properties as the builtins. */
+
+static unsigned long long usec_since(usec_t ts)
+{
+        return (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+}
+
+static char *sorted_lines(char **l)
+{
+        char *s;
+
+        strv_sort(l);
+        s = strv_join(l, "\n");
+        assert_se(s);
+        strv_free(l);
+        return s;
+}
+
+static void check_program(struct udev *udev, struct udev_event *event, const sigset_t *sigmask,
+                          const char *command, const char *node)
+{
+        _cleanup_free_ char *dir = NULL, *program = NULL, *builtin = NULL, *path = NULL;
+        _cleanup_free_ char *program_props = NULL, *builtin_props = NULL;
+        char result[UTIL_LINE_SIZE];
+        struct udev_device *dev;
+        struct udev_list_entry *entry;
+        enum udev_builtin_cmd cmd;
+        char **l = NULL;
+        unsigned int n;
+        int k;
+
+        assert_se(dir = get_current_dir_name());
+        assert_se(path = strjoin(dir, "/", command, NULL));
+        path[strcspn(path, " ")] = '\0';
+        if (access(path, X_OK) < 0) {
+                printf("check   %-44s no program, skipping\n", command);
+                return;
+        }
+
+        assert_se(asprintf(&program, "%s/%s %s", dir, command, node) >= 0);
+        assert_se(asprintf(&builtin, "%s %s", command, node) >= 0);
+
+        /* the program prints the properties, the builtin adds them to a device without any */
+        result[0] = '\0';
+        k = udev_event_spawn(event, program, NULL, sigmask, result, sizeof(result));
+        assert_se(l = strv_split(result, "\n"));
+        program_props = sorted_lines(l);
+
+        cmd = udev_builtin_lookup(builtin);
+        assert_se(cmd < UDEV_BUILTIN_MAX);
+        assert_se(dev = udev_device_new(udev));
+        udev_device_set_info_loaded(dev);
+        assert_se(udev_builtin_run(dev, cmd, builtin, false) == (k == 0 ? EXIT_SUCCESS : EXIT_FAILURE));
+
+        l = NULL;
+        udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(dev)) {
+                _cleanup_free_ char *line = NULL;
+
+                assert_se(line = strjoin(udev_list_entry_get_name(entry), "=", udev_list_entry_get_value(entry), NULL));
+                assert_se(strv_extend(&l, line) >= 0);
+        }
+        n = strv_length(l);
+        builtin_props = sorted_lines(l);
+        udev_device_unref(dev);
+
+        printf("check   %-44s %u properties\n", builtin, n);
+        assert_se(streq(program_props, builtin_props));
+}
+
+static void bench_program(struct udev_event *event, const char *program, const sigset_t *sigmask, unsigned int n)
+{
+        char result[UTIL_LINE_SIZE];
+        unsigned long long usec;
+        unsigned int i;
+        usec_t ts;
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                udev_event_spawn(event, program, NULL, sigmask, result, sizeof(result));
+        usec = usec_since(ts);
+
+        printf("program %-44s %6llu us/call %8llu calls/sec\n",
+               program, usec / n, usec > 0 ? n * USEC_PER_SEC / usec : 0);
+}
+
+static void bench_builtin(struct udev_device *dev, const char *command, unsigned int n)
+{
+        enum udev_builtin_cmd cmd;
+        unsigned long long usec;
+        unsigned int i;
+        usec_t ts;
+
+        cmd = udev_builtin_lookup(command);
+        assert_se(cmd < UDEV_BUILTIN_MAX);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                udev_builtin_run(dev, cmd, command, false);
+        usec = usec_since(ts);
+
+        printf("builtin %-44s %6llu us/call %8llu calls/sec\n",
+               command, usec / n, usec > 0 ? n * USEC_PER_SEC / usec : 0);
+}
+
+int main(int argc, char *argv[])
+{
+        struct udev *udev;
+        struct udev_device *dev;
+        struct udev_event *event;
+        const char *program = "/bin/true";
+        const char *node = "/dev/null";
+        unsigned int n = 2000;
+        sigset_t mask, sigmask_orig;
+
+        if (argc > 1)
+                program = argv[1];
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &n) >= 0 && n > 0);
+        if (argc > 3)
+                node = argv[3];
+
+        log_set_max_level(LOG_ERR);
+
+        assert_se(udev = udev_new());
+        dev = udev_device_new_from_syspath(udev, "/sys/devices/virtual/mem/null");
+        if (dev == NULL) {
+                printf("no /sys/devices/virtual/mem/null, skipping\n");
+                udev_unref(udev);
+                return EXIT_SUCCESS;
+        }
+        assert_se(event = udev_event_new(dev));
+
+        sigfillset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, &sigmask_orig);
+        event->fd_signal = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+        assert_se(event->fd_signal >= 0);
+
+        udev_builtin_init(udev);
+
+        check_program(udev, event, &sigmask_orig, "ata_id --export", node);
+        check_program(udev, event, &sigmask_orig, "scsi_id --export --whitelisted -d", node);
+        check_program(udev, event, &sigmask_orig, "cdrom_id", node);
+        check_program(udev, event, &sigmask_orig, "v4l_id", node);
+        check_program(udev, event, &sigmask_orig, "mtd_probe", node);
+
+        bench_program(event, program, &sigmask_orig, n);
+        bench_builtin(dev, "ata_id --export /dev/null", n);
+        bench_builtin(dev, "scsi_id --export --whitelisted -d /dev/null", n);
+        bench_builtin(dev, "cdrom_id /dev/null", n);
+        bench_builtin(dev, "v4l_id /dev/null", n);
+        bench_builtin(dev, "mtd_probe /dev/null", n);
+
+        udev_builtin_exit(udev);
+        close(event->fd_signal);
+        udev_event_unref(event);
+        udev_device_unref(dev);
+        udev_unref(udev);
+
+        return EXIT_SUCCESS;
+}
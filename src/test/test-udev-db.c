@@ -0,0 +1,350 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "fileio.h"
+#include "util.h"
+
+/* Checks that the mapped database, which udevd merges the files in
+ * /run/udev/data into, gives the same properties as the files, on a
+ * synthetic set of devices. With "bench", reading them from the files
+ * and from the database is timed, and the devices of the running
+ * system are enumerated with their properties. */
+
+static unsigned long long usec_since(usec_t ts)
+{
+        return (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+}
+
+static void device_id(char *id, size_t size, unsigned int i)
+{
+        if (i % 2)
+                snprintf(id, size, "b8:%u", i);
+        else
+                snprintf(id, size, "+usb:%u-%u:1.0", i / 100, i % 100);
+}
+
+static void write_devices(const char *dir, unsigned int n)
+{
+        unsigned int i;
+
+        for (i = 0; i < n; i++) {
+                char id[UTIL_NAME_SIZE];
+                char path[UTIL_PATH_SIZE];
+                FILE *f;
+
+                device_id(id, sizeof(id), i);
+                strscpyl(path, sizeof(path), dir, "/", id, NULL);
+                assert_se(f = fopen(path, "we"));
+                fprintf(f, "S:disk/by-id/ata-DISK_%u\n", i);
+                fprintf(f, "S:disk/by-path/pci-0000:00:1f.2-scsi-0:0:%u:0\n", i);
+                fprintf(f, "I:%u\n", 1000000 + i);
+                fprintf(f, "E:ID_SERIAL=DISK_%u\n", i);
+                fprintf(f, "E:ID_MODEL=Model_%u\n", i % 7);
+                if (i % 3 == 0)
+                        fprintf(f, "G:systemd\n");
+                if (i % 10 == 0)
+                        fprintf(f, "G:uaccess\n");
+                fclose(f);
+        }
+}
+
+static void bench_files(const char *dir, unsigned int n)
+{
+        unsigned long long usec;
+        size_t bytes = 0;
+        unsigned int i;
+        usec_t ts;
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                char id[UTIL_NAME_SIZE];
+                char path[UTIL_PATH_SIZE];
+                char *data;
+                size_t len;
+
+                device_id(id, sizeof(id), i);
+                strscpyl(path, sizeof(path), dir, "/", id, NULL);
+                assert_se(read_full_file(path, &data, &len) >= 0);
+                bytes += len;
+                free(data);
+        }
+        usec = usec_since(ts);
+
+        printf("files    %6u devices %8llu us %6llu ns/device %8zu bytes\n",
+               n, usec, usec * 1000 / n, bytes);
+}
+
+static void bench_db(struct udev *udev, const char *filename, unsigned int n)
+{
+        struct udev_db *db;
+        unsigned long long usec;
+        size_t bytes = 0;
+        unsigned int i;
+        usec_t ts;
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(db = udev_db_new(udev, filename));
+        for (i = 0; i < n; i++) {
+                char id[UTIL_NAME_SIZE];
+                const char *data;
+                size_t len;
+
+                device_id(id, sizeof(id), i);
+                assert_se(udev_db_get(db, id, &data, &len) == 1);
+                bytes += len;
+        }
+        usec = usec_since(ts);
+
+        printf("database %6u devices %8llu us %6llu ns/device %8zu bytes\n",
+               n, usec, usec * 1000 / n, bytes);
+
+        udev_db_free(db);
+}
+
+/* merging the appended records, from the files or from the database */
+static void bench_rebuild(struct udev *udev, const char *dir, const char *filename, unsigned int n)
+{
+        unsigned long long rebuild, compact;
+        usec_t ts;
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(udev_db_rebuild(udev, dir, filename) >= 0);
+        rebuild = usec_since(ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(udev_db_compact(udev, filename) >= 0);
+        compact = usec_since(ts);
+
+        printf("rebuild  %6u devices %8llu us, compact %8llu us\n", n, rebuild, compact);
+}
+
+/* the database has the same text as the files */
+static void test_db(struct udev *udev, const char *dir, const char *filename, unsigned int n)
+{
+        struct udev_db *db;
+        unsigned int i;
+
+        assert_se(db = udev_db_new(udev, filename));
+        for (i = 0; i < n; i++) {
+                char id[UTIL_NAME_SIZE];
+                char path[UTIL_PATH_SIZE];
+                const char *data;
+                char *text;
+                size_t len, text_len;
+
+                device_id(id, sizeof(id), i);
+                strscpyl(path, sizeof(path), dir, "/", id, NULL);
+                assert_se(read_full_file(path, &text, &text_len) >= 0);
+                assert_se(udev_db_get(db, id, &data, &len) == 1);
+                assert_se(len == text_len && memcmp(data, text, len) == 0);
+                free(text);
+        }
+
+        udev_db_free(db);
+}
+
+static unsigned int count_tagged(struct udev *udev, struct udev_db *db, const char *tag)
+{
+        struct udev_list list;
+        struct udev_list_entry *entry;
+        unsigned int n = 0;
+
+        udev_list_init(udev, &list, false);
+        assert_se(udev_db_get_tagged(db, tag, &list) >= 0);
+        udev_list_entry_foreach(entry, udev_list_get_entry(&list))
+                n++;
+        udev_list_cleanup(&list);
+
+        return n;
+}
+
+static void test_append(struct udev *udev, const char *filename, unsigned int n)
+{
+        static const char text[] = "S:disk/by-label/root\nE:ID_FS_LABEL=root\nG:uaccess\n";
+        struct udev_db *db;
+        unsigned long long count;
+        unsigned int tagged;
+        const char *data;
+        size_t len;
+
+        assert_se(db = udev_db_new(udev, filename));
+        tagged = count_tagged(udev, db, "uaccess");
+        assert_se(tagged == (n + 9) / 10);
+        assert_se(count_tagged(udev, db, "systemd") == (n + 2) / 3);
+        assert_se(count_tagged(udev, db, "seat") == 0);
+        assert_se(udev_db_get(db, "c1:3", &data, &len) == 0);
+
+        /* a changed device, a removed device and a new device */
+        assert_se(udev_db_append(udev, filename, "b8:1", text, strlen(text)) == 0);
+        assert_se(udev_db_append(udev, filename, "+usb:0-0:1.0", NULL, 0) == 0);
+        assert_se(udev_db_append(udev, filename, "c1:3", text, strlen(text)) == 0);
+        assert_se(udev_db_get_tail_count(udev, filename, &count) >= 0 && count == 3);
+
+        assert_se(udev_db_get(db, "b8:1", &data, &len) == 1);
+        assert_se(len == strlen(text) && streq(data, text));
+        assert_se(udev_db_get(db, "+usb:0-0:1.0", &data, &len) == 0);
+        assert_se(udev_db_get(db, "c1:3", &data, &len) == 1);
+        assert_se(streq(data, text));
+
+        /* "+usb:0-0:1.0" lost the tag, "b8:1" and "c1:3" got it */
+        assert_se(count_tagged(udev, db, "uaccess") == tagged + 1);
+
+        udev_db_free(db);
+
+        /* a replaced database is not used anymore */
+        assert_se(udev_db_invalidate(udev, filename) >= 0);
+        assert_se(access(filename, F_OK) < 0);
+        assert_se(udev_db_new(udev, filename) == NULL);
+        assert_se(udev_db_append(udev, filename, "b8:1", text, strlen(text)) == 0);
+}
+
+static void test_compact(struct udev *udev, const char *dir, const char *filename, unsigned int n)
+{
+        static const char text[] = "S:disk/by-label/home\nE:ID_FS_LABEL=home\nG:compact\n";
+        struct udev_db *db;
+        unsigned long long count;
+        const char *data;
+        size_t len;
+        unsigned int i;
+
+        /* a changed device, a removed device, and new devices */
+        assert_se(udev_db_append(udev, filename, "b8:5", text, strlen(text)) == 0);
+        assert_se(udev_db_append(udev, filename, "+usb:0-2:1.0", NULL, 0) == 0);
+        assert_se(udev_db_append(udev, filename, "c1:5", text, strlen(text)) == 0);
+        assert_se(udev_db_append(udev, filename, "c1:5", NULL, 0) == 0);
+        assert_se(udev_db_append(udev, filename, "c1:7", text, strlen(text)) == 0);
+
+        assert_se(udev_db_compact(udev, filename) >= 0);
+        assert_se(udev_db_get_tail_count(udev, filename, &count) >= 0 && count == 0);
+
+        assert_se(db = udev_db_new(udev, filename));
+        assert_se(udev_db_get(db, "b8:5", &data, &len) == 1);
+        assert_se(len == strlen(text) && streq(data, text));
+        assert_se(udev_db_get(db, "+usb:0-2:1.0", &data, &len) == 0);
+        assert_se(udev_db_get(db, "c1:5", &data, &len) == 0);
+        assert_se(udev_db_get(db, "c1:7", &data, &len) == 1);
+        assert_se(streq(data, text));
+        assert_se(count_tagged(udev, db, "compact") == 2);
+
+        /* everything else is unchanged */
+        for (i = 0; i < n; i++) {
+                char id[UTIL_NAME_SIZE];
+                char path[UTIL_PATH_SIZE];
+                char *file;
+                size_t file_len;
+
+                if (i == 2 || i == 5)
+                        continue;
+
+                device_id(id, sizeof(id), i);
+                strscpyl(path, sizeof(path), dir, "/", id, NULL);
+                assert_se(read_full_file(path, &file, &file_len) >= 0);
+                assert_se(udev_db_get(db, id, &data, &len) == 1);
+                assert_se(len == file_len && memcmp(data, file, len) == 0);
+                free(file);
+        }
+
+        udev_db_free(db);
+}
+
+static void bench_enumerate(struct udev *udev)
+{
+        struct udev_enumerate *e;
+        struct udev_list_entry *entry;
+        unsigned long long usec;
+        unsigned int devices = 0, properties = 0;
+        usec_t ts;
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(e = udev_enumerate_new(udev));
+        udev_enumerate_scan_devices(e);
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e)) {
+                struct udev_device *dev;
+                struct udev_list_entry *p;
+
+                dev = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+                if (dev == NULL)
+                        continue;
+                udev_list_entry_foreach(p, udev_device_get_properties_list_entry(dev))
+                        properties++;
+                devices++;
+                udev_device_unref(dev);
+        }
+        udev_enumerate_unref(e);
+        usec = usec_since(ts);
+
+        printf("system   %6u devices %8llu us %6llu ns/device %8u properties (%s)\n",
+               devices, usec, devices > 0 ? usec * 1000 / devices : 0, properties,
+               access(UDEV_DB_FILE, F_OK) == 0 ? UDEV_DB_FILE : "/run/udev/data");
+}
+
+int main(int argc, char *argv[])
+{
+        struct udev *udev;
+        char tmpdir[] = "/tmp/test-udev-db.XXXXXX";
+        char dir[UTIL_PATH_SIZE];
+        char filename[UTIL_PATH_SIZE];
+        unsigned int n = 1000;
+        bool bench = false;
+
+        if (argc > 1) {
+                assert_se(streq(argv[1], "bench"));
+                bench = true;
+                n = 10000;
+
+                if (argc > 2)
+                        assert_se(safe_atou(argv[2], &n) >= 0 && n > 0);
+        }
+
+        log_set_max_level(LOG_ERR);
+
+        assert_se(udev = udev_new());
+        assert_se(mkdtemp(tmpdir) != NULL);
+        strscpyl(dir, sizeof(dir), tmpdir, "/data", NULL);
+        strscpyl(filename, sizeof(filename), tmpdir, "/data.bin", NULL);
+        assert_se(mkdir(dir, 0755) >= 0);
+
+        write_devices(dir, n);
+        assert_se(udev_db_rebuild(udev, dir, filename) >= 0);
+
+        if (bench) {
+                bench_files(dir, n);
+                bench_db(udev, filename, n);
+                bench_rebuild(udev, dir, filename, n);
+        }
+
+        test_db(udev, dir, filename, n);
+        test_compact(udev, dir, filename, n);
+        test_append(udev, filename, n);
+
+        if (bench)
+                bench_enumerate(udev);
+
+        rm_rf_dangerous(tmpdir, false, true, false);
+        udev_unref(udev);
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "strv.h"
+#include "util.h"
+
+/* Enumerates the devices in /sys with one and with several threads,
+ * with the matches which are checked on the files in /sys, and the
+ * ones which need the device. All of them need to return the same
+ * list, in the same order. With "bench", both are timed. */
+
+#define ROUNDS 20
+
+typedef void (*add_matches_t)(struct udev_enumerate *e);
+
+static void no_matches(struct udev_enumerate *e)
+{
+}
+
+static void match_subsystem(struct udev_enumerate *e)
+{
+        udev_enumerate_add_match_subsystem(e, "block");
+        udev_enumerate_add_match_subsystem(e, "net");
+        udev_enumerate_add_match_subsystem(e, "tty");
+}
+
+static void match_sysname(struct udev_enumerate *e)
+{
+        udev_enumerate_add_match_sysname(e, "loop*");
+        udev_enumerate_add_match_sysname(e, "tty*");
+}
+
+static void match_sysattr(struct udev_enumerate *e)
+{
+        udev_enumerate_add_match_sysattr(e, "dev", NULL);
+        udev_enumerate_add_nomatch_sysattr(e, "subsystem", "mem");
+}
+
+static void match_driver(struct udev_enumerate *e)
+{
+        udev_enumerate_add_match_sysattr(e, "driver", NULL);
+}
+
+static void match_property(struct udev_enumerate *e)
+{
+        udev_enumerate_add_match_property(e, "DEVTYPE", "*");
+}
+
+static char **scan(struct udev *udev, add_matches_t add_matches, unsigned int threads)
+{
+        struct udev_enumerate *e;
+        struct udev_list_entry *entry;
+        char **list = NULL;
+
+        assert_se(e = udev_enumerate_new(udev));
+        add_matches(e);
+        assert_se(udev_enumerate_set_threads(e, threads) == 0);
+        assert_se(udev_enumerate_scan_devices(e) == 0);
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e))
+                assert_se(strv_extend(&list, udev_list_entry_get_name(entry)) >= 0);
+        udev_enumerate_unref(e);
+
+        return list;
+}
+
+static bool lists_equal(char **a, char **b)
+{
+        unsigned int i;
+
+        if (strv_length(a) != strv_length(b))
+                return false;
+        for (i = 0; a != NULL && a[i] != NULL; i++)
+                if (!streq(a[i], b[i]))
+                        return false;
+        return true;
+}
+
+static const struct {
+        const char *name;
+        add_matches_t add_matches;
+} matches[] = {
+        { "all",       no_matches },
+        { "subsystem", match_subsystem },
+        { "sysname",   match_sysname },
+        { "sysattr",   match_sysattr },
+        { "driver",    match_driver },
+        { "property",  match_property },
+};
+
+static void test_scan(struct udev *udev, add_matches_t add_matches, unsigned int threads)
+{
+        char **serial, **parallel;
+
+        serial = scan(udev, add_matches, 0);
+        parallel = scan(udev, add_matches, threads);
+        assert_se(lists_equal(serial, parallel));
+
+        strv_free(serial);
+        strv_free(parallel);
+}
+
+static void bench(struct udev *udev, const char *name, add_matches_t add_matches, unsigned int threads)
+{
+        char **serial;
+        unsigned long long usec_serial, usec_parallel;
+        unsigned int i;
+        usec_t ts;
+
+        serial = scan(udev, add_matches, 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < ROUNDS; i++)
+                strv_free(scan(udev, add_matches, 0));
+        usec_serial = (unsigned long long) (now(CLOCK_MONOTONIC) - ts) / ROUNDS;
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < ROUNDS; i++)
+                strv_free(scan(udev, add_matches, threads));
+        usec_parallel = (unsigned long long) (now(CLOCK_MONOTONIC) - ts) / ROUNDS;
+
+        printf("%-10s %5u devices: %8llu us, %2u threads %8llu us\n",
+               name, strv_length(serial), usec_serial, threads, usec_parallel);
+
+        strv_free(serial);
+}
+
+static void test_delayed(struct udev *udev)
+{
+        assert_se(udev_enumerate_syspath_delayed(udev, "/sys/devices/virtual/block/dm-0"));
+        assert_se(udev_enumerate_syspath_delayed(udev, "/sys/devices/virtual/block/md0"));
+        assert_se(udev_enumerate_syspath_delayed(udev, "/sys/devices/pci0000:00/0000:00:1b.0/sound/card0/controlC0"));
+        assert_se(!udev_enumerate_syspath_delayed(udev, "/sys/devices/pci0000:00/0000:00:1b.0/sound/card0/pcmC0D0p"));
+        assert_se(!udev_enumerate_syspath_delayed(udev, "/sys/devices/virtual/block/loop0"));
+}
+
+int main(int argc, char *argv[])
+{
+        struct udev *udev;
+        unsigned int threads = 4, i;
+
+        if (argc > 1)
+                assert_se(streq(argv[1], "bench"));
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &threads) >= 0 && threads > 0);
+
+        log_set_max_level(LOG_ERR);
+
+        assert_se(udev = udev_new());
+
+        test_delayed(udev);
+        for (i = 0; i < ELEMENTSOF(matches); i++)
+                test_scan(udev, matches[i].add_matches, threads);
+
+        if (argc > 1)
+                for (i = 0; i < ELEMENTSOF(matches); i++)
+                        bench(udev, matches[i].name, matches[i].add_matches, threads);
+
+        udev_unref(udev);
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,294 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "udev.h"
+
+/* Replays a synthetic coldplug, i.e. an "add" event for every device
+ * in sysfs order followed by a "change" event for every disk, through
+ * the scheduling loop of udevd. The scheduling is done with the event
+ * index, and the way udevd did it before, i.e. with a linear search of
+ * the queue for every queued event, and on every pass the entire queue.
+ * Both have to make the same decisions, which is checked by default.
+ * The timings are only measured with "bench". */
+
+#define WORKERS 32
+
+struct bench_event {
+        struct udev_list_node node;
+        unsigned long long int seqnum;
+        unsigned long long int delaying_seqnum;
+        char *devpath;
+        size_t devpath_len;
+        dev_t devnum;
+        int ifindex;
+        bool is_block;
+        bool running;
+        struct udev_event_index_entry *entry;
+};
+
+static inline struct bench_event *node_to_event(struct udev_list_node *node)
+{
+        return container_of(node, struct bench_event, node);
+}
+
+static unsigned int make_events(struct bench_event *events, unsigned int n)
+{
+        unsigned int i = 0, c, h, p, disks = 0, nets = 0;
+
+        /* controllers with hosts with a disk with partitions, 7 events each */
+        for (c = 0; i + 7 <= n - n / 8; c++) {
+                for (h = 0; h < 2 && i + 7 <= n - n / 8; h++) {
+                        char disk[256];
+
+                        snprintf(disk, sizeof(disk), "/devices/pci0000:%02x/0000:%02x:%02x.0/host%u/target%u:0:0/%u:0:0:0/block/sd%u",
+                                 c / 32, c / 32, c % 32, c * 2 + h, c * 2 + h, c * 2 + h, disks);
+
+                        assert_se(asprintf(&events[i++].devpath, "/devices/pci0000:%02x/0000:%02x:%02x.0/host%u",
+                                           c / 32, c / 32, c % 32, c * 2 + h) >= 0);
+                        assert_se(events[i++].devpath = strdup(disk));
+                        events[i-1].devnum = makedev(8, disks * 16);
+                        events[i-1].is_block = true;
+
+                        for (p = 1; p <= 4; p++) {
+                                assert_se(asprintf(&events[i++].devpath, "%s/sd%u%u", disk, disks, p) >= 0);
+                                events[i-1].devnum = makedev(8, disks * 16 + p);
+                                events[i-1].is_block = true;
+                        }
+
+                        /* the change event of the disk comes later */
+                        assert_se(events[i++].devpath = strdup(disk));
+                        events[i-1].devnum = makedev(8, disks * 16);
+                        events[i-1].is_block = true;
+
+                        disks++;
+                }
+        }
+
+        for (; i < n; i++) {
+                assert_se(asprintf(&events[i].devpath, "/devices/virtual/net/veth%u", nets) >= 0);
+                events[i].ifindex = 2 + nets++;
+        }
+
+        for (i = 0; i < n; i++) {
+                events[i].seqnum = 1000 + i;
+                events[i].devpath_len = strlen(events[i].devpath);
+        }
+
+        return n;
+}
+
+/* what udevd did before the index */
+static bool is_devpath_busy_linear(struct udev_list_node *list, struct bench_event *event)
+{
+        struct udev_list_node *loop;
+        size_t common;
+
+        udev_list_node_foreach(loop, list) {
+                struct bench_event *loop_event = node_to_event(loop);
+
+                if (loop_event->seqnum < event->delaying_seqnum)
+                        continue;
+                if (loop_event->seqnum == event->delaying_seqnum)
+                        return true;
+                if (loop_event->seqnum >= event->seqnum)
+                        break;
+                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
+                        return true;
+                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
+                        return true;
+
+                common = MIN(loop_event->devpath_len, event->devpath_len);
+                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
+                        continue;
+
+                if (loop_event->devpath_len == event->devpath_len) {
+                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
+                                continue;
+                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
+                                continue;
+                        event->delaying_seqnum = loop_event->seqnum;
+                        return true;
+                }
+                if (event->devpath[common] == '/' || loop_event->devpath[common] == '/') {
+                        event->delaying_seqnum = loop_event->seqnum;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+static unsigned long long usec_since(usec_t ts)
+{
+        return (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+}
+
+/* returns the number of passes of the scheduling loop */
+static unsigned int replay(struct bench_event *events, unsigned int n, bool linear, bool compare)
+{
+        struct udev_event_index *idx;
+        UDEV_LIST(queue);
+        struct udev_list_node *loop, *tmp;
+        unsigned int i, passes = 0;
+
+        assert_se(idx = udev_event_index_new());
+
+        for (i = 0; i < n; i++) {
+                events[i].delaying_seqnum = 0;
+                events[i].running = false;
+                assert_se(events[i].entry = udev_event_index_add(idx, events[i].seqnum, events[i].devpath, NULL,
+                                                                  events[i].devnum, events[i].is_block,
+                                                                  events[i].ifindex, false));
+                udev_list_node_append(&events[i].node, &queue);
+        }
+
+        while (!udev_list_node_is_empty(&queue)) {
+                unsigned int running = 0;
+
+                passes++;
+
+                /* event_queue_start() */
+                udev_list_node_foreach(loop, &queue) {
+                        struct bench_event *event = node_to_event(loop);
+                        bool busy;
+
+                        if (event->running)
+                                continue;
+
+                        if (linear)
+                                busy = is_devpath_busy_linear(&queue, event);
+                        else
+                                busy = udev_event_index_is_busy(idx, event->entry);
+
+                        if (compare)
+                                assert_se(busy == is_devpath_busy_linear(&queue, event));
+
+                        if (busy)
+                                continue;
+
+                        /* before, the queue was not left early when
+                         * all workers were busy */
+                        if (running >= WORKERS)
+                                continue;
+
+                        event->running = true;
+                        if (++running >= WORKERS && !linear)
+                                break;
+                }
+
+                assert_se(running > 0);
+
+                /* all workers return */
+                udev_list_node_foreach_safe(loop, tmp, &queue) {
+                        struct bench_event *event = node_to_event(loop);
+
+                        if (!event->running)
+                                continue;
+
+                        udev_list_node_remove(&event->node);
+                        udev_event_index_remove(idx, event->entry);
+                }
+        }
+
+        assert_se(udev_event_index_size(idx) == 0);
+        udev_event_index_free(idx);
+
+        return passes;
+}
+
+static void free_events(struct bench_event *events, unsigned int n)
+{
+        unsigned int i;
+
+        for (i = 0; i < n; i++)
+                free(events[i].devpath);
+        free(events);
+}
+
+static void test_replay(unsigned int n)
+{
+        struct bench_event *events;
+        unsigned int passes;
+
+        assert_se(events = calloc(n, sizeof(struct bench_event)));
+        make_events(events, n);
+
+        passes = replay(events, n, false, true);
+        assert_se(passes > 0);
+        assert_se(replay(events, n, true, false) == passes);
+
+        free_events(events, n);
+}
+
+static void bench(unsigned int n, bool linear)
+{
+        struct bench_event *events;
+        unsigned int passes;
+        unsigned long long indexed, lin = 0;
+        usec_t ts;
+
+        assert_se(events = calloc(n, sizeof(struct bench_event)));
+        make_events(events, n);
+
+        ts = now(CLOCK_MONOTONIC);
+        passes = replay(events, n, false, false);
+        indexed = usec_since(ts);
+
+        if (linear) {
+                ts = now(CLOCK_MONOTONIC);
+                assert_se(replay(events, n, true, false) == passes);
+                lin = usec_since(ts);
+        }
+
+        if (linear)
+                printf("%6u events, %5u passes: index %9llu us, linear %9llu us\n", n, passes, indexed, lin);
+        else
+                printf("%6u events, %5u passes: index %9llu us\n", n, passes, indexed);
+
+        free_events(events, n);
+}
+
+int main(int argc, char *argv[])
+{
+        unsigned int n = 50000;
+
+        if (argc <= 1) {
+                test_replay(100);
+                test_replay(1000);
+                test_replay(2000);
+                return 0;
+        }
+
+        assert_se(streq(argv[1], "bench"));
+
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &n) >= 0);
+
+        bench(1000, true);
+        bench(2000, true);
+        bench(4000, true);
+        bench(n, false);
+
+        return 0;
+}
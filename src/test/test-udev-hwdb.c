@@ -0,0 +1,188 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "strv.h"
+#include "util.h"
+
+/* Looks up the modalias of every device in /sys in the hardware
+ * database, with both formats, hwdb.bin and hwdb2.bin, which
+ * "udevadm hwdb --update" writes, and with the cache of the recent
+ * lookups. All of them need to return the same properties. With
+ * "bench", the lookups are timed. */
+
+#define LOOKUPS 200000
+
+static char **read_modaliases(struct udev *udev)
+{
+        struct udev_enumerate *e;
+        struct udev_list_entry *entry;
+        char **modaliases = NULL;
+
+        assert_se(e = udev_enumerate_new(udev));
+        udev_enumerate_scan_devices(e);
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e)) {
+                struct udev_device *dev;
+                const char *modalias;
+
+                dev = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+                if (dev == NULL)
+                        continue;
+                modalias = udev_device_get_sysattr_value(dev, "modalias");
+                if (modalias != NULL)
+                        assert_se(strv_extend(&modaliases, modalias) >= 0);
+                udev_device_unref(dev);
+        }
+        udev_enumerate_unref(e);
+
+        return modaliases;
+}
+
+static char *properties_string(struct udev_hwdb *hwdb, const char *modalias)
+{
+        struct udev_list_entry *entry;
+        char *s = strdup("");
+
+        udev_list_entry_foreach(entry, udev_hwdb_get_properties_list_entry(hwdb, modalias, 0)) {
+                char *t;
+
+                assert_se(s != NULL);
+                t = strjoin(s, udev_list_entry_get_name(entry), "=", udev_list_entry_get_value(entry), "\n", NULL);
+                free(s);
+                s = t;
+        }
+        assert_se(s != NULL);
+
+        return s;
+}
+
+static void test_lookup(struct udev *udev, const char *filename, unsigned int cache_size, char **modaliases, char **expected)
+{
+        struct udev_hwdb *hwdb;
+        unsigned int i;
+
+        hwdb = udev_hwdb_new_from_file(udev, filename, cache_size);
+        if (hwdb == NULL) {
+                printf("no %s, skipping\n", filename);
+                return;
+        }
+
+        for (i = 0; modaliases[i] != NULL; i++) {
+                char *s;
+
+                s = properties_string(hwdb, modaliases[i]);
+                if (expected[i] == NULL)
+                        expected[i] = s;
+                else {
+                        assert_se(streq(s, expected[i]));
+                        free(s);
+                }
+        }
+
+        udev_hwdb_unref(hwdb);
+}
+
+static void bench(struct udev *udev, const char *filename, unsigned int cache_size, char **modaliases)
+{
+        struct udev_hwdb *hwdb;
+        unsigned int n = 0, properties = 0, i;
+        unsigned long long usec;
+        usec_t ts;
+
+        hwdb = udev_hwdb_new_from_file(udev, filename, cache_size);
+        if (hwdb == NULL)
+                return;
+
+        ts = now(CLOCK_MONOTONIC);
+        while (n < LOOKUPS) {
+                for (i = 0; modaliases[i] != NULL; i++, n++) {
+                        struct udev_list_entry *entry;
+
+                        udev_list_entry_foreach(entry, udev_hwdb_get_properties_list_entry(hwdb, modaliases[i], 0))
+                                properties++;
+                }
+        }
+        usec = (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+
+        printf("%-28s cache %3u: %8u lookups %9llu us %9llu lookups/sec %8u properties\n",
+               filename, cache_size, n, usec, usec > 0 ? n * USEC_PER_SEC / usec : 0, properties);
+
+        udev_hwdb_unref(hwdb);
+}
+
+int main(int argc, char *argv[])
+{
+        struct udev *udev;
+        const char *hwdb_bin = "/etc/udev/hwdb.bin";
+        const char *hwdb2_bin = "/etc/udev/hwdb2.bin";
+        char **modaliases;
+        char **expected;
+        unsigned int count;
+        bool run_bench = false;
+
+        if (argc > 1 && streq(argv[1], "bench")) {
+                run_bench = true;
+                argc--;
+                argv++;
+        }
+
+        if (argc > 2) {
+                hwdb_bin = argv[1];
+                hwdb2_bin = argv[2];
+        }
+
+        log_set_max_level(LOG_ERR);
+
+        assert_se(udev = udev_new());
+
+        modaliases = read_modaliases(udev);
+        count = strv_length(modaliases);
+        if (count == 0) {
+                printf("no modalias in /sys, skipping\n");
+                udev_unref(udev);
+                return EXIT_SUCCESS;
+        }
+        printf("%u modaliases\n", count);
+
+        assert_se(expected = new0(char *, count + 1));
+
+        test_lookup(udev, hwdb_bin, 0, modaliases, expected);
+        test_lookup(udev, hwdb2_bin, 0, modaliases, expected);
+        test_lookup(udev, hwdb_bin, 64, modaliases, expected);
+        test_lookup(udev, hwdb2_bin, 64, modaliases, expected);
+
+        if (run_bench) {
+                bench(udev, hwdb_bin, 0, modaliases);
+                bench(udev, hwdb2_bin, 0, modaliases);
+                bench(udev, hwdb_bin, 64, modaliases);
+                bench(udev, hwdb2_bin, 64, modaliases);
+        }
+
+        strv_free(expected);
+        strv_free(modaliases);
+        udev_unref(udev);
+
+        return EXIT_SUCCESS;
+}
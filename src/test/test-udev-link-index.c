@@ -0,0 +1,193 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "udev.h"
+
+/* Checks the link index against a linear search of all claims of a
+ * link, like the one of the stack directory, with a synthetic set of
+ * links claimed by many paths of the same disks, like multipath sets
+ * up, which are added and removed in random order. The updates are
+ * timed with "bench". */
+
+struct claim {
+        bool active;
+        int priority;
+        unsigned long long int seq;
+};
+
+static void test_basic(void)
+{
+        struct udev_link_index *idx;
+
+        assert_se(idx = udev_link_index_new());
+        assert_se(udev_link_index_find(idx, "/dev/disk/by-id/wwn-0x1") == NULL);
+
+        /* the latest claim with the same priority wins */
+        assert_se(udev_link_index_add(idx, "/dev/disk/by-id/wwn-0x1", "b8:0", "/dev/sda", 0) == 0);
+        assert_se(streq(udev_link_index_find(idx, "/dev/disk/by-id/wwn-0x1"), "/dev/sda"));
+        assert_se(udev_link_index_add(idx, "/dev/disk/by-id/wwn-0x1", "b8:16", "/dev/sdb", 0) == 0);
+        assert_se(streq(udev_link_index_find(idx, "/dev/disk/by-id/wwn-0x1"), "/dev/sdb"));
+
+        /* a higher priority wins over a later claim */
+        assert_se(udev_link_index_add(idx, "/dev/disk/by-id/wwn-0x1", "b253:0", "/dev/dm-0", 10) == 0);
+        assert_se(udev_link_index_add(idx, "/dev/disk/by-id/wwn-0x1", "b8:32", "/dev/sdc", 0) == 0);
+        assert_se(streq(udev_link_index_find(idx, "/dev/disk/by-id/wwn-0x1"), "/dev/dm-0"));
+
+        /* a claim again replaces the earlier one */
+        assert_se(udev_link_index_add(idx, "/dev/disk/by-id/wwn-0x1", "b8:0", "/dev/sda", 0) == 0);
+        udev_link_index_remove(idx, "/dev/disk/by-id/wwn-0x1", "b253:0");
+        assert_se(streq(udev_link_index_find(idx, "/dev/disk/by-id/wwn-0x1"), "/dev/sda"));
+        udev_link_index_remove(idx, "/dev/disk/by-id/wwn-0x1", "b8:0");
+        assert_se(streq(udev_link_index_find(idx, "/dev/disk/by-id/wwn-0x1"), "/dev/sdc"));
+
+        /* removing an unknown claim does nothing */
+        udev_link_index_remove(idx, "/dev/disk/by-id/wwn-0x1", "b8:48");
+        udev_link_index_remove(idx, "/dev/disk/by-id/wwn-0x2", "b8:0");
+        assert_se(udev_link_index_size(idx) == 1);
+
+        udev_link_index_remove(idx, "/dev/disk/by-id/wwn-0x1", "b8:16");
+        udev_link_index_remove(idx, "/dev/disk/by-id/wwn-0x1", "b8:32");
+        assert_se(udev_link_index_find(idx, "/dev/disk/by-id/wwn-0x1") == NULL);
+        assert_se(udev_link_index_size(idx) == 0);
+
+        udev_link_index_free(idx);
+}
+
+/* the claim with the highest priority, and for the same priority the latest one */
+static int find_linear(struct claim *claims, unsigned int paths)
+{
+        int found = -1;
+        unsigned int p;
+
+        for (p = 0; p < paths; p++) {
+                if (!claims[p].active)
+                        continue;
+                if (found < 0 ||
+                    claims[p].priority > claims[found].priority ||
+                    (claims[p].priority == claims[found].priority && claims[p].seq > claims[found].seq))
+                        found = p;
+        }
+
+        return found;
+}
+
+static void test_multipath(unsigned int disks, unsigned int paths, unsigned int ops)
+{
+        struct udev_link_index *idx;
+        struct claim *claims;
+        unsigned long long int seq = 0;
+        unsigned int i;
+
+        assert_se(idx = udev_link_index_new());
+        assert_se(claims = calloc(disks * paths, sizeof(struct claim)));
+
+        srand(4711);
+        for (i = 0; i < ops; i++) {
+                unsigned int d = rand() % disks;
+                unsigned int p = rand() % paths;
+                struct claim *c = &claims[d * paths + p];
+                char link[UTIL_PATH_SIZE];
+                char id[UTIL_NAME_SIZE];
+                char devnode[UTIL_PATH_SIZE];
+                const char *target;
+                int found;
+
+                snprintf(link, sizeof(link), "/dev/disk/by-id/wwn-0x%08x", d);
+                snprintf(id, sizeof(id), "b8:%u", d * paths + p);
+                snprintf(devnode, sizeof(devnode), "/dev/sd-%u-%u", d, p);
+
+                if (rand() % 3 == 0) {
+                        udev_link_index_remove(idx, link, id);
+                        c->active = false;
+                } else {
+                        /* a few paths have a higher priority */
+                        c->priority = p % 16 == 0 ? 10 : 0;
+                        c->seq = ++seq;
+                        c->active = true;
+                        assert_se(udev_link_index_add(idx, link, id, devnode, c->priority) == 0);
+                }
+
+                target = udev_link_index_find(idx, link);
+                found = find_linear(&claims[d * paths], paths);
+                if (found < 0) {
+                        assert_se(target == NULL);
+                } else {
+                        snprintf(devnode, sizeof(devnode), "/dev/sd-%u-%u", d, found);
+                        assert_se(target != NULL && streq(target, devnode));
+                }
+        }
+
+        free(claims);
+        udev_link_index_free(idx);
+}
+
+static void bench(unsigned int disks, unsigned int paths, unsigned int ops)
+{
+        struct udev_link_index *idx;
+        unsigned long long usec;
+        unsigned int i;
+        usec_t ts;
+
+        assert_se(idx = udev_link_index_new());
+
+        srand(42);
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < ops; i++) {
+                unsigned int d = rand() % disks;
+                unsigned int p = rand() % paths;
+                char link[UTIL_PATH_SIZE];
+                char id[UTIL_NAME_SIZE];
+
+                snprintf(link, sizeof(link), "/dev/disk/by-id/wwn-0x%08x", d);
+                snprintf(id, sizeof(id), "b8:%u", d * paths + p);
+
+                if (rand() % 3 == 0)
+                        udev_link_index_remove(idx, link, id);
+                else
+                        assert_se(udev_link_index_add(idx, link, id, "/dev/sdx", p % 16 == 0 ? 10 : 0) == 0);
+                udev_link_index_find(idx, link);
+        }
+        usec = (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+
+        printf("%5u links, %4u paths: %8u updates %9llu us, %5llu ns/update\n",
+               disks, paths, ops, usec, usec * 1000 / ops);
+
+        udev_link_index_free(idx);
+}
+
+int main(int argc, char *argv[])
+{
+        test_basic();
+        test_multipath(16, 64, 100000);
+
+        if (argc <= 1)
+                return EXIT_SUCCESS;
+
+        assert_se(streq(argv[1], "bench"));
+
+        bench(1000, 4, 1000000);
+        bench(100, 64, 1000000);
+        bench(10, 1024, 1000000);
+
+        return EXIT_SUCCESS;
+}
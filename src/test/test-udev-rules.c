@@ -0,0 +1,349 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "udev.h"
+#include "fileio.h"
+#include "strv.h"
+
+/* Checks the matching of globs, and udev_rules_apply_to_event() over
+ * a set of recorded uevents, with a few thousand generated rules in
+ * the style of the shipped ones, with and without looking up the rules
+ * by ACTION, SUBSYSTEM and KERNEL first, and loading the rules from
+ * their files and from the cache. All must give the same result. With
+ * "bench", each of them is timed as well. */
+
+void udev_main_log(struct udev *udev, int priority,
+                   const char *file, int line, const char *fn,
+                   const char *format, va_list args) {}
+
+static const char * const uevents[] = {
+        "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block/sda\0SUBSYSTEM=block\0DEVNAME=/dev/sda\0DEVTYPE=disk\0MAJOR=8\0MINOR=0\0",
+        "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block/sda/sda1\0SUBSYSTEM=block\0DEVNAME=/dev/sda1\0DEVTYPE=partition\0MAJOR=8\0MINOR=1\0",
+        "ACTION=change\0DEVPATH=/devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block/sda\0SUBSYSTEM=block\0DEVNAME=/dev/sda\0DEVTYPE=disk\0MAJOR=8\0MINOR=0\0",
+        "ACTION=add\0DEVPATH=/devices/virtual/block/loop0\0SUBSYSTEM=block\0DEVNAME=/dev/loop0\0DEVTYPE=disk\0MAJOR=7\0MINOR=0\0",
+        "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:19.0/net/eth0\0SUBSYSTEM=net\0INTERFACE=eth0\0IFINDEX=2\0",
+        "ACTION=add\0DEVPATH=/devices/virtual/net/lo\0SUBSYSTEM=net\0INTERFACE=lo\0IFINDEX=1\0",
+        "ACTION=add\0DEVPATH=/devices/platform/i8042/serio0/input/input3/event3\0SUBSYSTEM=input\0DEVNAME=/dev/input/event3\0MAJOR=13\0MINOR=67\0",
+        "ACTION=add\0DEVPATH=/devices/platform/i8042/serio0/input/input3\0SUBSYSTEM=input\0PRODUCT=11/1/1/ab41\0EV=120013\0",
+        "ACTION=add\0DEVPATH=/devices/virtual/tty/tty7\0SUBSYSTEM=tty\0DEVNAME=/dev/tty7\0MAJOR=4\0MINOR=7\0",
+        "ACTION=add\0DEVPATH=/devices/pnp0/00:05/tty/ttyS0\0SUBSYSTEM=tty\0DEVNAME=/dev/ttyS0\0MAJOR=4\0MINOR=64\0",
+        "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:1d.0/usb2/2-1\0SUBSYSTEM=usb\0DEVNAME=/dev/bus/usb/002/002\0DEVTYPE=usb_device\0MAJOR=189\0MINOR=129\0PRODUCT=8087/24/0\0",
+        "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:1d.0/usb2/2-1/2-1:1.0\0SUBSYSTEM=usb\0DEVTYPE=usb_interface\0INTERFACE=9/0/0\0",
+        "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:1b.0/sound/card0/controlC0\0SUBSYSTEM=sound\0DEVNAME=/dev/snd/controlC0\0MAJOR=116\0MINOR=7\0",
+        "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:02.0\0SUBSYSTEM=pci\0PCI_CLASS=30000\0PCI_ID=8086:0126\0MODALIAS=pci:v00008086d00000126sv000017AAsd000021CEbc03sc00i00\0",
+        "ACTION=add\0DEVPATH=/devices/virtual/misc/fuse\0SUBSYSTEM=misc\0DEVNAME=/dev/fuse\0MAJOR=10\0MINOR=229\0",
+        "ACTION=remove\0DEVPATH=/devices/pci0000:00/0000:00:1d.0/usb2/2-1\0SUBSYSTEM=usb\0DEVNAME=/dev/bus/usb/002/002\0DEVTYPE=usb_device\0MAJOR=189\0MINOR=129\0",
+};
+
+static const char * const subsystems[] = {
+        "block", "net", "input", "tty", "usb", "sound", "pci", "misc",
+        "scsi", "video4linux", "hidraw", "drm", "firmware", "bluetooth",
+        "rfkill", "backlight", "leds", "power_supply", "mmc", "platform",
+};
+
+static void write_rules(const char *dir, unsigned int n_files, unsigned int n_rules)
+{
+        unsigned int i, j;
+
+        for (i = 0; i < n_files; i++) {
+                const char *subsystem = subsystems[i % ELEMENTSOF(subsystems)];
+                _cleanup_free_ char *fn = NULL;
+                FILE *f;
+
+                assert_se(asprintf(&fn, "%s/%02u-bench-%s-%u.rules", dir, 10 + i % 90, subsystem, i) >= 0);
+                assert_se(f = fopen(fn, "we"));
+
+                /* a block of rules skipped by GOTO */
+                fprintf(f, "ACTION==\"remove\", GOTO=\"bench_%u_end\"\n", i);
+                fprintf(f, "SUBSYSTEM!=\"%s\", GOTO=\"bench_%u_end\"\n", subsystem, i);
+                for (j = 0; j < n_rules / 4; j++)
+                        fprintf(f, "KERNEL==\"%.2s%u*\", ENV{BENCH_%u_%u}=\"1\"\n", subsystem, j, i, j);
+                fprintf(f, "ENV{BENCH_%u}=\"1\"\n", i);
+                fprintf(f, "LABEL=\"bench_%u_end\"\n\n", i);
+
+                /* rules with their own keys */
+                for (j = 0; j < n_rules / 4; j++)
+                        fprintf(f, "SUBSYSTEM==\"%s\", KERNEL==\"%s%u\", ENV{BENCH_K_%u_%u}=\"1\"\n",
+                                subsystem, j % 2 ? "sd" : "tty", j, i, j);
+                for (j = 0; j < n_rules / 4; j++)
+                        fprintf(f, "ACTION==\"add|change\", SUBSYSTEM==\"%s|%s\", ENV{DEVTYPE}==\"disk\", TAG+=\"bench%u\"\n",
+                                subsystem, subsystems[(i + j) % ELEMENTSOF(subsystems)], j);
+                for (j = 0; j < n_rules / 4; j++)
+                        fprintf(f, "KERNEL==\"event*\", SUBSYSTEM==\"input\", ENV{BENCH_I_%u_%u}=\"%u\"\n", i, j, j);
+
+                fclose(f);
+        }
+}
+
+static struct udev_device *device_from_uevent(struct udev *udev, const char *uevent)
+{
+        struct udev_device *dev;
+        const char *s;
+
+        assert_se(dev = udev_device_new(udev));
+        udev_device_set_info_loaded(dev);
+
+        for (s = uevent; *s; s += strlen(s) + 1)
+                udev_device_add_property_from_string_parse(dev, s);
+        assert_se(udev_device_add_property_from_string_parse_finish(dev) == 0);
+
+        return dev;
+}
+
+static char *apply(struct udev *udev, struct udev_rules *rules, const char *uevent, const sigset_t *sigmask)
+{
+        struct udev_device *dev;
+        struct udev_event *event;
+        struct udev_list_entry *entry;
+        char *result = NULL;
+
+        dev = device_from_uevent(udev, uevent);
+        assert_se(event = udev_event_new(dev));
+
+        assert_se(udev_rules_apply_to_event(rules, event, sigmask) == 0);
+
+        /* everything the rules did */
+        udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(dev)) {
+                char *s;
+
+                assert_se(s = strjoin(strempty(result), udev_list_entry_get_name(entry), "=",
+                                      udev_list_entry_get_value(entry), "\n", NULL));
+                free(result);
+                result = s;
+        }
+        udev_list_entry_foreach(entry, udev_device_get_tags_list_entry(dev)) {
+                char *s;
+
+                assert_se(s = strjoin(strempty(result), "TAG=", udev_list_entry_get_name(entry), "\n", NULL));
+                free(result);
+                result = s;
+        }
+
+        udev_event_unref(event);
+        udev_device_unref(dev);
+
+        return result;
+}
+
+static bool has_property(const char *result, const char *key)
+{
+        char s[UTIL_NAME_SIZE];
+
+        snprintf(s, sizeof(s), "%s=1\n", key);
+        return strstr(result, s) != NULL;
+}
+
+/* globs and alternatives are compiled when the rules are loaded */
+static void test_globs(struct udev *udev)
+{
+        char dir[] = "/tmp/test-udev-rules.XXXXXX";
+        const char *dirs[] = { dir, NULL };
+        _cleanup_free_ char *fn = NULL;
+        struct udev_rules *rules;
+        sigset_t sigmask;
+        FILE *f;
+        static const struct {
+                unsigned int uevent;
+                const char *set;
+                const char *unset;
+        } checks[] = {
+                { 0, "G_DISK G_NOT G_ESC G_ALL",             "G_PART G_ZERO G_VT G_TTY G_NI G_SPLIT" },
+                { 1, "G_DISK G_PART G_NOT G_SPLIT G_ALL",    "G_ZERO G_VT G_TTY G_NI G_ESC" },
+                { 3, "G_ZERO G_NOT G_ESC G_ALL",             "G_DISK G_PART G_VT G_TTY G_NI" },
+                { 4, "G_ZERO G_NI G_ALL",                    "G_DISK G_PART G_VT G_TTY G_NOT" },
+                { 6, "G_NI G_ALL",                           "G_DISK G_PART G_ZERO G_VT G_TTY G_NOT" },
+                { 8, "G_VT G_TTY G_NOT G_ALL",               "G_DISK G_PART G_ZERO G_NI" },
+                { 9, "G_TTY G_ZERO G_NOT G_ALL",             "G_DISK G_PART G_VT G_NI" },
+        };
+        unsigned int i;
+
+        assert_se(mkdtemp(dir));
+        assert_se(asprintf(&fn, "%s/10-globs.rules", dir) >= 0);
+        assert_se(f = fopen(fn, "we"));
+        fputs("KERNEL==\"sd*|vd*|nvme*\", ENV{G_DISK}=\"1\"\n"
+              "KERNEL==\"sd*1\", ENV{G_PART}=\"1\"\n"
+              "KERNEL==\"*0\", ENV{G_ZERO}=\"1\"\n"
+              "KERNEL==\"tty[0-9]*\", ENV{G_VT}=\"1\"\n"
+              "KERNEL==\"tty?*\", ENV{G_TTY}=\"1\"\n"
+              "SUBSYSTEM==\"net|input\", ENV{G_NI}=\"1\"\n"
+              "KERNEL!=\"event*|eth*|input?\", ENV{G_NOT}=\"1\"\n"
+              "ENV{DEVTYPE}==\"dis\\k*\", ENV{G_ESC}=\"1\"\n"
+              "ENV{DEVTYPE}==\"dis\\k|partition\", ENV{G_SPLIT}=\"1\"\n"
+              "KERNEL==\"*\", ENV{G_ALL}=\"1\"\n", f);
+        fclose(f);
+
+        assert_se(rules = udev_rules_new_from_dirs(udev, 0, dirs));
+        sigprocmask(SIG_SETMASK, NULL, &sigmask);
+
+        for (i = 0; i < ELEMENTSOF(checks); i++) {
+                _cleanup_free_ char *result = NULL;
+                char *key, *state;
+                size_t l;
+
+                result = apply(udev, rules, uevents[checks[i].uevent], &sigmask);
+                assert_se(result);
+
+                FOREACH_WORD(key, l, checks[i].set, state)
+                        assert_se(has_property(result, strndupa(key, l)));
+                FOREACH_WORD(key, l, checks[i].unset, state)
+                        assert_se(!has_property(result, strndupa(key, l)));
+        }
+
+        udev_rules_unref(rules);
+        assert_se(rm_rf_dangerous(dir, false, true, false) >= 0);
+}
+
+/* same results with and without the index, and from the cache */
+static void test_rules(struct udev *udev, unsigned int n_files, unsigned int n_rules)
+{
+        char dir[] = "/tmp/test-udev-rules.XXXXXX";
+        char cache_dir[] = "/tmp/test-udev-rules-cache.XXXXXX";
+        const char *dirs[] = { dir, NULL };
+        _cleanup_free_ char *cache = NULL, *fn = NULL;
+        struct udev_rules *rules, *cached;
+        sigset_t sigmask;
+        const struct timespec old[2] = { { 1, 0 }, { 1, 0 } };
+        unsigned int i;
+
+        assert_se(mkdtemp(dir));
+        write_rules(dir, n_files, n_rules);
+
+        assert_se(rules = udev_rules_new_from_dirs(udev, 0, dirs));
+        sigprocmask(SIG_SETMASK, NULL, &sigmask);
+
+        assert_se(mkdtemp(cache_dir));
+        assert_se(asprintf(&cache, "%s/rules.bin", cache_dir) >= 0);
+        assert_se(udev_rules_store_cache(rules, cache) == 0);
+        assert_se(cached = udev_rules_new_from_cache(udev, 0, dirs, cache));
+
+        for (i = 0; i < ELEMENTSOF(uevents); i++) {
+                _cleanup_free_ char *a = NULL, *b = NULL, *c = NULL;
+
+                udev_rules_set_use_index(rules, true);
+                a = apply(udev, rules, uevents[i], &sigmask);
+                udev_rules_set_use_index(rules, false);
+                b = apply(udev, rules, uevents[i], &sigmask);
+                c = apply(udev, cached, uevents[i], &sigmask);
+
+                assert_se(streq_ptr(a, b));
+                assert_se(streq_ptr(a, c));
+
+                /* the first rules file is about block devices */
+                if (i == 0)
+                        assert_se(strstr(a, "BENCH_0=1\n"));
+        }
+
+        udev_rules_unref(cached);
+        udev_rules_unref(rules);
+
+        /* the cache is not used for different settings, or after a rules file changed */
+        assert_se(!udev_rules_new_from_cache(udev, 1, dirs, cache));
+        assert_se(asprintf(&fn, "%s/10-bench-block-0.rules", dir) >= 0);
+        assert_se(utimensat(AT_FDCWD, fn, old, 0) == 0);
+        assert_se(!udev_rules_new_from_cache(udev, 0, dirs, cache));
+
+        assert_se(rm_rf_dangerous(dir, false, true, false) >= 0);
+        assert_se(rm_rf_dangerous(cache_dir, false, true, false) >= 0);
+}
+
+static unsigned long long usec_since(usec_t ts)
+{
+        return (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+}
+
+static void bench(struct udev *udev, unsigned int n_files, unsigned int n_rules, unsigned int rounds)
+{
+        char dir[] = "/tmp/test-udev-rules.XXXXXX";
+        char cache_dir[] = "/tmp/test-udev-rules-cache.XXXXXX";
+        const char *dirs[] = { dir, NULL };
+        _cleanup_free_ char *cache = NULL;
+        struct udev_rules *rules, *cached;
+        sigset_t sigmask;
+        unsigned long long with, without, parse, load;
+        unsigned int i, j;
+        usec_t ts;
+
+        assert_se(mkdtemp(dir));
+        write_rules(dir, n_files, n_rules);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(rules = udev_rules_new_from_dirs(udev, 0, dirs));
+        parse = usec_since(ts);
+        sigprocmask(SIG_SETMASK, NULL, &sigmask);
+
+        assert_se(mkdtemp(cache_dir));
+        assert_se(asprintf(&cache, "%s/rules.bin", cache_dir) >= 0);
+        assert_se(udev_rules_store_cache(rules, cache) == 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(cached = udev_rules_new_from_cache(udev, 0, dirs, cache));
+        load = usec_since(ts);
+
+        udev_rules_set_use_index(rules, false);
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                for (i = 0; i < ELEMENTSOF(uevents); i++)
+                        free(apply(udev, rules, uevents[i], &sigmask));
+        without = usec_since(ts);
+
+        udev_rules_set_use_index(rules, true);
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 0; j < rounds; j++)
+                for (i = 0; i < ELEMENTSOF(uevents); i++)
+                        free(apply(udev, rules, uevents[i], &sigmask));
+        with = usec_since(ts);
+
+        printf("%5u rules, %5u events: all rules %8llu us, looked up %8llu us; parsed %7llu us, from cache %5llu us\n",
+               n_files * (n_rules + 3), rounds * (unsigned int) ELEMENTSOF(uevents), without, with, parse, load);
+
+        udev_rules_unref(cached);
+        udev_rules_unref(rules);
+
+        assert_se(rm_rf_dangerous(dir, false, true, false) >= 0);
+        assert_se(rm_rf_dangerous(cache_dir, false, true, false) >= 0);
+}
+
+int main(int argc, char *argv[])
+{
+        struct udev *udev;
+
+        assert_se(udev = udev_new());
+
+        test_globs(udev);
+        test_rules(udev, 10, 40);
+        test_rules(udev, 60, 80);
+
+        if (argc > 1) {
+                assert_se(streq(argv[1], "bench"));
+
+                bench(udev, 10, 40, 100);
+                bench(udev, 60, 80, 100);
+        }
+
+        udev_unref(udev);
+        return 0;
+}
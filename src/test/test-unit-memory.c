@@ -0,0 +1,161 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "manager.h"
+#include "unit.h"
+#include "service.h"
+#include "fileio.h"
+#include "util.h"
+
+/* Benchmarks building a synthetic unit graph, roughly shaped like a
+ * big system: every service wants and is ordered after a few others,
+ * and is pulled in by one of a few targets. Prints the resident set
+ * size the graph costs and how long walking it takes. */
+
+static unsigned long rss_kb(void) {
+        _cleanup_free_ char *statm = NULL;
+        unsigned long size, resident;
+
+        assert_se(read_one_line_file("/proc/self/statm", &statm) >= 0);
+        assert_se(sscanf(statm, "%lu %lu", &size, &resident) == 2);
+
+        return resident * (page_size() / 1024);
+}
+
+static unsigned long long usec_since(usec_t ts) {
+        return (unsigned long long) (now(CLOCK_MONOTONIC) - ts);
+}
+
+static unsigned walk(Unit *u, unsigned marker) {
+        static const UnitDependency deps[] = {
+                UNIT_REFERENCES,
+                UNIT_WANTS,
+                UNIT_AFTER,
+        };
+        Iterator i;
+        Unit *other;
+        unsigned k, n = 1;
+
+        /* The same traversal pattern as the GC sweep */
+
+        if (u->gc_marker == marker)
+                return 0;
+
+        u->gc_marker = marker;
+
+        for (k = 0; k < ELEMENTSOF(deps); k++)
+                SET_FOREACH(other, u->dependencies[deps[k]], i)
+                        n += walk(other, marker);
+
+        return n;
+}
+
+static Unit *add_unit(Manager *m, const char *name) {
+        Unit *u;
+
+        assert_se(u = unit_new(m, sizeof(Service)));
+        assert_se(unit_add_name(u, name) >= 0);
+
+        return u;
+}
+
+static void bench(unsigned n) {
+        Manager *m = NULL;
+        Unit **units, *targets[4];
+        unsigned long before, after;
+        unsigned long long build, traverse, teardown;
+        unsigned i, j, marker = 1;
+        usec_t ts;
+
+        assert_se(units = new(Unit*, n));
+
+        before = rss_kb();
+
+        ts = now(CLOCK_MONOTONIC);
+
+        assert_se(manager_new(SYSTEMD_USER, &m) >= 0);
+
+        for (j = 0; j < ELEMENTSOF(targets); j++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 20];
+
+                snprintf(name, sizeof(name), "bench-%u.target", j);
+                targets[j] = add_unit(m, name);
+        }
+
+        for (i = 0; i < n; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + 20];
+
+                snprintf(name, sizeof(name), "bench-%u.service", i);
+                units[i] = add_unit(m, name);
+
+                assert_se(unit_add_dependency(targets[i % ELEMENTSOF(targets)], UNIT_WANTS, units[i], true) >= 0);
+
+                for (j = 1; j <= 3 && j <= i; j++) {
+                        Unit *other = units[(i * 7 + j * 13) % i];
+
+                        assert_se(unit_add_two_dependencies(units[i], UNIT_AFTER, UNIT_WANTS, other, true) >= 0);
+                }
+        }
+
+        build = usec_since(ts);
+        after = rss_kb();
+
+        ts = now(CLOCK_MONOTONIC);
+        for (j = 0; j < 10; j++) {
+                unsigned k = 0, t;
+
+                marker++;
+                for (t = 0; t < ELEMENTSOF(targets); t++)
+                        k += walk(targets[t], marker);
+
+                assert_se(k == n + ELEMENTSOF(targets));
+        }
+        traverse = usec_since(ts) / 10;
+
+        ts = now(CLOCK_MONOTONIC);
+        manager_free(m);
+        teardown = usec_since(ts);
+
+        printf("%6u units: %7lu kB RSS (%4lu bytes/unit), build %7llu us, walk %6llu us, free %7llu us\n",
+               n, after - before, (after - before) * 1024 / n, build, traverse, teardown);
+
+        free(units);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n = 10000;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0);
+
+        log_set_max_level(LOG_NOTICE);
+        log_parse_environment();
+        log_open();
+
+        bench(1000);
+        bench(n);
+
+        return 0;
+}
@@ -67,11 +67,26 @@ static char model_enc_str[256];
 static char revision_str[16];
 static char type_str[16];
 
-static void log_fn(struct udev *udev, int priority,
-                   const char *file, int line, const char *fn,
-                   const char *format, va_list args)
+/* the options are global, and reset for every probe */
+static void reset_options(void)
 {
-        vsyslog(priority, format, args);
+        all_good = 0;
+        dev_specified = 0;
+        strscpy(config_file, sizeof(config_file), "/etc/scsi_id.config");
+        default_page_code = PAGE_UNSPECIFIED;
+        sg_version = 4;
+        use_stderr = 0;
+        debug = 0;
+        reformat_serial = 0;
+        export = 0;
+}
+
+static void export_key(scsi_id_export_fn export_fn, void *userdata, const char *key, const char *value)
+{
+        if (export_fn != NULL)
+                export_fn(key, value, userdata);
+        else
+                printf("%s=%s\n", key, value);
 }
 
 static void set_type(const char *from, char *to, size_t len)
@@ -369,7 +384,7 @@ static int set_options(struct udev *udev,
                                "  --version                     print version\n"
                                "  --export                      print values as environment keys\n"
                                "  --help                        print this help text\n\n");
-                        exit(0);
+                        return 1;
 
                 case 'p':
                         if (streq(optarg, "0x80")) {
@@ -406,11 +421,10 @@ static int set_options(struct udev *udev,
 
                 case 'V':
                         printf("%s\n", VERSION);
-                        exit(0);
-                        break;
+                        return 1;
 
                 default:
-                        exit(1);
+                        return -1;
                 }
         }
         if (optind < argc && !dev_specified) {
@@ -499,10 +513,10 @@ static int set_inq_values(struct udev *udev, struct scsi_id_device *dev_scsi, co
 }
 
 /*
- * scsi_id: try to get an id, if one is found, printf it to stdout.
- * returns a value passed to exit() - 0 if printed an id, else 1.
+ * scsi_id: try to get an id, if one is found, export it or printf it to
+ * stdout. returns a value passed to exit() - 0 if printed an id, else 1.
  */
-static int scsi_id(struct udev *udev, char *maj_min_dev)
+static int scsi_id(struct udev *udev, char *maj_min_dev, scsi_id_export_fn export_fn, void *userdata)
 {
         struct scsi_id_device dev_scsi;
         int good_dev;
@@ -529,35 +543,40 @@ static int scsi_id(struct udev *udev, char *maj_min_dev)
         if (export) {
                 char serial_str[MAX_SERIAL_LEN];
 
-                printf("ID_SCSI=1\n");
-                printf("ID_VENDOR=%s\n", vendor_str);
-                printf("ID_VENDOR_ENC=%s\n", vendor_enc_str);
-                printf("ID_MODEL=%s\n", model_str);
-                printf("ID_MODEL_ENC=%s\n", model_enc_str);
-                printf("ID_REVISION=%s\n", revision_str);
-                printf("ID_TYPE=%s\n", type_str);
+                export_key(export_fn, userdata, "ID_SCSI", "1");
+                export_key(export_fn, userdata, "ID_VENDOR", vendor_str);
+                export_key(export_fn, userdata, "ID_VENDOR_ENC", vendor_enc_str);
+                export_key(export_fn, userdata, "ID_MODEL", model_str);
+                export_key(export_fn, userdata, "ID_MODEL_ENC", model_enc_str);
+                export_key(export_fn, userdata, "ID_REVISION", revision_str);
+                export_key(export_fn, userdata, "ID_TYPE", type_str);
                 if (dev_scsi.serial[0] != '\0') {
                         util_replace_whitespace(dev_scsi.serial, serial_str, sizeof(serial_str));
                         util_replace_chars(serial_str, NULL);
-                        printf("ID_SERIAL=%s\n", serial_str);
+                        export_key(export_fn, userdata, "ID_SERIAL", serial_str);
                         util_replace_whitespace(dev_scsi.serial_short, serial_str, sizeof(serial_str));
                         util_replace_chars(serial_str, NULL);
-                        printf("ID_SERIAL_SHORT=%s\n", serial_str);
+                        export_key(export_fn, userdata, "ID_SERIAL_SHORT", serial_str);
                 }
                 if (dev_scsi.wwn[0] != '\0') {
-                        printf("ID_WWN=0x%s\n", dev_scsi.wwn);
+                        char wwn_str[64];
+
+                        snprintf(wwn_str, sizeof(wwn_str), "0x%s", dev_scsi.wwn);
+                        export_key(export_fn, userdata, "ID_WWN", wwn_str);
                         if (dev_scsi.wwn_vendor_extension[0] != '\0') {
-                                printf("ID_WWN_VENDOR_EXTENSION=0x%s\n", dev_scsi.wwn_vendor_extension);
-                                printf("ID_WWN_WITH_EXTENSION=0x%s%s\n", dev_scsi.wwn, dev_scsi.wwn_vendor_extension);
+                                snprintf(wwn_str, sizeof(wwn_str), "0x%s", dev_scsi.wwn_vendor_extension);
+                                export_key(export_fn, userdata, "ID_WWN_VENDOR_EXTENSION", wwn_str);
+                                snprintf(wwn_str, sizeof(wwn_str), "0x%s%s", dev_scsi.wwn, dev_scsi.wwn_vendor_extension);
                         } else {
-                                printf("ID_WWN_WITH_EXTENSION=0x%s\n", dev_scsi.wwn);
+                                snprintf(wwn_str, sizeof(wwn_str), "0x%s", dev_scsi.wwn);
                         }
+                        export_key(export_fn, userdata, "ID_WWN_WITH_EXTENSION", wwn_str);
                 }
                 if (dev_scsi.tgpt_group[0] != '\0') {
-                        printf("ID_TARGET_PORT=%s\n", dev_scsi.tgpt_group);
+                        export_key(export_fn, userdata, "ID_TARGET_PORT", dev_scsi.tgpt_group);
                 }
                 if (dev_scsi.unit_serial_number[0] != '\0') {
-                        printf("ID_SCSI_SERIAL=%s\n", dev_scsi.unit_serial_number);
+                        export_key(export_fn, userdata, "ID_SCSI_SERIAL", dev_scsi.unit_serial_number);
                 }
                 goto out;
         }
@@ -581,54 +600,49 @@ out:
         return retval;
 }
 
-int main(int argc, char **argv)
+int scsi_id_probe(struct udev *udev, int argc, char **argv, scsi_id_export_fn export_fn, void *userdata)
 {
-        struct udev *udev;
         int retval = 0;
         char maj_min_dev[MAX_PATH_LEN];
         int newargc;
         char **newargv;
 
-        udev = udev_new();
-        if (udev == NULL)
-                goto exit;
-
-        log_open();
-        udev_set_log_fn(udev, log_fn);
+        reset_options();
 
         /*
          * Get config file options.
          */
         newargv = NULL;
         retval = get_file_options(udev, NULL, NULL, &newargc, &newargv);
-        if (retval < 0) {
-                retval = 1;
-                goto exit;
-        }
+        if (retval < 0)
+                return 1;
         if (newargv && (retval == 0)) {
-                if (set_options(udev, newargc, newargv, short_options, maj_min_dev) < 0) {
-                        retval = 2;
-                        goto exit;
-                }
+                retval = set_options(udev, newargc, newargv, short_options, maj_min_dev);
+                free(newargv[0]);
                 free(newargv);
+                if (retval < 0)
+                        return 2;
+                if (retval > 0)
+                        return 0;
         }
 
         /*
          * Get command line options (overriding any config file settings).
          */
-        if (set_options(udev, argc, argv, short_options, maj_min_dev) < 0)
-                exit(1);
+        retval = set_options(udev, argc, argv, short_options, maj_min_dev);
+        if (retval < 0)
+                return 1;
+        if (retval > 0)
+                return 0;
 
         if (!dev_specified) {
                 log_error("no device specified\n");
-                retval = 1;
-                goto exit;
+                return 1;
         }
 
-        retval = scsi_id(udev, maj_min_dev);
+        /* the values of the builtin are always imported as properties */
+        if (export_fn != NULL)
+                export = 1;
 
-exit:
-        udev_unref(udev);
-        log_close();
-        return retval;
+        return scsi_id(udev, maj_min_dev, export_fn, userdata);
 }
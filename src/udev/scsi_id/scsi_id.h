@@ -71,3 +71,17 @@ enum page_code {
                 PAGE_80                 = 0x80,
                 PAGE_83                 = 0x83,
 };
+
+/*
+ * Called for every key of --export, instead of printing it to stdout.
+ */
+typedef void (*scsi_id_export_fn)(const char *key, const char *value, void *userdata);
+
+/*
+ * Parses the options of the config file and the arguments like the
+ * scsi_id program, and probes the device. Returns the exit code of the
+ * scsi_id program. The options are kept in globals, it is not safe to
+ * call it from several threads.
+ */
+extern int scsi_id_probe(struct udev *udev, int argc, char **argv,
+                         scsi_id_export_fn export_fn, void *userdata);
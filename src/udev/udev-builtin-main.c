@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2013 Kay Sievers <kay@vrfy.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "udev.h"
+
+/* the programs which were replaced by builtins are kept for the callers
+ * outside of the udev rules; they run the builtin on a device without
+ * any properties, and print what it adds */
+
+void udev_main_log(struct udev *udev, int priority,
+                   const char *file, int line, const char *fn,
+                   const char *format, va_list args)
+{
+        log_metav(priority, file, line, fn, format, args);
+}
+
+int udev_builtin_main(const struct udev_builtin *builtin, const char *key, int argc, char *argv[])
+{
+        struct udev *udev;
+        struct udev_device *dev = NULL;
+        int rc = EXIT_FAILURE;
+
+        udev = udev_new();
+        if (udev == NULL)
+                goto out;
+
+        log_parse_environment();
+        log_open();
+        udev_set_log_fn(udev, udev_main_log);
+
+        /* there is nothing in /sys or the database to read for it */
+        dev = udev_device_new(udev);
+        if (dev == NULL)
+                goto out;
+        udev_device_set_info_loaded(dev);
+
+        if (builtin->init && builtin->init(udev) < 0)
+                goto out;
+
+        /* all properties as KEY=value, or only the value of the key */
+        rc = builtin->cmd(dev, argc, argv, key == NULL);
+        if (rc == EXIT_SUCCESS && key != NULL) {
+                const char *value;
+
+                value = udev_device_get_property_value(dev, key);
+                if (value != NULL)
+                        printf("%s\n", value);
+        }
+
+        if (builtin->exit)
+                builtin->exit(udev);
+out:
+        udev_device_unref(dev);
+        udev_unref(udev);
+        log_close();
+        return rc;
+}
@@ -23,18 +23,24 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdint.h>
-#include <stdlib.h>
-#include "mtd_probe.h"
+
+#include "udev.h"
+
+/* one sector is always 512 bytes, but it can consist of two nand pages */
+#define SM_SECTOR_SIZE                512
+
+/* support for small page nand */
+#define SM_SMALL_PAGE                 256
 
 static const uint8_t cis_signature[] = {
         0x01, 0x03, 0xD9, 0x01, 0xFF, 0x18, 0x02, 0xDF, 0x01, 0x20
 };
 
-
-void probe_smart_media(int mtd_fd, mtd_info_t* info)
+static bool probe_smart_media(int mtd_fd, mtd_info_t* info)
 {
         int sector_size;
         int block_size;
@@ -43,9 +49,10 @@ void probe_smart_media(int mtd_fd, mtd_info_t* info)
         char* cis_buffer = malloc(SM_SECTOR_SIZE);
         int offset;
         int cis_found = 0;
+        bool found = false;
 
         if (!cis_buffer)
-                return;
+                return false;
 
         if (info->type != MTD_NANDFLASH)
                 goto exit;
@@ -87,10 +94,46 @@ void probe_smart_media(int mtd_fd, mtd_info_t* info)
                         sizeof(cis_signature)) != 0))
                 goto exit;
 
-        printf("MTD_FTL=smartmedia\n");
-        free(cis_buffer);
-        exit(0);
+        found = true;
 exit:
         free(cis_buffer);
-        return;
+        return found;
+}
+
+static int builtin_mtd_probe(struct udev_device *dev, int argc, char *argv[], bool test)
+{
+        const char *node;
+        int mtd_fd;
+        mtd_info_t mtd_info;
+        int rc = EXIT_FAILURE;
+
+        /* the device node of the event, if none is given */
+        node = argc > 1 ? argv[1] : udev_device_get_devnode(dev);
+        if (node == NULL)
+                return EXIT_FAILURE;
+
+        mtd_fd = open(node, O_RDONLY|O_CLOEXEC);
+        if (mtd_fd < 0) {
+                log_error("unable to open '%s': %m\n", node);
+                return EXIT_FAILURE;
+        }
+
+        if (ioctl(mtd_fd, MEMGETINFO, &mtd_info) < 0) {
+                log_debug("MEMGETINFO failed for '%s': %m\n", node);
+                goto out;
+        }
+
+        if (probe_smart_media(mtd_fd, &mtd_info)) {
+                udev_builtin_add_property(dev, test, "MTD_FTL", "smartmedia");
+                rc = EXIT_SUCCESS;
+        }
+out:
+        close_nointr_nofail(mtd_fd);
+        return rc;
 }
+
+const struct udev_builtin udev_builtin_mtd_probe = {
+        .name = "mtd_probe",
+        .cmd = builtin_mtd_probe,
+        .help = "MTD flash translation layer",
+};
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2013 Kay Sievers <kay@vrfy.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "udev.h"
+#include "scsi_id/scsi_id.h"
+
+/* the probe is shared with the scsi_id program, which is still
+ * installed for the users of /etc/scsi_id.config */
+
+struct scsi_id_export {
+        struct udev_device *dev;
+        bool test;
+};
+
+static void export_property(const char *key, const char *value, void *userdata)
+{
+        struct scsi_id_export *e = userdata;
+
+        udev_builtin_add_property(e->dev, e->test, key, value);
+}
+
+static int builtin_scsi_id(struct udev_device *dev, int argc, char *argv[], bool test)
+{
+        struct scsi_id_export e = {
+                .dev = dev,
+                .test = test,
+        };
+
+        if (scsi_id_probe(udev_device_get_udev(dev), argc, argv, export_property, &e) != 0)
+                return EXIT_FAILURE;
+        return EXIT_SUCCESS;
+}
+
+const struct udev_builtin udev_builtin_scsi_id = {
+        .name = "scsi_id",
+        .cmd = builtin_scsi_id,
+        .help = "SCSI device identification",
+};
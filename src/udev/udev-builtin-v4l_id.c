@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2009 Kay Sievers <kay@vrfy.org>
+ * Copyright (c) 2009 Filippo Argiolas <filippo.argiolas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details:
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+#include "udev.h"
+
+static int builtin_v4l_id(struct udev_device *dev, int argc, char *argv[], bool test)
+{
+        const char *node;
+        int fd;
+        struct v4l2_capability v2cap;
+
+        /* the device node of the event, if none is given */
+        node = argc > 1 ? argv[1] : udev_device_get_devnode(dev);
+        if (node == NULL)
+                return EXIT_FAILURE;
+
+        fd = open(node, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return EXIT_FAILURE;
+
+        if (ioctl(fd, VIDIOC_QUERYCAP, &v2cap) == 0) {
+                char capabilities[128] = ":";
+
+                udev_builtin_add_property(dev, test, "ID_V4L_VERSION", "2");
+                udev_builtin_add_property(dev, test, "ID_V4L_PRODUCT", (const char *) v2cap.card);
+                if ((v2cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) > 0)
+                        strcat(capabilities, "capture:");
+                if ((v2cap.capabilities & V4L2_CAP_VIDEO_OUTPUT) > 0)
+                        strcat(capabilities, "video_output:");
+                if ((v2cap.capabilities & V4L2_CAP_VIDEO_OVERLAY) > 0)
+                        strcat(capabilities, "video_overlay:");
+                if ((v2cap.capabilities & V4L2_CAP_AUDIO) > 0)
+                        strcat(capabilities, "audio:");
+                if ((v2cap.capabilities & V4L2_CAP_TUNER) > 0)
+                        strcat(capabilities, "tuner:");
+                if ((v2cap.capabilities & V4L2_CAP_RADIO) > 0)
+                        strcat(capabilities, "radio:");
+                udev_builtin_add_property(dev, test, "ID_V4L_CAPABILITIES", capabilities);
+        }
+
+        close_nointr_nofail(fd);
+        return EXIT_SUCCESS;
+}
+
+const struct udev_builtin udev_builtin_v4l_id = {
+        .name = "v4l_id",
+        .cmd = builtin_v4l_id,
+        .help = "video4linux capabilities",
+};
@@ -30,19 +30,24 @@
 static bool initialized;
 
 static const struct udev_builtin *builtins[] = {
+        [UDEV_BUILTIN_ATA_ID] = &udev_builtin_ata_id,
 #ifdef HAVE_BLKID
         [UDEV_BUILTIN_BLKID] = &udev_builtin_blkid,
 #endif
         [UDEV_BUILTIN_BTRFS] = &udev_builtin_btrfs,
+        [UDEV_BUILTIN_CDROM_ID] = &udev_builtin_cdrom_id,
         [UDEV_BUILTIN_FIRMWARE] = &udev_builtin_firmware,
         [UDEV_BUILTIN_HWDB] = &udev_builtin_hwdb,
         [UDEV_BUILTIN_INPUT_ID] = &udev_builtin_input_id,
 #ifdef HAVE_KMOD
         [UDEV_BUILTIN_KMOD] = &udev_builtin_kmod,
 #endif
+        [UDEV_BUILTIN_MTD_PROBE] = &udev_builtin_mtd_probe,
         [UDEV_BUILTIN_NET_ID] = &udev_builtin_net_id,
         [UDEV_BUILTIN_PATH_ID] = &udev_builtin_path_id,
+        [UDEV_BUILTIN_SCSI_ID] = &udev_builtin_scsi_id,
         [UDEV_BUILTIN_USB_ID] = &udev_builtin_usb_id,
+        [UDEV_BUILTIN_V4L_ID] = &udev_builtin_v4l_id,
 #ifdef HAVE_ACL
         [UDEV_BUILTIN_UACCESS] = &udev_builtin_uaccess,
 #endif
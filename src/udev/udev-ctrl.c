@@ -25,6 +25,9 @@
 /* wire protocol magic must match */
 #define UDEV_CTRL_MAGIC                                0xdead1dea
 
+/* a reply is sent as a sequence of records of at most this size */
+#define UDEV_CTRL_REPLY_SIZE                           4096
+
 enum udev_ctrl_msg_type {
         UDEV_CTRL_UNKNOWN,
         UDEV_CTRL_SET_LOG_LEVEL,
@@ -35,6 +38,7 @@ enum udev_ctrl_msg_type {
         UDEV_CTRL_SET_CHILDREN_MAX,
         UDEV_CTRL_PING,
         UDEV_CTRL_EXIT,
+        UDEV_CTRL_GET_WORKER_STATS,
 };
 
 struct udev_ctrl_msg_wire {
@@ -334,6 +338,68 @@ int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout)
         return ctrl_send(uctrl, UDEV_CTRL_EXIT, 0, NULL, timeout);
 }
 
+int udev_ctrl_send_get_worker_stats(struct udev_ctrl *uctrl, FILE *f, int timeout)
+{
+        int err;
+
+        err = ctrl_send(uctrl, UDEV_CTRL_GET_WORKER_STATS, 0, NULL, timeout);
+        if (err < 0)
+                return err;
+
+        /* copy the reply until the peer closes the connection */
+        for (;;) {
+                char buf[UDEV_CTRL_REPLY_SIZE];
+                struct pollfd pfd[1];
+                ssize_t size;
+                int r;
+
+                pfd[0].fd = uctrl->sock;
+                pfd[0].events = POLLIN;
+                r = poll(pfd, 1, timeout * 1000);
+                if (r < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+                if (r == 0)
+                        return -ETIMEDOUT;
+
+                size = recv(uctrl->sock, buf, sizeof(buf), 0);
+                if (size < 0) {
+                        if (errno == EINTR || errno == EAGAIN)
+                                continue;
+                        return -errno;
+                }
+                if (size == 0)
+                        return 0;
+                fwrite(buf, size, 1, f);
+        }
+}
+
+int udev_ctrl_connection_send_reply(struct udev_ctrl_connection *conn, const char *buf, size_t len)
+{
+        while (len > 0) {
+                size_t n = MIN(len, UDEV_CTRL_REPLY_SIZE);
+
+                if (send(conn->sock, buf, n, 0) < 0) {
+                        struct pollfd pfd[1];
+
+                        if (errno != EAGAIN)
+                                return -errno;
+
+                        /* the connection is non-blocking, wait for the peer to read */
+                        pfd[0].fd = conn->sock;
+                        pfd[0].events = POLLOUT;
+                        if (poll(pfd, 1, 1000) <= 0)
+                                return -ETIMEDOUT;
+                        continue;
+                }
+                buf += n;
+                len -= n;
+        }
+        return 0;
+}
+
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn)
 {
         struct udev_ctrl_msg *uctrl_msg;
@@ -488,3 +554,10 @@ int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg)
                 return 1;
         return -1;
 }
+
+int udev_ctrl_get_worker_stats(struct udev_ctrl_msg *ctrl_msg)
+{
+        if (ctrl_msg->ctrl_msg_wire.type == UDEV_CTRL_GET_WORKER_STATS)
+                return 1;
+        return -1;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2013 Kay Sievers <kay@vrfy.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/sysmacros.h>
+
+#include "udev.h"
+#include "hashmap.h"
+
+/*
+ * Index over the queued and running events, to find out quickly if an
+ * event has to wait for an earlier one of the same, a parent or a child
+ * device.
+ *
+ * Every devpath which has events, and all its parent devpaths, have a
+ * node in a tree. A node lists the events of its own devpath, and every
+ * event of a devpath below it, in the order the events were added. The
+ * first entry of a list is therefore the earliest one, and a check only
+ * needs to look at the first entries of the lists of the nodes along the
+ * devpath of the event.
+ */
+
+struct udev_event_index {
+        Hashmap *paths;
+        Hashmap *devnums[2];
+        Hashmap *ifindexes;
+};
+
+struct index_path {
+        struct index_path *parent;
+        unsigned int refcount;
+        struct udev_list_node entries;
+        struct udev_list_node below;
+        char devpath[];
+};
+
+struct index_bucket {
+        uint64_t key;
+        struct udev_list_node entries;
+};
+
+struct index_link {
+        struct udev_list_node node;
+        struct udev_event_index_entry *entry;
+};
+
+struct udev_event_index_entry {
+        unsigned long long int seqnum;
+        const char *devpath_old;
+        dev_t devnum;
+        int ifindex;
+        bool is_block;
+        bool nodelay;
+
+        struct index_path *path;
+        struct udev_list_node path_node;
+        struct index_bucket *devnum_bucket;
+        struct udev_list_node devnum_node;
+        struct index_bucket *ifindex_bucket;
+        struct udev_list_node ifindex_node;
+
+        /* one link for every parent of the devpath */
+        unsigned int links_count;
+        struct index_link links[];
+};
+
+static inline struct udev_event_index_entry *path_node_to_entry(struct udev_list_node *node)
+{
+        return container_of(node, struct udev_event_index_entry, path_node);
+}
+
+static inline struct udev_event_index_entry *devnum_node_to_entry(struct udev_list_node *node)
+{
+        return container_of(node, struct udev_event_index_entry, devnum_node);
+}
+
+static inline struct udev_event_index_entry *ifindex_node_to_entry(struct udev_list_node *node)
+{
+        return container_of(node, struct udev_event_index_entry, ifindex_node);
+}
+
+static inline struct index_link *node_to_link(struct udev_list_node *node)
+{
+        return container_of(node, struct index_link, node);
+}
+
+struct udev_event_index *udev_event_index_new(void)
+{
+        struct udev_event_index *idx;
+
+        idx = calloc(1, sizeof(struct udev_event_index));
+        if (idx == NULL)
+                return NULL;
+
+        idx->paths = hashmap_new(string_hash_func, string_compare_func);
+        idx->devnums[0] = hashmap_new(uint64_hash_func, uint64_compare_func);
+        idx->devnums[1] = hashmap_new(uint64_hash_func, uint64_compare_func);
+        idx->ifindexes = hashmap_new(uint64_hash_func, uint64_compare_func);
+        if (idx->paths == NULL || idx->devnums[0] == NULL || idx->devnums[1] == NULL || idx->ifindexes == NULL) {
+                udev_event_index_free(idx);
+                return NULL;
+        }
+
+        return idx;
+}
+
+void udev_event_index_free(struct udev_event_index *idx)
+{
+        if (idx == NULL)
+                return;
+
+        /* entries are owned by the caller, and need to be removed first */
+        assert(hashmap_isempty(idx->paths));
+
+        hashmap_free(idx->paths);
+        hashmap_free(idx->devnums[0]);
+        hashmap_free(idx->devnums[1]);
+        hashmap_free(idx->ifindexes);
+        free(idx);
+}
+
+static void path_unref(struct udev_event_index *idx, struct index_path *path)
+{
+        while (path != NULL) {
+                struct index_path *parent = path->parent;
+
+                path->refcount--;
+                if (path->refcount > 0)
+                        return;
+
+                hashmap_remove(idx->paths, path->devpath);
+                free(path);
+
+                /* the parent loses a child */
+                path = parent;
+        }
+}
+
+static struct index_path *path_get(struct udev_event_index *idx, const char *devpath, size_t len)
+{
+        struct index_path *path, *parent = NULL;
+        const char *pos;
+        char *key;
+
+        key = strndupa(devpath, len);
+
+        path = hashmap_get(idx->paths, key);
+        if (path != NULL) {
+                path->refcount++;
+                return path;
+        }
+
+        /* the parent is the devpath up to the last '/', "/devices" has none */
+        pos = memrchr(devpath, '/', len);
+        if (pos != NULL && pos > devpath) {
+                parent = path_get(idx, devpath, pos - devpath);
+                if (parent == NULL)
+                        return NULL;
+        }
+
+        path = malloc(offsetof(struct index_path, devpath) + len + 1);
+        if (path == NULL)
+                goto err;
+
+        path->parent = parent;
+        path->refcount = 1;
+        udev_list_node_init(&path->entries);
+        udev_list_node_init(&path->below);
+        memcpy(path->devpath, key, len + 1);
+
+        if (hashmap_put(idx->paths, path->devpath, path) < 0) {
+                free(path);
+                goto err;
+        }
+
+        return path;
+err:
+        path_unref(idx, parent);
+        return NULL;
+}
+
+static struct index_bucket *bucket_get(Hashmap *h, uint64_t key)
+{
+        struct index_bucket *bucket;
+
+        bucket = hashmap_get(h, &key);
+        if (bucket != NULL)
+                return bucket;
+
+        bucket = malloc(sizeof(struct index_bucket));
+        if (bucket == NULL)
+                return NULL;
+
+        bucket->key = key;
+        udev_list_node_init(&bucket->entries);
+
+        if (hashmap_put(h, &bucket->key, bucket) < 0) {
+                free(bucket);
+                return NULL;
+        }
+
+        return bucket;
+}
+
+static void bucket_remove(Hashmap *h, struct index_bucket *bucket, struct udev_list_node *node)
+{
+        udev_list_node_remove(node);
+        if (!udev_list_node_is_empty(&bucket->entries))
+                return;
+
+        hashmap_remove(h, &bucket->key);
+        free(bucket);
+}
+
+/* devpath_old is not copied, it needs to stay valid until the entry is removed */
+struct udev_event_index_entry *udev_event_index_add(struct udev_event_index *idx,
+                                                    unsigned long long int seqnum,
+                                                    const char *devpath, const char *devpath_old,
+                                                    dev_t devnum, bool is_block, int ifindex, bool nodelay)
+{
+        struct udev_event_index_entry *entry;
+        struct index_path *path, *p;
+        unsigned int depth = 0;
+        unsigned int i;
+
+        path = path_get(idx, devpath, strlen(devpath));
+        if (path == NULL)
+                return NULL;
+
+        for (p = path->parent; p != NULL; p = p->parent)
+                depth++;
+
+        entry = calloc(1, offsetof(struct udev_event_index_entry, links) + depth * sizeof(struct index_link));
+        if (entry == NULL) {
+                path_unref(idx, path);
+                return NULL;
+        }
+
+        entry->seqnum = seqnum;
+        entry->devpath_old = devpath_old;
+        entry->devnum = devnum;
+        entry->is_block = is_block;
+        entry->ifindex = ifindex;
+        entry->nodelay = nodelay;
+        entry->path = path;
+
+        if (major(devnum) != 0) {
+                entry->devnum_bucket = bucket_get(idx->devnums[is_block], devnum);
+                if (entry->devnum_bucket == NULL)
+                        goto err;
+                udev_list_node_append(&entry->devnum_node, &entry->devnum_bucket->entries);
+        }
+
+        if (ifindex != 0) {
+                entry->ifindex_bucket = bucket_get(idx->ifindexes, ifindex);
+                if (entry->ifindex_bucket == NULL)
+                        goto err;
+                udev_list_node_append(&entry->ifindex_node, &entry->ifindex_bucket->entries);
+        }
+
+        udev_list_node_append(&entry->path_node, &path->entries);
+
+        for (p = path->parent, i = 0; p != NULL; p = p->parent, i++) {
+                entry->links[i].entry = entry;
+                udev_list_node_append(&entry->links[i].node, &p->below);
+        }
+        entry->links_count = depth;
+
+        return entry;
+err:
+        udev_event_index_remove(idx, entry);
+        return NULL;
+}
+
+void udev_event_index_remove(struct udev_event_index *idx, struct udev_event_index_entry *entry)
+{
+        unsigned int i;
+
+        if (entry == NULL)
+                return;
+
+        for (i = 0; i < entry->links_count; i++)
+                udev_list_node_remove(&entry->links[i].node);
+
+        if (entry->path_node.next != NULL)
+                udev_list_node_remove(&entry->path_node);
+        if (entry->devnum_bucket != NULL)
+                bucket_remove(idx->devnums[entry->is_block], entry->devnum_bucket, &entry->devnum_node);
+        if (entry->ifindex_bucket != NULL)
+                bucket_remove(idx->ifindexes, entry->ifindex_bucket, &entry->ifindex_node);
+
+        path_unref(idx, entry->path);
+        free(entry);
+}
+
+/* the first entry of the lists is the earliest one */
+static bool has_earlier(struct udev_list_node *list, struct udev_event_index_entry *(*to_entry)(struct udev_list_node *),
+                        unsigned long long int seqnum)
+{
+        if (udev_list_node_is_empty(list))
+                return false;
+        return to_entry(list->next)->seqnum < seqnum;
+}
+
+static struct udev_event_index_entry *link_node_to_entry(struct udev_list_node *node)
+{
+        return node_to_link(node)->entry;
+}
+
+bool udev_event_index_is_busy(struct udev_event_index *idx, struct udev_event_index_entry *entry)
+{
+        struct udev_list_node *loop;
+        struct index_path *p;
+
+        /* check major/minor */
+        if (entry->devnum_bucket != NULL &&
+            has_earlier(&entry->devnum_bucket->entries, devnum_node_to_entry, entry->seqnum))
+                return true;
+
+        /* check network device ifindex */
+        if (entry->ifindex_bucket != NULL &&
+            has_earlier(&entry->ifindex_bucket->entries, ifindex_node_to_entry, entry->seqnum))
+                return true;
+
+        /* check our old name */
+        if (entry->devpath_old != NULL) {
+                p = hashmap_get(idx->paths, entry->devpath_old);
+                if (p != NULL && has_earlier(&p->entries, path_node_to_entry, entry->seqnum))
+                        return true;
+        }
+
+        /* identical device event found */
+        udev_list_node_foreach(loop, &entry->path->entries) {
+                struct udev_event_index_entry *e = path_node_to_entry(loop);
+
+                if (e->seqnum >= entry->seqnum)
+                        break;
+
+                /* devices names might have changed/swapped in the meantime */
+                if (major(entry->devnum) != 0 && (entry->devnum != e->devnum || entry->is_block != e->is_block))
+                        continue;
+                if (entry->ifindex != 0 && entry->ifindex != e->ifindex)
+                        continue;
+                return true;
+        }
+
+        /* allow to bypass the dependency tracking */
+        if (entry->nodelay)
+                return false;
+
+        /* parent device event found */
+        for (p = entry->path->parent; p != NULL; p = p->parent)
+                if (has_earlier(&p->entries, path_node_to_entry, entry->seqnum))
+                        return true;
+
+        /* child device event found */
+        if (has_earlier(&entry->path->below, link_node_to_entry, entry->seqnum))
+                return true;
+
+        return false;
+}
+
+unsigned int udev_event_index_size(struct udev_event_index *idx)
+{
+        return hashmap_size(idx->paths);
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2013 Kay Sievers <kay@vrfy.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "udev.h"
+#include "hashmap.h"
+
+/*
+ * Index of the devices claiming a symlink in /dev, to find the device
+ * node with the highest priority a link has to point to, without reading
+ * the stack directory in /run/udev/links and the database of every
+ * device listed in it.
+ *
+ * The claims of a link are sorted by priority, and for the same priority
+ * by the order they were added in, the latest first. A device adding a
+ * link takes it over from the devices with the same priority, like it
+ * did with the stack directory.
+ */
+
+struct udev_link_index {
+        Hashmap *links;
+};
+
+struct link_claim {
+        int priority;
+        char *devnode;
+        char id[];
+};
+
+struct index_link {
+        struct link_claim **claims;
+        size_t claims_count;
+        size_t claims_allocated;
+        char name[];
+};
+
+struct udev_link_index *udev_link_index_new(void)
+{
+        struct udev_link_index *idx;
+
+        idx = calloc(1, sizeof(struct udev_link_index));
+        if (idx == NULL)
+                return NULL;
+
+        idx->links = hashmap_new(string_hash_func, string_compare_func);
+        if (idx->links == NULL) {
+                free(idx);
+                return NULL;
+        }
+
+        return idx;
+}
+
+static void claim_free(struct link_claim *claim)
+{
+        free(claim->devnode);
+        free(claim);
+}
+
+static void link_free(struct index_link *link)
+{
+        size_t i;
+
+        for (i = 0; i < link->claims_count; i++)
+                claim_free(link->claims[i]);
+        free(link->claims);
+        free(link);
+}
+
+void udev_link_index_free(struct udev_link_index *idx)
+{
+        struct index_link *link;
+
+        if (idx == NULL)
+                return;
+
+        while ((link = hashmap_steal_first(idx->links)) != NULL)
+                link_free(link);
+        hashmap_free(idx->links);
+        free(idx);
+}
+
+static struct index_link *link_get(struct udev_link_index *idx, const char *name)
+{
+        struct index_link *link;
+        size_t len;
+
+        link = hashmap_get(idx->links, name);
+        if (link != NULL)
+                return link;
+
+        len = strlen(name);
+        link = calloc(1, offsetof(struct index_link, name) + len + 1);
+        if (link == NULL)
+                return NULL;
+        memcpy(link->name, name, len + 1);
+
+        if (hashmap_put(idx->links, link->name, link) < 0) {
+                free(link);
+                return NULL;
+        }
+
+        return link;
+}
+
+static void link_remove_claim(struct udev_link_index *idx, struct index_link *link, const char *id)
+{
+        size_t i;
+
+        for (i = 0; i < link->claims_count; i++) {
+                if (!streq(link->claims[i]->id, id))
+                        continue;
+
+                claim_free(link->claims[i]);
+                link->claims_count--;
+                memmove(&link->claims[i], &link->claims[i+1], (link->claims_count - i) * sizeof(struct link_claim *));
+                break;
+        }
+
+        if (link->claims_count > 0)
+                return;
+
+        hashmap_remove(idx->links, link->name);
+        link_free(link);
+}
+
+/* the device with the id claims the link for its device node, replacing an earlier claim */
+int udev_link_index_add(struct udev_link_index *idx, const char *name, const char *id,
+                        const char *devnode, int priority)
+{
+        struct index_link *link;
+        struct link_claim *claim;
+        size_t len, lo, hi;
+
+        link = hashmap_get(idx->links, name);
+        if (link != NULL)
+                link_remove_claim(idx, link, id);
+
+        link = link_get(idx, name);
+        if (link == NULL)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(link->claims, link->claims_allocated, link->claims_count + 1))
+                goto err;
+
+        len = strlen(id);
+        claim = malloc(offsetof(struct link_claim, id) + len + 1);
+        if (claim == NULL)
+                goto err;
+        claim->devnode = strdup(devnode);
+        if (claim->devnode == NULL) {
+                free(claim);
+                goto err;
+        }
+        claim->priority = priority;
+        memcpy(claim->id, id, len + 1);
+
+        /* the new claim goes before all claims with the same or a lower priority */
+        lo = 0;
+        hi = link->claims_count;
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+
+                if (link->claims[mid]->priority > priority)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        memmove(&link->claims[lo+1], &link->claims[lo], (link->claims_count - lo) * sizeof(struct link_claim *));
+        link->claims[lo] = claim;
+        link->claims_count++;
+
+        return 0;
+err:
+        if (link->claims_count == 0) {
+                hashmap_remove(idx->links, link->name);
+                link_free(link);
+        }
+        return -ENOMEM;
+}
+
+/* the device with the id does not claim the link anymore */
+void udev_link_index_remove(struct udev_link_index *idx, const char *name, const char *id)
+{
+        struct index_link *link;
+
+        link = hashmap_get(idx->links, name);
+        if (link == NULL)
+                return;
+
+        link_remove_claim(idx, link, id);
+}
+
+/* the device node the link points to, NULL if no device claims it */
+const char *udev_link_index_find(struct udev_link_index *idx, const char *name)
+{
+        struct index_link *link;
+
+        link = hashmap_get(idx->links, name);
+        if (link == NULL)
+                return NULL;
+
+        return link->claims[0]->devnode;
+}
+
+unsigned int udev_link_index_size(struct udev_link_index *idx)
+{
+        return hashmap_size(idx->links);
+}
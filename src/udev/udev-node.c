@@ -31,6 +31,15 @@
 
 #include "udev.h"
 
+/* asks udevd for the device node a link points to, instead of reading the stack directory */
+static int (*link_resolve)(struct udev_device *dev, const char *slink, bool add, char *target, size_t size);
+
+void udev_node_set_link_resolver(int (*resolve)(struct udev_device *dev, const char *slink, bool add,
+                                                char *target, size_t size))
+{
+        link_resolve = resolve;
+}
+
 static int node_symlink(struct udev_device *dev, const char *node, const char *slink)
 {
         struct stat stats;
@@ -187,6 +196,7 @@ static void link_update(struct udev_device *dev, const char *slink, bool add)
         char dirname[UTIL_PATH_SIZE];
         const char *target;
         char buf[UTIL_PATH_SIZE];
+        int err;
 
         util_path_encode(slink + strlen("/dev"), name_enc, sizeof(name_enc));
         strscpyl(dirname, sizeof(dirname), "/run/udev/links/", name_enc, NULL);
@@ -195,7 +205,15 @@ static void link_update(struct udev_device *dev, const char *slink, bool add)
         if (!add && unlink(filename) == 0)
                 rmdir(dirname);
 
-        target = link_find_prioritized(dev, add, dirname, buf, sizeof(buf));
+        err = -ENOSYS;
+        if (link_resolve != NULL)
+                err = link_resolve(dev, slink, add, buf, sizeof(buf));
+        if (err > 0)
+                target = buf;
+        else if (err == 0)
+                target = NULL;
+        else
+                target = link_find_prioritized(dev, add, dirname, buf, sizeof(buf));
         if (target == NULL) {
                 log_debug("no reference left, remove '%s'\n", slink);
                 if (unlink(slink) == 0)
@@ -206,8 +224,6 @@ static void link_update(struct udev_device *dev, const char *slink, bool add)
         }
 
         if (add) {
-                int err;
-
                 do {
                         int fd;
 
@@ -28,11 +28,14 @@
 #include <dirent.h>
 #include <fnmatch.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "udev.h"
 #include "path-util.h"
 #include "conf-files.h"
 #include "strbuf.h"
+#include "hashmap.h"
 
 #define PREALLOC_TOKEN          2048
 
@@ -50,6 +53,14 @@ struct udev_rules {
         usec_t *dirs_ts_usec;
         int resolve_names;
 
+        /* the files the rules are read from, to validate the cache */
+        char **sources;
+        usec_t *sources_ts_usec;
+
+        /* the precompiled rules, if loaded from the cache */
+        void *map;
+        size_t map_size;
+
         /* every key in the rules file becomes a token */
         struct token *tokens;
         unsigned int token_cur;
@@ -58,6 +69,18 @@ struct udev_rules {
         /* all key strings are copied and de-duplicated in a single continous string buffer */
         struct strbuf *strbuf;
 
+        /* rules by the ACTION and SUBSYSTEM they match, to skip rules
+         * which can not match an event without looking at them */
+        Hashmap *rule_lists;
+        bool use_rule_lists;
+
+        /* the values of match keys with globs or alternatives, compiled
+         * into their parts, indexed by the token */
+        struct glob_part *glob_parts;
+        unsigned int glob_parts_cur;
+        unsigned int glob_parts_max;
+        unsigned int *token_globs;
+
         /* during rule parsing, uid/gid lookup results are cached */
         struct uid_gid *uids;
         unsigned int uids_cur;
@@ -67,6 +90,20 @@ struct udev_rules {
         unsigned int gids_max;
 };
 
+static const char * const default_rules_dirs[] = {
+        "/etc/udev/rules.d",
+        "/run/udev/rules.d",
+        UDEVLIBEXECDIR "/rules.d",
+        NULL
+};
+
+/* the uid/gid lookups of the rules depend on them */
+static const char * const user_db_files[] = {
+        "/etc/passwd",
+        "/etc/group",
+        NULL
+};
+
 static char *rules_str(struct udev_rules *rules, unsigned int off) {
         return rules->strbuf->buf + off;
 }
@@ -209,6 +246,86 @@ struct rule_tmp {
         unsigned int token_cur;
 };
 
+/* a rule, with the literal prefix of the KERNEL it needs to match */
+struct rule_entry {
+        unsigned int token;
+        unsigned int kernel_off;
+        unsigned int kernel_len;
+};
+
+struct rule_list {
+        struct rule_entry *entries;
+        unsigned int entries_cur;
+        unsigned int entries_max;
+        char key[];
+};
+
+/* the rules an event needs to look at, merged from the rule lists of
+ * its ACTION and SUBSYSTEM, and the ones which match any of them */
+struct rule_filter {
+        struct rule_list *lists[4];
+        unsigned int pos[4];
+        const char *sysname;
+};
+
+enum glob_part_type {
+        GP_EXACT,                       /* literal */
+        GP_STAR,                        /* literal prefix and suffix around a single '*' */
+        GP_FNMATCH,                     /* anything else, literal prefix checked first */
+};
+
+/* one alternative of A|B*|C?, the parts of a value follow each other */
+struct glob_part {
+        enum glob_part_type type:8;
+        bool last:1;
+        unsigned int prefix_off;
+        unsigned int prefix_len;
+        unsigned int suffix_off;
+        unsigned int suffix_len;
+};
+
+/*
+ * The precompiled rules, written by "udevadm rules --update". The tokens,
+ * glob parts and strings are stored as they are in memory, the cache is
+ * only valid for the udev version which wrote it, and only as long as all
+ * the rules directories and files it was built from are unchanged.
+ */
+#define RULES_CACHE_SIG         { 'U', 'D', 'E', 'V', 'R', 'U', 'L', 'E' }
+
+struct rules_cache_header {
+        uint8_t signature[8];
+        uint64_t tool_version;
+        uint64_t file_size;
+        uint64_t header_size;
+        uint64_t token_size;
+        uint64_t glob_part_size;
+        int64_t resolve_names;
+
+        /* the directories and files the rules were read from */
+        uint64_t stamps_off;
+        uint64_t stamps_count;
+        uint64_t stamp_paths_off;
+        uint64_t stamp_paths_len;
+
+        uint64_t tokens_off;
+        uint64_t tokens_count;
+        uint64_t token_globs_off;
+        uint64_t glob_parts_off;
+        uint64_t glob_parts_count;
+        uint64_t strings_off;
+        uint64_t strings_len;
+
+        /* the names of the builtins, in the order of enum udev_builtin_cmd */
+        uint64_t builtins_off;
+        uint64_t builtins_len;
+};
+
+struct rules_cache_stamp {
+        uint64_t usec;
+        uint32_t path_off;
+        uint32_t is_dir;
+};
+
 #ifdef DEBUG
 static const char *operation_str(enum operation_type type)
 {
@@ -1575,35 +1692,324 @@ static int parse_file(struct udev_rules *rules, const char *filename)
         return 0;
 }
 
-struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names)
+static int rule_list_add(struct udev_rules *rules, const char *action, size_t action_len,
+                         const char *subsystem, size_t subsystem_len, struct rule_entry *entry)
+{
+        struct rule_list *list;
+        char key[UTIL_NAME_SIZE * 2];
+
+        snprintf(key, sizeof(key), "%.*s|%.*s", (int) action_len, action, (int) subsystem_len, subsystem);
+
+        list = hashmap_get(rules->rule_lists, key);
+        if (list == NULL) {
+                list = calloc(1, offsetof(struct rule_list, key) + strlen(key) + 1);
+                if (list == NULL)
+                        return -ENOMEM;
+                strcpy(list->key, key);
+                if (hashmap_put(rules->rule_lists, list->key, list) < 0) {
+                        free(list);
+                        return -ENOMEM;
+                }
+        }
+
+        /* a rule might be listed twice with A|A, but never out of order */
+        if (list->entries_cur > 0 && list->entries[list->entries_cur-1].token == entry->token)
+                return 0;
+
+        if (list->entries_cur >= list->entries_max) {
+                struct rule_entry *entries;
+                unsigned int add;
+
+                add = list->entries_max;
+                if (add < 8)
+                        add = 8;
+                entries = realloc(list->entries, (list->entries_max + add) * sizeof(struct rule_entry));
+                if (entries == NULL)
+                        return -ENOMEM;
+                list->entries = entries;
+                list->entries_max += add;
+        }
+
+        list->entries[list->entries_cur++] = *entry;
+        return 0;
+}
+
+/* the parts of A|B, or the string itself, or "" for any */
+static bool next_split(const char *value, const char **s, size_t *len)
+{
+        const char *next;
+
+        if (*s == NULL) {
+                *s = value;
+        } else {
+                if ((*s)[*len] == '\0')
+                        return false;
+                *s += *len + 1;
+        }
+
+        next = strchr(*s, '|');
+        *len = next != NULL ? (size_t)(next - *s) : strlen(*s);
+        return true;
+}
+
+static struct token *find_match_token(struct token *rule, enum token_type type)
+{
+        unsigned int i;
+
+        for (i = 1; i < rule->rule.token_count; i++) {
+                struct token *t = &rule[i];
+
+                if (t->type != type || t->key.op != OP_MATCH)
+                        continue;
+                if (t->key.glob != GL_PLAIN && t->key.glob != GL_SPLIT && t->key.glob != GL_GLOB)
+                        continue;
+                return t;
+        }
+        return NULL;
+}
+
+static int add_rule_lists(struct udev_rules *rules)
+{
+        unsigned int i;
+        unsigned int count = 0;
+
+        rules->rule_lists = hashmap_new(string_hash_func, string_compare_func);
+        if (rules->rule_lists == NULL)
+                return -ENOMEM;
+
+        for (i = 0; i < rules->token_cur && rules->tokens[i].type == TK_RULE; i += rules->tokens[i].rule.token_count) {
+                struct token *rule = &rules->tokens[i];
+                struct token *action, *subsystem, *kernel;
+                const char *action_value = "", *subsystem_value = "";
+                const char *a = NULL;
+                size_t a_len = 0;
+                struct rule_entry entry = { .token = i };
+
+                /* only plain values and lists of them can be looked up, KERNEL globs
+                 * are checked for their literal prefix */
+                action = find_match_token(rule, TK_M_ACTION);
+                if (action != NULL && action->key.glob != GL_GLOB)
+                        action_value = rules_str(rules, action->key.value_off);
+
+                subsystem = find_match_token(rule, TK_M_SUBSYSTEM);
+                if (subsystem != NULL && subsystem->key.glob != GL_GLOB)
+                        subsystem_value = rules_str(rules, subsystem->key.value_off);
+
+                kernel = find_match_token(rule, TK_M_KERNEL);
+                if (kernel != NULL && kernel->key.glob != GL_SPLIT) {
+                        const char *k = rules_str(rules, kernel->key.value_off);
+
+                        entry.kernel_off = kernel->key.value_off;
+                        entry.kernel_len = strcspn(k, "*?[\\");
+                }
+
+                while (next_split(action_value, &a, &a_len)) {
+                        const char *b = NULL;
+                        size_t b_len = 0;
+
+                        while (next_split(subsystem_value, &b, &b_len))
+                                if (rule_list_add(rules, a, a_len, b, b_len, &entry) < 0)
+                                        return -ENOMEM;
+                }
+                count++;
+        }
+
+        log_debug("%u rules in %u lists\n", count, hashmap_size(rules->rule_lists));
+        rules->use_rule_lists = true;
+        return 0;
+}
+
+static int glob_part_add(struct udev_rules *rules, const char *value, size_t len, bool glob, bool last)
+{
+        struct glob_part *part;
+        const char *s;
+        ssize_t off;
+        size_t literal;
+
+        if (rules->glob_parts_cur >= rules->glob_parts_max) {
+                struct glob_part *parts;
+                unsigned int add;
+
+                add = rules->glob_parts_max;
+                if (add < 64)
+                        add = 64;
+                parts = realloc(rules->glob_parts, (rules->glob_parts_max + add) * sizeof(struct glob_part));
+                if (parts == NULL)
+                        return -ENOMEM;
+                rules->glob_parts = parts;
+                rules->glob_parts_max += add;
+        }
+
+        /* the part gets its own string, to call fnmatch() without splitting the value again */
+        s = strndupa(value, len);
+        off = strbuf_add_string(rules->strbuf, s, len);
+        if (off < 0)
+                return off;
+
+        part = &rules->glob_parts[rules->glob_parts_cur++];
+        part->last = last;
+        part->prefix_off = off;
+
+        /* parts of values without glob characters are compared
+         * literally, even if they contain a backslash */
+        literal = glob ? strcspn(s, "*?[\\") : len;
+        if (literal == len) {
+                part->type = GP_EXACT;
+                part->prefix_len = len;
+                part->suffix_off = 0;
+                part->suffix_len = 0;
+        } else if (s[literal] == '*' && literal + 1 + strcspn(&s[literal+1], "*?[\\") == len) {
+                part->type = GP_STAR;
+                part->prefix_len = literal;
+                part->suffix_off = off + literal + 1;
+                part->suffix_len = len - literal - 1;
+        } else {
+                part->type = GP_FNMATCH;
+                part->prefix_len = literal;
+                part->suffix_off = 0;
+                part->suffix_len = 0;
+        }
+
+        return 0;
+}
+
+static int add_globs(struct udev_rules *rules)
+{
+        unsigned int i;
+
+        rules->token_globs = calloc(rules->token_cur, sizeof(unsigned int));
+        if (rules->token_globs == NULL)
+                return -ENOMEM;
+
+        for (i = 0; i < rules->token_cur; i++) {
+                struct token *t = &rules->tokens[i];
+                char value[UTIL_LINE_SIZE];
+                const char *s = NULL;
+                size_t len = 0;
+
+                /* only the keys which are compared with match_key() */
+                switch (t->type) {
+                case TK_M_ACTION:
+                case TK_M_DEVPATH:
+                case TK_M_KERNEL:
+                case TK_M_DEVLINK:
+                case TK_M_NAME:
+                case TK_M_ENV:
+                case TK_M_SUBSYSTEM:
+                case TK_M_DRIVER:
+                case TK_M_ATTR:
+                case TK_M_KERNELS:
+                case TK_M_SUBSYSTEMS:
+                case TK_M_DRIVERS:
+                case TK_M_ATTRS:
+                case TK_M_RESULT:
+                        break;
+                default:
+                        continue;
+                }
+
+                if (t->key.glob != GL_GLOB && t->key.glob != GL_SPLIT && t->key.glob != GL_SPLIT_GLOB)
+                        continue;
+
+                /* the string buffer might move while parts are added */
+                strscpy(value, sizeof(value), rules_str(rules, t->key.value_off));
+
+                rules->token_globs[i] = rules->glob_parts_cur;
+                if (t->key.glob == GL_GLOB) {
+                        if (glob_part_add(rules, value, strlen(value), true, true) < 0)
+                                return -ENOMEM;
+                        continue;
+                }
+
+                while (next_split(value, &s, &len))
+                        if (glob_part_add(rules, s, len, t->key.glob == GL_SPLIT_GLOB, s[len] == '\0') < 0)
+                                return -ENOMEM;
+        }
+
+        log_debug("%u glob parts\n", rules->glob_parts_cur);
+        return 0;
+}
+
+static void rule_filter_init(struct udev_rules *rules, struct rule_filter *filter, struct udev_device *dev)
+{
+        const char *action, *subsystem;
+        char key[UTIL_NAME_SIZE * 2];
+        unsigned int i, j;
+
+        action = udev_device_get_action(dev);
+        if (action == NULL)
+                action = "";
+        subsystem = udev_device_get_subsystem(dev);
+        if (subsystem == NULL)
+                subsystem = "";
+
+        snprintf(key, sizeof(key), "%s|%s", action, subsystem);
+        filter->lists[0] = hashmap_get(rules->rule_lists, key);
+        snprintf(key, sizeof(key), "%s|", action);
+        filter->lists[1] = hashmap_get(rules->rule_lists, key);
+        snprintf(key, sizeof(key), "|%s", subsystem);
+        filter->lists[2] = hashmap_get(rules->rule_lists, key);
+        filter->lists[3] = hashmap_get(rules->rule_lists, "|");
+
+        /* with an empty ACTION or SUBSYSTEM, the same list is found twice */
+        for (i = 0; i < ELEMENTSOF(filter->lists); i++) {
+                filter->pos[i] = 0;
+                for (j = 0; j < i; j++)
+                        if (filter->lists[i] == filter->lists[j])
+                                filter->lists[i] = NULL;
+        }
+
+        filter->sysname = udev_device_get_sysname(dev);
+        if (filter->sysname == NULL)
+                filter->sysname = "";
+}
+
+/* the next rule at or after token which might match, or the end token */
+static unsigned int rule_filter_next(struct udev_rules *rules, struct rule_filter *filter, unsigned int token)
+{
+        for (;;) {
+                struct rule_entry *next = NULL;
+                unsigned int i;
+
+                for (i = 0; i < ELEMENTSOF(filter->lists); i++) {
+                        struct rule_list *list = filter->lists[i];
+
+                        if (list == NULL)
+                                continue;
+                        while (filter->pos[i] < list->entries_cur && list->entries[filter->pos[i]].token < token)
+                                filter->pos[i]++;
+                        if (filter->pos[i] >= list->entries_cur)
+                                continue;
+                        if (next == NULL || list->entries[filter->pos[i]].token < next->token)
+                                next = &list->entries[filter->pos[i]];
+                }
+
+                if (next == NULL)
+                        return rules->token_cur - 1;
+
+                if (next->kernel_len == 0 ||
+                    strneq(filter->sysname, rules_str(rules, next->kernel_off), next->kernel_len))
+                        return next->token;
+
+                /* KERNEL can not match */
+                token = next->token + 1;
+        }
+}
+
+static struct udev_rules *rules_alloc(struct udev *udev, int resolve_names, const char * const *dirs)
 {
         struct udev_rules *rules;
-        struct udev_list file_list;
-        struct token end_token;
-        char **files, **f;
-        int r;
 
         rules = calloc(1, sizeof(struct udev_rules));
         if (rules == NULL)
                 return NULL;
         rules->udev = udev;
         rules->resolve_names = resolve_names;
-        udev_list_init(udev, &file_list, true);
-
-        /* init token array and string buffer */
-        rules->tokens = malloc(PREALLOC_TOKEN * sizeof(struct token));
-        if (rules->tokens == NULL)
-                return udev_rules_unref(rules);
-        rules->token_max = PREALLOC_TOKEN;
 
-        rules->strbuf = strbuf_new();
-        if (!rules->strbuf)
-                return udev_rules_unref(rules);
+        if (dirs == NULL)
+                dirs = default_rules_dirs;
 
-        rules->dirs = strv_new("/etc/udev/rules.d",
-                               "/run/udev/rules.d",
-                               UDEVLIBEXECDIR "/rules.d",
-                               NULL);
+        rules->dirs = strv_copy((char **) dirs);
         if (!rules->dirs) {
                 log_error("failed to build config directory array");
                 return udev_rules_unref(rules);
@@ -1617,6 +2023,43 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names)
         rules->dirs_ts_usec = calloc(strv_length(rules->dirs), sizeof(long long));
         if(!rules->dirs_ts_usec)
                 return udev_rules_unref(rules);
+
+        return rules;
+}
+
+struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names)
+{
+        struct udev_rules *rules;
+
+        rules = udev_rules_new_from_cache(udev, resolve_names, NULL, UDEV_RULES_CACHE);
+        if (rules != NULL)
+                return rules;
+
+        return udev_rules_new_from_dirs(udev, resolve_names, NULL);
+}
+
+struct udev_rules *udev_rules_new_from_dirs(struct udev *udev, int resolve_names, const char * const *dirs)
+{
+        struct udev_rules *rules;
+        struct token end_token;
+        char **files, **f;
+        unsigned int i;
+        int r;
+
+        rules = rules_alloc(udev, resolve_names, dirs);
+        if (rules == NULL)
+                return NULL;
+
+        /* init token array and string buffer */
+        rules->tokens = malloc(PREALLOC_TOKEN * sizeof(struct token));
+        if (rules->tokens == NULL)
+                return udev_rules_unref(rules);
+        rules->token_max = PREALLOC_TOKEN;
+
+        rules->strbuf = strbuf_new();
+        if (!rules->strbuf)
+                return udev_rules_unref(rules);
+
         udev_rules_check_timestamp(rules);
 
         r = conf_files_list_strv(&files, ".rules", NULL, (const char **)rules->dirs);
@@ -1632,6 +2075,24 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names)
         STRV_FOREACH(f, files)
                 rules_add_string(rules, *f);
 
+        /* remember the timestamps of the files before they are read */
+        rules->sources = strv_merge(files, (char **) user_db_files);
+        if (rules->sources == NULL) {
+                strv_free(files);
+                return udev_rules_unref(rules);
+        }
+        rules->sources_ts_usec = calloc(strv_length(rules->sources), sizeof(usec_t));
+        if (rules->sources_ts_usec == NULL) {
+                strv_free(files);
+                return udev_rules_unref(rules);
+        }
+        for (i = 0; rules->sources[i] != NULL; i++) {
+                struct stat stats;
+
+                if (stat(rules->sources[i], &stats) >= 0)
+                        rules->sources_ts_usec[i] = timespec_load(&stats.st_mtim);
+        }
+
         STRV_FOREACH(f, files)
                 parse_file(rules, *f);
 
@@ -1640,6 +2101,17 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names)
         memset(&end_token, 0x00, sizeof(struct token));
         end_token.type = TK_END;
         add_token(rules, &end_token);
+
+        if (add_rule_lists(rules) < 0) {
+                log_error("failed to index rules\n");
+                return udev_rules_unref(rules);
+        }
+
+        if (add_globs(rules) < 0) {
+                log_error("failed to compile rules\n");
+                return udev_rules_unref(rules);
+        }
+
         log_debug("rules contain %zu bytes tokens (%u * %zu bytes), %zu bytes strings\n",
                   rules->token_max * sizeof(struct token), rules->token_max, sizeof(struct token), rules->strbuf->len);
 
@@ -1667,16 +2139,384 @@ struct udev_rules *udev_rules_unref(struct udev_rules *rules)
 {
         if (rules == NULL)
                 return NULL;
+        if (rules->map != NULL) {
+                /* tokens, glob parts and strings are in the mapped cache */
+                rules->tokens = NULL;
+                rules->glob_parts = NULL;
+                rules->token_globs = NULL;
+                if (rules->strbuf != NULL)
+                        rules->strbuf->buf = NULL;
+                munmap(rules->map, rules->map_size);
+        }
+        if (rules->rule_lists != NULL) {
+                struct rule_list *list;
+
+                while ((list = hashmap_steal_first(rules->rule_lists))) {
+                        free(list->entries);
+                        free(list);
+                }
+                hashmap_free(rules->rule_lists);
+        }
+        free(rules->glob_parts);
+        free(rules->token_globs);
         free(rules->tokens);
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
         free(rules->gids);
         strv_free(rules->dirs);
         free(rules->dirs_ts_usec);
+        strv_free(rules->sources);
+        free(rules->sources_ts_usec);
         free(rules);
         return NULL;
 }
 
+static bool cache_section_valid(const struct rules_cache_header *h, uint64_t off, uint64_t count, uint64_t size)
+{
+        if (off < h->header_size || off > h->file_size || off % 4 != 0)
+                return false;
+        return count <= (h->file_size - off) / size;
+}
+
+/* the tokens index into the other sections, and are used without further checks */
+static bool cache_tokens_valid(struct udev_rules *rules)
+{
+        size_t strings_len = rules->strbuf->len;
+        unsigned int i;
+
+        for (i = 0; i < rules->glob_parts_cur; i++) {
+                const struct glob_part *part = &rules->glob_parts[i];
+
+                if (part->type > GP_FNMATCH ||
+                    part->prefix_off >= strings_len || part->prefix_len > strings_len - part->prefix_off ||
+                    part->suffix_off >= strings_len || part->suffix_len > strings_len - part->suffix_off)
+                        return false;
+        }
+        /* the parts of a value end with the last one, which must be in the cache */
+        if (rules->glob_parts_cur > 0 && !rules->glob_parts[rules->glob_parts_cur-1].last)
+                return false;
+
+        i = 0;
+        while (rules->tokens[i].type == TK_RULE) {
+                const struct token *rule = &rules->tokens[i];
+                unsigned int j;
+
+                if (rule->rule.token_count == 0 || rule->rule.token_count > rules->token_cur - 1 - i ||
+                    rule->rule.label_off >= strings_len || rule->rule.filename_off >= strings_len)
+                        return false;
+
+                for (j = i + 1; j < i + rule->rule.token_count; j++) {
+                        const struct token *key = &rules->tokens[j];
+
+                        if (key->type <= TK_RULE || key->type >= TK_END ||
+                            key->key.op > OP_ASSIGN_FINAL || key->key.glob > GL_SOMETHING ||
+                            key->key.value_off >= strings_len)
+                                return false;
+
+                        switch (key->type) {
+                        case TK_M_ENV:
+                        case TK_M_ATTR:
+                        case TK_M_ATTRS:
+                        case TK_A_ATTR:
+                        case TK_A_ENV:
+                                if (key->key.attr_off >= strings_len)
+                                        return false;
+                                break;
+                        case TK_M_IMPORT_BUILTIN:
+                        case TK_A_RUN_BUILTIN:
+                                if (key->key.builtin_cmd >= UDEV_BUILTIN_MAX)
+                                        return false;
+                                break;
+                        case TK_A_RUN_PROGRAM:
+                                if (key->key.builtin_cmd > UDEV_BUILTIN_MAX)
+                                        return false;
+                                break;
+                        case TK_A_GOTO:
+                                if (key->key.rule_goto != 0 &&
+                                    (key->key.rule_goto >= rules->token_cur ||
+                                     rules->tokens[key->key.rule_goto].type != TK_RULE))
+                                        return false;
+                                break;
+                        default:
+                                break;
+                        }
+
+                        if ((key->key.glob == GL_GLOB || key->key.glob == GL_SPLIT || key->key.glob == GL_SPLIT_GLOB) &&
+                            rules->token_globs[j] >= rules->glob_parts_cur)
+                                return false;
+                }
+
+                i += rule->rule.token_count;
+        }
+
+        /* nothing but rules in front of the end token */
+        return i == rules->token_cur - 1;
+}
+
+/* the cache is written by udevadm like hwdb.bin, only its layout is checked */
+struct udev_rules *udev_rules_new_from_cache(struct udev *udev, int resolve_names,
+                                             const char * const *dirs, const char *filename)
+{
+        static const uint8_t sig[] = RULES_CACHE_SIG;
+        struct udev_rules *rules;
+        const struct rules_cache_header *h;
+        const struct rules_cache_stamp *stamps;
+        const char *paths;
+        const char *builtins;
+        size_t builtins_len;
+        struct stat stats;
+        unsigned int i;
+        unsigned int n_dirs = 0;
+        void *map;
+        int fd;
+
+        fd = open(filename, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return NULL;
+
+        if (fstat(fd, &stats) < 0 || (size_t)stats.st_size < sizeof(struct rules_cache_header)) {
+                close(fd);
+                return NULL;
+        }
+
+        map = mmap(NULL, stats.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                log_debug("error mapping %s: %m\n", filename);
+                return NULL;
+        }
+
+        rules = rules_alloc(udev, resolve_names, dirs);
+        if (rules == NULL) {
+                munmap(map, stats.st_size);
+                return NULL;
+        }
+        rules->map = map;
+        rules->map_size = stats.st_size;
+
+        h = map;
+        if (memcmp(h->signature, sig, sizeof(h->signature)) != 0 ||
+            h->tool_version != (uint64_t) atoi(VERSION) ||
+            h->file_size != (uint64_t) stats.st_size ||
+            h->header_size != sizeof(struct rules_cache_header) ||
+            h->token_size != sizeof(struct token) ||
+            h->glob_part_size != sizeof(struct glob_part)) {
+                log_debug("error recognizing the format of %s\n", filename);
+                goto invalid;
+        }
+
+        if (!cache_section_valid(h, h->stamps_off, h->stamps_count, sizeof(struct rules_cache_stamp)) ||
+            !cache_section_valid(h, h->stamp_paths_off, h->stamp_paths_len, 1) ||
+            !cache_section_valid(h, h->tokens_off, h->tokens_count, sizeof(struct token)) ||
+            !cache_section_valid(h, h->token_globs_off, h->tokens_count, sizeof(unsigned int)) ||
+            !cache_section_valid(h, h->glob_parts_off, h->glob_parts_count, sizeof(struct glob_part)) ||
+            !cache_section_valid(h, h->strings_off, h->strings_len, 1) ||
+            !cache_section_valid(h, h->builtins_off, h->builtins_len, 1) ||
+            h->stamp_paths_len == 0 || h->tokens_count == 0 || h->strings_len == 0) {
+                log_debug("error reading %s\n", filename);
+                goto invalid;
+        }
+
+        if (h->resolve_names != resolve_names) {
+                log_debug("%s resolves names differently\n", filename);
+                goto invalid;
+        }
+
+        /* the tokens store the builtins by their number, which depends on the configure options */
+        builtins = (const char *) map + h->builtins_off;
+        builtins_len = h->builtins_len;
+        for (i = 0; i < UDEV_BUILTIN_MAX; i++) {
+                size_t len = strlen(udev_builtin_name(i)) + 1;
+
+                if (len > builtins_len || memcmp(builtins, udev_builtin_name(i), len) != 0)
+                        break;
+                builtins += len;
+                builtins_len -= len;
+        }
+        if (i < UDEV_BUILTIN_MAX || builtins_len > 0) {
+                log_debug("%s is built with different builtins\n", filename);
+                goto invalid;
+        }
+
+        /* the same directories, and nothing changed since the cache was written */
+        stamps = (const struct rules_cache_stamp *) ((const uint8_t *) map + h->stamps_off);
+        paths = (const char *) map + h->stamp_paths_off;
+        if (paths[h->stamp_paths_len - 1] != '\0')
+                goto invalid;
+
+        for (i = 0; i < h->stamps_count; i++) {
+                const char *path;
+                usec_t usec = 0;
+
+                if (stamps[i].path_off >= h->stamp_paths_len)
+                        goto invalid;
+                path = &paths[stamps[i].path_off];
+
+                if (stamps[i].is_dir) {
+                        if (rules->dirs[n_dirs] == NULL || !streq(rules->dirs[n_dirs], path)) {
+                                log_debug("%s is built from different directories\n", filename);
+                                goto invalid;
+                        }
+                        rules->dirs_ts_usec[n_dirs++] = stamps[i].usec;
+                }
+
+                if (stat(path, &stats) >= 0)
+                        usec = timespec_load(&stats.st_mtim);
+                if (usec != stamps[i].usec) {
+                        log_debug("'%s' changed since %s was written\n", path, filename);
+                        goto invalid;
+                }
+        }
+        if (rules->dirs[n_dirs] != NULL) {
+                log_debug("%s is built from different directories\n", filename);
+                goto invalid;
+        }
+
+        rules->tokens = (struct token *) ((uint8_t *) map + h->tokens_off);
+        rules->token_cur = h->tokens_count;
+        rules->token_max = h->tokens_count;
+        rules->token_globs = (unsigned int *) ((uint8_t *) map + h->token_globs_off);
+        rules->glob_parts = (struct glob_part *) ((uint8_t *) map + h->glob_parts_off);
+        rules->glob_parts_cur = h->glob_parts_count;
+        rules->glob_parts_max = h->glob_parts_count;
+        if (rules->tokens[rules->token_cur-1].type != TK_END)
+                goto invalid;
+
+        rules->strbuf = new0(struct strbuf, 1);
+        if (rules->strbuf == NULL)
+                goto invalid;
+        rules->strbuf->buf = (char *) map + h->strings_off;
+        rules->strbuf->len = h->strings_len;
+        if (rules->strbuf->buf[rules->strbuf->len - 1] != '\0')
+                goto invalid;
+
+        if (!cache_tokens_valid(rules)) {
+                log_debug("error reading the tokens of %s\n", filename);
+                goto invalid;
+        }
+
+        if (add_rule_lists(rules) < 0) {
+                log_error("failed to index rules\n");
+                goto invalid;
+        }
+
+        log_debug("rules loaded from %s, %u tokens, %zu bytes strings\n",
+                  filename, rules->token_cur, rules->strbuf->len);
+        dump_rules(rules);
+        return rules;
+invalid:
+        return udev_rules_unref(rules);
+}
+
+static void cache_write_stamp(FILE *f, const char *path, usec_t usec, bool is_dir, uint64_t *paths_len)
+{
+        struct rules_cache_stamp stamp = {
+                .usec = usec,
+                .path_off = *paths_len,
+                .is_dir = is_dir,
+        };
+
+        fwrite(&stamp, sizeof(struct rules_cache_stamp), 1, f);
+        *paths_len += strlen(path) + 1;
+}
+
+/* sections start at 8 byte aligned offsets */
+static uint64_t cache_align(FILE *f)
+{
+        off_t pos = ftello(f);
+
+        while (pos % 8 != 0) {
+                fputc('\0', f);
+                pos++;
+        }
+        return pos;
+}
+
+int udev_rules_store_cache(struct udev_rules *rules, const char *filename)
+{
+        struct rules_cache_header h = {
+                .signature = RULES_CACHE_SIG,
+                .tool_version = atoi(VERSION),
+                .header_size = sizeof(struct rules_cache_header),
+                .token_size = sizeof(struct token),
+                .glob_part_size = sizeof(struct glob_part),
+                .resolve_names = rules->resolve_names,
+        };
+        char *filename_tmp;
+        FILE *f;
+        unsigned int i;
+        int err;
+
+        /* only rules read from their files know where they came from */
+        if (rules->sources == NULL)
+                return -EINVAL;
+
+        err = fopen_temporary(filename, &f, &filename_tmp);
+        if (err < 0)
+                return err;
+        fchmod(fileno(f), 0444);
+
+        fseeko(f, sizeof(struct rules_cache_header), SEEK_SET);
+
+        h.stamps_off = cache_align(f);
+        for (i = 0; rules->dirs[i] != NULL; i++)
+                cache_write_stamp(f, rules->dirs[i], rules->dirs_ts_usec[i], true, &h.stamp_paths_len);
+        for (i = 0; rules->sources[i] != NULL; i++)
+                cache_write_stamp(f, rules->sources[i], rules->sources_ts_usec[i], false, &h.stamp_paths_len);
+        h.stamps_count = strv_length(rules->dirs) + strv_length(rules->sources);
+
+        h.stamp_paths_off = cache_align(f);
+        for (i = 0; rules->dirs[i] != NULL; i++)
+                fwrite(rules->dirs[i], strlen(rules->dirs[i]) + 1, 1, f);
+        for (i = 0; rules->sources[i] != NULL; i++)
+                fwrite(rules->sources[i], strlen(rules->sources[i]) + 1, 1, f);
+
+        h.tokens_off = cache_align(f);
+        fwrite(rules->tokens, sizeof(struct token), rules->token_cur, f);
+        h.tokens_count = rules->token_cur;
+
+        h.token_globs_off = cache_align(f);
+        fwrite(rules->token_globs, sizeof(unsigned int), rules->token_cur, f);
+
+        h.glob_parts_off = cache_align(f);
+        fwrite(rules->glob_parts, sizeof(struct glob_part), rules->glob_parts_cur, f);
+        h.glob_parts_count = rules->glob_parts_cur;
+
+        h.strings_off = cache_align(f);
+        fwrite(rules->strbuf->buf, rules->strbuf->len, 1, f);
+        h.strings_len = rules->strbuf->len;
+
+        h.builtins_off = cache_align(f);
+        for (i = 0; i < UDEV_BUILTIN_MAX; i++) {
+                fwrite(udev_builtin_name(i), strlen(udev_builtin_name(i)) + 1, 1, f);
+                h.builtins_len += strlen(udev_builtin_name(i)) + 1;
+        }
+
+        h.file_size = ftello(f);
+        fseeko(f, 0, SEEK_SET);
+        fwrite(&h, sizeof(struct rules_cache_header), 1, f);
+
+        fflush(f);
+        if (ferror(f))
+                err = -EIO;
+        fclose(f);
+        if (err >= 0 && rename(filename_tmp, filename) < 0)
+                err = -errno;
+        if (err < 0)
+                unlink(filename_tmp);
+        free(filename_tmp);
+
+        log_debug("rules cache %s: %llu bytes, %u tokens, %u glob parts, %zu bytes strings\n",
+                  filename, (unsigned long long) h.file_size, rules->token_cur,
+                  rules->glob_parts_cur, rules->strbuf->len);
+        return err;
+}
+
+void udev_rules_set_use_index(struct udev_rules *rules, bool use)
+{
+        rules->use_rule_lists = use && rules->rule_lists != NULL;
+}
+
 bool udev_rules_check_timestamp(struct udev_rules *rules)
 {
         unsigned int i;
@@ -1707,10 +2547,39 @@ out:
         return changed;
 }
 
+static bool match_glob(struct udev_rules *rules, struct token *token, const char *val)
+{
+        struct glob_part *part;
+        size_t len = strlen(val);
+
+        for (part = &rules->glob_parts[rules->token_globs[token - rules->tokens]];; part++) {
+                const char *s = rules_str(rules, part->prefix_off);
+
+                switch (part->type) {
+                case GP_EXACT:
+                        if (len == part->prefix_len && memcmp(val, s, len) == 0)
+                                return true;
+                        break;
+                case GP_STAR:
+                        if (len >= part->prefix_len + part->suffix_len &&
+                            memcmp(val, s, part->prefix_len) == 0 &&
+                            memcmp(&val[len - part->suffix_len], rules_str(rules, part->suffix_off), part->suffix_len) == 0)
+                                return true;
+                        break;
+                case GP_FNMATCH:
+                        if (strneq(val, s, part->prefix_len) && fnmatch(s, val, 0) == 0)
+                                return true;
+                        break;
+                }
+
+                if (part->last)
+                        return false;
+        }
+}
+
 static int match_key(struct udev_rules *rules, struct token *token, const char *val)
 {
         char *key_value = rules_str(rules, token->key.value_off);
-        char *pos;
         bool match = false;
 
         if (val == NULL)
@@ -1721,52 +2590,10 @@ static int match_key(struct udev_rules *rules, struct token *token, const char *
                 match = (streq(key_value, val));
                 break;
         case GL_GLOB:
-                match = (fnmatch(key_value, val, 0) == 0);
-                break;
         case GL_SPLIT:
-                {
-                        const char *s;
-                        size_t len;
-
-                        s = rules_str(rules, token->key.value_off);
-                        len = strlen(val);
-                        for (;;) {
-                                const char *next;
-
-                                next = strchr(s, '|');
-                                if (next != NULL) {
-                                        size_t matchlen = (size_t)(next - s);
-
-                                        match = (matchlen == len && strneq(s, val, matchlen));
-                                        if (match)
-                                                break;
-                                } else {
-                                        match = (streq(s, val));
-                                        break;
-                                }
-                                s = &next[1];
-                        }
-                        break;
-                }
         case GL_SPLIT_GLOB:
-                {
-                        char value[UTIL_PATH_SIZE];
-
-                        strscpy(value, sizeof(value), rules_str(rules, token->key.value_off));
-                        key_value = value;
-                        while (key_value != NULL) {
-                                pos = strchr(key_value, '|');
-                                if (pos != NULL) {
-                                        pos[0] = '\0';
-                                        pos = &pos[1];
-                                }
-                                match = (fnmatch(key_value, val, 0) == 0);
-                                if (match)
-                                        break;
-                                key_value = pos;
-                        }
-                        break;
-                }
+                match = match_glob(rules, token, val);
+                break;
         case GL_SOMETHING:
                 match = (val[0] != '\0');
                 break;
@@ -1842,10 +2669,14 @@ int udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event
         struct token *rule;
         enum escape_type esc = ESCAPE_UNSET;
         bool can_set_name;
+        struct rule_filter filter;
 
         if (rules->tokens == NULL)
                 return -1;
 
+        if (rules->use_rule_lists)
+                rule_filter_init(rules, &filter, event->dev);
+
         can_set_name = ((!streq(udev_device_get_action(event->dev), "remove")) &&
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
@@ -1857,6 +2688,16 @@ int udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event
                 dump_token(rules, cur);
                 switch (cur->type) {
                 case TK_RULE:
+                        /* skip rules whose ACTION, SUBSYSTEM or KERNEL can not match */
+                        if (rules->use_rule_lists) {
+                                unsigned int next;
+
+                                next = rule_filter_next(rules, &filter, cur - rules->tokens);
+                                if (next != (unsigned int) (cur - rules->tokens)) {
+                                        cur = &rules->tokens[next];
+                                        continue;
+                                }
+                        }
                         /* current rule */
                         rule = cur;
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
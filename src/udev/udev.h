@@ -67,10 +67,16 @@ struct udev_watch {
 };
 
 /* udev-rules.c */
+#define UDEV_RULES_CACHE "/etc/udev/rules.bin"
 struct udev_rules;
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names);
+struct udev_rules *udev_rules_new_from_dirs(struct udev *udev, int resolve_names, const char * const *dirs);
+struct udev_rules *udev_rules_new_from_cache(struct udev *udev, int resolve_names,
+                                             const char * const *dirs, const char *filename);
+int udev_rules_store_cache(struct udev_rules *rules, const char *filename);
 struct udev_rules *udev_rules_unref(struct udev_rules *rules);
 bool udev_rules_check_timestamp(struct udev_rules *rules);
+void udev_rules_set_use_index(struct udev_rules *rules, bool use);
 int udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event, const sigset_t *sigmask);
 void udev_rules_apply_static_dev_perms(struct udev_rules *rules);
 
@@ -98,6 +104,31 @@ struct udev_device *udev_watch_lookup(struct udev *udev, int wd);
 void udev_node_add(struct udev_device *dev, bool apply, mode_t mode, uid_t uid, gid_t gid);
 void udev_node_remove(struct udev_device *dev);
 void udev_node_update_old_links(struct udev_device *dev, struct udev_device *dev_old);
+void udev_node_set_link_resolver(int (*resolve)(struct udev_device *dev, const char *slink, bool add,
+                                                char *target, size_t size));
+
+/* udev-event-index.c */
+struct udev_event_index;
+struct udev_event_index_entry;
+struct udev_event_index *udev_event_index_new(void);
+void udev_event_index_free(struct udev_event_index *idx);
+struct udev_event_index_entry *udev_event_index_add(struct udev_event_index *idx,
+                                                    unsigned long long int seqnum,
+                                                    const char *devpath, const char *devpath_old,
+                                                    dev_t devnum, bool is_block, int ifindex, bool nodelay);
+void udev_event_index_remove(struct udev_event_index *idx, struct udev_event_index_entry *entry);
+bool udev_event_index_is_busy(struct udev_event_index *idx, struct udev_event_index_entry *entry);
+unsigned int udev_event_index_size(struct udev_event_index *idx);
+
+/* udev-link-index.c */
+struct udev_link_index;
+struct udev_link_index *udev_link_index_new(void);
+void udev_link_index_free(struct udev_link_index *idx);
+int udev_link_index_add(struct udev_link_index *idx, const char *name, const char *id,
+                        const char *devnode, int priority);
+void udev_link_index_remove(struct udev_link_index *idx, const char *name, const char *id);
+const char *udev_link_index_find(struct udev_link_index *idx, const char *name);
+unsigned int udev_link_index_size(struct udev_link_index *idx);
 
 /* udev-ctrl.c */
 struct udev_ctrl;
@@ -117,10 +148,12 @@ int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_set_env(struct udev_ctrl *uctrl, const char *key, int timeout);
 int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int timeout);
+int udev_ctrl_send_get_worker_stats(struct udev_ctrl *uctrl, FILE *f, int timeout);
 struct udev_ctrl_connection;
 struct udev_ctrl_connection *udev_ctrl_get_connection(struct udev_ctrl *uctrl);
 struct udev_ctrl_connection *udev_ctrl_connection_ref(struct udev_ctrl_connection *conn);
 struct udev_ctrl_connection *udev_ctrl_connection_unref(struct udev_ctrl_connection *conn);
+int udev_ctrl_connection_send_reply(struct udev_ctrl_connection *conn, const char *buf, size_t len);
 struct udev_ctrl_msg;
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn);
 struct udev_ctrl_msg *udev_ctrl_msg_ref(struct udev_ctrl_msg *ctrl_msg);
@@ -133,22 +166,28 @@ int udev_ctrl_get_ping(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg);
 const char *udev_ctrl_get_set_env(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_set_children_max(struct udev_ctrl_msg *ctrl_msg);
+int udev_ctrl_get_worker_stats(struct udev_ctrl_msg *ctrl_msg);
 
 /* built-in commands */
 enum udev_builtin_cmd {
+        UDEV_BUILTIN_ATA_ID,
 #ifdef HAVE_BLKID
         UDEV_BUILTIN_BLKID,
 #endif
         UDEV_BUILTIN_BTRFS,
+        UDEV_BUILTIN_CDROM_ID,
         UDEV_BUILTIN_FIRMWARE,
         UDEV_BUILTIN_HWDB,
         UDEV_BUILTIN_INPUT_ID,
 #ifdef HAVE_KMOD
         UDEV_BUILTIN_KMOD,
 #endif
+        UDEV_BUILTIN_MTD_PROBE,
         UDEV_BUILTIN_NET_ID,
         UDEV_BUILTIN_PATH_ID,
+        UDEV_BUILTIN_SCSI_ID,
         UDEV_BUILTIN_USB_ID,
+        UDEV_BUILTIN_V4L_ID,
 #ifdef HAVE_ACL
         UDEV_BUILTIN_UACCESS,
 #endif
@@ -163,19 +202,24 @@ struct udev_builtin {
         bool (*validate)(struct udev *udev);
         bool run_once;
 };
+extern const struct udev_builtin udev_builtin_ata_id;
 #ifdef HAVE_BLKID
 extern const struct udev_builtin udev_builtin_blkid;
 #endif
 extern const struct udev_builtin udev_builtin_btrfs;
+extern const struct udev_builtin udev_builtin_cdrom_id;
 extern const struct udev_builtin udev_builtin_firmware;
 extern const struct udev_builtin udev_builtin_hwdb;
 extern const struct udev_builtin udev_builtin_input_id;
 #ifdef HAVE_KMOD
 extern const struct udev_builtin udev_builtin_kmod;
 #endif
+extern const struct udev_builtin udev_builtin_mtd_probe;
 extern const struct udev_builtin udev_builtin_net_id;
 extern const struct udev_builtin udev_builtin_path_id;
+extern const struct udev_builtin udev_builtin_scsi_id;
 extern const struct udev_builtin udev_builtin_usb_id;
+extern const struct udev_builtin udev_builtin_v4l_id;
 extern const struct udev_builtin udev_builtin_uaccess;
 void udev_builtin_init(struct udev *udev);
 void udev_builtin_exit(struct udev *udev);
@@ -187,6 +231,7 @@ void udev_builtin_list(struct udev *udev);
 bool udev_builtin_validate(struct udev *udev);
 int udev_builtin_add_property(struct udev_device *dev, bool test, const char *key, const char *val);
 int udev_builtin_hwdb_lookup(struct udev_device *dev, const char *modalias, bool test);
+int udev_builtin_main(const struct udev_builtin *builtin, const char *key, int argc, char *argv[]);
 
 /* udev logging */
 void udev_main_log(struct udev *udev, int priority,
@@ -206,6 +251,7 @@ extern const struct udevadm_cmd udevadm_settle;
 extern const struct udevadm_cmd udevadm_control;
 extern const struct udevadm_cmd udevadm_monitor;
 extern const struct udevadm_cmd udevadm_hwdb;
+extern const struct udevadm_cmd udevadm_rules;
 extern const struct udevadm_cmd udevadm_test;
 extern const struct udevadm_cmd udevadm_test_builtin;
 #endif
@@ -37,6 +37,7 @@ static void print_help(void)
                 "  --reload                 reload rules and databases\n"
                 "  --property=<KEY>=<value> set a global property for all events\n"
                 "  --children-max=<N>       maximum number of children\n"
+                "  --worker-stats           print the event latency of the workers\n"
                 "  --timeout=<seconds>      maximum time to block for a reply\n"
                 "  --help                   print this help text\n\n");
 }
@@ -57,6 +58,7 @@ static int adm_control(struct udev *udev, int argc, char *argv[])
                 { "property", required_argument, NULL, 'p' },
                 { "env", required_argument, NULL, 'p' },
                 { "children-max", required_argument, NULL, 'm' },
+                { "worker-stats", no_argument, NULL, 'w' },
                 { "timeout", required_argument, NULL, 't' },
                 { "help", no_argument, NULL, 'h' },
                 {}
@@ -74,7 +76,7 @@ static int adm_control(struct udev *udev, int argc, char *argv[])
         for (;;) {
                 int option;
 
-                option = getopt_long(argc, argv, "el:sSRp:m:h", options, NULL);
+                option = getopt_long(argc, argv, "el:sSRp:m:wh", options, NULL);
                 if (option == -1)
                         break;
 
@@ -142,6 +144,12 @@ static int adm_control(struct udev *udev, int argc, char *argv[])
                                 rc = 0;
                         break;
                 }
+                case 'w':
+                        if (udev_ctrl_send_get_worker_stats(uctrl, stdout, timeout) < 0)
+                                rc = 2;
+                        else
+                                rc = 0;
+                        break;
                 case 't': {
                         int seconds;
 
@@ -337,7 +337,110 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename) {
+/* a table of the children, if it is not much larger than the sorted array */
+static bool node_dense_v2(const struct trie_node *node) {
+        size_t range;
+
+        if (node->children_count < 8)
+                return false;
+
+        range = node->children[node->children_count-1].c - node->children[0].c + 1;
+        return range * sizeof(le32_t) <= 2 * (ALIGN_TO(node->children_count, 4) + node->children_count * sizeof(le32_t));
+}
+
+static size_t node_children_size_v2(const struct trie_node *node) {
+        if (node_dense_v2(node))
+                return (node->children[node->children_count-1].c - node->children[0].c + 1) * sizeof(le32_t);
+        return ALIGN_TO(node->children_count, 4) + node->children_count * sizeof(le32_t);
+}
+
+static void trie_store_nodes_size_v2(struct trie_f *trie, struct trie_node *node) {
+        uint64_t i;
+
+        for (i = 0; i < node->children_count; i++)
+                trie_store_nodes_size_v2(trie, node->children[i].child);
+
+        trie->strings_off += sizeof(struct trie_node_f2);
+        trie->strings_off += node_children_size_v2(node);
+        trie->strings_off += node->values_count * sizeof(struct trie_value_entry_f2);
+}
+
+static int64_t trie_store_nodes_v2(struct trie_f *trie, struct trie_node *node) {
+        uint64_t i;
+        struct trie_node_f2 n = {
+                .prefix_off = htole32(trie->strings_off + node->prefix_off),
+                .values_count = htole32(node->values_count),
+        };
+        _cleanup_free_ le32_t *offs = NULL;
+        _cleanup_free_ uint8_t *chars = NULL;
+        size_t offs_count = 0;
+        int64_t node_off;
+
+        if (node->children_count) {
+                bool dense = node_dense_v2(node);
+
+                offs_count = dense ? node->children[node->children_count-1].c - node->children[0].c + 1 : node->children_count;
+                offs = new0(le32_t, offs_count);
+                if (!offs)
+                        return -ENOMEM;
+                if (!dense) {
+                        chars = new0(uint8_t, ALIGN_TO(node->children_count, 4));
+                        if (!chars)
+                                return -ENOMEM;
+                }
+
+                n.children_count = htole16(offs_count);
+                n.children_first = node->children[0].c;
+                if (dense)
+                        n.flags |= TRIE_NODE_DENSE;
+        }
+
+        /* post-order recursion */
+        for (i = 0; i < node->children_count; i++) {
+                uint8_t c = node->children[i].c;
+                int64_t child_off;
+
+                child_off = trie_store_nodes_v2(trie, node->children[i].child);
+                if (child_off < 0)
+                        return child_off;
+
+                if (c == '*' || c == '?' || c == '[')
+                        n.flags |= TRIE_NODE_GLOB;
+
+                if (chars) {
+                        chars[i] = c;
+                        offs[i] = htole32(child_off);
+                } else
+                        offs[c - node->children[0].c] = htole32(child_off);
+        }
+
+        /* write node */
+        node_off = ftello(trie->f);
+        fwrite(&n, sizeof(struct trie_node_f2), 1, trie->f);
+        trie->nodes_count++;
+
+        /* append children array or table */
+        if (chars)
+                fwrite(chars, 1, ALIGN_TO(node->children_count, 4), trie->f);
+        if (offs)
+                fwrite(offs, sizeof(le32_t), offs_count, trie->f);
+        trie->children_count += node->children_count;
+
+        /* append values array */
+        for (i = 0; i < node->values_count; i++) {
+                struct trie_value_entry_f2 v = {
+                        .key_off = htole32(trie->strings_off + node->values[i].key_off),
+                        .value_off = htole32(trie->strings_off + node->values[i].value_off),
+                };
+
+                fwrite(&v, sizeof(struct trie_value_entry_f2), 1, trie->f);
+                trie->values_count++;
+        }
+
+        return node_off;
+}
+
+static int trie_store(struct trie *trie, const char *filename, bool v2) {
         struct trie_f t = {
                 .trie = trie,
         };
@@ -357,7 +460,21 @@ static int trie_store(struct trie *trie, const char *filename) {
 
         /* calculate size of header, nodes, children entries, value entries */
         t.strings_off = sizeof(struct trie_header_f);
-        trie_store_nodes_size(&t, trie->root);
+        if (v2) {
+                const uint8_t sig[] = HWDB_SIG_V2;
+
+                memcpy(h.signature, sig, sizeof(h.signature));
+                h.node_size = htole64(sizeof(struct trie_node_f2));
+                h.child_entry_size = htole64(sizeof(le32_t));
+                h.value_entry_size = htole64(sizeof(struct trie_value_entry_f2));
+
+                trie_store_nodes_size_v2(&t, trie->root);
+
+                /* all offsets are 32 bits */
+                if (t.strings_off + trie->strings->len > UINT32_MAX)
+                        return -EFBIG;
+        } else
+                trie_store_nodes_size(&t, trie->root);
 
         err = fopen_temporary(filename , &t.f, &filename_tmp);
         if (err < 0)
@@ -366,7 +483,16 @@ static int trie_store(struct trie *trie, const char *filename) {
 
         /* write nodes */
         fseeko(t.f, sizeof(struct trie_header_f), SEEK_SET);
-        root_off = trie_store_nodes(&t, trie->root);
+        if (v2)
+                root_off = trie_store_nodes_v2(&t, trie->root);
+        else
+                root_off = trie_store_nodes(&t, trie->root);
+        if (root_off < 0) {
+                fclose(t.f);
+                unlink(filename_tmp);
+                err = root_off;
+                goto out;
+        }
         h.nodes_root_off = htole64(root_off);
         pos = ftello(t.f);
         h.nodes_len = htole64(pos - sizeof(struct trie_header_f));
@@ -389,15 +515,14 @@ static int trie_store(struct trie *trie, const char *filename) {
                 goto out;
         }
 
-        log_debug("=== trie on-disk ===\n");
+        log_debug("=== trie on-disk, version %i ===\n", v2 ? 2 : 1);
         log_debug("size:             %8llu bytes\n", (unsigned long long)size);
         log_debug("header:           %8zu bytes\n", sizeof(struct trie_header_f));
         log_debug("nodes:            %8llu bytes (%8llu)\n",
-                  (unsigned long long)t.nodes_count * sizeof(struct trie_node_f), (unsigned long long)t.nodes_count);
-        log_debug("child pointers:   %8llu bytes (%8llu)\n",
-                  (unsigned long long)t.children_count * sizeof(struct trie_child_entry_f), (unsigned long long)t.children_count);
+                  (unsigned long long)le64toh(h.nodes_len), (unsigned long long)t.nodes_count);
+        log_debug("child pointers:   %8llu\n", (unsigned long long)t.children_count);
         log_debug("value pointers:   %8llu bytes (%8llu)\n",
-                  (unsigned long long)t.values_count * sizeof(struct trie_value_entry_f), (unsigned long long)t.values_count);
+                  (unsigned long long)t.values_count * le64toh(h.value_entry_size), (unsigned long long)t.values_count);
         log_debug("string store:     %8llu bytes\n", (unsigned long long)trie->strings->len);
         log_debug("strings start:    %8llu\n", (unsigned long long) t.strings_off);
 out:
@@ -522,6 +647,7 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
         if (update) {
                 char **files, **f;
                 _cleanup_free_ char *hwdb_bin = NULL;
+                _cleanup_free_ char *hwdb2_bin = NULL;
 
                 trie = calloc(sizeof(struct trie), 1);
                 if (!trie) {
@@ -577,7 +703,21 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                         goto out;
                 }
                 mkdir_parents(hwdb_bin, 0755);
-                err = trie_store(trie, hwdb_bin);
+
+                /* the compact version, which libudev prefers; written first, so a
+                 * reload after hwdb.bin has changed finds the new one */
+                if (asprintf(&hwdb2_bin, "%s/etc/udev/hwdb2.bin", root) < 0) {
+                        rc = EXIT_FAILURE;
+                        goto out;
+                }
+                err = trie_store(trie, hwdb2_bin, true);
+                if (err < 0) {
+                        log_error("Failure writing database %s: %s", hwdb2_bin, strerror(-err));
+                        unlink(hwdb2_bin);
+                        rc = EXIT_FAILURE;
+                }
+
+                err = trie_store(trie, hwdb_bin, false);
                 if (err < 0) {
                         log_error("Failure writing database %s: %s", hwdb_bin, strerror(-err));
                         rc = EXIT_FAILURE;
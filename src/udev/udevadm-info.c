@@ -232,6 +232,7 @@ static void cleanup_db(struct udev *udev)
         DIR *dir;
 
         unlink("/run/udev/queue.bin");
+        udev_db_invalidate(udev, UDEV_DB_FILE);
 
         dir = opendir("/run/udev/data");
         if (dir != NULL) {
@@ -0,0 +1,106 @@
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Kay Sievers <kay@vrfy.org>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string.h>
+
+#include "util.h"
+#include "mkdir.h"
+
+#include "udev.h"
+
+static void help(void) {
+        printf("Usage: udevadm rules OPTIONS\n"
+               "  --update                          store the precompiled rules\n"
+               "  --resolve-names=early|late|never  when to resolve users and groups\n"
+               "  --help\n\n");
+}
+
+static int adm_rules(struct udev *udev, int argc, char *argv[]) {
+        static const struct option options[] = {
+                { "update", no_argument, NULL, 'u' },
+                { "resolve-names", required_argument, NULL, 'N' },
+                { "help", no_argument, NULL, 'h' },
+                {}
+        };
+        bool update = false;
+        int resolve_names = 1;
+        struct udev_rules *rules;
+        int err;
+        int rc = EXIT_SUCCESS;
+
+        for (;;) {
+                int option;
+
+                option = getopt_long(argc, argv, "uN:h", options, NULL);
+                if (option == -1)
+                        break;
+
+                switch (option) {
+                case 'u':
+                        update = true;
+                        break;
+                case 'N':
+                        if (streq(optarg, "early")) {
+                                resolve_names = 1;
+                        } else if (streq(optarg, "late")) {
+                                resolve_names = 0;
+                        } else if (streq(optarg, "never")) {
+                                resolve_names = -1;
+                        } else {
+                                log_error("resolve-names must be early, late or never\n");
+                                return EXIT_FAILURE;
+                        }
+                        break;
+                case 'h':
+                        help();
+                        return EXIT_SUCCESS;
+                }
+        }
+
+        if (!update) {
+                help();
+                return EXIT_SUCCESS;
+        }
+
+        /* always read the rules files, not the cache */
+        rules = udev_rules_new_from_dirs(udev, resolve_names, NULL);
+        if (rules == NULL) {
+                log_error("error reading rules\n");
+                return EXIT_FAILURE;
+        }
+
+        mkdir_parents(UDEV_RULES_CACHE, 0755);
+        err = udev_rules_store_cache(rules, UDEV_RULES_CACHE);
+        if (err < 0) {
+                log_error("Failure writing rules cache %s: %s", UDEV_RULES_CACHE, strerror(-err));
+                rc = EXIT_FAILURE;
+        }
+
+        udev_rules_unref(rules);
+        return rc;
+}
+
+const struct udevadm_cmd udevadm_rules = {
+        .name = "rules",
+        .cmd = adm_rules,
+        .help = "maintain the precompiled rules",
+};
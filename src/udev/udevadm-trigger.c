@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <syslog.h>
 #include <fnmatch.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -33,29 +34,191 @@
 
 #include "udev.h"
 
+#define TRIGGER_THREADS_MAX 16
+
 static int verbose;
 static int dry_run;
 
-static void exec_list(struct udev_enumerate *udev_enumerate, const char *action)
+static void trigger(const char *syspath, const char *action)
+{
+        char filename[UTIL_PATH_SIZE];
+        int fd;
+
+        strscpyl(filename, sizeof(filename), syspath, "/uevent", NULL);
+        fd = open(filename, O_WRONLY|O_CLOEXEC);
+        if (fd < 0)
+                return;
+        if (write(fd, action, strlen(action)) < 0)
+                log_debug("error writing '%s' to '%s': %m\n", action, filename);
+        close(fd);
+}
+
+/*
+ * The events are requested by several threads, in the order of the
+ * list. A device waits for its parent device in the list. A device the
+ * list moved out of the sorted order, like the ones which need to be
+ * last, and all devices after it, wait for all devices before it.
+ */
+struct trigger_entry {
+        const char *syspath;
+        int parent;
+        unsigned int after;
+        bool done;
+};
+
+struct trigger_context {
+        struct trigger_entry *entries;
+        unsigned int entries_count;
+        unsigned int next_entry;
+        unsigned int done_count;
+        const char *action;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+};
+
+static bool entry_ready(struct trigger_context *c, unsigned int k)
+{
+        struct trigger_entry *entry = &c->entries[k];
+
+        if (c->done_count < entry->after)
+                return false;
+        if (entry->parent >= 0)
+                return c->entries[entry->parent].done;
+        return true;
+}
+
+static void *trigger_thread(void *userdata)
+{
+        struct trigger_context *c = userdata;
+
+        for (;;) {
+                unsigned int k;
+
+                k = __sync_fetch_and_add(&c->next_entry, 1);
+                if (k >= c->entries_count)
+                        break;
+
+                pthread_mutex_lock(&c->lock);
+                while (!entry_ready(c, k))
+                        pthread_cond_wait(&c->cond, &c->lock);
+                pthread_mutex_unlock(&c->lock);
+
+                trigger(c->entries[k].syspath, c->action);
+
+                pthread_mutex_lock(&c->lock);
+                c->entries[k].done = true;
+                while (c->done_count < c->entries_count && c->entries[c->done_count].done)
+                        c->done_count++;
+                pthread_cond_broadcast(&c->cond);
+                pthread_mutex_unlock(&c->lock);
+        }
+
+        return NULL;
+}
+
+static bool is_parent(const char *parent, const char *syspath)
+{
+        size_t len = strlen(parent);
+
+        return strneq(parent, syspath, len) && syspath[len] == '/';
+}
+
+static int exec_list_parallel(struct udev_enumerate *udev_enumerate, const char *action, unsigned int threads)
 {
         struct udev_list_entry *entry;
+        struct trigger_context c;
+        pthread_t tids[TRIGGER_THREADS_MAX];
+        unsigned int n_threads = 0, allocated = 0, i;
+        int *stack = NULL;
+        unsigned int stack_count = 0, after = 0;
+
+        zero(c);
+        c.action = action;
 
         udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate)) {
-                char filename[UTIL_PATH_SIZE];
-                int fd;
+                struct trigger_entry *e;
 
-                if (verbose)
-                        printf("%s\n", udev_list_entry_get_name(entry));
-                if (dry_run)
-                        continue;
-                strscpyl(filename, sizeof(filename), udev_list_entry_get_name(entry), "/uevent", NULL);
-                fd = open(filename, O_WRONLY);
-                if (fd < 0)
-                        continue;
-                if (write(fd, action, strlen(action)) < 0)
-                        log_debug("error writing '%s' to '%s': %m\n", action, filename);
-                close(fd);
+                if (c.entries_count >= allocated) {
+                        struct trigger_entry *buf;
+                        int *s;
+
+                        allocated = MAX(allocated * 2, 1024u);
+                        buf = realloc(c.entries, allocated * sizeof(struct trigger_entry));
+                        if (buf == NULL)
+                                goto oom;
+                        c.entries = buf;
+                        s = realloc(stack, allocated * sizeof(int));
+                        if (s == NULL)
+                                goto oom;
+                        stack = s;
+                }
+
+                e = &c.entries[c.entries_count];
+                e->syspath = udev_list_entry_get_name(entry);
+                e->parent = -1;
+                e->done = false;
+
+                /* the list is sorted, apart from the devices moved behind the others,
+                 * which may still sort after the device before them */
+                if (udev_enumerate_syspath_delayed(udev_enumerate_get_udev(udev_enumerate), e->syspath))
+                        after = c.entries_count;
+                e->after = after;
+
+                /* the closest parent device earlier in the list */
+                while (stack_count > 0 && !is_parent(c.entries[stack[stack_count-1]].syspath, e->syspath))
+                        stack_count--;
+                if (stack_count > 0)
+                        e->parent = stack[stack_count-1];
+                stack[stack_count++] = c.entries_count;
+
+                c.entries_count++;
+        }
+        free(stack);
+
+        pthread_mutex_init(&c.lock, NULL);
+        pthread_cond_init(&c.cond, NULL);
+
+        while (n_threads + 1 < MIN(threads, c.entries_count) && n_threads < TRIGGER_THREADS_MAX) {
+                int r;
+
+                r = pthread_create(&tids[n_threads], NULL, trigger_thread, &c);
+                if (r != 0) {
+                        log_debug("failed to create trigger thread: %s\n", strerror(r));
+                        break;
+                }
+                n_threads++;
         }
+
+        trigger_thread(&c);
+
+        for (i = 0; i < n_threads; i++)
+                pthread_join(tids[i], NULL);
+
+        pthread_cond_destroy(&c.cond);
+        pthread_mutex_destroy(&c.lock);
+        free(c.entries);
+        return 0;
+oom:
+        free(stack);
+        free(c.entries);
+        return -ENOMEM;
+}
+
+static void exec_list(struct udev_enumerate *udev_enumerate, const char *action, unsigned int threads)
+{
+        struct udev_list_entry *entry;
+
+        if (verbose)
+                udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate))
+                        printf("%s\n", udev_list_entry_get_name(entry));
+        if (dry_run)
+                return;
+
+        if (threads > 1 && exec_list_parallel(udev_enumerate, action, threads) >= 0)
+                return;
+
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate))
+                trigger(udev_list_entry_get_name(entry), action);
 }
 
 static const char *keyval(const char *str, const char **val, char *buf, size_t size)
@@ -87,6 +250,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                 { "tag-match", required_argument, NULL, 'g' },
                 { "sysname-match", required_argument, NULL, 'y' },
                 { "parent-match", required_argument, NULL, 'b' },
+                { "parallel", no_argument, NULL, 'P' },
                 { "help", no_argument, NULL, 'h' },
                 {}
         };
@@ -96,6 +260,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
         } device_type = TYPE_DEVICES;
         const char *action = "change";
         struct udev_enumerate *udev_enumerate;
+        unsigned int threads = 0;
         int rc = 0;
 
         udev_enumerate = udev_enumerate_new(udev);
@@ -110,7 +275,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                 const char *val;
                 char buf[UTIL_PATH_SIZE];
 
-                option = getopt_long(argc, argv, "vng:o:t:hc:p:s:S:a:A:y:b:", options, NULL);
+                option = getopt_long(argc, argv, "vng:o:t:hc:p:s:S:a:A:y:b:P", options, NULL);
                 if (option == -1)
                         break;
 
@@ -180,6 +345,13 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                         udev_device_unref(dev);
                         break;
                 }
+                case 'P': {
+                        long cpus;
+
+                        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                        threads = cpus > 1 ? MIN((unsigned int) cpus, (unsigned int) TRIGGER_THREADS_MAX) : 1;
+                        break;
+                }
                 case 'h':
                         printf("Usage: udevadm trigger OPTIONS\n"
                                "  --verbose                       print the list of devices while running\n"
@@ -196,6 +368,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
                                "  --tag-match=<key>=<value>       trigger devices with a matching property\n"
                                "  --sysname-match=<name>          trigger devices with a matching name\n"
                                "  --parent-match=<name>           trigger devices with that parent device\n"
+                               "  --parallel                      scan /sys and trigger the events with several threads\n"
                                "  --help\n\n");
                         goto exit;
                 default:
@@ -207,11 +380,12 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[])
         switch (device_type) {
         case TYPE_SUBSYSTEMS:
                 udev_enumerate_scan_subsystems(udev_enumerate);
-                exec_list(udev_enumerate, action);
+                exec_list(udev_enumerate, action, threads);
                 goto exit;
         case TYPE_DEVICES:
+                udev_enumerate_set_threads(udev_enumerate, threads);
                 udev_enumerate_scan_devices(udev_enumerate);
-                exec_list(udev_enumerate, action);
+                exec_list(udev_enumerate, action, threads);
                 goto exit;
         default:
                 goto exit;
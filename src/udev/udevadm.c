@@ -57,6 +57,7 @@ static const struct udevadm_cmd *udevadm_cmds[] = {
         &udevadm_control,
         &udevadm_monitor,
         &udevadm_hwdb,
+        &udevadm_rules,
         &udevadm_test,
         &udevadm_test_builtin,
         &udevadm_version,
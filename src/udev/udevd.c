@@ -50,6 +50,15 @@
 #include "dev-setup.h"
 #include "fileio.h"
 
+/* the rules of a new generation, the workers map it instead of reading the rules files */
+#define WORKER_RULES "/run/udev/rules.bin"
+
+/* the properties of a device are limited to this size by libudev */
+#define WORKER_PROPERTIES_SIZE 4096
+
+/* the number of events after which the records appended to the database are merged */
+#define DB_TAIL_MAX 1024
+
 static bool debug;
 
 void udev_main_log(struct udev *udev, int priority,
@@ -72,8 +81,16 @@ static bool reload;
 static int children;
 static int children_max;
 static int exec_delay;
+static int resolve_names = 1;
+static unsigned int rules_generation;
+static unsigned long long int stats_events;
+static usec_t stats_usec;
+static unsigned long long int db_events;
 static sigset_t sigmask_orig;
 static UDEV_LIST(event_list);
+static struct udev_event_index *event_index;
+static struct udev_link_index *link_index;
+static int worker_fd_main = -1;
 static UDEV_LIST(worker_list);
 char *udev_cgroup;
 static bool udev_exit;
@@ -90,15 +107,9 @@ struct event {
         struct udev_device *dev;
         enum event_state state;
         int exitcode;
-        unsigned long long int delaying_seqnum;
         unsigned long long int seqnum;
         const char *devpath;
-        size_t devpath_len;
-        const char *devpath_old;
-        dev_t devnum;
-        int ifindex;
-        bool is_block;
-        bool nodelay;
+        struct udev_event_index_entry *index_entry;
 };
 
 static inline struct event *node_to_event(struct udev_list_node *node)
@@ -120,10 +131,33 @@ struct worker {
         struct udev *udev;
         int refcount;
         pid_t pid;
-        struct udev_monitor *monitor;
+        int fd;
         enum worker_state state;
         struct event *event;
         usec_t event_start_usec;
+        unsigned long long int events;
+        usec_t usec_total;
+        usec_t usec_max;
+        usec_t usec_last;
+};
+
+static const char* const worker_state_names[] = {
+        [WORKER_UNDEF] = "undef",
+        [WORKER_RUNNING] = "running",
+        [WORKER_IDLE] = "idle",
+        [WORKER_KILLED] = "killed",
+};
+
+/* the messages from the main process to a worker start with their type */
+enum worker_message_type {
+        WORKER_MESSAGE_DEVICE,
+        WORKER_MESSAGE_LINK_REPLY,
+};
+
+/* passed from main process to worker, followed by the properties of the device */
+struct worker_request {
+        unsigned int type;
+        unsigned int rules_generation;
 };
 
 /* passed from worker to main process */
@@ -132,6 +166,20 @@ struct worker_message {
         int exitcode;
 };
 
+/* passed from worker to main process, followed by the id, the link and the device node */
+struct worker_link_request {
+        unsigned int seq;
+        int add;
+        int priority;
+};
+
+/* passed from main process to worker, followed by the device node the link points to */
+struct worker_link_reply {
+        unsigned int type;
+        unsigned int seq;
+        int result;
+};
+
 static inline struct worker *node_to_worker(struct udev_list_node *node)
 {
         return container_of(node, struct worker, node);
@@ -140,6 +188,7 @@ static inline struct worker *node_to_worker(struct udev_list_node *node)
 static void event_queue_delete(struct event *event, bool export)
 {
         udev_list_node_remove(&event->node);
+        udev_event_index_remove(event_index, event->index_entry);
 
         if (export) {
                 udev_queue_export_device_finished(udev_queue_export, event->dev);
@@ -158,7 +207,7 @@ static struct worker *worker_ref(struct worker *worker)
 static void worker_cleanup(struct worker *worker)
 {
         udev_list_node_remove(&worker->node);
-        udev_monitor_unref(worker->monitor);
+        close(worker->fd);
         children--;
         free(worker);
 }
@@ -183,36 +232,213 @@ static void worker_list_cleanup(struct udev *udev)
         }
 }
 
+static int worker_send_device(struct worker *worker, struct udev_device *dev)
+{
+        struct worker_request req;
+        const char *buf;
+        ssize_t len;
+        struct msghdr smsg;
+        struct iovec iov[2];
+
+        len = udev_device_get_properties_monitor_buf(dev, &buf);
+        if (len < 32)
+                return -EINVAL;
+
+        memset(&req, 0, sizeof(struct worker_request));
+        req.type = WORKER_MESSAGE_DEVICE;
+        req.rules_generation = rules_generation;
+
+        iov[0].iov_base = &req;
+        iov[0].iov_len = sizeof(struct worker_request);
+        iov[1].iov_base = (char *)buf;
+        iov[1].iov_len = len;
+
+        memset(&smsg, 0, sizeof(struct msghdr));
+        smsg.msg_iov = iov;
+        smsg.msg_iovlen = 2;
+
+        if (sendmsg(worker->fd, &smsg, 0) < 0)
+                return -errno;
+        return 0;
+}
+
+/* a reply to a link request which timed out is dropped, and no device is returned */
+static int worker_receive_device(struct udev *udev, int fd, struct udev_device **ret, unsigned int *generation)
+{
+        struct worker_request req;
+        char buf[WORKER_PROPERTIES_SIZE];
+        struct msghdr smsg;
+        struct iovec iov[2];
+        struct udev_device *dev;
+        ssize_t size;
+        size_t bufpos = 0;
+
+        iov[0].iov_base = &req;
+        iov[0].iov_len = sizeof(struct worker_request);
+        iov[1].iov_base = buf;
+        iov[1].iov_len = sizeof(buf);
+
+        memset(&smsg, 0, sizeof(struct msghdr));
+        smsg.msg_iov = iov;
+        smsg.msg_iovlen = 2;
+
+        *ret = NULL;
+
+        size = recvmsg(fd, &smsg, 0);
+        if (size < 0) {
+                log_error("unable to receive device from main process: %m\n");
+                return -errno;
+        }
+        if (size >= (ssize_t) sizeof(unsigned int) && req.type == WORKER_MESSAGE_LINK_REPLY) {
+                log_debug("dropping late link reply from main process\n");
+                return 0;
+        }
+        if (size < (ssize_t) sizeof(struct worker_request) || smsg.msg_flags & MSG_TRUNC ||
+            req.type != WORKER_MESSAGE_DEVICE) {
+                log_error("invalid message from main process\n");
+                return -EINVAL;
+        }
+        size -= sizeof(struct worker_request);
+
+        dev = udev_device_new(udev);
+        if (dev == NULL)
+                return -ENOMEM;
+        udev_device_set_info_loaded(dev);
+
+        while (bufpos < (size_t) size) {
+                char *key;
+                size_t keylen;
+
+                key = &buf[bufpos];
+                keylen = strnlen(key, size - bufpos);
+                if (keylen == 0 || bufpos + keylen == (size_t) size)
+                        break;
+                bufpos += keylen + 1;
+                udev_device_add_property_from_string_parse(dev, key);
+        }
+
+        if (udev_device_add_property_from_string_parse_finish(dev) < 0) {
+                log_error("missing values, invalid device\n");
+                udev_device_unref(dev);
+                return -EINVAL;
+        }
+
+        *generation = req.rules_generation;
+        *ret = dev;
+        return 0;
+}
+
+/* ask the main process for the device node a link points to, it keeps the index of the links */
+static int worker_resolve_link(struct udev_device *dev, const char *slink, bool add, char *target, size_t size)
+{
+        static unsigned int seq;
+        struct worker_link_request req;
+        struct worker_link_reply rep;
+        const char *id = udev_device_get_id_filename(dev);
+        const char *devnode = strempty(udev_device_get_devnode(dev));
+        struct pollfd pfd;
+        struct msghdr smsg;
+        struct iovec iov[4];
+        ssize_t len;
+
+        memset(&req, 0, sizeof(struct worker_link_request));
+        req.seq = ++seq;
+        req.add = add;
+        req.priority = udev_device_get_devlink_priority(dev);
+
+        iov[0].iov_base = &req;
+        iov[0].iov_len = sizeof(struct worker_link_request);
+        iov[1].iov_base = (char *)id;
+        iov[1].iov_len = strlen(id) + 1;
+        iov[2].iov_base = (char *)slink;
+        iov[2].iov_len = strlen(slink) + 1;
+        iov[3].iov_base = (char *)devnode;
+        iov[3].iov_len = strlen(devnode) + 1;
+
+        memset(&smsg, 0, sizeof(struct msghdr));
+        smsg.msg_iov = iov;
+        smsg.msg_iovlen = 4;
+
+        if (sendmsg(worker_fd_main, &smsg, 0) < 0)
+                return -errno;
+
+        iov[0].iov_base = &rep;
+        iov[0].iov_len = sizeof(struct worker_link_reply);
+        iov[1].iov_base = target;
+        iov[1].iov_len = size;
+        smsg.msg_iovlen = 2;
+
+        /* replies to earlier requests which timed out are skipped */
+        do {
+                memset(&pfd, 0, sizeof(struct pollfd));
+                pfd.fd = worker_fd_main;
+                pfd.events = POLLIN;
+                if (poll(&pfd, 1, 10 * 1000) != 1) {
+                        /* a late reply is dropped when the next device is received */
+                        log_error("no reply from main process for link '%s', disabling the link index\n", slink);
+                        udev_node_set_link_resolver(NULL);
+                        return -ETIMEDOUT;
+                }
+
+                len = recvmsg(worker_fd_main, &smsg, 0);
+                if (len < (ssize_t) sizeof(struct worker_link_reply) || smsg.msg_flags & MSG_TRUNC ||
+                    rep.type != WORKER_MESSAGE_LINK_REPLY)
+                        return -EIO;
+        } while (rep.seq != req.seq);
+
+        if (rep.result <= 0)
+                return rep.result;
+
+        len -= sizeof(struct worker_link_reply);
+        if (len == 0 || target[len-1] != '\0')
+                return -EIO;
+        return 1;
+}
+
+/* the main process has reloaded the rules, use them from the file it has written */
+static void worker_reload_rules(struct udev *udev)
+{
+        udev_rules_unref(rules);
+        rules = udev_rules_new_from_cache(udev, resolve_names, NULL, WORKER_RULES);
+        if (rules == NULL)
+                rules = udev_rules_new(udev, resolve_names);
+
+        udev_builtin_exit(udev);
+        udev_builtin_init(udev);
+}
+
 static void worker_new(struct event *event)
 {
         struct udev *udev = event->udev;
         struct worker *worker;
-        struct udev_monitor *worker_monitor;
+        int fds[2];
         pid_t pid;
 
-        /* listen for new events */
-        worker_monitor = udev_monitor_new_from_netlink(udev, NULL);
-        if (worker_monitor == NULL)
+        /* unnamed socket from the main daemon to the worker, to pass the events */
+        if (socketpair(AF_LOCAL, SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC, 0, fds) < 0) {
+                log_error("error creating socketpair: %m\n");
                 return;
-        /* allow the main daemon netlink address to send devices to the worker */
-        udev_monitor_allow_unicast_sender(worker_monitor, monitor);
-        udev_monitor_enable_receiving(worker_monitor);
+        }
 
         worker = calloc(1, sizeof(struct worker));
         if (worker == NULL) {
-                udev_monitor_unref(worker_monitor);
+                close(fds[0]);
+                close(fds[1]);
                 return;
         }
         /* worker + event reference */
         worker->refcount = 2;
         worker->udev = udev;
+        worker->fd = fds[0];
 
         pid = fork();
         switch (pid) {
         case 0: {
                 struct udev_device *dev = NULL;
-                int fd_monitor;
-                struct epoll_event ep_signal, ep_monitor;
+                struct udev_monitor *worker_monitor = NULL;
+                unsigned int generation = rules_generation;
+                int fd_main = fds[1];
+                struct epoll_event ep_signal, ep_main;
                 sigset_t mask;
                 int rc = EXIT_SUCCESS;
 
@@ -221,8 +447,11 @@ static void worker_new(struct event *event)
                 event->dev = NULL;
 
                 free(worker);
+                close(fds[0]);
                 worker_list_cleanup(udev);
                 event_queue_cleanup(udev, EVENT_UNDEF);
+                udev_event_index_free(event_index);
+                udev_link_index_free(link_index);
                 udev_queue_export_unref(udev_queue_export);
                 udev_monitor_unref(monitor);
                 udev_ctrl_unref(udev_ctrl);
@@ -249,18 +478,29 @@ static void worker_new(struct event *event)
                 ep_signal.events = EPOLLIN;
                 ep_signal.data.fd = fd_signal;
 
-                fd_monitor = udev_monitor_get_fd(worker_monitor);
-                memset(&ep_monitor, 0, sizeof(struct epoll_event));
-                ep_monitor.events = EPOLLIN;
-                ep_monitor.data.fd = fd_monitor;
+                memset(&ep_main, 0, sizeof(struct epoll_event));
+                ep_main.events = EPOLLIN;
+                ep_main.data.fd = fd_main;
 
                 if (epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_signal, &ep_signal) < 0 ||
-                    epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_monitor, &ep_monitor) < 0) {
+                    epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_main, &ep_main) < 0) {
                         log_error("fail to add fds to epoll: %m\n");
                         rc = 4;
                         goto out;
                 }
 
+                /* send the processed events to the libudev listeners */
+                worker_monitor = udev_monitor_new_from_netlink(udev, NULL);
+                if (worker_monitor == NULL) {
+                        log_error("error creating netlink socket\n");
+                        rc = 6;
+                        goto out;
+                }
+
+                /* the main process tells us where the links point to */
+                worker_fd_main = fd_main;
+                udev_node_set_link_resolver(worker_resolve_link);
+
                 /* request TERM signal if parent exits */
                 prctl(PR_SET_PDEATHSIG, SIGTERM);
 
@@ -272,6 +512,18 @@ static void worker_new(struct event *event)
                         struct worker_message msg;
                         int err;
 
+                        /* the rules have been reloaded since the last event */
+                        if (generation != rules_generation) {
+                                log_debug("rules generation %u, reloading rules\n", generation);
+                                rules_generation = generation;
+                                worker_reload_rules(udev);
+                                if (rules == NULL) {
+                                        log_error("error reading rules\n");
+                                        rc = 7;
+                                        goto out;
+                                }
+                        }
+
                         log_debug("seq %llu running\n", udev_device_get_seqnum(dev));
                         udev_event = udev_event_new(dev);
                         if (udev_event == NULL) {
@@ -334,8 +586,11 @@ static void worker_new(struct event *event)
                                 }
 
                                 for (i = 0; i < fdcount; i++) {
-                                        if (ev[i].data.fd == fd_monitor && ev[i].events & EPOLLIN) {
-                                                dev = udev_monitor_receive_device(worker_monitor);
+                                        if (ev[i].data.fd == fd_main && ev[i].events & EPOLLIN) {
+                                                if (worker_receive_device(udev, fd_main, &dev, &generation) < 0) {
+                                                        rc = 8;
+                                                        goto out;
+                                                }
                                                 break;
                                         } else if (ev[i].data.fd == fd_signal && ev[i].events & EPOLLIN) {
                                                 struct signalfd_siginfo fdsi;
@@ -360,6 +615,7 @@ out:
                         close(fd_ep);
                 close(fd_inotify);
                 close(worker_watch[WRITE_END]);
+                close(fd_main);
                 udev_rules_unref(rules);
                 udev_builtin_exit(udev);
                 udev_monitor_unref(worker_monitor);
@@ -368,15 +624,24 @@ out:
                 exit(rc);
         }
         case -1:
-                udev_monitor_unref(worker_monitor);
+                close(fds[0]);
+                close(fds[1]);
                 event->state = EVENT_QUEUED;
                 free(worker);
                 log_error("fork of child failed: %m\n");
                 break;
-        default:
-                /* close monitor, but keep address around */
-                udev_monitor_disconnect(worker_monitor);
-                worker->monitor = worker_monitor;
+        default: {
+                struct epoll_event ep_main;
+
+                close(fds[1]);
+
+                /* the requests of the worker for the links */
+                memset(&ep_main, 0, sizeof(struct epoll_event));
+                ep_main.events = EPOLLIN;
+                ep_main.data.fd = worker->fd;
+                if (epoll_ctl(fd_ep, EPOLL_CTL_ADD, worker->fd, &ep_main) < 0)
+                        log_error("fail to add worker fd to epoll: %m\n");
+
                 worker->pid = pid;
                 worker->state = WORKER_RUNNING;
                 worker->event_start_usec = now(CLOCK_MONOTONIC);
@@ -387,22 +652,23 @@ out:
                 log_debug("seq %llu forked new worker [%u]\n", udev_device_get_seqnum(event->dev), pid);
                 break;
         }
+        }
 }
 
-static void event_run(struct event *event)
+static int event_run(struct event *event)
 {
         struct udev_list_node *loop;
 
         udev_list_node_foreach(loop, &worker_list) {
                 struct worker *worker = node_to_worker(loop);
-                ssize_t count;
+                int err;
 
                 if (worker->state != WORKER_IDLE)
                         continue;
 
-                count = udev_monitor_send_device(monitor, worker->monitor, event->dev);
-                if (count < 0) {
-                        log_error("worker [%u] did not accept message %zi (%m), kill it\n", worker->pid, count);
+                err = worker_send_device(worker, event->dev);
+                if (err < 0) {
+                        log_error("worker [%u] did not accept message (%s), kill it\n", worker->pid, strerror(-err));
                         kill(worker->pid, SIGKILL);
                         worker->state = WORKER_KILLED;
                         continue;
@@ -412,17 +678,18 @@ static void event_run(struct event *event)
                 worker->state = WORKER_RUNNING;
                 worker->event_start_usec = now(CLOCK_MONOTONIC);
                 event->state = EVENT_RUNNING;
-                return;
+                return 0;
         }
 
         if (children >= children_max) {
                 if (children_max > 1)
                         log_debug("maximum number (%i) of children reached\n", children);
-                return;
+                return -EBUSY;
         }
 
         /* start new worker and pass initial device */
         worker_new(event);
+        return 0;
 }
 
 static int event_queue_insert(struct udev_device *dev)
@@ -437,13 +704,17 @@ static int event_queue_insert(struct udev_device *dev)
         event->dev = dev;
         event->seqnum = udev_device_get_seqnum(dev);
         event->devpath = udev_device_get_devpath(dev);
-        event->devpath_len = strlen(event->devpath);
-        event->devpath_old = udev_device_get_devpath_old(dev);
-        event->devnum = udev_device_get_devnum(dev);
-        event->is_block = streq("block", udev_device_get_subsystem(dev));
-        event->ifindex = udev_device_get_ifindex(dev);
-        if (streq(udev_device_get_subsystem(dev), "firmware"))
-                event->nodelay = true;
+        event->index_entry = udev_event_index_add(event_index, event->seqnum,
+                                                  event->devpath,
+                                                  udev_device_get_devpath_old(dev),
+                                                  udev_device_get_devnum(dev),
+                                                  streq("block", udev_device_get_subsystem(dev)),
+                                                  udev_device_get_ifindex(dev),
+                                                  streq("firmware", udev_device_get_subsystem(dev)));
+        if (event->index_entry == NULL) {
+                free(event);
+                return -1;
+        }
 
         udev_queue_export_device_queued(udev_queue_export, dev);
         log_debug("seq %llu queued, '%s' '%s'\n", udev_device_get_seqnum(dev),
@@ -471,111 +742,152 @@ static void worker_kill(struct udev *udev)
 
 /* lookup event for identical, parent, child device */
 static bool is_devpath_busy(struct event *event)
+{
+        return udev_event_index_is_busy(event_index, event->index_entry);
+}
+
+static void event_queue_start(struct udev *udev)
 {
         struct udev_list_node *loop;
-        size_t common;
 
-        /* check if queue contains events we depend on */
         udev_list_node_foreach(loop, &event_list) {
-                struct event *loop_event = node_to_event(loop);
+                struct event *event = node_to_event(loop);
 
-                /* we already found a later event, earlier can not block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
+                if (event->state != EVENT_QUEUED)
                         continue;
 
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
+                /* do not start event if parent or child event is still running */
+                if (is_devpath_busy(event))
+                        continue;
 
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
+                /* no idle worker left and no new one may be started */
+                if (event_run(event) < 0)
                         break;
+        }
+}
 
-                /* check major/minor */
-                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
-                        return true;
+static void event_queue_cleanup(struct udev *udev, enum event_state match_type)
+{
+        struct udev_list_node *loop, *tmp;
 
-                /* check network device ifindex */
-                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
-                        return true;
+        udev_list_node_foreach_safe(loop, tmp, &event_list) {
+                struct event *event = node_to_event(loop);
 
-                /* check our old name */
-                if (event->devpath_old != NULL && streq(loop_event->devpath, event->devpath_old)) {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+                if (match_type != EVENT_UNDEF && match_type != event->state)
+                        continue;
 
-                /* compare devpath */
-                common = MIN(loop_event->devpath_len, event->devpath_len);
+                event_queue_delete(event, false);
+        }
+}
 
-                /* one devpath is contained in the other? */
-                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
-                        continue;
+/* a worker adds or removes a link of a device, and asks for the device node it points to */
+static void worker_link_request(int fd)
+{
+        struct worker_link_request req;
+        struct worker_link_reply rep;
+        char buf[UTIL_PATH_SIZE * 3];
+        const char *id, *slink, *devnode, *target = NULL;
+        struct msghdr smsg;
+        struct iovec iov[2];
+        struct udev_list_node *loop;
+        bool found = false;
+        ssize_t size;
 
-                /* identical device event found */
-                if (loop_event->devpath_len == event->devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
-                                continue;
-                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
+        udev_list_node_foreach(loop, &worker_list) {
+                if (node_to_worker(loop)->fd == fd) {
+                        found = true;
+                        break;
                 }
+        }
+        if (!found)
+                return;
 
-                /* allow to bypass the dependency tracking */
-                if (event->nodelay)
-                        continue;
+        iov[0].iov_base = &req;
+        iov[0].iov_len = sizeof(struct worker_link_request);
+        iov[1].iov_base = buf;
+        iov[1].iov_len = sizeof(buf);
 
-                /* parent device event found */
-                if (event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        memset(&smsg, 0, sizeof(struct msghdr));
+        smsg.msg_iov = iov;
+        smsg.msg_iovlen = 2;
 
-                /* child device event found */
-                if (loop_event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        size = recvmsg(fd, &smsg, MSG_DONTWAIT);
+        if (size == 0 || (size < 0 && errno != EAGAIN && errno != EINTR)) {
+                /* the worker is gone, it is cleaned up with its SIGCHLD */
+                epoll_ctl(fd_ep, EPOLL_CTL_DEL, fd, NULL);
+                return;
+        }
+        if (size < (ssize_t) sizeof(struct worker_link_request) || smsg.msg_flags & MSG_TRUNC)
+                return;
+        size -= sizeof(struct worker_link_request);
+
+        /* the id, the link and the device node, each NUL terminated */
+        if (size == 0 || buf[size-1] != '\0')
+                return;
+        id = buf;
+        slink = id + strlen(id) + 1;
+        if (slink >= buf + size)
+                return;
+        devnode = slink + strlen(slink) + 1;
+        if (devnode >= buf + size)
+                return;
 
-                /* no matching device */
-                continue;
+        if (req.add)
+                rep.result = udev_link_index_add(link_index, slink, id, devnode, req.priority);
+        else {
+                udev_link_index_remove(link_index, slink, id);
+                rep.result = 0;
+        }
+        if (rep.result == 0) {
+                target = udev_link_index_find(link_index, slink);
+                rep.result = target != NULL;
         }
 
-        return false;
+        log_debug("'%s' %s '%s', points to '%s'\n", id, req.add ? "claims" : "releases", slink, strempty(target));
+
+        rep.type = WORKER_MESSAGE_LINK_REPLY;
+        rep.seq = req.seq;
+        iov[0].iov_base = &rep;
+        iov[0].iov_len = sizeof(struct worker_link_reply);
+        iov[1].iov_base = (char *)strempty(target);
+        iov[1].iov_len = strlen(strempty(target)) + 1;
+        if (sendmsg(fd, &smsg, MSG_DONTWAIT) < 0)
+                log_error("unable to send link reply to worker: %m\n");
 }
 
-static void event_queue_start(struct udev *udev)
+/* the links claimed by the devices in the database, to continue where the last udevd stopped */
+static void link_index_load(struct udev *udev)
 {
-        struct udev_list_node *loop;
+        DIR *dir;
+        struct dirent *dent;
 
-        udev_list_node_foreach(loop, &event_list) {
-                struct event *event = node_to_event(loop);
+        dir = opendir("/run/udev/data");
+        if (dir == NULL)
+                return;
 
-                if (event->state != EVENT_QUEUED)
-                        continue;
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                struct udev_device *dev;
+                struct udev_list_entry *list_entry;
+                const char *devnode;
 
-                /* do not start event if parent or child event is still running */
-                if (is_devpath_busy(event))
+                /* only devices with a device node have links */
+                if (dent->d_name[0] != 'b' && dent->d_name[0] != 'c')
                         continue;
 
-                event_run(event);
-        }
-}
-
-static void event_queue_cleanup(struct udev *udev, enum event_state match_type)
-{
-        struct udev_list_node *loop, *tmp;
-
-        udev_list_node_foreach_safe(loop, tmp, &event_list) {
-                struct event *event = node_to_event(loop);
-
-                if (match_type != EVENT_UNDEF && match_type != event->state)
+                dev = udev_device_new_from_device_id(udev, dent->d_name);
+                if (dev == NULL)
                         continue;
 
-                event_queue_delete(event, false);
+                devnode = udev_device_get_devnode(dev);
+                if (devnode != NULL)
+                        udev_list_entry_foreach(list_entry, udev_device_get_devlinks_list_entry(dev))
+                                udev_link_index_add(link_index, udev_list_entry_get_name(list_entry),
+                                                    dent->d_name, devnode, udev_device_get_devlink_priority(dev));
+                udev_device_unref(dev);
         }
+        closedir(dir);
+
+        log_debug("loaded %u links\n", udev_link_index_size(link_index));
 }
 
 static void worker_returned(int fd_worker)
@@ -598,6 +910,16 @@ static void worker_returned(int fd_worker)
 
                         /* worker returned */
                         if (worker->event) {
+                                usec_t usec = now(CLOCK_MONOTONIC) - worker->event_start_usec;
+
+                                worker->events++;
+                                worker->usec_total += usec;
+                                worker->usec_last = usec;
+                                if (usec > worker->usec_max)
+                                        worker->usec_max = usec;
+                                stats_events++;
+                                stats_usec += usec;
+
                                 worker->event->exitcode = msg.exitcode;
                                 event_queue_delete(worker->event, true);
                                 worker->event = NULL;
@@ -610,6 +932,86 @@ static void worker_returned(int fd_worker)
         }
 }
 
+static void worker_stats_reply(struct udev_ctrl_connection *ctrl_conn)
+{
+        struct udev_list_node *loop;
+        char *buf = NULL;
+        size_t len = 0;
+        FILE *f;
+        int err;
+
+        f = open_memstream(&buf, &len);
+        if (f == NULL)
+                return;
+
+        fprintf(f, "children %i/%i, rules generation %u, %llu events, average %llu usec\n\n",
+                children, children_max, rules_generation, stats_events,
+                stats_events > 0 ? (unsigned long long) (stats_usec / stats_events) : 0ULL);
+        fprintf(f, "%8s %-8s %8s %10s %10s %10s\n", "PID", "STATE", "EVENTS", "AVG-USEC", "MAX-USEC", "LAST-USEC");
+
+        udev_list_node_foreach(loop, &worker_list) {
+                struct worker *worker = node_to_worker(loop);
+
+                fprintf(f, "%8u %-8s %8llu %10llu %10llu %10llu\n",
+                        worker->pid, worker_state_names[worker->state], worker->events,
+                        worker->events > 0 ? (unsigned long long) (worker->usec_total / worker->events) : 0ULL,
+                        (unsigned long long) worker->usec_max, (unsigned long long) worker->usec_last);
+        }
+
+        fclose(f);
+        if (buf == NULL)
+                return;
+
+        err = udev_ctrl_connection_send_reply(ctrl_conn, buf, len);
+        if (err < 0)
+                log_error("error sending worker statistics: %s\n", strerror(-err));
+        free(buf);
+}
+
+/* the workers pick up the rules of the new generation with the next event */
+static void rules_share(void)
+{
+        int err;
+
+        rules_generation++;
+
+        err = udev_rules_store_cache(rules, WORKER_RULES);
+        if (err < 0) {
+                /* without the file, the workers load the rules like we do */
+                unlink(WORKER_RULES);
+                /* loaded from the precompiled rules, which the workers map too */
+                if (err != -EINVAL)
+                        log_error("error writing %s: %s\n", WORKER_RULES, strerror(-err));
+        }
+}
+
+/* write the mapped database from the files of all devices */
+static void db_rebuild(struct udev *udev)
+{
+        int err;
+
+        err = udev_db_rebuild(udev, "/run/udev/data", UDEV_DB_FILE);
+        if (err < 0 && err != -ENOENT)
+                log_error("error writing %s: %s\n", UDEV_DB_FILE, strerror(-err));
+        db_events = stats_events;
+}
+
+/* merge the records the workers appended to the mapped database */
+static void db_compact(struct udev *udev)
+{
+        int err;
+
+        err = udev_db_compact(udev, UDEV_DB_FILE);
+        if (err == -ENOENT) {
+                /* the database was removed after an error, start over */
+                db_rebuild(udev);
+                return;
+        }
+        if (err < 0)
+                log_error("error writing %s: %s\n", UDEV_DB_FILE, strerror(-err));
+        db_events = stats_events;
+}
+
 /* receive the udevd message from userspace */
 static struct udev_ctrl_connection *handle_ctrl_msg(struct udev_ctrl *uctrl)
 {
@@ -686,6 +1088,11 @@ static struct udev_ctrl_connection *handle_ctrl_msg(struct udev_ctrl *uctrl)
         if (udev_ctrl_get_ping(ctrl_msg) > 0)
                 log_debug("udevd message (SYNC) received\n");
 
+        if (udev_ctrl_get_worker_stats(ctrl_msg) > 0) {
+                log_debug("udevd message (WORKER_STATS) received\n");
+                worker_stats_reply(ctrl_conn);
+        }
+
         if (udev_ctrl_get_exit(ctrl_msg) > 0) {
                 log_debug("udevd message (EXIT) received\n");
                 udev_exit = true;
@@ -1066,7 +1473,6 @@ int main(int argc, char *argv[])
         struct udev *udev;
         sigset_t mask;
         int daemonize = false;
-        int resolve_names = 1;
         static const struct option options[] = {
                 { "daemon", no_argument, NULL, 'd' },
                 { "debug", no_argument, NULL, 'D' },
@@ -1357,6 +1763,7 @@ int main(int argc, char *argv[])
 
         /* if needed, convert old database from earlier udev version */
         convert_db(udev);
+        db_rebuild(udev);
 
         if (children_max <= 0) {
                 int memsize = mem_size_mb();
@@ -1374,6 +1781,19 @@ int main(int argc, char *argv[])
         udev_list_node_init(&event_list);
         udev_list_node_init(&worker_list);
 
+        event_index = udev_event_index_new();
+        if (event_index == NULL) {
+                log_error("error creating event index\n");
+                goto exit;
+        }
+
+        link_index = udev_link_index_new();
+        if (link_index == NULL) {
+                log_error("error creating link index\n");
+                goto exit;
+        }
+        link_index_load(udev);
+
         for (;;) {
                 static usec_t last_usec;
                 struct epoll_event ev[8];
@@ -1437,6 +1857,10 @@ int main(int argc, char *argv[])
                         if (udev_list_node_is_empty(&event_list)) {
                                 log_debug("cleanup idle workers\n");
                                 worker_kill(udev);
+
+                                /* no worker is writing to the database */
+                                if (stats_events != db_events)
+                                        db_compact(udev);
                         }
 
                         /* check for hanging events */
@@ -1477,6 +1901,8 @@ int main(int argc, char *argv[])
                                 is_inotify = true;
                         else if (ev[i].data.fd == fd_ctrl && ev[i].events & EPOLLIN)
                                 is_ctrl = true;
+                        else
+                                worker_link_request(ev[i].data.fd);
                 }
 
                 /* check for changed config, every 3 seconds at most */
@@ -1489,18 +1915,25 @@ int main(int argc, char *argv[])
                         last_usec = now(CLOCK_MONOTONIC);
                 }
 
-                /* reload requested, HUP signal received, rules changed, builtin changed */
+                /*
+                 * reload requested, HUP signal received, rules changed, builtin changed;
+                 * the workers are kept, and switch to the new rules with their next event
+                 */
                 if (reload) {
-                        worker_kill(udev);
                         rules = udev_rules_unref(rules);
                         udev_builtin_exit(udev);
                         reload = false;
                 }
 
                 /* event has finished */
-                if (is_worker)
+                if (is_worker) {
                         worker_returned(fd_worker);
 
+                        /* keep the appended records short during a long event storm */
+                        if (stats_events - db_events >= DB_TAIL_MAX && access(UDEV_DB_FILE, F_OK) == 0)
+                                db_compact(udev);
+                }
+
                 if (is_netlink) {
                         struct udev_device *dev;
 
@@ -1515,8 +1948,11 @@ int main(int argc, char *argv[])
                 /* start new events */
                 if (!udev_list_node_is_empty(&event_list) && !udev_exit && !stop_exec_queue) {
                         udev_builtin_init(udev);
-                        if (rules == NULL)
+                        if (rules == NULL) {
                                 rules = udev_rules_new(udev, resolve_names);
+                                if (rules != NULL)
+                                        rules_share();
+                        }
                         if (rules != NULL)
                                 event_queue_start(udev);
                 }
@@ -1560,6 +1996,8 @@ exit_daemonize:
                 close(fd_ep);
         worker_list_cleanup(udev);
         event_queue_cleanup(udev, EVENT_UNDEF);
+        udev_event_index_free(event_index);
+        udev_link_index_free(link_index);
         udev_rules_unref(rules);
         udev_builtin_exit(udev);
         if (fd_signal >= 0)